@@ -29,11 +29,34 @@
 namespace google {
 namespace api_manager {
 
+// The statistics of the JWT caches.
+// Important note: please don't use std::string. These fields are directly
+// copied into a shared memory.
+struct JwtCacheStatistics {
+  // Lookups which found a valid token.
+  uint64_t hits;
+  // Lookups which found no token or an expired token.
+  uint64_t misses;
+  // Tokens removed to make room for new ones.
+  uint64_t evictions;
+  // Tokens in the caches.
+  uint64_t entries;
+
+  // Merge two statistics.
+  void Merge(const JwtCacheStatistics &v) {
+    hits += v.hits;
+    misses += v.misses;
+    evictions += v.evictions;
+    entries += v.entries;
+  }
+};
+
 // Data to summarize the API Manager statistics.
 // Important note: please don't use std::string. These fields are directly
 // copied into a shared memory.
 struct ApiManagerStatistics {
   service_control::Statistics service_control_statistics;
+  JwtCacheStatistics jwt_cache_statistics;
 };
 
 // Service config rollouts information for /endpoints_status
@@ -20,6 +20,7 @@
 #include <chrono>
 #include <functional>
 #include <memory>
+#include <string>
 
 #include "include/api_manager/grpc_request.h"
 #include "include/api_manager/http_request.h"
@@ -61,6 +62,27 @@ class ApiManagerEnvInterface {
   virtual void RunHTTPRequest(std::unique_ptr<HTTPRequest> request) = 0;
 
   virtual void RunGRPCRequest(std::unique_ptr<GRPCRequest> request) = 0;
+
+  // Optional cache shared by all the processes of the host, such as the
+  // nginx workers. API Manager uses it to share verified tokens and fetched
+  // keys. Looks up a value which has not expired. Returns false if the value
+  // is not found or the environment has no shared cache.
+  virtual bool SharedCacheLookup(
+      const std::string &key, std::string *value,
+      std::chrono::system_clock::time_point *expiration) {
+    return false;
+  }
+
+  // Inserts a value to the shared cache, replacing the existing value. The
+  // value may be evicted before it expires.
+  virtual void SharedCacheInsert(
+      const std::string &key, const std::string &value,
+      std::chrono::system_clock::time_point expiration) {}
+
+  // The number of processes of the host which serve the same services, such
+  // as the nginx workers. The quota limits enforced locally by each process
+  // are divided by it.
+  virtual int GetProcessCount() { return 1; }
 };
 
 }  // namespace api_manager
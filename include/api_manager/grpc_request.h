@@ -29,7 +29,7 @@ class GRPCRequest {
  public:
   // GRPCRequest constructor without headers in the callback function.
   GRPCRequest(std::function<void(utils::Status, std::string&&)> callback)
-      : callback_(callback) {}
+      : callback_(callback), use_ssl_(false), timeout_ms_(0) {}
 
   // A callback for the environment to invoke when the request is
   // complete. This will be invoked by the environment exactly once,
@@ -39,7 +39,7 @@ class GRPCRequest {
     callback_(status, std::move(body));
   }
 
-  // the gRPC method to call
+  // The gRPC method to call, the call path is "/<service>/<method>".
   const std::string& method() const { return method_; }
   GRPCRequest& set_method(const std::string& value) {
     method_ = value;
@@ -50,7 +50,7 @@ class GRPCRequest {
     return *this;
   }
 
-  // DNS or IP address of the gRPC server.
+  // DNS or IP address of the gRPC server, followed by ":<port>".
   const std::string& server() const { return server_; }
   GRPCRequest& set_server(const std::string& value) {
     server_ = value;
@@ -72,6 +72,27 @@ class GRPCRequest {
     return *this;
   }
 
+  // If true, the channel to the server is secured with SSL.
+  bool use_ssl() const { return use_ssl_; }
+  GRPCRequest& set_use_ssl(bool value) {
+    use_ssl_ = value;
+    return *this;
+  }
+
+  // The OAuth token sent in the authorization metadata, empty for none.
+  const std::string& auth_token() const { return auth_token_; }
+  GRPCRequest& set_auth_token(const std::string& value) {
+    auth_token_ = value;
+    return *this;
+  }
+
+  // The deadline of the call, 0 for no deadline.
+  int timeout_ms() const { return timeout_ms_; }
+  GRPCRequest& set_timeout_ms(int value) {
+    timeout_ms_ = value;
+    return *this;
+  }
+
   // The request body serialized as string.
   const std::string& body() const { return body_; }
   GRPCRequest& set_body(const std::string& value) {
@@ -89,6 +110,9 @@ class GRPCRequest {
   std::string server_;
   std::string service_;
   std::string body_;
+  bool use_ssl_;
+  std::string auth_token_;
+  int timeout_ms_;
 };
 
 }  // namespace api_manager
@@ -46,6 +46,42 @@ struct Statistics {
   // Maximum report request size send to server.
   uint64_t max_report_size;
 
+  // The number of report requests send to server by size. The bucket i counts
+  // the reports smaller than kMinReportSizeBound << (2 * i) bytes: 16 KB,
+  // 64 KB, 256 KB, 1 MB, 4 MB. The last bucket counts the larger ones.
+  static const int kReportSizeBuckets = 6;
+  static const uint64_t kMinReportSizeBound = 16 * 1024;
+  uint64_t report_size_counts[kReportSizeBuckets];
+
+  // Returns the bucket of report_size_counts of a report size.
+  static int ReportSizeBucket(uint64_t size) {
+    int bucket = 0;
+    for (uint64_t bound = kMinReportSizeBound;
+         size >= bound && bucket < kReportSizeBuckets - 1; bound <<= 2) {
+      bucket++;
+    }
+    return bucket;
+  }
+
+  // The number of open circuit breakers, the number of times they opened,
+  // and the number of calls they did not send.
+  uint64_t circuit_breaker_open;
+  uint64_t circuit_breaker_opens;
+  uint64_t circuit_breaker_rejected_calls;
+
+  // The percentiles of the latencies of the recent check and allocate quota
+  // calls, and the number of hedged attempts of these calls.
+  uint64_t check_latency_p50_ms;
+  uint64_t check_latency_p99_ms;
+  uint64_t quota_latency_p50_ms;
+  uint64_t quota_latency_p99_ms;
+  uint64_t hedged_calls;
+
+  // The number of checks answered from the refreshed check results. They are
+  // also counted in total_called_checks, and their refreshes sent to the
+  // server in send_checks_in_flight.
+  uint64_t check_result_cache_hits;
+
   // Merge two statistics.
   void Merge(const Statistics& v) {
     total_called_checks += v.total_called_checks;
@@ -57,6 +93,26 @@ struct Statistics {
     if (v.max_report_size > max_report_size) {
       max_report_size = v.max_report_size;
     }
+    for (int i = 0; i < kReportSizeBuckets; i++) {
+      report_size_counts[i] += v.report_size_counts[i];
+    }
+    circuit_breaker_open += v.circuit_breaker_open;
+    circuit_breaker_opens += v.circuit_breaker_opens;
+    circuit_breaker_rejected_calls += v.circuit_breaker_rejected_calls;
+    if (v.check_latency_p50_ms > check_latency_p50_ms) {
+      check_latency_p50_ms = v.check_latency_p50_ms;
+    }
+    if (v.check_latency_p99_ms > check_latency_p99_ms) {
+      check_latency_p99_ms = v.check_latency_p99_ms;
+    }
+    if (v.quota_latency_p50_ms > quota_latency_p50_ms) {
+      quota_latency_p50_ms = v.quota_latency_p50_ms;
+    }
+    if (v.quota_latency_p99_ms > quota_latency_p99_ms) {
+      quota_latency_p99_ms = v.quota_latency_p99_ms;
+    }
+    hedged_calls += v.hedged_calls;
+    check_result_cache_hits += v.check_result_cache_hits;
   }
 };
 
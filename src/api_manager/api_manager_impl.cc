@@ -15,6 +15,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 //
 #include "src/api_manager/api_manager_impl.h"
+#include "src/api_manager/check_auth.h"
 #include "src/api_manager/check_workflow.h"
 #include "src/api_manager/request_handler.h"
 
@@ -28,13 +29,18 @@ namespace {
 
 const std::string kConfigRolloutManaged("managed");
 
+// The interval to refresh the verification keys, it should be shorter than
+// the time a key is refreshed ahead of its expiration. Unit: milliseconds.
+const int kAuthKeyRefreshIntervalMs = 10000;
+
 }  // namespace anonymous
 
 ApiManagerImpl::ApiManagerImpl(std::unique_ptr<ApiManagerEnvInterface> env,
                                const std::string &server_config)
     : global_context_(
           new context::GlobalContext(std::move(env), server_config)) {
-  check_workflow_ = std::unique_ptr<CheckWorkflow>(new CheckWorkflow);
+  check_workflow_ = std::unique_ptr<CheckWorkflow>(
+      new CheckWorkflow(global_context_->ParallelChecks()));
   check_workflow_->RegisterAll();
 
   if (global_context_->server_config() &&
@@ -59,6 +65,12 @@ ApiManagerImpl::ApiManagerImpl(std::unique_ptr<ApiManagerEnvInterface> env,
   }
 }
 
+ApiManagerImpl::~ApiManagerImpl() {
+  if (auth_key_refresh_timer_) {
+    auth_key_refresh_timer_->Stop();
+  }
+}
+
 utils::Status ApiManagerImpl::LoadServiceRollouts() {
   if (!global_context_->server_config()) {
     std::string err_msg = "Invalid server config";
@@ -183,10 +195,18 @@ utils::Status ApiManagerImpl::Init() {
                          "Service config loading was failed");
   }
 
+  bool require_auth = false;
   for (auto it : service_context_map_) {
     if (it.second->service_control()) {
       it.second->service_control()->Init();
     }
+    require_auth = require_auth || it.second->RequireAuth();
+  }
+
+  if (require_auth && !auth_key_refresh_timer_) {
+    auth_key_refresh_timer_ = global_context_->env()->StartPeriodicTimer(
+        std::chrono::milliseconds(kAuthKeyRefreshIntervalMs),
+        [this]() { OnAuthKeyRefreshTimer(); });
   }
 
   if (global_context_->rollout_strategy() == kConfigRolloutManaged) {
@@ -211,7 +231,19 @@ utils::Status ApiManagerImpl::Init() {
   return utils::Status::OK;
 }
 
+void ApiManagerImpl::OnAuthKeyRefreshTimer() {
+  for (auto it : service_context_map_) {
+    if (it.second->RequireAuth()) {
+      RefreshAuthKeys(it.second);
+    }
+  }
+}
+
 utils::Status ApiManagerImpl::Close() {
+  if (auth_key_refresh_timer_) {
+    auth_key_refresh_timer_->Stop();
+  }
+
   if (global_context_->cloud_trace_aggregator()) {
     global_context_->cloud_trace_aggregator()->SendAndClearTraces();
   }
@@ -262,6 +294,7 @@ utils::Status ApiManagerImpl::GetStatistics(
     ApiManagerStatistics *statistics) const {
   memset(&statistics->service_control_statistics, 0,
          sizeof(service_control::Statistics));
+  memset(&statistics->jwt_cache_statistics, 0, sizeof(JwtCacheStatistics));
   for (const auto &it : service_context_map_) {
     if (it.second->service_control()) {
       service_control::Statistics stat;
@@ -270,6 +303,13 @@ utils::Status ApiManagerImpl::GetStatistics(
         statistics->service_control_statistics.Merge(stat);
       }
     }
+    const auth::JwtCache &jwt_cache = it.second->jwt_cache();
+    JwtCacheStatistics jwt_cache_stat;
+    jwt_cache_stat.hits = jwt_cache.hits();
+    jwt_cache_stat.misses = jwt_cache.misses();
+    jwt_cache_stat.evictions = jwt_cache.evictions();
+    jwt_cache_stat.entries = jwt_cache.Size();
+    statistics->jwt_cache_statistics.Merge(jwt_cache_stat);
   }
   return utils::Status::OK;
 }
@@ -33,6 +33,7 @@ class ApiManagerImpl : public ApiManager {
  public:
   ApiManagerImpl(std::unique_ptr<ApiManagerEnvInterface> env,
                  const std::string &server_config);
+  ~ApiManagerImpl();
 
   bool Enabled() const override;
 
@@ -86,6 +87,9 @@ class ApiManagerImpl : public ApiManager {
   utils::Status AddAndDeployConfigs(
       std::vector<std::pair<std::string, int>> &&configs, bool initialize);
 
+  // Refreshes the verification keys of all the services in background.
+  void OnAuthKeyRefreshTimer();
+
   // The check work flow.
   std::shared_ptr<CheckWorkflow> check_workflow_;
 
@@ -107,6 +111,9 @@ class ApiManagerImpl : public ApiManager {
   std::unique_ptr<ConfigManager> config_manager_;
 
   std::vector<std::unique_ptr<RewriteRule>> rewrite_rules_;
+
+  // Periodic timer task to refresh the verification keys
+  std::unique_ptr<PeriodicTimer> auth_key_refresh_timer_;
 };
 
 }  // namespace api_manager
@@ -315,6 +315,11 @@ TEST_F(ApiManagerTest, CorrectStatistics) {
   EXPECT_EQ(0, service_control_stat.send_reports_by_flush);
   EXPECT_EQ(0, service_control_stat.send_reports_in_flight);
   EXPECT_EQ(0, service_control_stat.send_report_operations);
+  const JwtCacheStatistics &jwt_cache_stat = statistics.jwt_cache_statistics;
+  EXPECT_EQ(0, jwt_cache_stat.hits);
+  EXPECT_EQ(0, jwt_cache_stat.misses);
+  EXPECT_EQ(0, jwt_cache_stat.evictions);
+  EXPECT_EQ(0, jwt_cache_stat.entries);
 }
 
 TEST_F(ApiManagerTest, InitializedOnApiManagerInstanceCreation) {
@@ -16,33 +16,114 @@
 #define API_MANAGER_AUTH_CERTS_H_
 
 #include <chrono>
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
+
+#include "src/api_manager/auth/lib/auth_jwt_validator.h"
 
 namespace google {
 namespace api_manager {
 namespace auth {
 
+// A verification key fetched for an issuer.
+struct Cert {
+  // The key document as fetched.
+  std::string cert;
+  // The keys parsed from cert, so they are parsed once per fetch instead of
+  // once per request.
+  std::shared_ptr<PublicKeys> keys;
+  // The absolute expiration time.
+  std::chrono::system_clock::time_point expiration;
+  // The last time the key was used to verify a token.
+  std::chrono::system_clock::time_point last_used;
+  // Whether the last fetch of a new key failed.
+  bool fetch_failed = false;
+};
+
 // A class to manage certs for token validation.
 class Certs {
  public:
   void Update(const std::string& issuer, const std::string& cert,
               std::chrono::system_clock::time_point expiration) {
-    issuer_cert_map_[issuer] = std::make_pair(cert, expiration);
+    Cert& entry = issuer_cert_map_[issuer];
+    entry.cert = cert;
+    entry.keys = PublicKeys::Create(cert.c_str(), cert.size());
+    entry.expiration = expiration;
+    entry.fetch_failed = false;
+  }
+
+  const Cert* GetCert(const std::string& iss) const {
+    auto it = issuer_cert_map_.find(iss);
+    return it == issuer_cert_map_.end() ? nullptr : &it->second;
+  }
+
+  // Records that the key of an issuer was used to verify a token.
+  void MarkUsed(const std::string& iss,
+                std::chrono::system_clock::time_point now) {
+    auto it = issuer_cert_map_.find(iss);
+    if (it != issuer_cert_map_.end()) {
+      it->second.last_used = now;
+    }
+  }
+
+  // Returns the issuers whose keys were used since active_since and expire
+  // before expire_before, and have no key fetch in flight.
+  std::vector<std::string> GetIssuersToRefresh(
+      std::chrono::system_clock::time_point active_since,
+      std::chrono::system_clock::time_point expire_before) const {
+    std::vector<std::string> issuers;
+    for (const auto& it : issuer_cert_map_) {
+      if (it.second.last_used >= active_since &&
+          it.second.expiration < expire_before &&
+          fetch_waiters_.find(it.first) == fetch_waiters_.end()) {
+        issuers.push_back(it.first);
+      }
+    }
+    return issuers;
+  }
+
+  // Adds a waiter for the key fetch of an issuer. Returns true if there is
+  // no fetch in flight for the issuer, the caller should then start one and
+  // call FinishFetch when it completes. Otherwise the waiter is called when
+  // the in-flight fetch completes.
+  bool AddFetchWaiter(const std::string& issuer,
+                      std::function<void(const utils::Status&)> waiter) {
+    auto& waiters = fetch_waiters_[issuer];
+    waiters.push_back(waiter);
+    return waiters.size() == 1;
   }
 
-  const std::pair<std::string, std::chrono::system_clock::time_point>* GetCert(
-      const std::string& iss) {
-    return issuer_cert_map_.find(iss) == issuer_cert_map_.end()
-               ? nullptr
-               : &(issuer_cert_map_[iss]);
+  // Completes the key fetch of an issuer, calls all its waiters with the
+  // status of the fetch. A failure is recorded on the cached key, if any.
+  void FinishFetch(const std::string& issuer, const utils::Status& status) {
+    if (!status.ok()) {
+      auto cert = issuer_cert_map_.find(issuer);
+      if (cert != issuer_cert_map_.end()) {
+        cert->second.fetch_failed = true;
+      }
+    }
+    auto it = fetch_waiters_.find(issuer);
+    if (it == fetch_waiters_.end()) {
+      return;
+    }
+    // Waiters may start a new fetch for the issuer.
+    std::vector<std::function<void(const utils::Status&)>> waiters;
+    waiters.swap(it->second);
+    fetch_waiters_.erase(it);
+    for (const auto& waiter : waiters) {
+      waiter(status);
+    }
   }
 
  private:
-  // Map from issuer to a verification key and its absolute expiration time.
-  std::map<std::string,
-           std::pair<std::string, std::chrono::system_clock::time_point> >
-      issuer_cert_map_;
+  // Map from issuer to a verification key.
+  std::map<std::string, Cert> issuer_cert_map_;
+  // Map from issuer to the requests waiting for its in-flight key fetch.
+  std::map<std::string, std::vector<std::function<void(const utils::Status&)>>>
+      fetch_waiters_;
 };
 
 }  // namespace auth
@@ -16,7 +16,10 @@
 //
 #include "src/api_manager/auth/jwt_cache.h"
 
-using ::google::service_control_client::SimpleLRUCache;
+#include <openssl/sha.h>
+#include <string.h>
+#include <algorithm>
+
 using std::chrono::system_clock;
 
 namespace google {
@@ -27,23 +30,236 @@ namespace {
 // The maximum lifetime of a cache entry. Unit: seconds.
 // TODO: This value should be configurable via server config.
 const int kJwtCacheTimeout = 300;
-// The number of entries in JWT cache.
-// TODO: This value should be configurable via server config.
+// The default number of entries in JWT cache.
 const int kJwtCacheSize = 100;
+// The maximum number of shards of JWT cache.
+const size_t kJwtCacheMaxShards = 16;
+// The minimum capacity of a shard, so a few hot tokens falling into the same
+// shard do not evict each other in a small cache.
+const size_t kJwtCacheMinShardCapacity = 64;
+// The interned strings are swept when their number doubles since the last
+// sweep, but not before reaching this number.
+const size_t kMinSweepSize = 64;
+// The prefix of the JWT keys in the shared cache.
+const char kSharedJwtCacheKeyPrefix[] = "jwt:";
+
+// Appends a length prefixed field to a serialized user info.
+void AppendField(const std::string& field, std::string* data) {
+  data->append(std::to_string(field.size()));
+  data->push_back(':');
+  data->append(field);
+}
+
+// Reads a length prefixed field at *pos, and advances *pos past it.
+bool ReadField(const std::string& data, size_t* pos, std::string* field) {
+  size_t colon = data.find(':', *pos);
+  if (colon == std::string::npos || colon == *pos) {
+    return false;
+  }
+  size_t size = 0;
+  for (size_t i = *pos; i < colon; ++i) {
+    if (data[i] < '0' || data[i] > '9' || size > data.size()) {
+      return false;
+    }
+    size = size * 10 + (data[i] - '0');
+  }
+  if (size > data.size() - colon - 1) {
+    return false;
+  }
+  field->assign(data, colon + 1, size);
+  *pos = colon + 1 + size;
+  return true;
+}
 }  // namespace
 
-JwtCache::JwtCache() : SimpleLRUCache<std::string, JwtValue>(kJwtCacheSize) {}
+JwtDigest JwtDigest::Of(const std::string& jwt) {
+  JwtDigest digest;
+  SHA256(reinterpret_cast<const uint8_t*>(jwt.data()), jwt.size(),
+         digest.bytes);
+  return digest;
+}
+
+bool JwtDigest::operator==(const JwtDigest& other) const {
+  return memcmp(bytes, other.bytes, kSize) == 0;
+}
 
-JwtCache::~JwtCache() { Clear(); }
+size_t JwtCache::DigestHash::operator()(const JwtDigest& digest) const {
+  // The digest is uniformly distributed, any of its bytes make a good hash.
+  size_t hash;
+  memcpy(&hash, digest.bytes, sizeof(hash));
+  return hash;
+}
+
+JwtCache::JwtCache(int capacity)
+    : sweep_size_(kMinSweepSize), hits_(0), misses_(0), evictions_(0) {
+  if (capacity <= 0) {
+    capacity = kJwtCacheSize;
+  }
+  size_t num_shards =
+      std::min(kJwtCacheMaxShards,
+               std::max<size_t>(1, capacity / kJwtCacheMinShardCapacity));
+  shards_.resize(num_shards);
+  shard_capacity_ = (capacity + num_shards - 1) / num_shards;
+}
+
+JwtCache::Shard& JwtCache::GetShard(const JwtDigest& digest) {
+  // The hash uses the first bytes, the shard uses the last one.
+  return shards_[digest.bytes[JwtDigest::kSize - 1] % shards_.size()];
+}
+
+bool JwtCache::Lookup(const std::string& jwt,
+                      const system_clock::time_point& now,
+                      UserInfo* user_info) {
+  JwtDigest digest = JwtDigest::Of(jwt);
+  Shard& shard = GetShard(digest);
+  auto it = shard.index.find(digest);
+  if (it == shard.index.end()) {
+    ++misses_;
+    return false;
+  }
+  const Entry& entry = *it->second;
+  if (now > entry.exp) {
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+    ++misses_;
+    return false;
+  }
+  // Moves the entry to the front of the LRU list.
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  ++hits_;
+
+  user_info->id = entry.id;
+  user_info->email = entry.email;
+  user_info->consumer_id = entry.consumer_id;
+  user_info->issuer = *entry.issuer;
+  user_info->audiences.clear();
+  for (const auto& audience : entry.audiences) {
+    user_info->audiences.insert(*audience);
+  }
+  user_info->authorized_party = entry.authorized_party;
+  user_info->claims.clear();
+  return true;
+}
 
 void JwtCache::Insert(const std::string& jwt, const UserInfo& user_info,
                       const system_clock::time_point& token_exp,
                       const system_clock::time_point& now) {
-  JwtValue* newval = new JwtValue();
-  newval->user_info = user_info;
-  newval->exp =
-      std::min(token_exp, now + std::chrono::seconds(kJwtCacheTimeout));
-  SimpleLRUCache::Insert(jwt, newval, 1);
+  JwtDigest digest = JwtDigest::Of(jwt);
+  Shard& shard = GetShard(digest);
+  auto it = shard.index.find(digest);
+  if (it != shard.index.end()) {
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+  } else if (shard.lru.size() >= shard_capacity_) {
+    shard.index.erase(shard.lru.back().digest);
+    shard.lru.pop_back();
+    ++evictions_;
+  }
+
+  shard.lru.emplace_front();
+  Entry& entry = shard.lru.front();
+  entry.digest = digest;
+  entry.exp = EntryExpiration(token_exp, now);
+  entry.id = user_info.id;
+  entry.email = user_info.email;
+  entry.consumer_id = user_info.consumer_id;
+  entry.authorized_party = user_info.authorized_party;
+  entry.issuer = Intern(user_info.issuer);
+  entry.audiences.reserve(user_info.audiences.size());
+  for (const auto& audience : user_info.audiences) {
+    entry.audiences.push_back(Intern(audience));
+  }
+  shard.index[digest] = shard.lru.begin();
+}
+
+system_clock::time_point JwtCache::EntryExpiration(
+    const system_clock::time_point& token_exp,
+    const system_clock::time_point& now) {
+  return std::min(token_exp, now + std::chrono::seconds(kJwtCacheTimeout));
+}
+
+void JwtCache::Remove(const std::string& jwt) {
+  JwtDigest digest = JwtDigest::Of(jwt);
+  Shard& shard = GetShard(digest);
+  auto it = shard.index.find(digest);
+  if (it != shard.index.end()) {
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+  }
+}
+
+size_t JwtCache::Size() const {
+  size_t size = 0;
+  for (const auto& shard : shards_) {
+    size += shard.lru.size();
+  }
+  return size;
+}
+
+std::shared_ptr<const std::string> JwtCache::Intern(const std::string& str) {
+  std::weak_ptr<const std::string>& interned = interned_[str];
+  std::shared_ptr<const std::string> shared = interned.lock();
+  if (shared) {
+    return shared;
+  }
+  shared = std::make_shared<const std::string>(str);
+  interned = shared;
+
+  if (interned_.size() > sweep_size_) {
+    for (auto it = interned_.begin(); it != interned_.end();) {
+      if (it->second.expired()) {
+        it = interned_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    sweep_size_ = std::max(kMinSweepSize, 2 * interned_.size());
+  }
+  return shared;
+}
+
+std::string SharedJwtCacheKey(const std::string& service_name,
+                              const std::string& jwt) {
+  JwtDigest digest = JwtDigest::Of(jwt);
+  // The digest has a fixed size, so the service name needs no delimiter.
+  std::string key(kSharedJwtCacheKeyPrefix);
+  key.append(service_name);
+  key.append(reinterpret_cast<const char*>(digest.bytes), JwtDigest::kSize);
+  return key;
+}
+
+std::string SerializeUserInfo(const UserInfo& user_info) {
+  std::string data;
+  AppendField(user_info.id, &data);
+  AppendField(user_info.email, &data);
+  AppendField(user_info.consumer_id, &data);
+  AppendField(user_info.issuer, &data);
+  AppendField(user_info.authorized_party, &data);
+  for (const auto& audience : user_info.audiences) {
+    AppendField(audience, &data);
+  }
+  return data;
+}
+
+bool ParseUserInfo(const std::string& data, UserInfo* user_info) {
+  size_t pos = 0;
+  if (!ReadField(data, &pos, &user_info->id) ||
+      !ReadField(data, &pos, &user_info->email) ||
+      !ReadField(data, &pos, &user_info->consumer_id) ||
+      !ReadField(data, &pos, &user_info->issuer) ||
+      !ReadField(data, &pos, &user_info->authorized_party)) {
+    return false;
+  }
+  user_info->claims.clear();
+  user_info->audiences.clear();
+  std::string audience;
+  while (pos < data.size()) {
+    if (!ReadField(data, &pos, &audience)) {
+      return false;
+    }
+    user_info->audiences.insert(audience);
+  }
+  return true;
 }
 
 }  // namespace auth
@@ -16,39 +16,146 @@
 #define API_MANAGER_AUTH_JWT_CACHE_H_
 
 #include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "src/api_manager/auth.h"
-#include "utils/simple_lru_cache_inl.h"
 
 namespace google {
 namespace api_manager {
 namespace auth {
 
-// The value of a JwtCache entry.
-struct JwtValue {
-  // User info extracted from the JWT.
-  UserInfo user_info;
+// The SHA256 digest of a JWT, the key of JwtCache. The tokens are often
+// 1-2 KB, the digest keeps the key size fixed.
+struct JwtDigest {
+  static const size_t kSize = 32;
+  uint8_t bytes[kSize];
 
-  // Expiration time of the cache entry. This is the minimum of "exp" field in
-  // the JWT and [the time this cache entry is added + kJwtCacheTimeout].
-  std::chrono::system_clock::time_point exp;
+  // Computes the digest of a JWT.
+  static JwtDigest Of(const std::string& jwt);
+
+  bool operator==(const JwtDigest& other) const;
 };
 
-// A local cache that resides in ESP. The key of the cache is a JWT,
-// and the value is of type JwtValue.
-class JwtCache
-    : public google::service_control_client::SimpleLRUCache<std::string,
-                                                            JwtValue> {
+// A local cache that resides in ESP. The key of the cache is the digest of
+// a JWT, and the value is the user info extracted from the verified JWT,
+// without the claims. The claims are as large as the token and are only
+// needed by the security rules check, which parses them from the token.
+//
+// A large cache is split into shards by the digest, each shard is a LRU
+// cache with a part of the capacity. With millions of tokens, a shard
+// growing rehashes only its part of the tokens, so the worker does not
+// stall on one huge rehash. A small cache keeps a single shard. The issuer
+// and the audiences, which are shared by most of the tokens, are interned.
+//
+// Like Certs, the cache is not thread safe, it is only used by the worker
+// owning the service context.
+class JwtCache {
  public:
-  JwtCache();
-  ~JwtCache();
+  // Creates a cache holding up to capacity tokens, the default capacity is
+  // used if capacity is not positive.
+  explicit JwtCache(int capacity = 0);
+
+  // Looks up a JWT. Returns true and fills user_info, except the claims, if
+  // the JWT is cached and the entry has not expired at now. An expired entry
+  // is removed.
+  bool Lookup(const std::string& jwt,
+              const std::chrono::system_clock::time_point& now,
+              UserInfo* user_info);
 
+  // Inserts a verified JWT. The entry expires at the earlier of token_exp and
+  // now plus the cache timeout.
   void Insert(const std::string& jwt, const UserInfo& user_info,
               const std::chrono::system_clock::time_point& token_exp,
               const std::chrono::system_clock::time_point& now);
+
+  // Returns the expiration time of a cache entry inserted at now for a token
+  // expiring at token_exp.
+  static std::chrono::system_clock::time_point EntryExpiration(
+      const std::chrono::system_clock::time_point& token_exp,
+      const std::chrono::system_clock::time_point& now);
+
+  // Removes a JWT.
+  void Remove(const std::string& jwt);
+
+  // Returns the number of cached tokens.
+  size_t Size() const;
+
+  // The number of lookups which found a valid token.
+  uint64_t hits() const { return hits_; }
+  // The number of lookups which found no token or an expired token.
+  uint64_t misses() const { return misses_; }
+  // The number of tokens removed to make room for new ones.
+  uint64_t evictions() const { return evictions_; }
+
+ private:
+  // A cached token.
+  struct Entry {
+    JwtDigest digest;
+    // Expiration time of the cache entry.
+    std::chrono::system_clock::time_point exp;
+    std::string id;
+    std::string email;
+    std::string consumer_id;
+    std::string authorized_party;
+    // Interned issuer and audiences.
+    std::shared_ptr<const std::string> issuer;
+    std::vector<std::shared_ptr<const std::string>> audiences;
+  };
+
+  struct DigestHash {
+    size_t operator()(const JwtDigest& digest) const;
+  };
+
+  // A LRU cache of a part of the tokens, the most recently used is first.
+  struct Shard {
+    std::list<Entry> lru;
+    std::unordered_map<JwtDigest, std::list<Entry>::iterator, DigestHash>
+        index;
+  };
+
+  // Returns the shard of a digest.
+  Shard& GetShard(const JwtDigest& digest);
+
+  // Returns the interned copy of a string.
+  std::shared_ptr<const std::string> Intern(const std::string& str);
+
+  std::vector<Shard> shards_;
+  // The capacity of each shard.
+  size_t shard_capacity_;
+
+  // Interned strings, the entries not used by any token are swept when the
+  // map grows past sweep_size_.
+  std::unordered_map<std::string, std::weak_ptr<const std::string>>
+      interned_;
+  size_t sweep_size_;
+
+  uint64_t hits_;
+  uint64_t misses_;
+  uint64_t evictions_;
 };
 
+// Helpers to share the verified JWTs with the other processes of the host
+// through ApiManagerEnvInterface::SharedCacheLookup/SharedCacheInsert.
+
+// Returns the key of a JWT verified for a service in the shared cache, based
+// on its digest. A token verified for one service is not accepted by the
+// other services of the host, which may trust other issuers and keys.
+std::string SharedJwtCacheKey(const std::string& service_name,
+                              const std::string& jwt);
+
+// Serializes the user info extracted from a verified JWT, without the claims,
+// like the entries of JwtCache.
+std::string SerializeUserInfo(const UserInfo& user_info);
+
+// Parses a user info serialized by SerializeUserInfo, with empty claims.
+// Returns false if the data is malformed.
+bool ParseUserInfo(const std::string& data, UserInfo* user_info);
+
 }  // namespace auth
 }  // namespace api_manager
 }  // namespace google
@@ -16,6 +16,7 @@
 //
 #include "src/api_manager/auth/jwt_cache.h"
 #include <memory>
+#include <string>
 #include "gtest/gtest.h"
 
 using std::chrono::system_clock;
@@ -51,7 +52,9 @@ class TestJwtCache : public ::testing::Test {
 
 // Test the Insert function in JwtCache class.
 void InsertAndLookupImpl(JwtCache *cache, bool token_exp_earlier) {
-  ASSERT_EQ(nullptr, cache->Lookup(kJwt));
+  system_clock::time_point now = system_clock::now();
+  UserInfo found;
+  ASSERT_FALSE(cache->Lookup(kJwt, now, &found));
 
   UserInfo user_info;
   user_info.id = kId;
@@ -60,7 +63,7 @@ void InsertAndLookupImpl(JwtCache *cache, bool token_exp_earlier) {
   user_info.issuer = kIssuer;
   user_info.audiences.insert("aud1");
   user_info.audiences.insert("aud2");
-  system_clock::time_point now = system_clock::now();
+  user_info.claims = "{\"sub\":\"user1\"}";
 
   system_clock::time_point token_exp;
   if (token_exp_earlier) {
@@ -69,22 +72,28 @@ void InsertAndLookupImpl(JwtCache *cache, bool token_exp_earlier) {
     token_exp = now + std::chrono::seconds(kJwtCacheTimeout + 1);
   }
   cache->Insert(kJwt, user_info, token_exp, now);
-  JwtValue *val = cache->Lookup(kJwt);
-  ASSERT_NE(nullptr, val);
-  ASSERT_EQ(val->user_info.id, kId);
-  ASSERT_EQ(val->user_info.email, kEmail);
-  ASSERT_EQ(val->user_info.consumer_id, kConsumer);
-  ASSERT_EQ(val->user_info.issuer, kIssuer);
-  ASSERT_EQ(val->user_info.AudiencesAsString(), "aud1,aud2");
-  if (token_exp_earlier) {
-    ASSERT_EQ(val->exp, token_exp);
-  } else {
-    ASSERT_EQ(val->exp, now + std::chrono::seconds(kJwtCacheTimeout));
-  }
+  ASSERT_TRUE(cache->Lookup(kJwt, now, &found));
+  ASSERT_EQ(found.id, kId);
+  ASSERT_EQ(found.email, kEmail);
+  ASSERT_EQ(found.consumer_id, kConsumer);
+  ASSERT_EQ(found.issuer, kIssuer);
+  ASSERT_EQ(found.AudiencesAsString(), "aud1,aud2");
+  // The claims are not cached.
+  ASSERT_EQ(found.claims, "");
 
-  cache->Release(kJwt, val);
+  // The entry expires at the earlier of the token expiration and the cache
+  // timeout.
+  system_clock::time_point exp =
+      token_exp_earlier ? token_exp
+                        : now + std::chrono::seconds(kJwtCacheTimeout);
+  ASSERT_TRUE(cache->Lookup(kJwt, exp, &found));
+  ASSERT_FALSE(cache->Lookup(kJwt, exp + std::chrono::seconds(1), &found));
+  // The expired entry was removed.
+  ASSERT_EQ(0U, cache->Size());
+
+  cache->Insert(kJwt, user_info, token_exp, now);
   cache->Remove(kJwt);
-  ASSERT_EQ(nullptr, cache->Lookup(kJwt));
+  ASSERT_FALSE(cache->Lookup(kJwt, now, &found));
 }
 
 TEST_F(TestJwtCache, InsertAndLookUp) {
@@ -95,6 +104,102 @@ TEST_F(TestJwtCache, InsertAndLookUp) {
   InsertAndLookupImpl(cache_.get(), false);
 }
 
+TEST_F(TestJwtCache, Statistics) {
+  system_clock::time_point now = system_clock::now();
+  UserInfo user_info;
+  user_info.issuer = kIssuer;
+  UserInfo found;
+  ASSERT_FALSE(cache_->Lookup(kJwt, now, &found));
+  cache_->Insert(kJwt, user_info, now + std::chrono::seconds(10), now);
+  ASSERT_TRUE(cache_->Lookup(kJwt, now, &found));
+  ASSERT_TRUE(cache_->Lookup(kJwt, now, &found));
+  ASSERT_FALSE(
+      cache_->Lookup(kJwt, now + std::chrono::seconds(11), &found));
+
+  EXPECT_EQ(2U, cache_->hits());
+  EXPECT_EQ(2U, cache_->misses());
+  EXPECT_EQ(0U, cache_->evictions());
+}
+
+TEST_F(TestJwtCache, Capacity) {
+  const int kCapacity = 64;
+  const int kTokens = 1000;
+  cache_.reset(new JwtCache(kCapacity));
+  system_clock::time_point now = system_clock::now();
+  system_clock::time_point token_exp = now + std::chrono::seconds(10);
+
+  for (int i = 0; i < kTokens; ++i) {
+    UserInfo user_info;
+    user_info.id = std::to_string(i);
+    user_info.issuer = kIssuer;
+    user_info.audiences.insert("aud1");
+    cache_->Insert(kJwt + std::to_string(i), user_info, token_exp, now);
+  }
+  ASSERT_LE(cache_->Size(), static_cast<size_t>(kCapacity));
+  EXPECT_EQ(kTokens - cache_->Size(), cache_->evictions());
+
+  // The most recently inserted token is kept.
+  UserInfo found;
+  ASSERT_TRUE(
+      cache_->Lookup(kJwt + std::to_string(kTokens - 1), now, &found));
+  EXPECT_EQ(found.id, std::to_string(kTokens - 1));
+  EXPECT_EQ(found.issuer, kIssuer);
+  EXPECT_EQ(found.AudiencesAsString(), "aud1");
+}
+
+// A small cache is not split into shards, so tokens are only evicted once
+// the whole capacity is used.
+TEST_F(TestJwtCache, NoEarlyEvictions) {
+  system_clock::time_point now = system_clock::now();
+  system_clock::time_point token_exp = now + std::chrono::seconds(10);
+  UserInfo user_info;
+  user_info.issuer = kIssuer;
+
+  for (int capacity : {100, 2048}) {
+    cache_.reset(new JwtCache(capacity));
+    int tokens = capacity == 100 ? 100 : 256;
+    for (int i = 0; i < tokens; ++i) {
+      cache_->Insert(kJwt + std::to_string(i), user_info, token_exp, now);
+    }
+    EXPECT_EQ(static_cast<size_t>(tokens), cache_->Size());
+    EXPECT_EQ(0U, cache_->evictions());
+  }
+}
+
+TEST(SharedJwtCache, SerializeUserInfo) {
+  UserInfo user_info;
+  user_info.id = kId;
+  user_info.email = kEmail;
+  user_info.consumer_id = kConsumer;
+  user_info.issuer = kIssuer;
+  user_info.audiences.insert("aud:1");
+  user_info.audiences.insert("aud2");
+  user_info.claims = "{\"sub\":\"user1\"}";
+
+  UserInfo found;
+  ASSERT_TRUE(ParseUserInfo(SerializeUserInfo(user_info), &found));
+  EXPECT_EQ(found.id, kId);
+  EXPECT_EQ(found.email, kEmail);
+  EXPECT_EQ(found.consumer_id, kConsumer);
+  EXPECT_EQ(found.issuer, kIssuer);
+  EXPECT_EQ(found.authorized_party, "");
+  // The claims are not shared either.
+  EXPECT_EQ(found.claims, "");
+  EXPECT_EQ(found.AudiencesAsString(), "aud2,aud:1");
+
+  std::string data = SerializeUserInfo(user_info);
+  EXPECT_FALSE(ParseUserInfo(data.substr(0, data.size() - 1), &found));
+  EXPECT_FALSE(ParseUserInfo("", &found));
+  EXPECT_FALSE(ParseUserInfo("100:a", &found));
+
+  EXPECT_EQ(SharedJwtCacheKey("service1", kJwt),
+            SharedJwtCacheKey("service1", kJwt));
+  EXPECT_NE(SharedJwtCacheKey("service1", kJwt),
+            SharedJwtCacheKey("service1", kId));
+  EXPECT_NE(SharedJwtCacheKey("service1", kJwt),
+            SharedJwtCacheKey("service2", kJwt));
+}
+
 }  // namespace
 
 }  // namespace auth
@@ -66,6 +66,7 @@ extern "C" {
 #include <cstring>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "src/api_manager/auth/lib/json_util.h"
 
@@ -84,23 +85,81 @@ struct JoseHeader {
   const char *kid;
 };
 
+// An implementation of PublicKeys, holds the parsed keys.
+class PublicKeysImpl : public PublicKeys {
+ public:
+  // The format of the key document.
+  enum Format {
+    // Not a JSON document.
+    INVALID,
+    // A JSON object of X509 certificates keyed by kid.
+    X509,
+    // A JWK set, see https://tools.ietf.org/html/rfc7517#section-5.
+    JWK,
+  };
+
+  // A key of the key document.
+  struct Key {
+    // The kid of the key, the property name of a X509 certificate.
+    std::string kid;
+    // For X509, whether the certificate is a string.
+    // For JWK, whether the kid is present.
+    bool has_kid;
+    // For JWK, the kty of the key, or nullptr if it is missing.
+    const char *kty;
+    // The RSA or X509 public key, or nullptr if it could not be extracted.
+    EVP_PKEY *pkey;
+    // The EC public key, or nullptr if it could not be extracted.
+    EC_KEY *eck;
+  };
+
+  PublicKeysImpl(const char *pkey, size_t pkey_len);
+  ~PublicKeysImpl();
+
+  // The keys and the JSON document are owned and freed by the destructor.
+  PublicKeysImpl(const PublicKeysImpl &) = delete;
+  PublicKeysImpl &operator=(const PublicKeysImpl &) = delete;
+
+  // The raw key document, it is the secret for HS algorithms.
+  const std::string &secret() const { return secret_; }
+  Format format() const { return format_; }
+  // Whether the key document has no keys at all. Some of keys_ may not be
+  // usable even if it is false.
+  bool empty() const { return empty_; }
+  const std::vector<Key> &keys() const { return keys_; }
+
+ private:
+  void ParseX509Keys();
+  void ParseJwkKeys(const grpc_json *jwk_keys);
+  // Extracts the public key from x509 string (key).
+  // Returns nullptr if failed.
+  static EVP_PKEY *ExtractPubkeyFromX509(const char *key);
+  // Extracts the public key from a jwk key (jkey).
+  // Returns nullptr if failed.
+  EVP_PKEY *ExtractPubkeyFromJwkRSA(const grpc_json *jkey);
+  EC_KEY *ExtractPubkeyFromJwkEC(const grpc_json *jkey);
+
+  std::string secret_;
+  grpc_json *json_;
+  Format format_;
+  bool empty_;
+  std::vector<Key> keys_;
+  grpc_exec_ctx exec_ctx_;
+};
+
 // An implementation of JwtValidator, hold ALL allocated memory data.
 class JwtValidatorImpl : public JwtValidator {
  public:
   JwtValidatorImpl(const char *jwt, size_t jwt_len);
   Status Parse(UserInfo *user_info);
   Status VerifySignature(const char *pkey, size_t pkey_len);
+  Status VerifySignature(const PublicKeys &keys);
   system_clock::time_point &GetExpirationTime() { return exp_; }
   ~JwtValidatorImpl();
 
  private:
-  // Validates given JWT with pkey.
-  grpc_jwt_verifier_status Validate(const char *jwt, size_t jwt_len,
-                                    const char *pkey, size_t pkey_len,
-                                    const char *aud);
   grpc_jwt_verifier_status ParseImpl();
-  grpc_jwt_verifier_status VerifySignatureImpl(const char *pkey,
-                                               size_t pkey_len);
+  grpc_jwt_verifier_status VerifySignatureImpl(const PublicKeysImpl &keys);
   // Parses the audiences and removes the audiences from the json object.
   void UpdateAudience(grpc_json *json);
 
@@ -110,28 +169,15 @@ class JwtValidatorImpl : public JwtValidator {
   // And sets expiration time to exp_.
   grpc_jwt_verifier_status FillUserInfoAndSetExp(UserInfo *user_info);
   // Finds the public key and verifies JWT signature with it.
-  grpc_jwt_verifier_status FindAndVerifySignature();
-  // Extracts the public key from x509 string (key) and sets it to pkey_.
-  // Returns true if successful.
-  bool ExtractPubkeyFromX509(const char *key);
-  // Extracts the public key from a jwk key (jkey) and sets it to pkey_.
-  // Returns true if successful.
-  bool ExtractPubkeyFromJwk(const grpc_json *jkey);
-  bool ExtractPubkeyFromJwkRSA(const grpc_json *jkey);
-  bool ExtractPubkeyFromJwkEC(const grpc_json *jkey);
-  // Extracts the public key from jwk key set and verifies JWT signature with
-  // it.
-  grpc_jwt_verifier_status ExtractAndVerifyJwkKeys(const grpc_json *jwt_keys);
-  // Extracts the public key from pkey_json_ and verifies JWT signature with
-  // it.
-  grpc_jwt_verifier_status ExtractAndVerifyX509Keys();
+  grpc_jwt_verifier_status FindAndVerifySignature(const PublicKeysImpl &keys);
+  // Finds the public key in jwk key set and verifies JWT signature with it.
+  grpc_jwt_verifier_status VerifyJwkKeys(const PublicKeysImpl &keys);
+  // Finds the public key in x509 keys and verifies JWT signature with it.
+  grpc_jwt_verifier_status VerifyX509Keys(const PublicKeysImpl &keys);
   // Verifies signature with public key.
-  grpc_jwt_verifier_status VerifyPubkey();
-  grpc_jwt_verifier_status VerifyPubkeyRSA();
-  grpc_jwt_verifier_status VerifyPubkeyEC();
-  // Verifies asymmetric signature, including RS256/384/512 and ES256.
-  grpc_jwt_verifier_status VerifyAsymSignature(const char *pkey,
-                                               size_t pkey_len);
+  grpc_jwt_verifier_status VerifyPubkey(const PublicKeysImpl::Key &key);
+  grpc_jwt_verifier_status VerifyPubkeyRSA(EVP_PKEY *pkey);
+  grpc_jwt_verifier_status VerifyPubkeyEC(EC_KEY *eck);
   // Verifies HS (symmetric) signature.
   grpc_jwt_verifier_status VerifyHsSignature(const char *pkey, size_t pkey_len);
 
@@ -149,14 +195,8 @@ class JwtValidatorImpl : public JwtValidator {
   std::set<std::string> audiences_;
   system_clock::time_point exp_;
 
-  grpc_json *pkey_json_;
   grpc_slice pkey_buffer_;
-  BIO *bio_;
-  X509 *x509_;
-  RSA *rsa_;
-  EVP_PKEY *pkey_;
   EVP_MD_CTX *md_ctx_;
-  EC_KEY *eck_;
   ECDSA_SIG *ecdsa_sig_;
   grpc_exec_ctx exec_ctx_;
 };
@@ -172,7 +212,7 @@ grpc_json *DecodeBase64AndParseJson(grpc_exec_ctx *exec_ctx, const char *str,
                                     size_t len, grpc_slice *buffer);
 
 // Gets BIGNUM from b64 string, used for extracting pkey from jwk.
-// Result owned by rsa_.
+// Result owned by the caller.
 BIGNUM *BigNumFromBase64String(grpc_exec_ctx *exec_ctx, const char *b64);
 
 }  // namespace
@@ -182,6 +222,11 @@ std::unique_ptr<JwtValidator> JwtValidator::Create(const char *jwt,
   return std::unique_ptr<JwtValidator>(new JwtValidatorImpl(jwt, jwt_len));
 }
 
+std::shared_ptr<PublicKeys> PublicKeys::Create(const char *pkey,
+                                               size_t pkey_len) {
+  return std::make_shared<PublicKeysImpl>(pkey, pkey_len);
+}
+
 namespace {
 JwtValidatorImpl::JwtValidatorImpl(const char *jwt, size_t jwt_len)
     : jwt(jwt),
@@ -189,13 +234,7 @@ JwtValidatorImpl::JwtValidatorImpl(const char *jwt, size_t jwt_len)
       header_(nullptr),
       header_json_(nullptr),
       claims_(nullptr),
-      pkey_json_(nullptr),
-      bio_(nullptr),
-      x509_(nullptr),
-      rsa_(nullptr),
-      pkey_(nullptr),
       md_ctx_(nullptr),
-      eck_(nullptr),
       ecdsa_sig_(nullptr),
       exec_ctx_(GRPC_EXEC_CTX_INIT) {
   header_buffer_ = grpc_empty_slice();
@@ -212,9 +251,6 @@ JwtValidatorImpl::~JwtValidatorImpl() {
   if (header_json_ != nullptr) {
     grpc_json_destroy(header_json_);
   }
-  if (pkey_json_ != nullptr) {
-    grpc_json_destroy(pkey_json_);
-  }
   if (claims_ != nullptr) {
     grpc_jwt_claims_destroy(&exec_ctx_, claims_);
   }
@@ -230,24 +266,9 @@ JwtValidatorImpl::~JwtValidatorImpl() {
   if (!GRPC_SLICE_IS_EMPTY(pkey_buffer_)) {
     grpc_slice_unref(pkey_buffer_);
   }
-  if (bio_ != nullptr) {
-    BIO_free(bio_);
-  }
-  if (x509_ != nullptr) {
-    X509_free(x509_);
-  }
-  if (rsa_ != nullptr) {
-    RSA_free(rsa_);
-  }
-  if (pkey_ != nullptr) {
-    EVP_PKEY_free(pkey_);
-  }
   if (md_ctx_ != nullptr) {
     EVP_MD_CTX_destroy(md_ctx_);
   }
-  if (eck_ != nullptr) {
-    EC_KEY_free(eck_);
-  }
   if (ecdsa_sig_ != nullptr) {
     ECDSA_SIG_free(ecdsa_sig_);
   }
@@ -402,7 +423,13 @@ grpc_jwt_verifier_status JwtValidatorImpl::ParseImpl() {
 }
 
 Status JwtValidatorImpl::VerifySignature(const char *pkey, size_t pkey_len) {
-  grpc_jwt_verifier_status status = VerifySignatureImpl(pkey, pkey_len);
+  PublicKeysImpl keys(pkey, pkey_len);
+  return VerifySignature(keys);
+}
+
+Status JwtValidatorImpl::VerifySignature(const PublicKeys &keys) {
+  grpc_jwt_verifier_status status =
+      VerifySignatureImpl(static_cast<const PublicKeysImpl &>(keys));
   if (status == GRPC_JWT_VERIFIER_OK) {
     return Status::OK;
   } else {
@@ -412,8 +439,8 @@ Status JwtValidatorImpl::VerifySignature(const char *pkey, size_t pkey_len) {
 }
 
 grpc_jwt_verifier_status JwtValidatorImpl::VerifySignatureImpl(
-    const char *pkey, size_t pkey_len) {
-  if (pkey == nullptr || pkey_len <= 0) {
+    const PublicKeysImpl &keys) {
+  if (keys.secret().empty()) {
     return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
   }
   if (jwt == nullptr || jwt_len <= 0) {
@@ -424,9 +451,9 @@ grpc_jwt_verifier_status JwtValidatorImpl::VerifySignatureImpl(
   }
   if (strncmp(header_->alg, "ES256", 5) == 0 ||
       strncmp(header_->alg, "RS", 2) == 0) {  // Asymmetric keys.
-    return VerifyAsymSignature(pkey, pkey_len);
+    return FindAndVerifySignature(keys);
   } else {  // Symmetric key.
-    return VerifyHsSignature(pkey, pkey_len);
+    return VerifyHsSignature(keys.secret().c_str(), keys.secret().size());
   }
 }
 
@@ -452,8 +479,9 @@ void JwtValidatorImpl::CreateJoseHeader() {
   header_->kid = GetStringValue(header_json_, "kid");
 }
 
-grpc_jwt_verifier_status JwtValidatorImpl::FindAndVerifySignature() {
-  if (pkey_json_ == nullptr) {
+grpc_jwt_verifier_status JwtValidatorImpl::FindAndVerifySignature(
+    const PublicKeysImpl &keys) {
+  if (keys.format() == PublicKeysImpl::INVALID) {
     gpr_log(GPR_ERROR, "The public keys are empty.");
     return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
   }
@@ -462,52 +490,54 @@ grpc_jwt_verifier_status JwtValidatorImpl::FindAndVerifySignature() {
     gpr_log(GPR_ERROR, "JWT header is empty.");
     return GRPC_JWT_VERIFIER_BAD_FORMAT;
   }
-  // JWK set https://tools.ietf.org/html/rfc7517#section-5.
-  const grpc_json *jwk_keys = GetProperty(pkey_json_, "keys");
-  if (jwk_keys == nullptr) {
+  if (keys.format() == PublicKeysImpl::X509) {
     // Currently we only support JWK format for ES256.
     if (strncmp(header_->alg, "ES256", 5) == 0) {
       return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
     }
-    // Try x509 format.
-    return ExtractAndVerifyX509Keys();
+    return VerifyX509Keys(keys);
   } else {
-    // JWK format.
-    return ExtractAndVerifyJwkKeys(jwk_keys);
+    return VerifyJwkKeys(keys);
   }
 }
 
-grpc_jwt_verifier_status JwtValidatorImpl::ExtractAndVerifyX509Keys() {
-  // Precondition (checked by caller): pkey_json_ and header_ are not nullptr.
+grpc_jwt_verifier_status JwtValidatorImpl::VerifyX509Keys(
+    const PublicKeysImpl &keys) {
+  // Precondition (checked by caller): header_ is not nullptr.
   if (header_->kid != nullptr) {
-    const char *value = GetStringValue(pkey_json_, header_->kid);
-    if (value == nullptr) {
-      gpr_log(GPR_ERROR,
-              "Cannot find matching key in key set for kid=%s and alg=%s",
-              header_->kid, header_->alg);
-      return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
-    }
-    if (!ExtractPubkeyFromX509(value)) {
-      gpr_log(GPR_ERROR, "Failed to extract public key from X509 key (%s)",
-              header_->kid);
-      return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
+    // The first property with the kid name, like GetStringValue.
+    for (const auto &key : keys.keys()) {
+      if (key.kid != header_->kid) {
+        continue;
+      }
+      if (!key.has_kid) {
+        break;
+      }
+      if (key.pkey == nullptr) {
+        gpr_log(GPR_ERROR, "Failed to extract public key from X509 key (%s)",
+                header_->kid);
+        return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
+      }
+      return VerifyPubkey(key);
     }
-    return VerifyPubkey();
+    gpr_log(GPR_ERROR,
+            "Cannot find matching key in key set for kid=%s and alg=%s",
+            header_->kid, header_->alg);
+    return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
   }
   // If kid is not specified in the header, try all keys. If the JWT can be
   // validated with any of the keys, the request is successful.
-  const grpc_json *cur;
-  if (pkey_json_->child == nullptr) {
+  if (keys.empty()) {
     gpr_log(GPR_ERROR, "Failed to extract public key from X509 key (%s)",
             header_->kid);
     return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
   }
-  for (cur = pkey_json_->child; cur != nullptr; cur = cur->next) {
-    if (cur->value == nullptr || !ExtractPubkeyFromX509(cur->value)) {
+  for (const auto &key : keys.keys()) {
+    if (key.pkey == nullptr) {
       // Failed to extract public key from current X509 key, try next one.
       continue;
     }
-    if (VerifyPubkey() == GRPC_JWT_VERIFIER_OK) {
+    if (VerifyPubkey(key) == GRPC_JWT_VERIFIER_OK) {
       return GRPC_JWT_VERIFIER_OK;
     }
   }
@@ -518,63 +548,20 @@ grpc_jwt_verifier_status JwtValidatorImpl::ExtractAndVerifyX509Keys() {
   return GRPC_JWT_VERIFIER_BAD_SIGNATURE;
 }
 
-bool JwtValidatorImpl::ExtractPubkeyFromX509(const char *key) {
-  if (bio_ != nullptr) {
-    BIO_free(bio_);
-  }
-  bio_ = BIO_new(BIO_s_mem());
-  if (bio_ == nullptr) {
-    gpr_log(GPR_ERROR, "Unable to allocate a BIO object.");
-    return false;
-  }
-  if (BIO_write(bio_, key, strlen(key)) <= 0) {
-    gpr_log(GPR_ERROR, "BIO write error for key (%s).", key);
-    return false;
-  }
-  if (x509_ != nullptr) {
-    X509_free(x509_);
-  }
-  x509_ = PEM_read_bio_X509(bio_, nullptr, nullptr, nullptr);
-  if (x509_ == nullptr) {
-    gpr_log(GPR_ERROR, "Unable to parse x509 cert for key (%s).", key);
-    return false;
-  }
-  if (pkey_ != nullptr) {
-    EVP_PKEY_free(pkey_);
-  }
-  pkey_ = X509_get_pubkey(x509_);
-  if (pkey_ == nullptr) {
-    gpr_log(GPR_ERROR, "X509_get_pubkey failed");
-    return false;
-  }
-  return true;
-}
-
-grpc_jwt_verifier_status JwtValidatorImpl::ExtractAndVerifyJwkKeys(
-    const grpc_json *jwk_keys) {
-  // Precondition (checked by caller): jwk_keys and header_ are not nullptr.
-  if (jwk_keys->type != GRPC_JSON_ARRAY) {
-    gpr_log(GPR_ERROR,
-            "Unexpected value type of keys property in jwks key set.");
-    return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
-  }
-
-  const grpc_json *jkey = nullptr;
-
-  if (jwk_keys->child == nullptr) {
-    gpr_log(GPR_ERROR, "The jwks key set is empty");
+grpc_jwt_verifier_status JwtValidatorImpl::VerifyJwkKeys(
+    const PublicKeysImpl &keys) {
+  // Precondition (checked by caller): header_ is not nullptr.
+  if (keys.empty()) {
     return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
   }
 
   // JWK format from https://tools.ietf.org/html/rfc7518#section-6.
-  for (jkey = jwk_keys->child; jkey != nullptr; jkey = jkey->next) {
-    if (jkey->type != GRPC_JSON_OBJECT) continue;
-    const char *kid = GetStringValue(jkey, "kid");
-    if (kid == nullptr ||
-        (header_->kid != nullptr && strcmp(kid, header_->kid) != 0)) {
+  for (const auto &key : keys.keys()) {
+    if (!key.has_kid ||
+        (header_->kid != nullptr && key.kid != header_->kid)) {
       continue;
     }
-    const char *kty = GetStringValue(jkey, "kty");
+    const char *kty = key.kty;
     if (kty == nullptr ||
         (strncmp(header_->alg, "RS", 2) == 0 && strncmp(kty, "RSA", 3) != 0) ||
         (strncmp(header_->alg, "ES256", 5) == 0 &&
@@ -583,17 +570,18 @@ grpc_jwt_verifier_status JwtValidatorImpl::ExtractAndVerifyJwkKeys(
       continue;
     }
 
-    if (!ExtractPubkeyFromJwk(jkey)) {
+    if ((strncmp(header_->alg, "RS", 2) == 0 && key.pkey == nullptr) ||
+        (strncmp(header_->alg, "ES256", 5) == 0 && key.eck == nullptr)) {
       // Failed to extract public key from this Jwk key.
       continue;
     }
 
     if (header_->kid != nullptr) {
-      return VerifyPubkey();
+      return VerifyPubkey(key);
     }
     // If kid is not specified in the header, try all keys. If the JWT can be
     // validated with any of the keys, the request is successful.
-    if (VerifyPubkey() == GRPC_JWT_VERIFIER_OK) {
+    if (VerifyPubkey(key) == GRPC_JWT_VERIFIER_OK) {
       return GRPC_JWT_VERIFIER_OK;
     }
   }
@@ -611,108 +599,19 @@ grpc_jwt_verifier_status JwtValidatorImpl::ExtractAndVerifyJwkKeys(
   return GRPC_JWT_VERIFIER_BAD_SIGNATURE;
 }
 
-bool JwtValidatorImpl::ExtractPubkeyFromJwk(const grpc_json *jkey) {
+grpc_jwt_verifier_status JwtValidatorImpl::VerifyPubkey(
+    const PublicKeysImpl::Key &key) {
   if (strncmp(header_->alg, "RS", 2) == 0) {
-    return ExtractPubkeyFromJwkRSA(jkey);
+    return VerifyPubkeyRSA(key.pkey);
   } else if (strncmp(header_->alg, "ES256", 5) == 0) {
-    return ExtractPubkeyFromJwkEC(jkey);
-  } else {
-    return false;
-  }
-}
-
-bool JwtValidatorImpl::ExtractPubkeyFromJwkRSA(const grpc_json *jkey) {
-  if (rsa_ != nullptr) {
-    RSA_free(rsa_);
-  }
-  rsa_ = RSA_new();
-  if (rsa_ == nullptr) {
-    gpr_log(GPR_ERROR, "Could not create rsa key.");
-    return false;
-  }
-
-  const char *rsa_n = GetStringValue(jkey, "n");
-  rsa_->n =
-      rsa_n == nullptr ? nullptr : BigNumFromBase64String(&exec_ctx_, rsa_n);
-  const char *rsa_e = GetStringValue(jkey, "e");
-  rsa_->e =
-      rsa_e == nullptr ? nullptr : BigNumFromBase64String(&exec_ctx_, rsa_e);
-
-  if (rsa_->e == nullptr || rsa_->n == nullptr) {
-    gpr_log(GPR_ERROR, "Missing RSA public key field.");
-    return false;
-  }
-
-  if (pkey_ != nullptr) {
-    EVP_PKEY_free(pkey_);
-  }
-  pkey_ = EVP_PKEY_new();
-  if (EVP_PKEY_set1_RSA(pkey_, rsa_) == 0) {
-    gpr_log(GPR_ERROR, "EVP_PKEY_ste1_RSA failed");
-    return false;
-  }
-  return true;
-}
-
-bool JwtValidatorImpl::ExtractPubkeyFromJwkEC(const grpc_json *jkey) {
-  if (eck_ != nullptr) {
-    EC_KEY_free(eck_);
-  }
-  eck_ = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
-  if (eck_ == nullptr) {
-    gpr_log(GPR_ERROR, "Could not create ec key.");
-    return false;
-  }
-  const char *eck_x = GetStringValue(jkey, "x");
-  const char *eck_y = GetStringValue(jkey, "y");
-  if (eck_x == nullptr || eck_y == nullptr) {
-    gpr_log(GPR_ERROR, "Missing EC public key field.");
-    return false;
-  }
-  BIGNUM *bn_x = BigNumFromBase64String(&exec_ctx_, eck_x);
-  BIGNUM *bn_y = BigNumFromBase64String(&exec_ctx_, eck_y);
-  if (bn_x == nullptr || bn_y == nullptr) {
-    gpr_log(GPR_ERROR, "Could not generate BIGNUM-type x and y fields.");
-    return false;
-  }
-
-  if (EC_KEY_set_public_key_affine_coordinates(eck_, bn_x, bn_y) == 0) {
-    BN_free(bn_x);
-    BN_free(bn_y);
-    gpr_log(GPR_ERROR, "Could not populate ec key coordinates.");
-    return false;
-  }
-  return true;
-}
-
-grpc_jwt_verifier_status JwtValidatorImpl::VerifyAsymSignature(
-    const char *pkey, size_t pkey_len) {
-  pkey_buffer_ = grpc_slice_from_copied_buffer(pkey, pkey_len);
-  if (GRPC_SLICE_IS_EMPTY(pkey_buffer_)) {
-    return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
-  }
-  pkey_json_ = grpc_json_parse_string_with_len(
-      reinterpret_cast<char *>(GRPC_SLICE_START_PTR(pkey_buffer_)),
-      GRPC_SLICE_LENGTH(pkey_buffer_));
-  if (pkey_json_ == nullptr) {
-    return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
-  }
-
-  return FindAndVerifySignature();
-}
-
-grpc_jwt_verifier_status JwtValidatorImpl::VerifyPubkey() {
-  if (strncmp(header_->alg, "RS", 2) == 0) {
-    return VerifyPubkeyRSA();
-  } else if (strncmp(header_->alg, "ES256", 5) == 0) {
-    return VerifyPubkeyEC();
+    return VerifyPubkeyEC(key.eck);
   } else {
     return GRPC_JWT_VERIFIER_BAD_SIGNATURE;
   }
 }
 
-grpc_jwt_verifier_status JwtValidatorImpl::VerifyPubkeyEC() {
-  if (eck_ == nullptr) {
+grpc_jwt_verifier_status JwtValidatorImpl::VerifyPubkeyEC(EC_KEY *eck) {
+  if (eck == nullptr) {
     gpr_log(GPR_ERROR, "Cannot find eck.");
     return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
   }
@@ -733,15 +632,15 @@ grpc_jwt_verifier_status JwtValidatorImpl::VerifyPubkeyEC() {
 
   BN_bin2bn(GRPC_SLICE_START_PTR(sig_buffer_), 32, ecdsa_sig_->r);
   BN_bin2bn(GRPC_SLICE_START_PTR(sig_buffer_) + 32, 32, ecdsa_sig_->s);
-  if (ECDSA_do_verify(digest, SHA256_DIGEST_LENGTH, ecdsa_sig_, eck_) == 0) {
+  if (ECDSA_do_verify(digest, SHA256_DIGEST_LENGTH, ecdsa_sig_, eck) == 0) {
     gpr_log(GPR_ERROR, "JWT signature verification failed.");
     return GRPC_JWT_VERIFIER_BAD_SIGNATURE;
   }
   return GRPC_JWT_VERIFIER_OK;
 }
 
-grpc_jwt_verifier_status JwtValidatorImpl::VerifyPubkeyRSA() {
-  if (pkey_ == nullptr) {
+grpc_jwt_verifier_status JwtValidatorImpl::VerifyPubkeyRSA(EVP_PKEY *pkey) {
+  if (pkey == nullptr) {
     gpr_log(GPR_ERROR, "Cannot find public key.");
     return GRPC_JWT_VERIFIER_KEY_RETRIEVAL_ERROR;
   }
@@ -756,7 +655,7 @@ grpc_jwt_verifier_status JwtValidatorImpl::VerifyPubkeyRSA() {
   const EVP_MD *md = EvpMdFromAlg(header_->alg);
   GPR_ASSERT(md != nullptr);  // Checked before.
 
-  if (EVP_DigestVerifyInit(md_ctx_, nullptr, md, nullptr, pkey_) != 1) {
+  if (EVP_DigestVerifyInit(md_ctx_, nullptr, md, nullptr, pkey) != 1) {
     gpr_log(GPR_ERROR, "EVP_DigestVerifyInit failed.");
     return GRPC_JWT_VERIFIER_BAD_SIGNATURE;
   }
@@ -803,6 +702,200 @@ grpc_jwt_verifier_status JwtValidatorImpl::VerifyHsSignature(const char *pkey,
   return GRPC_JWT_VERIFIER_OK;
 }
 
+PublicKeysImpl::PublicKeysImpl(const char *pkey, size_t pkey_len)
+    : json_(nullptr),
+      format_(INVALID),
+      empty_(true),
+      exec_ctx_(GRPC_EXEC_CTX_INIT) {
+  if (pkey == nullptr || pkey_len <= 0) {
+    return;
+  }
+  secret_.assign(pkey, pkey_len);
+  // The parsed json keeps pointers into its buffer, so it parses a copy.
+  std::vector<char> buffer(secret_.begin(), secret_.end());
+  buffer.push_back('\0');
+  json_ = grpc_json_parse_string_with_len(buffer.data(), pkey_len);
+  if (json_ == nullptr) {
+    return;
+  }
+  // JWK set https://tools.ietf.org/html/rfc7517#section-5.
+  const grpc_json *jwk_keys = GetProperty(json_, "keys");
+  if (jwk_keys == nullptr) {
+    format_ = X509;
+    ParseX509Keys();
+  } else {
+    format_ = JWK;
+    ParseJwkKeys(jwk_keys);
+  }
+  // Only the parsed keys are kept.
+  grpc_json_destroy(json_);
+  json_ = nullptr;
+}
+
+PublicKeysImpl::~PublicKeysImpl() {
+  if (json_ != nullptr) {
+    grpc_json_destroy(json_);
+  }
+  for (auto &key : keys_) {
+    if (key.pkey != nullptr) {
+      EVP_PKEY_free(key.pkey);
+    }
+    if (key.eck != nullptr) {
+      EC_KEY_free(key.eck);
+    }
+  }
+}
+
+void PublicKeysImpl::ParseX509Keys() {
+  empty_ = json_->child == nullptr;
+  for (const grpc_json *cur = json_->child; cur != nullptr; cur = cur->next) {
+    Key key;
+    key.kid = cur->key == nullptr ? "" : cur->key;
+    key.has_kid = cur->type == GRPC_JSON_STRING && cur->value != nullptr;
+    key.kty = nullptr;
+    key.pkey = key.has_kid ? ExtractPubkeyFromX509(cur->value) : nullptr;
+    key.eck = nullptr;
+    keys_.push_back(key);
+  }
+}
+
+void PublicKeysImpl::ParseJwkKeys(const grpc_json *jwk_keys) {
+  if (jwk_keys->type != GRPC_JSON_ARRAY) {
+    gpr_log(GPR_ERROR,
+            "Unexpected value type of keys property in jwks key set.");
+    return;
+  }
+  if (jwk_keys->child == nullptr) {
+    gpr_log(GPR_ERROR, "The jwks key set is empty");
+    return;
+  }
+  empty_ = false;
+
+  // JWK format from https://tools.ietf.org/html/rfc7518#section-6.
+  for (const grpc_json *jkey = jwk_keys->child; jkey != nullptr;
+       jkey = jkey->next) {
+    if (jkey->type != GRPC_JSON_OBJECT) continue;
+    Key key;
+    const char *kid = GetStringValue(jkey, "kid");
+    key.kid = kid == nullptr ? "" : kid;
+    key.has_kid = kid != nullptr;
+    // kty is one of a few constants, keep a static copy of it.
+    const char *kty = GetStringValue(jkey, "kty");
+    if (kty == nullptr) {
+      key.kty = nullptr;
+    } else if (strncmp(kty, "RSA", 3) == 0) {
+      key.kty = "RSA";
+    } else if (strncmp(kty, "EC", 2) == 0) {
+      key.kty = "EC";
+    } else {
+      key.kty = "";
+    }
+    key.pkey = nullptr;
+    key.eck = nullptr;
+    if (key.has_kid && key.kty != nullptr) {
+      if (strcmp(key.kty, "RSA") == 0) {
+        key.pkey = ExtractPubkeyFromJwkRSA(jkey);
+      } else if (strcmp(key.kty, "EC") == 0) {
+        key.eck = ExtractPubkeyFromJwkEC(jkey);
+      }
+    }
+    keys_.push_back(key);
+  }
+}
+
+EVP_PKEY *PublicKeysImpl::ExtractPubkeyFromX509(const char *key) {
+  BIO *bio = BIO_new(BIO_s_mem());
+  if (bio == nullptr) {
+    gpr_log(GPR_ERROR, "Unable to allocate a BIO object.");
+    return nullptr;
+  }
+  if (BIO_write(bio, key, strlen(key)) <= 0) {
+    gpr_log(GPR_ERROR, "BIO write error for key (%s).", key);
+    BIO_free(bio);
+    return nullptr;
+  }
+  X509 *x509 = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr);
+  BIO_free(bio);
+  if (x509 == nullptr) {
+    gpr_log(GPR_ERROR, "Unable to parse x509 cert for key (%s).", key);
+    return nullptr;
+  }
+  EVP_PKEY *pkey = X509_get_pubkey(x509);
+  X509_free(x509);
+  if (pkey == nullptr) {
+    gpr_log(GPR_ERROR, "X509_get_pubkey failed");
+    return nullptr;
+  }
+  return pkey;
+}
+
+EVP_PKEY *PublicKeysImpl::ExtractPubkeyFromJwkRSA(const grpc_json *jkey) {
+  RSA *rsa = RSA_new();
+  if (rsa == nullptr) {
+    gpr_log(GPR_ERROR, "Could not create rsa key.");
+    return nullptr;
+  }
+
+  const char *rsa_n = GetStringValue(jkey, "n");
+  rsa->n =
+      rsa_n == nullptr ? nullptr : BigNumFromBase64String(&exec_ctx_, rsa_n);
+  const char *rsa_e = GetStringValue(jkey, "e");
+  rsa->e =
+      rsa_e == nullptr ? nullptr : BigNumFromBase64String(&exec_ctx_, rsa_e);
+
+  if (rsa->e == nullptr || rsa->n == nullptr) {
+    gpr_log(GPR_ERROR, "Missing RSA public key field.");
+    RSA_free(rsa);
+    return nullptr;
+  }
+
+  EVP_PKEY *pkey = EVP_PKEY_new();
+  if (pkey == nullptr || EVP_PKEY_set1_RSA(pkey, rsa) == 0) {
+    gpr_log(GPR_ERROR, "EVP_PKEY_ste1_RSA failed");
+    if (pkey != nullptr) {
+      EVP_PKEY_free(pkey);
+    }
+    RSA_free(rsa);
+    return nullptr;
+  }
+  // pkey holds its own reference of rsa.
+  RSA_free(rsa);
+  return pkey;
+}
+
+EC_KEY *PublicKeysImpl::ExtractPubkeyFromJwkEC(const grpc_json *jkey) {
+  const char *eck_x = GetStringValue(jkey, "x");
+  const char *eck_y = GetStringValue(jkey, "y");
+  if (eck_x == nullptr || eck_y == nullptr) {
+    gpr_log(GPR_ERROR, "Missing EC public key field.");
+    return nullptr;
+  }
+  EC_KEY *eck = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+  if (eck == nullptr) {
+    gpr_log(GPR_ERROR, "Could not create ec key.");
+    return nullptr;
+  }
+  BIGNUM *bn_x = BigNumFromBase64String(&exec_ctx_, eck_x);
+  BIGNUM *bn_y = BigNumFromBase64String(&exec_ctx_, eck_y);
+  if (bn_x == nullptr || bn_y == nullptr) {
+    gpr_log(GPR_ERROR, "Could not generate BIGNUM-type x and y fields.");
+    BN_free(bn_x);
+    BN_free(bn_y);
+    EC_KEY_free(eck);
+    return nullptr;
+  }
+
+  int ok = EC_KEY_set_public_key_affine_coordinates(eck, bn_x, bn_y);
+  BN_free(bn_x);
+  BN_free(bn_y);
+  if (ok == 0) {
+    gpr_log(GPR_ERROR, "Could not populate ec key coordinates.");
+    EC_KEY_free(eck);
+    return nullptr;
+  }
+  return eck;
+}
+
 grpc_jwt_verifier_status JwtValidatorImpl::FillUserInfoAndSetExp(
     UserInfo *user_info) {
   // Required fields.
@@ -28,6 +28,18 @@ namespace google {
 namespace api_manager {
 namespace auth {
 
+// Verification keys parsed from a key document: a JSON object of X509
+// certificates, a JWK set, or a base64 encoded secret for HS algorithms.
+// The keys are parsed once, so verifying a signature with them only costs
+// the cryptographic operation. Immutable, it can be shared by validators.
+class PublicKeys {
+ public:
+  // Parses the key document pkey.
+  static std::shared_ptr<PublicKeys> Create(const char *pkey, size_t pkey_len);
+
+  virtual ~PublicKeys() {}
+};
+
 class JwtValidator {
  public:
   // Create JwtValidator with JWT.
@@ -43,6 +55,11 @@ class JwtValidator {
   // Otherwise, produces a status error message.
   virtual Status VerifySignature(const char *pkey, size_t pkey_len) = 0;
 
+  // Verify signature with parsed keys.
+  // Returns Status::OK when signature verification is successful.
+  // Otherwise, produces a status error message.
+  virtual Status VerifySignature(const PublicKeys &keys) = 0;
+
   // Returns the expiration time of the JWT.
   virtual std::chrono::system_clock::time_point &GetExpirationTime() = 0;
 
@@ -597,6 +597,54 @@ TEST_F(JwtValidatorTest, WrongKeyEC) {
   ASSERT_EQ(status.message(), "KEY_RETRIEVAL_ERROR") << status.message();
 }
 
+TEST_F(JwtValidatorTest, SharedPublicKeys) {
+  std::shared_ptr<PublicKeys> x509_keys =
+      PublicKeys::Create(kPublicKeyX509, strlen(kPublicKeyX509));
+  std::shared_ptr<PublicKeys> jwk_keys =
+      PublicKeys::Create(kPublicKeyJwk, strlen(kPublicKeyJwk));
+  char *token = esp_get_auth_token(kOkPrivateKey, kAudience);
+  ASSERT_TRUE(token != nullptr);
+
+  // The parsed keys are reused by many validators.
+  for (int i = 0; i < 3; ++i) {
+    UserInfo user_info;
+    std::unique_ptr<JwtValidator> validator =
+        JwtValidator::Create(token, strlen(token));
+    Status status = validator->Parse(&user_info);
+    ASSERT_TRUE(status.ok());
+    status = validator->VerifySignature(*x509_keys);
+    ASSERT_TRUE(status.ok()) << status.message();
+    status = validator->VerifySignature(*jwk_keys);
+    ASSERT_TRUE(status.ok()) << status.message();
+  }
+  esp_grpc_free(token);
+
+  // Keys without kid are tried in turn.
+  UserInfo user_info;
+  std::unique_ptr<JwtValidator> validator =
+      JwtValidator::Create(kTokenNoKid, strlen(kTokenNoKid));
+  Status status = validator->Parse(&user_info);
+  ASSERT_TRUE(status.ok());
+  status = validator->VerifySignature(*x509_keys);
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  // Empty keys.
+  std::shared_ptr<PublicKeys> empty_keys = PublicKeys::Create("", 0);
+  status = validator->VerifySignature(*empty_keys);
+  ASSERT_FALSE(status.ok());
+  ASSERT_EQ(status.message(), "KEY_RETRIEVAL_ERROR") << status.message();
+
+  // The wrong key is rejected with shared keys too.
+  validator = JwtValidator::Create(kTokenECWrongKey, strlen(kTokenECWrongKey));
+  status = validator->Parse(&user_info);
+  ASSERT_TRUE(status.ok());
+  std::shared_ptr<PublicKeys> ec_keys =
+      PublicKeys::Create(kPublicKeyJwkEC, strlen(kPublicKeyJwkEC));
+  status = validator->VerifySignature(*ec_keys);
+  ASSERT_FALSE(status.ok());
+  ASSERT_EQ(status.message(), "KEY_RETRIEVAL_ERROR") << status.message();
+}
+
 }  // namespace
 
 }  // namespace auth
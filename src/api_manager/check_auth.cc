@@ -17,6 +17,7 @@
 
 #include <chrono>
 #include <string>
+#include <vector>
 
 #include "include/api_manager/api_manager.h"
 #include "include/api_manager/request.h"
@@ -29,9 +30,9 @@
 #include "src/api_manager/cloud_trace/cloud_trace.h"
 #include "src/api_manager/utils/url_util.h"
 
+using ::google::api_manager::auth::Cert;
 using ::google::api_manager::auth::Certs;
 using ::google::api_manager::auth::JwtCache;
-using ::google::api_manager::auth::JwtValue;
 using ::google::api_manager::auth::GetStringValue;
 using ::google::api_manager::auth::JwtValidator;
 using ::google::api_manager::utils::Status;
@@ -48,10 +49,59 @@ const char kAuthHeaderIAP[] = "x-goog-iap-jwt-assertion";
 const char kBearer[] = "Bearer ";
 // The lifetime of a public key cache entry. Unit: seconds.
 const int kPubKeyCacheDuration = 300;
+// The keys expiring in this time are refreshed in background. Unit: seconds.
+const int kPubKeyRefreshAhead = 30;
+// After a failed fetch of its replacement, an expired key is still used for
+// this long. Unit: seconds.
+const int kPubKeyStaleGrace = 300;
+// The prefix of the key documents in the shared cache.
+const char kSharedKeyCachePrefix[] = "key:";
+
+// Returns the key of the key document of an issuer in the shared cache. The
+// services sharing the cache may map the same issuer to different URIs, so
+// the service and the URI the key is fetched from are part of the key.
+std::string SharedKeyCacheKey(const std::string &service_name,
+                              const std::string &issuer,
+                              const std::string &url) {
+  return kSharedKeyCachePrefix + service_name + " " + issuer + " " + url;
+}
 
 // The header key to send endpoint api user info.
 const char kEndpointApiUserInfo[] = "X-Endpoint-API-UserInfo";
 
+// Returns true if a cached key can verify the tokens at now. An expired key
+// is used for a bounded grace period once fetching a new one failed, so an
+// outage of the key server does not fail the requests right away; the
+// background refresh keeps trying meanwhile.
+bool IsKeyUsable(const Cert *cert, system_clock::time_point now) {
+  if (cert == nullptr) {
+    return false;
+  }
+  if (now <= cert->expiration) {
+    return true;
+  }
+  return cert->fetch_failed &&
+         now <= cert->expiration + std::chrono::seconds(kPubKeyStaleGrace);
+}
+
+// Returns the status of an authentication error.
+Status UnauthenticatedStatus(const std::string &error) {
+  return Status(Code::UNAUTHENTICATED,
+                std::string("JWT validation failed: ") + error, Status::AUTH);
+}
+
+// Returns the status of a fetch error, takes upstream error.
+Status FetchFailureStatus(const std::string &error, Status status) {
+  // Append HTTP response code for the upstream statuses
+  return Status(
+      Code::UNAUTHENTICATED,
+      std::string("JWT validation failed: ") + error +
+          (status.code() >= 300
+               ? ". HTTP response code: " + std::to_string(status.code())
+               : ""),
+      Status::AUTH);
+}
+
 // An AuthChecker object is created for every incoming request. It authenticates
 // the request, extracts user info from the auth token and sets it to the
 // request context.
@@ -77,21 +127,23 @@ class AuthChecker : public std::enable_shared_from_this<AuthChecker> {
 
   void LookupJwtCache();
 
+  // Looks up the JWT verified by another process of the host. Returns true
+  // and sets user_info_ if it is found.
+  bool LookupSharedJwtCache();
+
   void ParseJwt();
 
+  // Parses the claims of a token found in the JWT cache, which does not keep
+  // them. Returns false if the token cannot be parsed.
+  bool ParseClaims();
+
   void CheckAudience(bool cache_hit);
 
   void InitKey();
 
-  void DiscoverJwksUri(const std::string &url);
-
-  // Callback function for open ID discovery http fetch.
-  void PostFetchJwksUri(Status status, std::string &&body);
-
-  void FetchPubKey(const std::string &url);
-
-  // Callback function for public key http fetch.
-  void PostFetchPubKey(Status status, std::string &&body);
+  // Called when the key fetch of the issuer, started by this or by a
+  // concurrent request, completes.
+  void PostFetch(const Status &status);
 
   void VerifySignature();
 
@@ -102,19 +154,12 @@ class AuthChecker : public std::enable_shared_from_this<AuthChecker> {
   // Returns a shared pointer of this AuthChecker object.
   std::shared_ptr<AuthChecker> GetPtr() { return shared_from_this(); }
 
-  // Helper function to send a http GET request.
-  void HttpFetch(const std::string &url,
-                 std::function<void(Status, std::string &&)> continuation);
-
   // Authentication error
   void Unauthenticated(const std::string &error);
 
   // Authorization error
   void Unauthorized(const std::string &error);
 
-  // Fetch error, takes upstream error
-  void FetchFailure(const std::string &error, Status status);
-
   /*** Member Variables. ***/
 
   // Request context.
@@ -139,6 +184,59 @@ class AuthChecker : public std::enable_shared_from_this<AuthChecker> {
   std::shared_ptr<cloud_trace::CloudTraceSpan> trace_span_;
 };
 
+// A KeyFetcher object fetches the verification key of an issuer, via OpenID
+// discovery if needed, stores it in the key cache and resumes the requests
+// waiting for it. It is shared by the requests and the background refresh.
+class KeyFetcher : public std::enable_shared_from_this<KeyFetcher> {
+ public:
+  KeyFetcher(std::shared_ptr<context::ServiceContext> service_context,
+             const std::string &issuer,
+             std::shared_ptr<cloud_trace::CloudTraceSpan> trace_span);
+
+  // Starts the key fetch. The caller must be the first waiter of the key
+  // fetch of the issuer, see Certs::AddFetchWaiter.
+  void Fetch(const std::string &url, bool tryOpenId);
+
+ private:
+  // Takes the key fetched by another process of the host if it is not about
+  // to expire. Returns true if the key is taken.
+  bool LookupSharedKeyCache();
+
+  void DiscoverJwksUri(const std::string &url);
+
+  // Callback function for open ID discovery http fetch.
+  void PostFetchJwksUri(Status status, std::string &&body);
+
+  void FetchPubKey(const std::string &url);
+
+  // Callback function for public key http fetch.
+  void PostFetchPubKey(Status status, std::string &&body);
+
+  // Completes the key fetch of the issuer, resumes all the requests waiting
+  // for it.
+  void FinishFetch(const Status &status);
+
+  // Helper function to send a http GET request.
+  void HttpFetch(const std::string &url,
+                 std::function<void(Status, std::string &&)> continuation);
+
+  // The service context owning the key cache.
+  std::shared_ptr<context::ServiceContext> service_context_;
+
+  // Pointer to access ESP running environment.
+  ApiManagerEnvInterface *env_;
+
+  // The issuer of the key.
+  std::string issuer_;
+
+  // The key of the key document in the shared cache.
+  std::string shared_cache_key_;
+
+  // Trace span of the request fetching the key, nullptr for the background
+  // refresh or if trace is disabled.
+  std::shared_ptr<cloud_trace::CloudTraceSpan> trace_span_;
+};
+
 AuthChecker::AuthChecker(std::shared_ptr<context::RequestContext> context,
                          std::function<void(Status status)> continuation)
     : context_(context),
@@ -195,26 +293,11 @@ void AuthChecker::GetAuthToken() {
 }
 
 void AuthChecker::LookupJwtCache() {
-  bool remove = false;  // whether or not need to remove an expired entry.
-  bool cache_hit = false;
   JwtCache &jwt_cache = context_->service_context()->jwt_cache();
-  {
-    JwtCache::ScopedLookup lookup(&jwt_cache, auth_token_);
-    if (lookup.Found()) {
-      JwtValue *val = lookup.value();
-      if (system_clock::now() <= val->exp) {
-        // Cache hit and cache entry is not expired.
-        user_info_ = val->user_info;
-        cache_hit = true;
-      } else {
-        // Need to removes the expired cache entry.
-        remove = true;
-      }
-    }
-  }
-  if (remove) {
-    jwt_cache.Remove(auth_token_);
-  }
+  // An expired cache entry is removed by the lookup.
+  bool cache_hit =
+      jwt_cache.Lookup(auth_token_, system_clock::now(), &user_info_) ||
+      LookupSharedJwtCache();
 
   if (cache_hit) {
     CheckAudience(true);
@@ -223,6 +306,21 @@ void AuthChecker::LookupJwtCache() {
   }
 }
 
+bool AuthChecker::LookupSharedJwtCache() {
+  std::string data;
+  system_clock::time_point expiration;
+  if (!env_->SharedCacheLookup(
+          auth::SharedJwtCacheKey(context_->service_context()->service_name(),
+                                  auth_token_),
+          &data, &expiration) ||
+      !auth::ParseUserInfo(data, &user_info_)) {
+    return false;
+  }
+  context_->service_context()->jwt_cache().Insert(
+      auth_token_, user_info_, expiration, system_clock::now());
+  return true;
+}
+
 void AuthChecker::ParseJwt() {
   if (validator_ == nullptr) {
     validator_ = JwtValidator::Create(auth_token_.c_str(), auth_token_.size());
@@ -240,6 +338,19 @@ void AuthChecker::ParseJwt() {
   CheckAudience(false);
 }
 
+bool AuthChecker::ParseClaims() {
+  validator_ = JwtValidator::Create(auth_token_.c_str(), auth_token_.size());
+  if (validator_ == nullptr) {
+    return false;
+  }
+  UserInfo user_info;
+  if (!validator_->Parse(&user_info).ok()) {
+    return false;
+  }
+  user_info_.claims = std::move(user_info.claims);
+  return true;
+}
+
 void AuthChecker::CheckAudience(bool cache_hit) {
   std::string audience = user_info_.audiences.empty()
                              ? std::string()
@@ -248,6 +359,12 @@ void AuthChecker::CheckAudience(bool cache_hit) {
   context_->set_auth_audience(audience);
   context_->set_auth_authorized_party(user_info_.authorized_party);
 
+  // Only the security rules check needs the claims.
+  if (cache_hit && user_info_.claims.empty() &&
+      context_->service_context()->IsRulesCheckEnabled() && !ParseClaims()) {
+    Unauthenticated("Unable to parse the claims");
+    return;
+  }
   context_->set_auth_claims(user_info_.claims);
 
   // Remove http/s header and trailing '/' for issuer.
@@ -283,7 +400,7 @@ void AuthChecker::InitKey() {
   Certs &key_cache = context_->service_context()->certs();
   auto cert = key_cache.GetCert(user_info_.issuer);
 
-  if (cert == nullptr || system_clock::now() > cert->second) {
+  if (!IsKeyUsable(cert, system_clock::now())) {
     // Key has not been fetched or has expired.
     std::string url;
     bool tryOpenId =
@@ -293,75 +410,44 @@ void AuthChecker::InitKey() {
       return;
     }
 
-    if (tryOpenId) {
-      DiscoverJwksUri(url);
-    } else {
-      // JwksUri is available. No need to try openID discovery.
-      FetchPubKey(url);
+    // Only one fetch per issuer is in flight, concurrent requests wait for
+    // its result.
+    auto pChecker = GetPtr();
+    if (!key_cache.AddFetchWaiter(user_info_.issuer,
+                                  [pChecker](const Status &status) {
+                                    pChecker->PostFetch(status);
+                                  })) {
+      env_->LogDebug(std::string("Waiting for the key fetch of issuer: ") +
+                     user_info_.issuer);
+      return;
     }
+
+    // The aliased pointer keeps the request context, and so the service
+    // context, alive during the fetch.
+    std::shared_ptr<context::ServiceContext> service_context(
+        context_, context_->service_context());
+    std::make_shared<KeyFetcher>(service_context, user_info_.issuer,
+                                 trace_span_)
+        ->Fetch(url, tryOpenId);
   } else {
     // Key is in the cache, next step is to verify signature.
     VerifySignature();
   }
 }
 
-void AuthChecker::DiscoverJwksUri(const std::string &url) {
-  auto pChecker = GetPtr();
-  HttpFetch(url, [pChecker](Status status, std::string &&body) {
-    pChecker->PostFetchJwksUri(status, std::move(body));
-  });
-}
-
-void AuthChecker::PostFetchJwksUri(Status status, std::string &&body) {
+void AuthChecker::PostFetch(const Status &status) {
   if (!status.ok()) {
-    context_->service_context()->SetJwksUri(user_info_.issuer, std::string(),
-                                            false);
-    FetchFailure("Unable to fetch URI of the key via OpenID discovery", status);
-    return;
-  }
-
-  // Parse discovery doc and extract jwks_uri
-  grpc_json *discovery_json = grpc_json_parse_string_with_len(
-      const_cast<char *>(body.c_str()), body.size());
-  const char *jwks_uri;
-  if (discovery_json != nullptr) {
-    jwks_uri = GetStringValue(discovery_json, "jwks_uri");
-    grpc_json_destroy(discovery_json);
-  } else {
-    jwks_uri = nullptr;
-  }
-
-  if (jwks_uri == nullptr) {
-    env_->LogError("OpenID discovery failed due to invalid doc format");
-    context_->service_context()->SetJwksUri(user_info_.issuer, std::string(),
-                                            false);
-    Unauthenticated("Unable to parse URI of the key via OpenID discovery");
-    return;
-  }
-
-  // OpenID discovery completed. Set jwks_uri for the issuer in cache.
-  context_->service_context()->SetJwksUri(user_info_.issuer, jwks_uri, false);
-
-  FetchPubKey(jwks_uri);
-}
-
-void AuthChecker::FetchPubKey(const std::string &url) {
-  auto pChecker = GetPtr();
-  HttpFetch(url, [pChecker](Status status, std::string &&body) {
-    pChecker->PostFetchPubKey(status, std::move(body));
-  });
-}
-
-void AuthChecker::PostFetchPubKey(Status status, std::string &&body) {
-  if (!status.ok() || body.empty()) {
-    FetchFailure("Unable to fetch verification key", status);
-    return;
+    Certs &key_cache = context_->service_context()->certs();
+    if (!IsKeyUsable(key_cache.GetCert(user_info_.issuer),
+                     system_clock::now())) {
+      TRACE(trace_span_) << "Authentication failed: " << status.message();
+      trace_span_.reset();
+      on_done_(status);
+      return;
+    }
+    env_->LogWarning("Using the expired verification key of " +
+                     user_info_.issuer + ": " + status.message());
   }
-
-  Certs &key_cache = context_->service_context()->certs();
-  key_cache.Update(
-      user_info_.issuer, std::move(body),
-      system_clock::now() + std::chrono::seconds(kPubKeyCacheDuration));
   VerifySignature();
 }
 
@@ -372,9 +458,9 @@ void AuthChecker::VerifySignature() {
     Unauthenticated("Missing verification key");
     return;
   }
+  key_cache.MarkUsed(user_info_.issuer, system_clock::now());
 
-  Status status =
-      validator_->VerifySignature(cert->first.c_str(), cert->first.size());
+  Status status = validator_->VerifySignature(*cert->keys);
   if (!status.ok()) {
     Unauthenticated(status.message());
     return;
@@ -382,8 +468,14 @@ void AuthChecker::VerifySignature() {
 
   // Inserts the entry to JwtCache.
   JwtCache &cache = context_->service_context()->jwt_cache();
-  cache.Insert(auth_token_, user_info_, validator_->GetExpirationTime(),
-               system_clock::now());
+  auto now = system_clock::now();
+  auto token_exp = validator_->GetExpirationTime();
+  cache.Insert(auth_token_, user_info_, token_exp, now);
+  env_->SharedCacheInsert(
+      auth::SharedJwtCacheKey(context_->service_context()->service_name(),
+                              auth_token_),
+                          auth::SerializeUserInfo(user_info_),
+                          JwtCache::EntryExpiration(token_exp, now));
 
   PassUserInfoOnSuccess();
 }
@@ -408,9 +500,7 @@ void AuthChecker::PassUserInfoOnSuccess() {
 void AuthChecker::Unauthenticated(const std::string &error) {
   TRACE(trace_span_) << "Authentication failed: " << error;
   trace_span_.reset();
-  on_done_(Status(Code::UNAUTHENTICATED,
-                  std::string("JWT validation failed: ") + error,
-                  Status::AUTH));
+  on_done_(UnauthenticatedStatus(error));
 }
 
 void AuthChecker::Unauthorized(const std::string &error) {
@@ -421,19 +511,108 @@ void AuthChecker::Unauthorized(const std::string &error) {
                   Status::AUTH));
 }
 
-void AuthChecker::FetchFailure(const std::string &error, Status status) {
-  // Append HTTP response code for the upstream statuses
-  trace_span_.reset();
-  on_done_(
-      Status(Code::UNAUTHENTICATED,
-             std::string("JWT validation failed: ") + error +
-                 (status.code() >= 300
-                      ? ". HTTP response code: " + std::to_string(status.code())
-                      : ""),
-             Status::AUTH));
+KeyFetcher::KeyFetcher(
+    std::shared_ptr<context::ServiceContext> service_context,
+    const std::string &issuer,
+    std::shared_ptr<cloud_trace::CloudTraceSpan> trace_span)
+    : service_context_(service_context),
+      env_(service_context_->env()),
+      issuer_(issuer),
+      trace_span_(trace_span) {}
+
+void KeyFetcher::Fetch(const std::string &url, bool tryOpenId) {
+  shared_cache_key_ =
+      SharedKeyCacheKey(service_context_->service_name(), issuer_, url);
+  if (LookupSharedKeyCache()) {
+    FinishFetch(Status::OK);
+  } else if (tryOpenId) {
+    DiscoverJwksUri(url);
+  } else {
+    // JwksUri is available. No need to try openID discovery.
+    FetchPubKey(url);
+  }
+}
+
+bool KeyFetcher::LookupSharedKeyCache() {
+  std::string cert;
+  system_clock::time_point expiration;
+  if (!env_->SharedCacheLookup(shared_cache_key_, &cert, &expiration) ||
+      expiration <=
+          system_clock::now() + std::chrono::seconds(kPubKeyRefreshAhead)) {
+    return false;
+  }
+  env_->LogDebug("Using the verification key fetched by another process: " +
+                 issuer_);
+  service_context_->certs().Update(issuer_, cert, expiration);
+  return true;
+}
+
+void KeyFetcher::DiscoverJwksUri(const std::string &url) {
+  auto pFetcher = shared_from_this();
+  HttpFetch(url, [pFetcher](Status status, std::string &&body) {
+    pFetcher->PostFetchJwksUri(status, std::move(body));
+  });
 }
 
-void AuthChecker::HttpFetch(
+void KeyFetcher::PostFetchJwksUri(Status status, std::string &&body) {
+  if (!status.ok()) {
+    service_context_->SetJwksUri(issuer_, std::string(), false);
+    FinishFetch(FetchFailureStatus(
+        "Unable to fetch URI of the key via OpenID discovery", status));
+    return;
+  }
+
+  // Parse discovery doc and extract jwks_uri
+  grpc_json *discovery_json = grpc_json_parse_string_with_len(
+      const_cast<char *>(body.c_str()), body.size());
+  const char *jwks_uri;
+  if (discovery_json != nullptr) {
+    jwks_uri = GetStringValue(discovery_json, "jwks_uri");
+    grpc_json_destroy(discovery_json);
+  } else {
+    jwks_uri = nullptr;
+  }
+
+  if (jwks_uri == nullptr) {
+    env_->LogError("OpenID discovery failed due to invalid doc format");
+    service_context_->SetJwksUri(issuer_, std::string(), false);
+    FinishFetch(UnauthenticatedStatus(
+        "Unable to parse URI of the key via OpenID discovery"));
+    return;
+  }
+
+  // OpenID discovery completed. Set jwks_uri for the issuer in cache.
+  service_context_->SetJwksUri(issuer_, jwks_uri, false);
+
+  FetchPubKey(jwks_uri);
+}
+
+void KeyFetcher::FetchPubKey(const std::string &url) {
+  auto pFetcher = shared_from_this();
+  HttpFetch(url, [pFetcher](Status status, std::string &&body) {
+    pFetcher->PostFetchPubKey(status, std::move(body));
+  });
+}
+
+void KeyFetcher::PostFetchPubKey(Status status, std::string &&body) {
+  if (!status.ok() || body.empty()) {
+    FinishFetch(FetchFailureStatus(
+        "Unable to fetch verification key", status));
+    return;
+  }
+
+  auto expiration =
+      system_clock::now() + std::chrono::seconds(kPubKeyCacheDuration);
+  env_->SharedCacheInsert(shared_cache_key_, body, expiration);
+  service_context_->certs().Update(issuer_, std::move(body), expiration);
+  FinishFetch(Status::OK);
+}
+
+void KeyFetcher::FinishFetch(const Status &status) {
+  service_context_->certs().FinishFetch(issuer_, status);
+}
+
+void KeyFetcher::HttpFetch(
     const std::string &url,
     std::function<void(Status, std::string &&)> continuation) {
   std::shared_ptr<cloud_trace::CloudTraceSpan> fetch_span(
@@ -466,5 +645,33 @@ void CheckAuth(std::shared_ptr<context::RequestContext> context,
   authChecker->Check();
 }
 
+void RefreshAuthKeys(std::shared_ptr<context::ServiceContext> service_context) {
+  Certs &key_cache = service_context->certs();
+  ApiManagerEnvInterface *env = service_context->env();
+  auto now = system_clock::now();
+  std::vector<std::string> issuers = key_cache.GetIssuersToRefresh(
+      now - std::chrono::seconds(kPubKeyCacheDuration),
+      now + std::chrono::seconds(kPubKeyRefreshAhead));
+  for (const auto &issuer : issuers) {
+    std::string url;
+    bool tryOpenId = service_context->GetJwksUri(issuer, &url);
+    if (url.empty()) {
+      continue;
+    }
+    if (!key_cache.AddFetchWaiter(issuer, [env, issuer](const Status &status) {
+          if (!status.ok()) {
+            env->LogWarning("Unable to refresh the verification key of " +
+                            issuer + ", the cached key is kept: " +
+                            status.message());
+          }
+        })) {
+      continue;
+    }
+    env->LogDebug("Refreshing the verification key of " + issuer);
+    std::make_shared<KeyFetcher>(service_context, issuer, nullptr)
+        ->Fetch(url, tryOpenId);
+  }
+}
+
 }  // namespace api_manager
 }  // namespace google
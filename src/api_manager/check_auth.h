@@ -26,6 +26,13 @@ namespace api_manager {
 void CheckAuth(std::shared_ptr<context::RequestContext> context,
                std::function<void(utils::Status status)> continuation);
 
+// This function refreshes the verification keys of the recently used issuers
+// of a service shortly before they expire, so the requests do not wait for
+// key fetches. If a refresh fails, the cached key is still used for a bounded
+// grace period after it expires.
+// It is called periodically by ApiManagerImpl.
+void RefreshAuthKeys(std::shared_ptr<context::ServiceContext> service_context);
+
 }  // namespace api_manager
 }  // namespace google
 
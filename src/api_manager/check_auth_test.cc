@@ -28,6 +28,8 @@ using ::testing::Field;
 using ::testing::Invoke;
 using ::testing::Mock;
 using ::testing::Return;
+using ::testing::SaveArg;
+using ::testing::SetArgPointee;
 
 using ::google::api_manager::utils::Status;
 using ::google::protobuf::util::error::Code;
@@ -84,6 +86,38 @@ const char kServiceConfig[] =
     "  environment : \"http://127.0.0.1:8081\"\n"
     "}\n";
 
+// Another service of the host, which trusts the tokens of issuer2 issued
+// for the service of kServiceConfig but fetches their keys elsewhere.
+const char kOtherServiceConfig[] =
+    "name: \"other-service.cloudendpointsapis.com\"\n"
+    "authentication {\n"
+    "    providers: [\n"
+    "    {\n"
+    "      id: \"issuer2\"\n"
+    "      issuer: \"https://issuer2.com\"\n"
+    "      jwks_uri: \"https://other-service.com/pubkey\"\n"
+    "    }\n"
+    "    ],\n"
+    "    rules: {\n"
+    "      selector: \"ListShelves\"\n"
+    "      requirements: [\n"
+    "      {\n"
+    "        provider_id: \"issuer2\"\n"
+    "        audiences: \"endpoints-test.cloudendpointsapis.com\"\n"
+    "      }\n"
+    "      ]\n"
+    "    }\n"
+    "}\n"
+    "http {\n"
+    "  rules {\n"
+    "    selector: \"ListShelves\"\n"
+    "    get: \"/ListShelves\"\n"
+    "  }\n"
+    "}\n"
+    "control {\n"
+    "  environment : \"http://127.0.0.1:8081\"\n"
+    "}\n";
+
 // Auth token generated with the following header and payload.
 //{
 // "alg": "RS256",
@@ -333,36 +367,62 @@ class CheckAuthTest : public ::testing::Test {
         std::move(env), "", std::move(config));
     ASSERT_NE(service_context_.get(), nullptr);
 
+    context_ = CreateRequestContext(&raw_request_);
+  }
+
+  // Creates a request context for a GET /ListShelves request, to the service
+  // of service_context_ by default.
+  std::shared_ptr<context::RequestContext> CreateRequestContext(
+      MockRequest **raw_request,
+      std::shared_ptr<context::ServiceContext> service_context = nullptr) {
     std::unique_ptr<MockRequest> request(
         new ::testing::NiceMock<MockRequest>());
     // save the raw pointer of request before calling std::move(request).
-    raw_request_ = request.get();
+    *raw_request = request.get();
 
-    EXPECT_CALL(*raw_request_, GetRequestHTTPMethod())
+    EXPECT_CALL(**raw_request, GetRequestHTTPMethod())
         .WillOnce(Return(std::string("GET")));
-    EXPECT_CALL(*raw_request_, GetUnparsedRequestPath())
+    EXPECT_CALL(**raw_request, GetUnparsedRequestPath())
         .WillOnce(Return(std::string("/ListShelves")));
-    EXPECT_CALL(*raw_request_, FindQuery(_, _))
+    EXPECT_CALL(**raw_request, FindQuery(_, _))
         .WillOnce(Invoke([](const std::string &, std::string *apikey) {
           *apikey = "apikey";
           return true;
         }));
-    EXPECT_CALL(*raw_request_, FindHeader("X-HTTP-Method-Override", _))
+    EXPECT_CALL(**raw_request, FindHeader("X-HTTP-Method-Override", _))
         .Times(1);
-    EXPECT_CALL(*raw_request_, FindHeader("referer", _))
+    EXPECT_CALL(**raw_request, FindHeader("referer", _))
         .WillOnce(Invoke([](const std::string &, std::string *http_referer) {
           *http_referer = "";
           return true;
         }));
-    EXPECT_CALL(*raw_request_, FindHeader("X-Cloud-Trace-Context", _))
+    EXPECT_CALL(**raw_request, FindHeader("X-Cloud-Trace-Context", _))
         .WillOnce(Invoke([](const std::string &, std::string *trace_context) {
           *trace_context = "";
           return true;
         }));
 
-    context_ = std::make_shared<context::RequestContext>(service_context_,
-                                                         std::move(request));
-    EXPECT_TRUE(Mock::VerifyAndClearExpectations(raw_request_));
+    auto context = std::make_shared<context::RequestContext>(
+        service_context ? service_context : service_context_,
+        std::move(request));
+    EXPECT_TRUE(Mock::VerifyAndClearExpectations(*raw_request));
+    return context;
+  }
+
+  // Expects the request to carry auth_token in the authorization header.
+  void ExpectAuthToken(MockRequest *raw_request,
+                       const std::string &auth_token) {
+    EXPECT_CALL(*raw_request, FindHeader("x-goog-iap-jwt-assertion", _))
+        .WillOnce(Invoke([](const std::string &, std::string *token) {
+          *token = "";
+          return false;
+        }));
+    EXPECT_CALL(*raw_request, FindHeader(kAuthHeader, _))
+        .WillOnce(Invoke([auth_token](const std::string &, std::string *token) {
+          *token = std::string(kBearer) + auth_token;
+          return true;
+        }));
+    EXPECT_CALL(*raw_request, SetAuthToken(auth_token)).Times(1);
   }
 
   void TestValidToken(const std::string &auth_token);
@@ -554,6 +614,296 @@ TEST_F(CheckAuthTest, TestNoOpenId) {
   CheckAuth(context_, [](Status status) { ASSERT_TRUE(status.ok()); });
 }
 
+// Concurrent requests of the same issuer share one key fetch.
+TEST_F(CheckAuthTest, TestConcurrentKeyFetch) {
+  MockRequest *raw_request2;
+  std::shared_ptr<context::RequestContext> context2 =
+      CreateRequestContext(&raw_request2);
+
+  ExpectAuthToken(raw_request_, kTokenIssuer2);
+  ExpectAuthToken(raw_request2, kTokenIssuer2);
+  int done_count = 0;
+  // The second request arrives while the key is being fetched.
+  EXPECT_CALL(*raw_env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke([&](HTTPRequest *req) {
+        EXPECT_EQ(req->url(), kIssuer2PubkeyUrl);
+        CheckAuth(context2, [&done_count](Status status) {
+          ASSERT_TRUE(status.ok());
+          ++done_count;
+        });
+        EXPECT_EQ(done_count, 0);
+
+        std::string body(kPubkey);
+        std::map<std::string, std::string> empty;
+        req->OnComplete(Status::OK, std::move(empty), std::move(body));
+      }));
+  EXPECT_CALL(*raw_request_,
+              AddHeaderToBackend(kEndpointApiUserInfo, kUserInfo_kSub_kIss2))
+      .WillOnce(Return(utils::Status::OK));
+  EXPECT_CALL(*raw_request2,
+              AddHeaderToBackend(kEndpointApiUserInfo, kUserInfo_kSub_kIss2))
+      .WillOnce(Return(utils::Status::OK));
+
+  CheckAuth(context_, [&done_count](Status status) {
+    ASSERT_TRUE(status.ok());
+    ++done_count;
+  });
+  EXPECT_EQ(done_count, 2);
+}
+
+// A failed key fetch fails all the requests waiting for it.
+TEST_F(CheckAuthTest, TestConcurrentKeyFetchFailure) {
+  MockRequest *raw_request2;
+  std::shared_ptr<context::RequestContext> context2 =
+      CreateRequestContext(&raw_request2);
+
+  ExpectAuthToken(raw_request_, kTokenIssuer2);
+  ExpectAuthToken(raw_request2, kTokenIssuer2);
+  int done_count = 0;
+  EXPECT_CALL(*raw_env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke([&](HTTPRequest *req) {
+        CheckAuth(context2, [&done_count](Status status) {
+          ASSERT_EQ(status.code(), Code::UNAUTHENTICATED);
+          ASSERT_EQ(status.message(),
+                    "JWT validation failed: Unable to fetch verification key. "
+                    "HTTP response code: 503");
+          ++done_count;
+        });
+
+        std::map<std::string, std::string> empty;
+        req->OnComplete(Status(503, "Service Unavailable"), std::move(empty),
+                        std::string());
+      }));
+
+  CheckAuth(context_, [&done_count](Status status) {
+    ASSERT_EQ(status.code(), Code::UNAUTHENTICATED);
+    ++done_count;
+  });
+  EXPECT_EQ(done_count, 2);
+}
+
+// The recently used keys are refreshed before they expire.
+TEST_F(CheckAuthTest, TestRefreshAuthKeys) {
+  ExpectAuthToken(raw_request_, kTokenIssuer2);
+  EXPECT_CALL(*raw_env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke([](HTTPRequest *req) {
+        std::string body(kPubkey);
+        std::map<std::string, std::string> empty;
+        req->OnComplete(Status::OK, std::move(empty), std::move(body));
+      }));
+  EXPECT_CALL(*raw_request_,
+              AddHeaderToBackend(kEndpointApiUserInfo, kUserInfo_kSub_kIss2))
+      .WillOnce(Return(utils::Status::OK));
+  CheckAuth(context_, [](Status status) { ASSERT_TRUE(status.ok()); });
+  EXPECT_TRUE(Mock::VerifyAndClearExpectations(raw_env_));
+
+  // The key does not expire soon.
+  EXPECT_CALL(*raw_env_, DoRunHTTPRequest(_)).Times(0);
+  RefreshAuthKeys(service_context_);
+  EXPECT_TRUE(Mock::VerifyAndClearExpectations(raw_env_));
+
+  // The key expires soon and is refreshed.
+  auth::Certs &certs = service_context_->certs();
+  auto now = std::chrono::system_clock::now();
+  certs.Update("https://issuer2.com", kPubkey, now + std::chrono::seconds(5));
+  EXPECT_CALL(*raw_env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke([](HTTPRequest *req) {
+        EXPECT_EQ(req->url(), kIssuer2PubkeyUrl);
+        std::string body(kPubkey);
+        std::map<std::string, std::string> empty;
+        req->OnComplete(Status::OK, std::move(empty), std::move(body));
+      }));
+  RefreshAuthKeys(service_context_);
+  EXPECT_TRUE(Mock::VerifyAndClearExpectations(raw_env_));
+  const auth::Cert *cert = certs.GetCert("https://issuer2.com");
+  ASSERT_NE(cert, nullptr);
+  EXPECT_GT(cert->expiration, now + std::chrono::seconds(60));
+
+  // A failed refresh keeps the cached key.
+  certs.Update("https://issuer2.com", kPubkey, now + std::chrono::seconds(5));
+  EXPECT_CALL(*raw_env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke([](HTTPRequest *req) {
+        std::map<std::string, std::string> empty;
+        req->OnComplete(Status(503, "Service Unavailable"), std::move(empty),
+                        std::string());
+      }));
+  RefreshAuthKeys(service_context_);
+  cert = certs.GetCert("https://issuer2.com");
+  ASSERT_NE(cert, nullptr);
+  EXPECT_EQ(cert->expiration, now + std::chrono::seconds(5));
+  EXPECT_EQ(cert->cert, kPubkey);
+}
+
+// An expired key is still used for a while when fetching a new one fails.
+TEST_F(CheckAuthTest, TestExpiredKeyAfterFailedFetch) {
+  auth::Certs &certs = service_context_->certs();
+  auto now = std::chrono::system_clock::now();
+  certs.Update("https://issuer2.com", kPubkey, now - std::chrono::seconds(10));
+
+  // The fetch fails, the expired key verifies the token.
+  ExpectAuthToken(raw_request_, kTokenIssuer2);
+  EXPECT_CALL(*raw_env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke([](HTTPRequest *req) {
+        std::map<std::string, std::string> empty;
+        req->OnComplete(Status(503, "Service Unavailable"), std::move(empty),
+                        std::string());
+      }));
+  EXPECT_CALL(*raw_request_,
+              AddHeaderToBackend(kEndpointApiUserInfo, kUserInfo_kSub_kIss2))
+      .WillOnce(Return(utils::Status::OK));
+  CheckAuth(context_, [](Status status) { ASSERT_TRUE(status.ok()); });
+  EXPECT_TRUE(Mock::VerifyAndClearExpectations(raw_env_));
+
+  // The next request uses the expired key without waiting for a fetch.
+  service_context_->jwt_cache().Remove(kTokenIssuer2);
+  MockRequest *raw_request2;
+  std::shared_ptr<context::RequestContext> context2 =
+      CreateRequestContext(&raw_request2);
+  ExpectAuthToken(raw_request2, kTokenIssuer2);
+  EXPECT_CALL(*raw_env_, DoRunHTTPRequest(_)).Times(0);
+  EXPECT_CALL(*raw_request2,
+              AddHeaderToBackend(kEndpointApiUserInfo, kUserInfo_kSub_kIss2))
+      .WillOnce(Return(utils::Status::OK));
+  CheckAuth(context2, [](Status status) { ASSERT_TRUE(status.ok()); });
+  EXPECT_TRUE(Mock::VerifyAndClearExpectations(raw_env_));
+
+  // Past the grace period the request fails with the fetch.
+  service_context_->jwt_cache().Remove(kTokenIssuer2);
+  certs.Update("https://issuer2.com", kPubkey,
+               now - std::chrono::seconds(3600));
+  MockRequest *raw_request3;
+  std::shared_ptr<context::RequestContext> context3 =
+      CreateRequestContext(&raw_request3);
+  ExpectAuthToken(raw_request3, kTokenIssuer2);
+  EXPECT_CALL(*raw_env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke([](HTTPRequest *req) {
+        std::map<std::string, std::string> empty;
+        req->OnComplete(Status(503, "Service Unavailable"), std::move(empty),
+                        std::string());
+      }));
+  EXPECT_CALL(*raw_request3, AddHeaderToBackend(_, _)).Times(0);
+  CheckAuth(context3, [](Status status) { ASSERT_FALSE(status.ok()); });
+}
+
+// The keys and the tokens verified by other processes of the host are taken
+// from the shared cache.
+TEST_F(CheckAuthTest, TestSharedCache) {
+  const std::string jwt_key = auth::SharedJwtCacheKey(
+      "endpoints-test.cloudendpointsapis.com", kTokenIssuer2);
+  auto expiration =
+      std::chrono::system_clock::now() + std::chrono::seconds(60);
+
+  // The key is fetched by another process, the token is verified here.
+  ExpectAuthToken(raw_request_, kTokenIssuer2);
+  EXPECT_CALL(*raw_env_, SharedCacheLookup(jwt_key, _, _))
+      .WillOnce(Return(false));
+  const std::string key_key =
+      "key:endpoints-test.cloudendpointsapis.com https://issuer2.com "
+      "https://issuer2.com/pubkey";
+  EXPECT_CALL(*raw_env_, SharedCacheLookup(key_key, _, _))
+      .WillOnce(DoAll(SetArgPointee<1>(std::string(kPubkey)),
+                      SetArgPointee<2>(expiration), Return(true)));
+  EXPECT_CALL(*raw_env_, DoRunHTTPRequest(_)).Times(0);
+  std::string user_info;
+  EXPECT_CALL(*raw_env_, SharedCacheInsert(jwt_key, _, _))
+      .WillOnce(SaveArg<1>(&user_info));
+  EXPECT_CALL(*raw_request_,
+              AddHeaderToBackend(kEndpointApiUserInfo, kUserInfo_kSub_kIss2))
+      .WillOnce(Return(utils::Status::OK));
+  CheckAuth(context_, [](Status status) { ASSERT_TRUE(status.ok()); });
+  EXPECT_TRUE(Mock::VerifyAndClearExpectations(raw_env_));
+  const auth::Cert *cert =
+      service_context_->certs().GetCert("https://issuer2.com");
+  ASSERT_NE(cert, nullptr);
+  EXPECT_EQ(cert->expiration, expiration);
+
+  // The token is verified by another process.
+  service_context_->jwt_cache().Remove(kTokenIssuer2);
+  service_context_->certs().Update("https://issuer2.com", kPubkey,
+                                   std::chrono::system_clock::now());
+  MockRequest *raw_request2;
+  std::shared_ptr<context::RequestContext> context2 =
+      CreateRequestContext(&raw_request2);
+  ExpectAuthToken(raw_request2, kTokenIssuer2);
+  EXPECT_CALL(*raw_env_, SharedCacheLookup(jwt_key, _, _))
+      .WillOnce(DoAll(SetArgPointee<1>(user_info),
+                      SetArgPointee<2>(expiration), Return(true)));
+  EXPECT_CALL(*raw_env_, DoRunHTTPRequest(_)).Times(0);
+  EXPECT_CALL(*raw_request2,
+              AddHeaderToBackend(kEndpointApiUserInfo, kUserInfo_kSub_kIss2))
+      .WillOnce(Return(utils::Status::OK));
+  CheckAuth(context2, [](Status status) { ASSERT_TRUE(status.ok()); });
+  EXPECT_EQ(service_context_->jwt_cache().Size(), 1u);
+}
+
+// The services of the host sharing the cache do not see each other's tokens
+// and keys.
+TEST_F(CheckAuthTest, TestSharedCacheIsPerService) {
+  std::map<std::string, std::string> shared_cache;
+  auto lookup = [&shared_cache](const std::string &key, std::string *value,
+                                std::chrono::system_clock::time_point *exp) {
+    auto it = shared_cache.find(key);
+    if (it == shared_cache.end()) {
+      return false;
+    }
+    *value = it->second;
+    *exp = std::chrono::system_clock::now() + std::chrono::seconds(60);
+    return true;
+  };
+  auto insert = [&shared_cache](const std::string &key,
+                                const std::string &value,
+                                std::chrono::system_clock::time_point) {
+    shared_cache[key] = value;
+  };
+
+  std::unique_ptr<MockApiManagerEnvironment> env(
+      new ::testing::NiceMock<MockApiManagerEnvironment>());
+  MockApiManagerEnvironment *raw_env2 = env.get();
+  std::unique_ptr<Config> config =
+      Config::Create(raw_env2, kOtherServiceConfig);
+  ASSERT_NE(config.get(), nullptr);
+  auto service_context2 = std::make_shared<context::ServiceContext>(
+      std::move(env), "", std::move(config));
+
+  for (MockApiManagerEnvironment *mock_env : {raw_env_, raw_env2}) {
+    ON_CALL(*mock_env, SharedCacheLookup(_, _, _))
+        .WillByDefault(Invoke(lookup));
+    ON_CALL(*mock_env, SharedCacheInsert(_, _, _))
+        .WillByDefault(Invoke(insert));
+  }
+
+  // The first service fetches the key and verifies the token.
+  ExpectAuthToken(raw_request_, kTokenIssuer2);
+  EXPECT_CALL(*raw_env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke([](HTTPRequest *req) {
+        EXPECT_EQ(req->url(), kIssuer2PubkeyUrl);
+        std::string body(kPubkey);
+        std::map<std::string, std::string> empty;
+        req->OnComplete(Status::OK, std::move(empty), std::move(body));
+      }));
+  EXPECT_CALL(*raw_request_,
+              AddHeaderToBackend(kEndpointApiUserInfo, kUserInfo_kSub_kIss2))
+      .WillOnce(Return(utils::Status::OK));
+  CheckAuth(context_, [](Status status) { ASSERT_TRUE(status.ok()); });
+  EXPECT_EQ(shared_cache.size(), 2u);
+
+  // The other service neither takes the verified token nor the key, it
+  // fetches the key from its own URI.
+  MockRequest *raw_request2;
+  std::shared_ptr<context::RequestContext> context2 =
+      CreateRequestContext(&raw_request2, service_context2);
+  ExpectAuthToken(raw_request2, kTokenIssuer2);
+  EXPECT_CALL(*raw_env2, DoRunHTTPRequest(_))
+      .WillOnce(Invoke([](HTTPRequest *req) {
+        EXPECT_EQ(req->url(), "https://other-service.com/pubkey");
+        std::map<std::string, std::string> empty;
+        req->OnComplete(Status(503, "Service Unavailable"), std::move(empty),
+                        std::string());
+      }));
+  EXPECT_CALL(*raw_request2, AddHeaderToBackend(_, _)).Times(0);
+  CheckAuth(context2, [](Status status) { ASSERT_FALSE(status.ok()); });
+}
+
 // Negative test: invalid token and expired token.
 TEST_F(CheckAuthTest, TestInvalidToken) {
   EXPECT_CALL(*raw_request_, FindHeader("x-goog-iap-jwt-assertion", _))
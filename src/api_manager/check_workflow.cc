@@ -26,38 +26,122 @@ using ::google::api_manager::utils::Status;
 namespace google {
 namespace api_manager {
 
+// Runs the handlers of a request in the parallel mode. The object keeps
+// itself alive through the continuations of the running handlers.
+class CheckWorkflow::ParallelRun
+    : public std::enable_shared_from_this<ParallelRun> {
+ public:
+  ParallelRun(const CheckWorkflow *workflow,
+              std::shared_ptr<context::RequestContext> context)
+      : workflow_(workflow),
+        context_(context),
+        running_(0),
+        status_(Status::OK) {
+    for (const auto &stage : workflow_->stages_) {
+      pending_dependencies_.push_back(stage.num_dependencies);
+    }
+  }
+
+  // Starts the handlers without dependencies.
+  void Start() {
+    // Holds the completion until all the handlers are started, in case they
+    // complete synchronously.
+    ++running_;
+    for (size_t i = 0; i < pending_dependencies_.size(); ++i) {
+      if (pending_dependencies_[i] == 0) {
+        StartHandler(i);
+      }
+    }
+    Release();
+  }
+
+ private:
+  void StartHandler(size_t index) {
+    ++running_;
+    auto self = shared_from_this();
+    workflow_->stages_[index].handler(context_, [self, index](Status status) {
+      self->OnHandlerDone(index, status);
+    });
+  }
+
+  void OnHandlerDone(size_t index, const Status &status) {
+    if (!status.ok()) {
+      // Keeps the first failure; no handler starts after it.
+      if (status_.ok()) {
+        status_ = status;
+      }
+    } else if (status_.ok()) {
+      for (size_t dependent : workflow_->stages_[index].dependents) {
+        if (--pending_dependencies_[dependent] == 0) {
+          StartHandler(dependent);
+        }
+      }
+    }
+    Release();
+  }
+
+  // Completes the check when no handler is running. The running handlers
+  // write to the request in their continuations, so the check must not
+  // complete, and the request be finalized, before they all finish.
+  void Release() {
+    if (--running_ == 0) {
+      context_->CompleteCheck(status_);
+    }
+  }
+
+  const CheckWorkflow *workflow_;
+  std::shared_ptr<context::RequestContext> context_;
+  // The number of unfinished dependencies of each handler.
+  std::vector<size_t> pending_dependencies_;
+  // The number of running handlers.
+  size_t running_;
+  // The status of the first failed handler.
+  Status status_;
+};
+
 void CheckWorkflow::RegisterAll() {
   // Fetchs GCE metadata.
-  Register(FetchGceMetadata);
+  size_t metadata = Register(FetchGceMetadata);
   // Fetchs service account token.
-  Register(FetchServiceAccountToken);
+  size_t service_account_token =
+      Register(FetchServiceAccountToken, {metadata});
   // Authentication checks.
-  Register(CheckAuth);
+  size_t auth = Register(CheckAuth);
   // Check Security Rules.
-  Register(CheckSecurityRules);
+  Register(CheckSecurityRules, {service_account_token, auth});
   // Checks service control.
-  Register(CheckServiceControl);
-  // Quota control
-  Register(QuotaControl);
+  size_t service_control =
+      Register(CheckServiceControl, {service_account_token});
+  // Quota control, it uses the API key validated by the Check call.
+  Register(QuotaControl, {service_control});
 }
 
-void CheckWorkflow::Register(CheckHandler handler) {
-  handlers_.push_back(handler);
+size_t CheckWorkflow::Register(CheckHandler handler,
+                               const std::vector<size_t> &dependencies) {
+  size_t index = stages_.size();
+  for (size_t dependency : dependencies) {
+    GOOGLE_CHECK(dependency < index);
+    stages_[dependency].dependents.push_back(index);
+  }
+  stages_.push_back({handler, dependencies.size(), {}});
+  return index;
 }
 
 void CheckWorkflow::Run(std::shared_ptr<context::RequestContext> context) {
-  if (!handlers_.empty()) {
-    RunOneHandler(context, 0);
-  } else {
+  if (stages_.empty()) {
     // Empty check handler list means: not need to check.
     context->CompleteCheck(Status::OK);
+  } else if (parallel_) {
+    std::make_shared<ParallelRun>(this, context)->Start();
+  } else {
+    RunOneHandler(context, 0);
   }
 }
 
 void CheckWorkflow::RunOneHandler(
     std::shared_ptr<context::RequestContext> context, size_t index) {
-  handlers_[index](context, [context, index, this](Status status) {
-    if (status.ok() && index + 1 < handlers_.size()) {
+  stages_[index].handler(context, [context, index, this](Status status) {
+    if (status.ok() && index + 1 < stages_.size()) {
       RunOneHandler(context, index + 1);
     } else {
       context->CompleteCheck(status);
@@ -15,6 +15,8 @@
 #ifndef API_MANAGER_CHECK_WORKFLOW_H_
 #define API_MANAGER_CHECK_WORKFLOW_H_
 
+#include <vector>
+
 #include "include/api_manager/utils/status.h"
 #include "src/api_manager/context/request_context.h"
 
@@ -27,27 +29,53 @@ typedef std::function<void(std::shared_ptr<context::RequestContext>,
     CheckHandler;
 
 // A workflow to run all CheckHandlers
+//
+// Each handler declares the handlers it depends on. In the sequential mode,
+// the handlers run one by one in the order they are registered. In the
+// parallel mode, a handler starts as soon as all its dependencies succeed,
+// so the independent remote calls, such as the key fetch of CheckAuth and
+// the Check call of CheckServiceControl, overlap. After a handler fails, no
+// other handler starts; the check completes with the status of the first
+// failure once the running handlers finish.
 class CheckWorkflow {
  public:
+  explicit CheckWorkflow(bool parallel = false) : parallel_(parallel) {}
   virtual ~CheckWorkflow() {}
 
   // Registers all known check handlers.
   void RegisterAll();
 
-  // Runs the workflow to call each check handler sequentially.
+  // Registers a check handler which depends on the handlers of the given
+  // indexes, and returns the index of the handler. The dependencies must be
+  // registered before the handler.
+  size_t Register(CheckHandler handler,
+                  const std::vector<size_t> &dependencies = {});
+
+  // Runs the workflow to call the check handlers.
   void Run(std::shared_ptr<context::RequestContext> context);
 
  private:
-  // Registers a check handler. The order is important.
-  // They will be executed in the order they are registered.
-  void Register(CheckHandler handler);
+  // The state of a workflow run in the parallel mode.
+  class ParallelRun;
+
+  // A registered check handler.
+  struct Stage {
+    CheckHandler handler;
+    // The number of handlers this handler depends on.
+    size_t num_dependencies;
+    // The indexes of the handlers depending on this handler.
+    std::vector<size_t> dependents;
+  };
 
   // Runs one check handler with index.
   void RunOneHandler(std::shared_ptr<context::RequestContext> context,
                      size_t index);
 
-  // A vector to store all check handlers.
-  std::vector<CheckHandler> handlers_;
+  // A vector to store all check handlers, in the order of registration.
+  std::vector<Stage> stages_;
+
+  // If true, the independent handlers run in parallel.
+  bool parallel_;
 };
 
 }  // namespace api_manager
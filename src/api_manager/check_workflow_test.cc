@@ -0,0 +1,179 @@
+// Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/api_manager/check_workflow.h"
+
+#include "src/api_manager/context/service_context.h"
+#include "src/api_manager/mock_api_manager_environment.h"
+#include "src/api_manager/mock_request.h"
+
+using ::google::api_manager::utils::Status;
+using ::google::protobuf::util::error::Code;
+
+namespace google {
+namespace api_manager {
+
+namespace {
+
+const char kServiceConfig[] = R"(
+{
+  "name": "endpoints-test.cloudendpointsapis.com"
+})";
+
+class CheckWorkflowTest : public ::testing::Test {
+ public:
+  void SetUp() {
+    std::unique_ptr<MockApiManagerEnvironment> env(
+        new ::testing::NiceMock<MockApiManagerEnvironment>());
+    std::unique_ptr<Config> config = Config::Create(env.get(), kServiceConfig);
+    ASSERT_NE(config.get(), nullptr);
+
+    service_context_ = std::make_shared<context::ServiceContext>(
+        std::move(env), "", std::move(config));
+
+    std::unique_ptr<MockRequest> request(
+        new ::testing::NiceMock<MockRequest>());
+    request_ = request.get();
+    context_ = std::make_shared<context::RequestContext>(service_context_,
+                                                         std::move(request));
+    context_->set_check_continuation([this](Status status) {
+      ++completed_;
+      status_ = status;
+    });
+  }
+
+  // Returns a handler which records its start and keeps its continuation,
+  // to be completed by the test.
+  CheckHandler Handler(const std::string &name) {
+    return [this, name](std::shared_ptr<context::RequestContext>,
+                        std::function<void(Status)> continuation) {
+      started_.push_back(name);
+      continuations_[name] = continuation;
+    };
+  }
+
+  // Completes a started handler.
+  void Complete(const std::string &name, Status status) {
+    auto continuation = continuations_[name];
+    ASSERT_TRUE(continuation != nullptr);
+    continuations_.erase(name);
+    continuation(status);
+  }
+
+  std::shared_ptr<context::ServiceContext> service_context_;
+  std::shared_ptr<context::RequestContext> context_;
+  MockRequest *request_;
+  std::vector<std::string> started_;
+  std::map<std::string, std::function<void(Status)>> continuations_;
+  int completed_ = 0;
+  Status status_ = Status::OK;
+};
+
+TEST_F(CheckWorkflowTest, Sequential) {
+  CheckWorkflow workflow;
+  workflow.Register(Handler("a"));
+  workflow.Register(Handler("b"));
+  workflow.Run(context_);
+  EXPECT_EQ(started_, std::vector<std::string>({"a"}));
+  Complete("a", Status::OK);
+  EXPECT_EQ(started_, std::vector<std::string>({"a", "b"}));
+  EXPECT_EQ(completed_, 0);
+  Complete("b", Status::OK);
+  EXPECT_EQ(completed_, 1);
+  EXPECT_TRUE(status_.ok());
+}
+
+TEST_F(CheckWorkflowTest, Parallel) {
+  CheckWorkflow workflow(true);
+  size_t a = workflow.Register(Handler("a"));
+  size_t b = workflow.Register(Handler("b"));
+  workflow.Register(Handler("c"), {a, b});
+  workflow.Run(context_);
+  // The independent handlers start together.
+  EXPECT_EQ(started_, std::vector<std::string>({"a", "b"}));
+  Complete("b", Status::OK);
+  EXPECT_EQ(started_.size(), 2u);
+  Complete("a", Status::OK);
+  EXPECT_EQ(started_, std::vector<std::string>({"a", "b", "c"}));
+  EXPECT_EQ(completed_, 0);
+  Complete("c", Status::OK);
+  EXPECT_EQ(completed_, 1);
+  EXPECT_TRUE(status_.ok());
+}
+
+TEST_F(CheckWorkflowTest, ParallelFailure) {
+  CheckWorkflow workflow(true);
+  workflow.Register(Handler("a"));
+  size_t b = workflow.Register(Handler("b"));
+  workflow.Register(Handler("c"), {b});
+  workflow.Run(context_);
+  Complete("b", Status(Code::PERMISSION_DENIED, "b failed"));
+  // The check waits for the running handler. The dependents of the failed
+  // handler never start.
+  EXPECT_EQ(completed_, 0);
+  Complete("a", Status(Code::UNAUTHENTICATED, "a failed"));
+  // The check completes with the first failure.
+  EXPECT_EQ(completed_, 1);
+  EXPECT_EQ(status_.code(), Code::PERMISSION_DENIED);
+  EXPECT_EQ(started_, std::vector<std::string>({"a", "b"}));
+}
+
+TEST_F(CheckWorkflowTest, ParallelHandlerDoneAfterFailure) {
+  CheckWorkflow workflow(true);
+  workflow.Register(Handler("auth"));
+  size_t service_control = workflow.Register(Handler("service_control"));
+  // A dependent which writes to the request, like QuotaControl.
+  workflow.Register(
+      [this](std::shared_ptr<context::RequestContext> context,
+             std::function<void(Status)> continuation) {
+        started_.push_back("quota");
+        context->request()->AddHeaderToBackend("X-Quota", "ok");
+        continuation(Status::OK);
+      },
+      {service_control});
+  EXPECT_CALL(*request_, AddHeaderToBackend(::testing::_, ::testing::_))
+      .Times(0);
+
+  workflow.Run(context_);
+  Complete("auth", Status(Code::UNAUTHENTICATED, "bad token"));
+  EXPECT_EQ(completed_, 0);
+
+  // The sibling finishes after the failure: the check completes only now,
+  // and its dependent does not start.
+  Complete("service_control", Status::OK);
+  EXPECT_EQ(completed_, 1);
+  EXPECT_EQ(status_.code(), Code::UNAUTHENTICATED);
+  EXPECT_EQ(started_, std::vector<std::string>({"auth", "service_control"}));
+}
+
+TEST_F(CheckWorkflowTest, ParallelSynchronousHandlers) {
+  CheckWorkflow workflow(true);
+  auto ok_handler = [](std::shared_ptr<context::RequestContext>,
+                       std::function<void(Status)> continuation) {
+    continuation(Status::OK);
+  };
+  size_t a = workflow.Register(ok_handler);
+  workflow.Register(ok_handler, {a});
+  workflow.Register(ok_handler);
+  workflow.Run(context_);
+  EXPECT_EQ(completed_, 1);
+  EXPECT_TRUE(status_.ok());
+}
+
+}  // namespace
+
+}  // namespace api_manager
+}  // namespace google
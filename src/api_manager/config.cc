@@ -501,6 +501,29 @@ MethodCallInfo Config::GetMethodCallInfo(
   return call_info;
 }
 
+const MethodInfo *Config::MatchMethod(const std::string &http_method,
+                                      const std::string &url,
+                                      MethodMatch *match) const {
+  return path_matcher_ == nullptr
+             ? nullptr
+             : path_matcher_->Lookup(http_method, url.data(), url.size(),
+                                     match);
+}
+
+void Config::FillMethodCallInfo(const MethodMatch &match,
+                                const std::string &url,
+                                const std::string &query_params,
+                                MethodCallInfo *call_info) {
+  call_info->method_info = match.method();
+  PathMatcher<MethodInfo *>::ExtractBindings(
+      match, url.data(), query_params, &call_info->variable_bindings);
+  if (call_info->method_info == nullptr) {
+    call_info->body_field_path.clear();
+  } else {
+    call_info->body_field_path = match.body_field_path();
+  }
+}
+
 bool Config::GetJwksUri(const string &issuer, string *url) const {
   std::string iss = utils::GetUrlContent(issuer);
   auto it = issuer_jwks_uri_map_.find(iss);
@@ -70,6 +70,24 @@ class Config {
                                    const std::string &url,
                                    const std::string &query_params) const;
 
+  // The result of MatchMethod, from which the variable bindings can be
+  // extracted later.
+  typedef PathMatcher<MethodInfo *>::Match MethodMatch;
+
+  // Same as GetMethodInfo, but also records in |match| where the variables
+  // are in the url, so that the variable bindings can be extracted later with
+  // FillMethodCallInfo. It doesn't allocate memory.
+  const MethodInfo *MatchMethod(const std::string &http_method,
+                                const std::string &url,
+                                MethodMatch *match) const;
+
+  // Fills |call_info| with the method, the variable bindings and the body
+  // field path of |match|. |url| must be the url given to MatchMethod.
+  static void FillMethodCallInfo(const MethodMatch &match,
+                                 const std::string &url,
+                                 const std::string &query_params,
+                                 MethodCallInfo *call_info);
+
   const ::google::api::Service &service() const { return service_; }
 
   // TODO: Remove in favor of service().
@@ -756,6 +756,31 @@ TEST(Config, RpcMethodsWithHttpRulesAndVariableBindings) {
   EXPECT_EQ((std::vector<std::string>{"book", "id"}),
             create_book_3.variable_bindings[1].field_path);
   EXPECT_EQ("123", create_book_3.variable_bindings[1].value);
+
+  // Match first, extract the variable bindings later.
+  std::string url = "/shelves/77/books/88/auth";
+  Config::MethodMatch match;
+  const MethodInfo *create_book_4 = config->MatchMethod("POST", url, &match);
+  ASSERT_NE(nullptr, create_book_4);
+  EXPECT_EQ(create_book_1.method_info, create_book_4);
+
+  MethodCallInfo create_book_4_call;
+  Config::FillMethodCallInfo(match, url, "book.title=Readme",
+                             &create_book_4_call);
+  EXPECT_EQ(create_book_4, create_book_4_call.method_info);
+  EXPECT_EQ("book.title", create_book_4_call.body_field_path);
+  ASSERT_EQ(4, create_book_4_call.variable_bindings.size());
+  EXPECT_EQ("77", create_book_4_call.variable_bindings[0].value);
+  EXPECT_EQ("88", create_book_4_call.variable_bindings[1].value);
+  EXPECT_EQ("auth", create_book_4_call.variable_bindings[2].value);
+  EXPECT_EQ((std::vector<std::string>{"book", "title"}),
+            create_book_4_call.variable_bindings[3].field_path);
+  EXPECT_EQ("Readme", create_book_4_call.variable_bindings[3].value);
+
+  EXPECT_EQ(nullptr, config->MatchMethod("PUT", url, &match));
+  Config::FillMethodCallInfo(match, url, "", &create_book_4_call);
+  EXPECT_EQ(nullptr, create_book_4_call.method_info);
+  EXPECT_EQ(0, create_book_4_call.variable_bindings.size());
 }
 
 TEST(Config, TestHttpOptions) {
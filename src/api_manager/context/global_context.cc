@@ -48,6 +48,7 @@ GlobalContext::GlobalContext(std::unique_ptr<ApiManagerEnvInterface> env,
     : env_(std::move(env)),
       service_account_token_(env_.get()),
       is_auth_force_disabled_(false),
+      jwt_cache_entries_(0),
       intermediate_report_interval_(kIntermediateReportInterval) {
   // Need to load server config first.
   server_config_ = Config::LoadServerConfig(env_.get(), server_config);
@@ -68,6 +69,8 @@ GlobalContext::GlobalContext(std::unique_ptr<ApiManagerEnvInterface> env,
     is_auth_force_disabled_ =
         server_config_->has_api_authentication_config() &&
         server_config_->api_authentication_config().force_disable();
+    jwt_cache_entries_ =
+        server_config_->api_authentication_config().jwt_cache_entries();
 
     // Check server_config override.
     if (server_config_->has_service_control_config() &&
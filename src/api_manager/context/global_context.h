@@ -78,6 +78,14 @@ class GlobalContext {
     return false;
   }
 
+  bool ParallelChecks() {
+    if (server_config() && server_config()->has_experimental()) {
+      const auto &experimental = server_config()->experimental();
+      return experimental.parallel_checks();
+    }
+    return false;
+  }
+
   // report interval can be override by server_config.
   int64_t intermediate_report_interval() const {
     return intermediate_report_interval_;
@@ -86,6 +94,9 @@ class GlobalContext {
   // Check if auth is disabled from server_config.
   bool is_auth_force_disabled() const { return is_auth_force_disabled_; }
 
+  // The capacity of the JWT cache from server_config, 0 for the default.
+  int jwt_cache_entries() const { return jwt_cache_entries_; }
+
   // get producer project id from fetched metadata
   const std::string &project_id() const;
 
@@ -125,6 +136,9 @@ class GlobalContext {
   // Is auth force-disabled
   bool is_auth_force_disabled_;
 
+  // The capacity of the JWT cache.
+  int jwt_cache_entries_;
+
   // The time interval for grpc intermediate report.
   int64_t intermediate_report_interval_;
 };
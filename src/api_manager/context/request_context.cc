@@ -86,26 +86,18 @@ RequestContext::RequestContext(std::shared_ptr<ServiceContext> service_context,
       request_(std::move(request)),
       is_first_report_(true),
       last_request_bytes_(0),
-      last_response_bytes_(0) {
+      last_response_bytes_(0),
+      variable_bindings_extracted_(false) {
   start_time_ = std::chrono::system_clock::now();
   last_report_time_ = std::chrono::steady_clock::now();
   operation_id_ = GenerateUUID();
   const std::string &method = GetRequestHTTPMethodWithOverride();
-  const std::string &path = request_->GetUnparsedRequestPath();
-  std::string query_params = request_->GetQueryParameters();
-
-  // In addition to matching the method, service_context_->GetMethodCallInfo()
-  // will extract the variable bindings from the url. We need variable bindings
-  // only when we need to do transcoding. If this turns out to be a performance
-  // problem for non-transcoded calls, we have a couple of options:
-  // 1) Do not extract variable bindings here, and do the method matching again
-  //    with extracting variable bindings when transcoding is needed.
-  // 2) Store all the pieces needed for extracting variable bindings (such as
-  //    http template variables, url path parts) in MethodCallInfo and extract
-  //    variables lazily when needed.
-
-  method_call_ =
-      service_context_->GetMethodCallInfo(method, path, query_params);
+  request_path_ = request_->GetUnparsedRequestPath();
+
+  // Only match the method here. The variable bindings are needed only for
+  // transcoding, method_call() extracts them from method_match_ when asked.
+  method_call_.method_info =
+      service_context_->MatchMethod(method, request_path_, &method_match_);
 
   if (method_call_.method_info) {
     ExtractApiKey();
@@ -130,6 +122,15 @@ RequestContext::RequestContext(std::shared_ptr<ServiceContext> service_context,
   }
 }
 
+const MethodCallInfo *RequestContext::method_call() const {
+  if (!variable_bindings_extracted_) {
+    variable_bindings_extracted_ = true;
+    Config::FillMethodCallInfo(method_match_, request_path_,
+                               request_->GetQueryParameters(), &method_call_);
+  }
+  return &method_call_;
+}
+
 std::string RequestContext::GetRequestHTTPMethodWithOverride() {
   std::string method;
 
@@ -268,6 +269,7 @@ void RequestContext::FillAllocateQuotaRequestInfo(
   info->method_name = this->method_call_.method_info->name();
   info->metric_cost_vector =
       &this->method_call_.method_info->metric_cost_vector();
+  info->consumer_project_id = check_response_info_.consumer_project_id;
 }
 
 void RequestContext::FillReportRequestInfo(
@@ -47,8 +47,9 @@ class RequestContext {
   // Get the method info.
   const MethodInfo *method() const { return method_call_.method_info; }
 
-  // Get the method info.
-  const MethodCallInfo *method_call() const { return &method_call_; }
+  // Get the method info with the variable bindings. Only transcoding needs
+  // the variable bindings, so they are extracted on the first call.
+  const MethodCallInfo *method_call() const;
 
   // Get the api key.
   const std::string &api_key() const { return api_key_; }
@@ -164,7 +165,15 @@ class RequestContext {
   std::function<void(utils::Status status)> check_continuation_;
 
   // The method info from service config.
-  MethodCallInfo method_call_;
+  mutable MethodCallInfo method_call_;
+
+  // The request path and the method matched for it. The variable bindings
+  // in method_call_ are extracted from them on demand.
+  std::string request_path_;
+  Config::MethodMatch method_match_;
+
+  // True if the variable bindings have been extracted into method_call_.
+  mutable bool variable_bindings_extracted_;
 
   // Randomly generated UUID for each request, passed to service control
   // Check and Report calls.
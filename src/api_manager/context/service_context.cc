@@ -31,6 +31,7 @@ ServiceContext::ServiceContext(std::shared_ptr<GlobalContext> global_context,
                                std::unique_ptr<Config> config)
     : global_context_(global_context),
       config_(std::move(config)),
+      jwt_cache_(global_context_->jwt_cache_entries()),
       service_control_(CreateInterface()) {
   config_->set_server_config(global_context_->server_config());
 }
@@ -42,21 +43,19 @@ ServiceContext::ServiceContext(std::unique_ptr<ApiManagerEnvInterface> env,
           std::make_shared<GlobalContext>(std::move(env), server_config),
           std::move(config)) {}
 
-MethodCallInfo ServiceContext::GetMethodCallInfo(
+const MethodInfo* ServiceContext::MatchMethod(
     const std::string& http_method, const std::string& url,
-    const std::string& query_params) const {
+    Config::MethodMatch* match) const {
   if (config_ == nullptr) {
-    return MethodCallInfo();
+    return nullptr;
   }
-  MethodCallInfo method_call_info =
-      config_->GetMethodCallInfo(http_method, url, query_params);
+  const MethodInfo* method_info =
+      config_->MatchMethod(http_method, url, match);
   // HEAD should be treated as GET unless it is specified from service_config.
-  if (method_call_info.method_info == nullptr &&
-      http_method == kHTTPHeadMethod) {
-    method_call_info =
-        config_->GetMethodCallInfo(kHTTPGetMethod, url, query_params);
+  if (method_info == nullptr && http_method == kHTTPHeadMethod) {
+    method_info = config_->MatchMethod(kHTTPGetMethod, url, match);
   }
-  return method_call_info;
+  return method_info;
 }
 
 const std::string& ServiceContext::project_id() const {
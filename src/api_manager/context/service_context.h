@@ -50,9 +50,10 @@ class ServiceContext {
 
   ApiManagerEnvInterface *env() { return global_context_->env(); }
 
-  MethodCallInfo GetMethodCallInfo(const std::string &http_method,
-                                   const std::string &url,
-                                   const std::string &query_params) const;
+  // Looks-up the method for the request, see Config::MatchMethod.
+  const MethodInfo *MatchMethod(const std::string &http_method,
+                                const std::string &url,
+                                Config::MethodMatch *match) const;
 
   service_control::Interface *service_control() const {
     return service_control_.get();
@@ -69,6 +70,7 @@ class ServiceContext {
 
   auth::Certs &certs() { return certs_; }
   auth::JwtCache &jwt_cache() { return jwt_cache_; }
+  const auth::JwtCache &jwt_cache() const { return jwt_cache_; }
 
   auth::AuthzCache &authz_cache() { return authz_cache_; }
 
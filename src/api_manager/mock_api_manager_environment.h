@@ -30,6 +30,13 @@ class MockApiManagerEnvironment : public ApiManagerEnvInterface {
                                               std::function<void()>));
   MOCK_METHOD1(DoRunHTTPRequest, void(HTTPRequest *));
   MOCK_METHOD1(DoRunGRPCRequest, void(GRPCRequest *));
+  MOCK_METHOD3(SharedCacheLookup,
+               bool(const std::string &, std::string *,
+                    std::chrono::system_clock::time_point *));
+  MOCK_METHOD3(SharedCacheInsert,
+               void(const std::string &, const std::string &,
+                    std::chrono::system_clock::time_point));
+  MOCK_METHOD0(GetProcessCount, int());
   virtual void RunHTTPRequest(std::unique_ptr<HTTPRequest> req) {
     DoRunHTTPRequest(req.get());
   }
@@ -16,6 +16,7 @@
 #define API_MANAGER_PATH_MATCHER_H_
 
 #include <cstddef>
+#include <cstring>
 #include <memory>
 #include <set>
 #include <sstream>
@@ -48,11 +49,52 @@ class PathMatcherBuilder;  // required for PathMatcher constructor
 //                                           url_path);
 //      if (method == nullptr)  failed to find it.
 //
+// The location of a segment in a request path.
+struct RequestPathSegment {
+  size_t offset;
+  size_t size;
+};
+
 template <class Method>
 class PathMatcher {
+ private:
+  struct MethodData;
+
  public:
   ~PathMatcher(){};
 
+  // The result of the allocation-free Lookup. It records the matched method
+  // and the locations of the request path segments, so that the variable
+  // bindings can be extracted later, only when they are needed.
+  class Match {
+   public:
+    Match() : method_data_(nullptr), segment_count_(0) {}
+
+    // Returns the matched method, or nullptr if the lookup failed.
+    Method method() const;
+
+    // Returns the body field path of the matched method.
+    const std::string& body_field_path() const;
+
+   private:
+    friend class PathMatcher;
+
+    // Paths with more segments than this spill over to heap_segments_.
+    static const size_t kInlineSegments = 32;
+
+    void AddSegment(size_t offset, size_t size);
+    void RemoveTrailingEmptySegments();
+    const RequestPathSegment* segments() const {
+      return segment_count_ > kInlineSegments ? heap_segments_.data()
+                                              : inline_segments_;
+    }
+
+    const MethodData* method_data_;
+    RequestPathSegment inline_segments_[kInlineSegments];
+    std::vector<RequestPathSegment> heap_segments_;
+    size_t segment_count_;
+  };
+
   // TODO: Do not template VariableBinding
   template <class VariableBinding>
   Method Lookup(const std::string& http_method, const std::string& path,
@@ -62,13 +104,35 @@ class PathMatcher {
 
   Method Lookup(const std::string& http_method, const std::string& path) const;
 
+  // Looks up |path_size| bytes of |path|, which may include a query string,
+  // and records the result in |match|. The path is tokenized in place and
+  // nothing is unescaped, so the lookup does not allocate memory unless the
+  // path has more than Match::kInlineSegments segments.
+  Method Lookup(const std::string& http_method, const char* path,
+                size_t path_size, Match* match) const;
+
+  // Extracts the variable bindings of |match| from the |path| given to the
+  // Lookup which produced it, and from |query_params|. Only the path segments
+  // bound to variables are unescaped.
+  template <class VariableBinding>
+  static void ExtractBindings(const Match& match, const char* path,
+                              const std::string& query_params,
+                              std::vector<VariableBinding>* variable_bindings);
+
  private:
   // Creates a Path Matcher with a Builder by moving the builder's root node.
   explicit PathMatcher(PathMatcherBuilder<Method>&& builder);
 
-  // A root node shared by all services, i.e. paths of all services will be
-  // registered to this node.
-  std::unique_ptr<PathMatcherNode> root_ptr_;
+  // Splits |path| into slash separated segments in place and records their
+  // locations in |match|.
+  void SplitPath(const char* path, size_t path_size, Match* match) const;
+
+  // Returns true if |size| bytes of |verb| is a configured custom verb.
+  bool IsCustomVerb(const char* verb, size_t size) const;
+
+  // A frozen copy of the trie built by the builder. Paths of all services are
+  // registered to its root.
+  std::unique_ptr<PathMatcherTrie> trie_;
   // Holds the set of custom verbs found in configured templates.
   std::set<std::string> custom_verbs_;
   // Data we store per each registered method
@@ -107,7 +171,8 @@ class PathMatcherBuilder {
                 std::string body_field_path, Method method);
 
   // Returns a unique_ptr to a thread safe PathMatcher that contains all
-  // registered path-WrapperGraph pairs. Note the PathMatchBuilder instance
+  // registered path-WrapperGraph pairs. The trie is frozen into a flattened
+  // PathMatcherTrie for lookups. Note the PathMatchBuilder instance
   // will be moved so cannot use after invoking Build().
   PathMatcherPtr<Method> Build();
 
@@ -183,17 +248,17 @@ inline int hex_digit_to_int(char c) {
   return x & 0xf;
 }
 
-// This is a helper function for UrlUnescapeString. It takes a string and
-// the index of where we are within that string.
+// This is a helper function for UrlUnescapeAppend. It takes a string of
+// |size| bytes and the index of where we are within that string.
 //
 // The function returns true if the next three characters are of the format:
 // "%[0-9A-Fa-f]{2}".
 //
 // If the next three characters are an escaped character then this function will
 // also return what character is escaped.
-bool GetEscapedChar(const std::string& src, size_t i,
+bool GetEscapedChar(const char* src, size_t size, size_t i,
                     bool unescape_reserved_chars, char* out) {
-  if (i + 2 < src.size() && src[i] == '%') {
+  if (i + 2 < size && src[i] == '%') {
     if (ascii_isxdigit(src[i + 1]) && ascii_isxdigit(src[i + 2])) {
       char c =
           (hex_digit_to_int(src[i + 1]) << 4) | hex_digit_to_int(src[i + 2]);
@@ -207,48 +272,40 @@ bool GetEscapedChar(const std::string& src, size_t i,
   return false;
 }
 
-// Unescapes string 'part' and returns the unescaped string. Reserved characters
-// (as specified in RFC 6570) are not escaped if unescape_reserved_chars is
-// false.
-std::string UrlUnescapeString(const std::string& part,
-                              bool unescape_reserved_chars) {
-  std::string unescaped;
-  // Check whether we need to escape at all.
-  bool needs_unescaping = false;
+// Unescapes |size| bytes of |part| and appends the result to |out|. Reserved
+// characters (as specified in RFC 6570) are not escaped if
+// unescape_reserved_chars is false.
+void UrlUnescapeAppend(const char* part, size_t size,
+                       bool unescape_reserved_chars, std::string* out) {
+  out->reserve(out->size() + size);
   char ch = '\0';
-  for (size_t i = 0; i < part.size(); ++i) {
-    if (GetEscapedChar(part, i, unescape_reserved_chars, &ch)) {
-      needs_unescaping = true;
-      break;
-    }
-  }
-  if (!needs_unescaping) {
-    unescaped = part;
-    return unescaped;
-  }
-
-  unescaped.resize(part.size());
-
-  char* begin = &(unescaped)[0];
-  char* p = begin;
-
-  for (size_t i = 0; i < part.size();) {
-    if (GetEscapedChar(part, i, unescape_reserved_chars, &ch)) {
-      *p++ = ch;
+  for (size_t i = 0; i < size;) {
+    if (GetEscapedChar(part, size, i, unescape_reserved_chars, &ch)) {
+      out->push_back(ch);
       i += 3;
     } else {
-      *p++ = part[i];
+      out->push_back(part[i]);
       i += 1;
     }
   }
+}
 
-  unescaped.resize(p - begin);
+// Unescapes string 'part' and returns the unescaped string. Reserved characters
+// (as specified in RFC 6570) are not escaped if unescape_reserved_chars is
+// false.
+std::string UrlUnescapeString(const std::string& part,
+                              bool unescape_reserved_chars) {
+  std::string unescaped;
+  UrlUnescapeAppend(part.data(), part.size(), unescape_reserved_chars,
+                    &unescaped);
   return unescaped;
 }
 
 template <class VariableBinding>
 void ExtractBindingsFromPath(const std::vector<HttpTemplate::Variable>& vars,
-                             const std::vector<std::string>& parts,
+                             const char* path,
+                             const RequestPathSegment* segments,
+                             size_t segment_count,
                              std::vector<VariableBinding>* bindings) {
   for (const auto& var : vars) {
     // Determine the subpath bound to the variable based on the
@@ -261,7 +318,7 @@ void ExtractBindingsFromPath(const std::vector<HttpTemplate::Variable>& vars,
     // Calculate the absolute index of the ending segment in case it's negative.
     size_t end_segment = (var.end_segment >= 0)
                              ? var.end_segment
-                             : parts.size() + var.end_segment + 1;
+                             : segment_count + var.end_segment + 1;
     // It is multi-part match if we have more than one segment. We also make
     // sure that a single URL segment match with ** is also considered a
     // multi-part match by checking if it->second.end_segment is negative.
@@ -270,7 +327,8 @@ void ExtractBindingsFromPath(const std::vector<HttpTemplate::Variable>& vars,
     // Joins parts with "/"  to form a path string.
     for (size_t i = var.start_segment; i < end_segment; ++i) {
       // For multipart matches only unescape non-reserved characters.
-      binding.value += UrlUnescapeString(parts[i], !is_multipart);
+      UrlUnescapeAppend(path + segments[i].offset, segments[i].size,
+                        !is_multipart, &binding.value);
       if (i < end_segment - 1) {
         binding.value += "/";
       }
@@ -309,55 +367,6 @@ void ExtractBindingsFromQueryParameters(
   }
 }
 
-// Converts a request path into a format that can be used to perform a request
-// lookup in the PathMatcher trie. This utility method sanitizes the request
-// path and then splits the path into slash separated parts. Returns an empty
-// vector if the sanitized path is "/".
-//
-// custom_verbs is a set of configured custom verbs that are used to match
-// against any custom verbs in request path. If the request_path contains a
-// custom verb not found in custom_verbs, it is treated as a part of the path.
-//
-// - Strips off query string: "/a?foo=bar" --> "/a"
-// - Collapses extra slashes: "///" --> "/"
-std::vector<std::string> ExtractRequestParts(
-    std::string path, const std::set<std::string>& custom_verbs) {
-  // Remove query parameters.
-  path = path.substr(0, path.find_first_of('?'));
-
-  // Replace last ':' with '/' to handle custom verb.
-  // But not for /foo:bar/const.
-  std::size_t last_colon_pos = path.find_last_of(':');
-  std::size_t last_slash_pos = path.find_last_of('/');
-  if (last_colon_pos != std::string::npos && last_colon_pos > last_slash_pos) {
-    std::string verb = path.substr(last_colon_pos + 1);
-    // only verb in the configured custom verbs, treat it as verb
-    // replace ":" with / as a separate segment.
-    if (custom_verbs.find(verb) != custom_verbs.end()) {
-      path[last_colon_pos] = '/';
-    }
-  }
-
-  std::vector<std::string> result;
-  if (path.size() > 0) {
-    split(path.substr(1), '/', result);
-  }
-  // Removes all trailing empty parts caused by extra "/".
-  while (!result.empty() && (*(--result.end())).empty()) {
-    result.pop_back();
-  }
-  return result;
-}
-
-// Looks up on a PathMatcherNode.
-PathMatcherLookupResult LookupInPathMatcherNode(
-    const PathMatcherNode& root, const std::vector<std::string>& parts,
-    const HttpMethod& http_method) {
-  PathMatcherLookupResult result;
-  root.LookupPath(parts.begin(), parts.end(), http_method, &result);
-  return result;
-}
-
 PathMatcherNode::PathInfo TransformHttpTemplate(const HttpTemplate& ht) {
   PathMatcherNode::PathInfo::Builder builder;
 
@@ -375,77 +384,195 @@ PathMatcherNode::PathInfo TransformHttpTemplate(const HttpTemplate& ht) {
 
 template <class Method>
 PathMatcher<Method>::PathMatcher(PathMatcherBuilder<Method>&& builder)
-    : root_ptr_(std::move(builder.root_ptr_)),
+    : trie_(new PathMatcherTrie(*builder.root_ptr_)),
       custom_verbs_(std::move(builder.custom_verbs_)),
       methods_(std::move(builder.methods_)) {}
 
-// Lookup is a wrapper method for the recursive node Lookup. First, the wrapper
-// splits the request path into slash-separated path parts. Next, the method
-// checks that the |http_method| is supported. If not, then it returns an empty
-// WrapperGraph::SharedPtr. Next, this method invokes the node's Lookup on
-// the extracted |parts|. Finally, it fills the mapping from variables to their
-// values parsed from the path.
-// TODO: cache results by adding get/put methods here (if profiling reveals
-// benefit)
 template <class Method>
-template <class VariableBinding>
-Method PathMatcher<Method>::Lookup(
-    const std::string& http_method, const std::string& path,
-    const std::string& query_params,
-    std::vector<VariableBinding>* variable_bindings,
-    std::string* body_field_path) const {
-  const std::vector<std::string> parts =
-      ExtractRequestParts(path, custom_verbs_);
+const size_t PathMatcher<Method>::Match::kInlineSegments;
 
-  // If service_name has not been registered to ESP and strict_service_matching_
-  // is set to false, tries to lookup the method in all registered services.
-  if (root_ptr_ == nullptr) {
-    return nullptr;
+template <class Method>
+Method PathMatcher<Method>::Match::method() const {
+  return method_data_ == nullptr ? nullptr : method_data_->method;
+}
+
+template <class Method>
+const std::string& PathMatcher<Method>::Match::body_field_path() const {
+  return method_data_->body_field_path;
+}
+
+template <class Method>
+void PathMatcher<Method>::Match::AddSegment(size_t offset, size_t size) {
+  if (segment_count_ < kInlineSegments) {
+    inline_segments_[segment_count_] = {offset, size};
+  } else {
+    if (segment_count_ == kInlineSegments) {
+      heap_segments_.assign(inline_segments_,
+                            inline_segments_ + kInlineSegments);
+    }
+    heap_segments_.push_back({offset, size});
   }
+  ++segment_count_;
+}
 
-  PathMatcherLookupResult lookup_result =
-      LookupInPathMatcherNode(*root_ptr_, parts, http_method);
-  // Return nullptr if nothing is found.
-  // Not need to check duplication. Only first item is stored for duplicated
-  if (lookup_result.data == nullptr) {
-    return nullptr;
+template <class Method>
+void PathMatcher<Method>::Match::RemoveTrailingEmptySegments() {
+  while (segment_count_ > 0 && segments()[segment_count_ - 1].size == 0) {
+    if (segment_count_ > kInlineSegments) {
+      heap_segments_.pop_back();
+    }
+    --segment_count_;
   }
-  MethodData* method_data = reinterpret_cast<MethodData*>(lookup_result.data);
-  if (variable_bindings != nullptr) {
-    variable_bindings->clear();
-    ExtractBindingsFromPath(method_data->variables, parts, variable_bindings);
-    ExtractBindingsFromQueryParameters(
-        query_params, method_data->method->system_query_parameter_names(),
-        variable_bindings);
+}
+
+template <class Method>
+bool PathMatcher<Method>::IsCustomVerb(const char* verb, size_t size) const {
+  // There are only a few custom verbs, a linear search does not allocate.
+  for (const auto& custom_verb : custom_verbs_) {
+    if (custom_verb.size() == size &&
+        memcmp(custom_verb.data(), verb, size) == 0) {
+      return true;
+    }
   }
-  if (body_field_path != nullptr) {
-    *body_field_path = method_data->body_field_path;
+  return false;
+}
+
+// Splits a request path into slash separated segments, recording their
+// locations in |match|. No segment is empty if the path is "/".
+//
+// custom_verbs_ is a set of configured custom verbs that are used to match
+// against any custom verbs in request path. If the request path contains a
+// custom verb not found in custom_verbs_, it is treated as a part of the path.
+//
+// - Strips off query string: "/a?foo=bar" --> "/a"
+// - Collapses extra slashes: "///" --> "/"
+template <class Method>
+void PathMatcher<Method>::SplitPath(const char* path, size_t path_size,
+                                    Match* match) const {
+  match->segment_count_ = 0;
+
+  // Ignore query parameters.
+  const char* query = static_cast<const char*>(memchr(path, '?', path_size));
+  size_t size = query == nullptr ? path_size : query - path;
+  if (size == 0) {
+    return;
+  }
+
+  // Treat the last ':' as a separator to handle custom verb.
+  // But not for /foo:bar/const.
+  size_t verb_pos = size;
+  for (size_t i = size; i > 1; --i) {
+    if (path[i - 1] == '/') {
+      break;
+    }
+    if (path[i - 1] == ':') {
+      // only verb in the configured custom verbs, treat it as verb
+      if (memchr(path, '/', i - 1) != nullptr &&
+          IsCustomVerb(path + i, size - i)) {
+        verb_pos = i - 1;
+      }
+      break;
+    }
   }
-  return method_data->method;
+
+  // The first character is skipped, it is supposed to be '/'.
+  size_t start = 1;
+  for (size_t i = 1; i <= size; ++i) {
+    if (i == size || path[i] == '/' || i == verb_pos) {
+      match->AddSegment(start, i - start);
+      start = i + 1;
+    }
+  }
+  // Removes all trailing empty parts caused by extra "/".
+  match->RemoveTrailingEmptySegments();
 }
 
-// TODO: refactor common code with method above
+// The allocation-free Lookup. First, it splits the request path into
+// slash-separated segments in place. Next, it resolves each segment to the
+// interned segment ID of the trie and walks the trie. The variable bindings
+// are left for ExtractBindings.
 template <class Method>
 Method PathMatcher<Method>::Lookup(const std::string& http_method,
-                                   const std::string& path) const {
-  const std::vector<std::string> parts =
-      ExtractRequestParts(path, custom_verbs_);
-
+                                   const char* path, size_t path_size,
+                                   Match* match) const {
+  match->method_data_ = nullptr;
   // If service_name has not been registered to ESP and strict_service_matching_
   // is set to false, tries to lookup the method in all registered services.
-  if (root_ptr_ == nullptr) {
+  if (trie_ == nullptr) {
     return nullptr;
   }
+  SplitPath(path, path_size, match);
+
+  int32_t inline_ids[Match::kInlineSegments];
+  std::vector<int32_t> heap_ids;
+  int32_t* ids = inline_ids;
+  if (match->segment_count_ > Match::kInlineSegments) {
+    heap_ids.resize(match->segment_count_);
+    ids = heap_ids.data();
+  }
+  const RequestPathSegment* segments = match->segments();
+  for (size_t i = 0; i < match->segment_count_; ++i) {
+    ids[i] = trie_->FindSegment(path + segments[i].offset, segments[i].size);
+  }
 
-  PathMatcherLookupResult lookup_result =
-      LookupInPathMatcherNode(*root_ptr_, parts, http_method);
+  PathMatcherLookupResult lookup_result = trie_->Lookup(
+      ids, match->segment_count_,
+      trie_->FindMethod(http_method.data(), http_method.size()));
   // Return nullptr if nothing is found.
   // Not need to check duplication. Only first item is stored for duplicated
   if (lookup_result.data == nullptr) {
     return nullptr;
   }
-  MethodData* method_data = reinterpret_cast<MethodData*>(lookup_result.data);
-  return method_data->method;
+  match->method_data_ = reinterpret_cast<MethodData*>(lookup_result.data);
+  return match->method_data_->method;
+}
+
+template <class Method>
+template <class VariableBinding>
+void PathMatcher<Method>::ExtractBindings(
+    const Match& match, const char* path, const std::string& query_params,
+    std::vector<VariableBinding>* variable_bindings) {
+  variable_bindings->clear();
+  if (match.method_data_ == nullptr) {
+    return;
+  }
+  ExtractBindingsFromPath(match.method_data_->variables, path,
+                          match.segments(), match.segment_count_,
+                          variable_bindings);
+  ExtractBindingsFromQueryParameters(
+      query_params, match.method_data_->method->system_query_parameter_names(),
+      variable_bindings);
+}
+
+// Looks up the method and fills the mapping from variables to their values
+// parsed from the path and the query parameters.
+// TODO: cache results by adding get/put methods here (if profiling reveals
+// benefit)
+template <class Method>
+template <class VariableBinding>
+Method PathMatcher<Method>::Lookup(
+    const std::string& http_method, const std::string& path,
+    const std::string& query_params,
+    std::vector<VariableBinding>* variable_bindings,
+    std::string* body_field_path) const {
+  Match match;
+  if (Lookup(http_method, path.data(), path.size(), &match) == nullptr) {
+    return nullptr;
+  }
+  if (variable_bindings != nullptr) {
+    ExtractBindings(match, path.data(), query_params, variable_bindings);
+  }
+  if (body_field_path != nullptr) {
+    *body_field_path = match.body_field_path();
+  }
+  return match.method();
+}
+
+template <class Method>
+Method PathMatcher<Method>::Lookup(const std::string& http_method,
+                                   const std::string& path) const {
+  Match match;
+  return Lookup(http_method, path.data(), path.size(), &match);
 }
 
 // Initializes the builder with a root Path Segment
@@ -17,6 +17,9 @@
 #include "src/api_manager/path_matcher_node.h"
 #include "src/api_manager/http_template.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace google {
 namespace api_manager {
 
@@ -241,5 +244,214 @@ bool PathMatcherNode::GetResultForHttpMethod(
   return false;
 }
 
+const int32_t PathMatcherTrie::kUnknownId;
+
+PathMatcherTrie::PathMatcherTrie(const PathMatcherNode& root)
+    : wildcard_method_(kUnknownId) {
+  std::set<std::string> segments;
+  std::set<std::string> methods;
+  CollectKeys(root, &segments, &methods);
+
+  // std::set iterates in sorted order, so the interned strings are sorted
+  // and can be binary searched.
+  segments_.reserve(segments.size());
+  for (const auto& segment : segments) {
+    segments_.push_back(Intern(segment));
+  }
+  methods_.reserve(methods.size());
+  for (const auto& method : methods) {
+    methods_.push_back(Intern(method));
+  }
+  wildcard_method_ =
+      FindMethod(HttpMethod_WILD_CARD, sizeof(HttpMethod_WILD_CARD) - 1);
+
+  AddNode(root);
+}
+
+void PathMatcherTrie::CollectKeys(const PathMatcherNode& node,
+                                  std::set<std::string>* segments,
+                                  std::set<std::string>* methods) {
+  for (const auto& entry : node.result_map_) {
+    methods->insert(entry.first);
+  }
+  for (const auto& entry : node.children_) {
+    segments->insert(entry.first);
+    CollectKeys(*entry.second, segments, methods);
+  }
+}
+
+PathMatcherTrie::InternedString PathMatcherTrie::Intern(
+    const std::string& str) {
+  InternedString interned;
+  interned.offset = chars_.size();
+  interned.size = str.size();
+  chars_.append(str);
+  return interned;
+}
+
+// Nodes are stored in depth-first order so that a lookup descending into a
+// subtrie touches adjacent memory.
+uint32_t PathMatcherTrie::AddNode(const PathMatcherNode& node) {
+  uint32_t index = nodes_.size();
+  nodes_.emplace_back();
+  {
+    Node& n = nodes_[index];
+    n.method_mask = 0;
+    n.single_parameter_child = -1;
+    n.wildcard_path_part_child = -1;
+    n.wildcard_path_child = -1;
+    n.wildcard = node.wildcard_;
+
+    n.first_result = results_.size();
+    n.result_count = node.result_map_.size();
+    for (const auto& entry : node.result_map_) {
+      Result result;
+      result.method = FindMethod(entry.first.data(), entry.first.size());
+      result.result = entry.second;
+      results_.push_back(result);
+      n.method_mask |= MethodBit(result.method);
+    }
+
+    // Reserve the range of the children before recursing into them, so that
+    // the range stays contiguous.
+    n.first_child = children_.size();
+    n.child_count = node.children_.size();
+    children_.resize(children_.size() + node.children_.size());
+  }
+
+  std::vector<std::pair<int32_t, const PathMatcherNode*>> children;
+  children.reserve(node.children_.size());
+  for (const auto& entry : node.children_) {
+    children.emplace_back(FindSegment(entry.first.data(), entry.first.size()),
+                          entry.second.get());
+  }
+  std::sort(children.begin(), children.end());
+
+  uint32_t first_child = nodes_[index].first_child;
+  for (size_t i = 0; i < children.size(); ++i) {
+    // children_ may be reallocated by the recursive call.
+    uint32_t child = AddNode(*children[i].second);
+    children_[first_child + i].segment = children[i].first;
+    children_[first_child + i].node = child;
+  }
+
+  // nodes_ may have been reallocated by the recursive calls.
+  Node& n = nodes_[index];
+  n.single_parameter_child =
+      FindChild(n, FindSegment(HttpTemplate::kSingleParameterKey,
+                               strlen(HttpTemplate::kSingleParameterKey)));
+  n.wildcard_path_part_child =
+      FindChild(n, FindSegment(HttpTemplate::kWildCardPathPartKey,
+                               strlen(HttpTemplate::kWildCardPathPartKey)));
+  n.wildcard_path_child =
+      FindChild(n, FindSegment(HttpTemplate::kWildCardPathKey,
+                               strlen(HttpTemplate::kWildCardPathKey)));
+  return index;
+}
+
+int32_t PathMatcherTrie::Find(const std::vector<InternedString>& strings,
+                              const char* data, size_t size) const {
+  auto it = std::lower_bound(
+      strings.begin(), strings.end(), size,
+      [this, data](const InternedString& str, size_t data_size) {
+        int cmp = memcmp(chars_.data() + str.offset, data,
+                         std::min<size_t>(str.size, data_size));
+        return cmp < 0 || (cmp == 0 && str.size < data_size);
+      });
+  if (it == strings.end() || it->size != size ||
+      memcmp(chars_.data() + it->offset, data, size) != 0) {
+    return kUnknownId;
+  }
+  return it - strings.begin();
+}
+
+int32_t PathMatcherTrie::FindSegment(const char* data, size_t size) const {
+  return Find(segments_, data, size);
+}
+
+int32_t PathMatcherTrie::FindMethod(const char* data, size_t size) const {
+  return Find(methods_, data, size);
+}
+
+int32_t PathMatcherTrie::FindChild(const Node& node, int32_t segment) const {
+  if (segment == kUnknownId) {
+    return -1;
+  }
+  auto begin = children_.begin() + node.first_child;
+  auto end = begin + node.child_count;
+  auto it = std::lower_bound(
+      begin, end, segment,
+      [](const Child& child, int32_t id) { return child.segment < id; });
+  if (it == end || it->segment != segment) {
+    return -1;
+  }
+  return it->node;
+}
+
+PathMatcherLookupResult PathMatcherTrie::Lookup(const int32_t* segments,
+                                                size_t count,
+                                                int32_t method) const {
+  PathMatcherLookupResult result;
+  LookupPath(0, segments, segments + count, method, &result);
+  return result;
+}
+
+void PathMatcherTrie::LookupPath(uint32_t node, const int32_t* current,
+                                 const int32_t* end, int32_t method,
+                                 PathMatcherLookupResult* result) const {
+  const Node& n = nodes_[node];
+  // base case
+  if (current == end) {
+    if (!GetResultForHttpMethod(n, method, result) &&
+        n.wildcard_path_child >= 0) {
+      GetResultForHttpMethod(nodes_[n.wildcard_path_child], method, result);
+    }
+    return;
+  }
+  if (LookupPathFromChild(FindChild(n, *current), current, end, method,
+                          result)) {
+    return;
+  }
+  if (n.wildcard) {
+    LookupPath(node, current + 1, end, method, result);
+    return;
+  }
+  for (int32_t child : {n.single_parameter_child, n.wildcard_path_part_child,
+                        n.wildcard_path_child}) {
+    if (LookupPathFromChild(child, current, end, method, result)) {
+      return;
+    }
+  }
+}
+
+bool PathMatcherTrie::LookupPathFromChild(
+    int32_t child, const int32_t* current, const int32_t* end, int32_t method,
+    PathMatcherLookupResult* result) const {
+  if (child >= 0) {
+    LookupPath(child, current + 1, end, method, result);
+    if (result->data != nullptr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PathMatcherTrie::GetResultForHttpMethod(
+    const Node& node, int32_t method, PathMatcherLookupResult* result) const {
+  for (int32_t key : {method, wildcard_method_}) {
+    if (key == kUnknownId || (node.method_mask & MethodBit(key)) == 0) {
+      continue;
+    }
+    for (uint32_t i = node.first_result;
+         i < node.first_result + node.result_count; ++i) {
+      if (results_[i].method == key) {
+        *result = results_[i].result;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 }  // namespace api_manager
 }  // namespace google
@@ -15,8 +15,10 @@
 #ifndef API_MANAGER_PATH_MATCHER_NODE_H_
 #define API_MANAGER_PATH_MATCHER_NODE_H_
 
+#include <cstdint>
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -140,6 +142,8 @@ class PathMatcherNode {
   void set_wildcard(bool wildcard) { wildcard_ = wildcard; }
 
  private:
+  friend class PathMatcherTrie;
+
   // This method inserts a path of nodes into this subtrie (described by the
   // vector<Info>, starting from the |current| position in the iterator of path
   // parts, and if necessary, creating intermediate nodes along the way. The
@@ -187,6 +191,119 @@ class PathMatcherNode {
   bool wildcard_;
 };
 
+// PathMatcherTrie is a frozen, flattened copy of a PathMatcherNode trie used
+// for lookups. All nodes live in one contiguous array and refer to each other
+// by index. Path segments and HTTP methods are interned into small integer
+// IDs when the trie is built, so a lookup resolves each request segment once
+// with a binary search over the interned segments, and then walks the trie
+// comparing integers only. It never hashes strings or allocates memory.
+//
+// Lookup follows exactly the same matching precedence as
+// PathMatcherNode::LookupPath.
+//
+// Thread Safe (immutable once constructed).
+class PathMatcherTrie {
+ public:
+  // The ID returned for segments and methods not present in the trie.
+  static const int32_t kUnknownId = -1;
+
+  // Creates a frozen copy of the trie rooted at |root|.
+  explicit PathMatcherTrie(const PathMatcherNode& root);
+
+  // Returns the interned ID of a path segment, or kUnknownId if no template
+  // contains the segment.
+  int32_t FindSegment(const char* data, size_t size) const;
+
+  // Returns the interned ID of an HTTP method, or kUnknownId if no template
+  // was registered for the method.
+  int32_t FindMethod(const char* data, size_t size) const;
+
+  // Looks up the path given as a sequence of segment IDs for the HTTP method
+  // with the given method ID.
+  PathMatcherLookupResult Lookup(const int32_t* segments, size_t count,
+                                 int32_t method) const;
+
+ private:
+  struct Node {
+    // The range of the literal children in children_, sorted by segment ID.
+    uint32_t first_child;
+    uint32_t child_count;
+    // The range of the results in results_, one per HTTP method.
+    uint32_t first_result;
+    uint32_t result_count;
+    // A bit for each HTTP method that has a result in this node. Method IDs
+    // greater than 63 share the last bit.
+    uint64_t method_mask;
+    // Node indexes of the "/.", "*" and "**" children, or -1 if absent.
+    int32_t single_parameter_child;
+    int32_t wildcard_path_part_child;
+    int32_t wildcard_path_child;
+    // True if this node represents a wildcard path '**'.
+    bool wildcard;
+  };
+
+  struct Child {
+    int32_t segment;
+    uint32_t node;
+  };
+
+  struct Result {
+    int32_t method;
+    PathMatcherLookupResult result;
+  };
+
+  // The offset and the size of an interned string in chars_.
+  struct InternedString {
+    uint32_t offset;
+    uint32_t size;
+  };
+
+  // Collects the segments and the HTTP methods used in the subtrie of |node|.
+  static void CollectKeys(const PathMatcherNode& node,
+                          std::set<std::string>* segments,
+                          std::set<std::string>* methods);
+
+  // Copies |node| and its subtrie into nodes_, returns the node index.
+  uint32_t AddNode(const PathMatcherNode& node);
+
+  // Returns the bit of |method| in Node::method_mask.
+  static uint64_t MethodBit(int32_t method) {
+    return uint64_t(1) << (method < 63 ? method : 63);
+  }
+
+  // Adds |str| to chars_ and returns its location.
+  InternedString Intern(const std::string& str);
+
+  // Finds |data| in the sorted list of interned strings |strings|.
+  int32_t Find(const std::vector<InternedString>& strings, const char* data,
+               size_t size) const;
+
+  // Returns the node index of the literal child of |node| for |segment|, or
+  // -1 if there is none.
+  int32_t FindChild(const Node& node, int32_t segment) const;
+
+  // The counterparts of the PathMatcherNode methods with the same names.
+  void LookupPath(uint32_t node, const int32_t* current, const int32_t* end,
+                  int32_t method, PathMatcherLookupResult* result) const;
+  bool LookupPathFromChild(int32_t child, const int32_t* current,
+                           const int32_t* end, int32_t method,
+                           PathMatcherLookupResult* result) const;
+  bool GetResultForHttpMethod(const Node& node, int32_t method,
+                              PathMatcherLookupResult* result) const;
+
+  std::vector<Node> nodes_;
+  std::vector<Child> children_;
+  std::vector<Result> results_;
+
+  // Characters of all interned segments and methods.
+  std::string chars_;
+  // Interned segments and methods, sorted. The index is the ID.
+  std::vector<InternedString> segments_;
+  std::vector<InternedString> methods_;
+  // The method ID of the wildcard HTTP method "*", or kUnknownId.
+  int32_t wildcard_method_;
+};
+
 }  // namespace api_manager
 }  // namespace google
 
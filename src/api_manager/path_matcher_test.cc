@@ -152,6 +152,11 @@ class PathMatcherTest : public ::testing::Test {
     return result;
   }
 
+  MethodInfo* LookupMatch(std::string method, const std::string& path,
+                          PathMatcher<MethodInfo*>::Match* match) {
+    return matcher_->Lookup(method, path.data(), path.size(), match);
+  }
+
  private:
   PathMatcherBuilder<MethodInfo*> builder_;
   PathMatcherPtr<MethodInfo*> matcher_;
@@ -685,6 +690,24 @@ TEST_F(PathMatcherTest, DifferentHttpMethod) {
   EXPECT_EQ(LookupNoBindings("POST", "/a/b"), nullptr);
 }
 
+TEST_F(PathMatcherTest, ManyCustomHttpMethods) {
+  // More methods than bits in the per-node method mask.
+  std::vector<MethodInfo*> methods;
+  for (int i = 0; i < 100; ++i) {
+    methods.push_back(AddPath("CUSTOM" + std::to_string(i), "/a/b"));
+  }
+  auto c = AddPath("CUSTOM99", "/c");
+  Build();
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(LookupNoBindings("CUSTOM" + std::to_string(i), "/a/b"),
+              methods[i]);
+  }
+  EXPECT_EQ(LookupNoBindings("CUSTOM99", "/c"), c);
+  EXPECT_EQ(LookupNoBindings("CUSTOM98", "/c"), nullptr);
+  EXPECT_EQ(LookupNoBindings("CUSTOM100", "/a/b"), nullptr);
+  EXPECT_EQ(LookupNoBindings("CUSTOM1", "/a/x"), nullptr);
+}
+
 TEST_F(PathMatcherTest, BodyFieldPathTest) {
   auto a = AddPathWithBodyFieldPath("GET", "/a", "b");
   auto cd = AddPathWithBodyFieldPath("GET", "/c/d", "e.f.g");
@@ -783,6 +806,54 @@ TEST_F(PathMatcherTest, VariableBindingsWithQueryParamsAndSystemParams) {
       bindings);
 }
 
+TEST_F(PathMatcherTest, MatchExtractsBindingsOnDemand) {
+  MethodInfo* a_b = AddPathWithBodyFieldPath("POST", "/a/{x}/b/{y=**}", "z");
+  Build();
+
+  EXPECT_NE(nullptr, a_b);
+
+  // The path is not null terminated at the query string.
+  std::string path = "/a/hello%20world/b/c%2Fd/e?x=ignored";
+  PathMatcher<MethodInfo*>::Match match;
+  EXPECT_EQ(LookupMatch("POST", path, &match), a_b);
+  EXPECT_EQ(match.method(), a_b);
+  EXPECT_EQ("z", match.body_field_path());
+
+  Bindings bindings;
+  PathMatcher<MethodInfo*>::ExtractBindings(match, path.data(), "t=proxy",
+                                            &bindings);
+  EXPECT_EQ(
+      Bindings({
+          Binding{FieldPath{"x"}, "hello world"},
+          Binding{FieldPath{"y"}, "c%2Fd/e"}, Binding{FieldPath{"t"}, "proxy"},
+      }),
+      bindings);
+
+  EXPECT_EQ(LookupMatch("GET", path, &match), nullptr);
+  EXPECT_EQ(match.method(), nullptr);
+}
+
+TEST_F(PathMatcherTest, MatchLongPaths) {
+  MethodInfo* a__ = AddGetPath("/a/{x=**}/b");
+  Build();
+
+  EXPECT_NE(nullptr, a__);
+
+  std::string segments;
+  for (int i = 0; i < 100; ++i) {
+    segments += "/" + std::to_string(i);
+  }
+  PathMatcher<MethodInfo*>::Match match;
+  EXPECT_EQ(LookupMatch("GET", "/a" + segments + "/b//", &match), a__);
+
+  Bindings bindings;
+  EXPECT_EQ(Lookup("GET", "/a" + segments + "/b", &bindings), a__);
+  EXPECT_EQ(Bindings({
+                Binding{FieldPath{"x"}, segments.substr(1)},
+            }),
+            bindings);
+}
+
 }  // namespace
 
 }  // namespace api_manager
@@ -16,18 +16,25 @@
 //
 #include "src/api_manager/service_control/aggregated.h"
 
+#include <algorithm>
 #include <sstream>
 #include <typeinfo>
+#include <vector>
+
+#include "google/protobuf/arena.h"
 #include "src/api_manager/service_control/logs_metrics_loader.h"
 
 using ::google::api::servicecontrol::v1::CheckRequest;
 using ::google::api::servicecontrol::v1::CheckResponse;
+using ::google::api::servicecontrol::v1::Operation;
 using ::google::api::servicecontrol::v1::AllocateQuotaRequest;
 using ::google::api::servicecontrol::v1::AllocateQuotaResponse;
 using ::google::api::servicecontrol::v1::ReportRequest;
 using ::google::api::servicecontrol::v1::ReportResponse;
 using ::google::api_manager::proto::ServerConfig;
 using ::google::api_manager::utils::Status;
+using ::google::protobuf::Arena;
+using ::google::protobuf::ArenaOptions;
 using ::google::protobuf::util::error::Code;
 
 using ::google::service_control_client::CheckAggregationOptions;
@@ -57,6 +64,19 @@ const int kCheckAggregationExpirationMs = 300000;
 // Default config for report aggregator
 const int kReportAggregationEntries = 10000;
 const int kReportAggregationFlushIntervalMs = 1000;
+// The default maximum size of a report request.
+const int kReportMaxBytes = 1024 * 1024;
+
+// The default milliseconds the circuit breaker stays open.
+const int kCircuitBreakerOpenDurationMs = 10000;
+
+// The unit of the quota limits enforced locally, per minute and per consumer.
+const char kQuotaLimitPerMinuteUnit[] = "1/min/{project}";
+// The quota limit value of the consumers without a specific tier.
+const char kQuotaLimitStandardTier[] = "STANDARD";
+
+// The default minimum delay of the hedged attempts.
+const int kHedgeMinDelayMs = 50;
 
 // The default connection timeout for check requests.
 const int kCheckDefaultTimeoutInMs = 5000;
@@ -65,10 +85,9 @@ const int kAllocateQuotaDefaultTimeoutInMs = 1000;
 // The default connection timeout for report requests.
 const int kReportDefaultTimeoutInMs = 15000;
 
-// The maximum protobuf pool size. All usages of pool alloc() and free() are
-// within a function frame. If no con-current usage, pool size of 1 is enough.
-// This number should correspond to maximum of concurrent calls.
-const int kProtoPoolMaxSize = 100;
+// The size of the first block of the request arena. A typical Report
+// request with its log entries and metric values fits in it.
+const size_t kRequestArenaBlockSize = 8192;
 
 // Defines protobuf content type.
 const char application_proto[] = "application/x-protobuf";
@@ -81,6 +100,9 @@ const char servicecontrol_service[] =
 const char quotacontrol_service[] =
     "/google.api.servicecontrol.v1.QuotaController";
 
+// The transport value of the server config to call service control over gRPC.
+const char kGrpcTransport[] = "grpc";
+
 // Generates CheckAggregationOptions.
 CheckAggregationOptions GetCheckAggregationOptions(
     const ServerConfig* server_config) {
@@ -129,29 +151,161 @@ ReportAggregationOptions GetReportAggregationOptions(
                                   kReportAggregationFlushIntervalMs);
 }
 
-}  // namespace
+// Returns the maximum size of a report request.
+size_t GetReportMaxBytes(const ServerConfig* server_config) {
+  if (server_config &&
+      server_config->service_control_config()
+              .report_aggregator_config()
+              .max_report_bytes() > 0) {
+    return server_config->service_control_config()
+        .report_aggregator_config()
+        .max_report_bytes();
+  }
+  return kReportMaxBytes;
+}
 
-template <class Type>
-std::unique_ptr<Type> Aggregated::ProtoPool<Type>::Alloc() {
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (!pool_.empty()) {
-    auto item = std::move(pool_.front());
-    pool_.pop_front();
-    item->Clear();
-    return item;
-  } else {
-    return std::unique_ptr<Type>(new Type);
+// Returns the minimum delay of the hedged attempts.
+std::chrono::milliseconds GetHedgeMinDelay(const ServerConfig* server_config) {
+  if (server_config) {
+    const auto& config = server_config->service_control_config();
+    if (config.hedging_config().min_delay_ms() > 0) {
+      return std::chrono::milliseconds(config.hedging_config().min_delay_ms());
+    }
+  }
+  return std::chrono::milliseconds(kHedgeMinDelayMs);
+}
+
+// Creates the cache of the check results refreshed ahead of their
+// expiration. Returns null if refresh ahead is disabled.
+std::unique_ptr<CheckResultCache> CreateCheckResultCache(
+    const ServerConfig* server_config) {
+  int refresh_ahead_percent =
+      server_config ? server_config->service_control_config()
+                          .check_aggregator_config()
+                          .refresh_ahead_percent()
+                    : 0;
+  CheckAggregationOptions options = GetCheckAggregationOptions(server_config);
+  if (refresh_ahead_percent <= 0 || refresh_ahead_percent >= 100 ||
+      options.num_entries <= 0 || options.flush_interval_ms <= 0) {
+    return nullptr;
+  }
+  return std::unique_ptr<CheckResultCache>(new CheckResultCache(
+      options.num_entries, std::chrono::milliseconds(options.flush_interval_ms),
+      refresh_ahead_percent));
+}
+
+// Returns the key of the cached check result of a request. The result of an
+// API key depends on its restrictions on the caller.
+std::string GetCheckResultKey(const CheckRequestInfo& info) {
+  std::string key;
+  for (const std::string& field :
+       {std::string(info.api_key), std::string(info.operation_name),
+        std::string(info.referer), info.client_ip, info.android_package_name,
+        info.android_cert_fingerprint, info.ios_bundle_id}) {
+    key.append(field);
+    key.push_back('\0');
+  }
+  return key;
+}
+
+// Returns the interval of the refreshes of the aggregated quota, also used to
+// send the quota allocated locally.
+int GetQuotaRefreshIntervalMs(const ServerConfig* server_config) {
+  if (server_config && server_config->service_control_config()
+                               .quota_aggregator_config()
+                               .refresh_interval_ms() > 0) {
+    return server_config->service_control_config()
+        .quota_aggregator_config()
+        .refresh_interval_ms();
   }
+  return kQuotaAggregationRefreshMs;
 }
 
-template <class Type>
-void Aggregated::ProtoPool<Type>::Free(std::unique_ptr<Type> item) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (pool_.size() < kProtoPoolMaxSize) {
-    pool_.push_back(std::move(item));
+// Adds the per minute quota limits of the service config to local_quota, if
+// local enforcement is enabled. Each of the process_count processes enforces
+// its share of the limits, at least 1 token per minute.
+void LoadLocalQuotaLimits(const ::google::api::Service& service,
+                          const ServerConfig* server_config, int process_count,
+                          LocalQuota* local_quota) {
+  if (server_config == nullptr || !server_config->service_control_config()
+                                       .quota_aggregator_config()
+                                       .local_enforcement()) {
+    return;
+  }
+  for (const auto& limit : service.quota().limits()) {
+    if (limit.unit() != kQuotaLimitPerMinuteUnit) {
+      continue;
+    }
+    auto it = limit.values().find(kQuotaLimitStandardTier);
+    int64_t tokens = it != limit.values().end() ? it->second
+                                                 : limit.default_limit();
+    if (tokens > 0 && process_count > 1) {
+      tokens = std::max<int64_t>(1, tokens / process_count);
+    }
+    local_quota->AddLimit(limit.metric(), tokens);
   }
 }
 
+// Returns the consumer of a quota request, the key of its local quota. It is
+// the consumer project the server charges, or the credential the server
+// resolves to it if the check returned no consumer project. It is empty if
+// the request has no consumer.
+std::string GetQuotaConsumer(const QuotaRequestInfo& info) {
+  if (!info.consumer_project_id.empty()) {
+    return "project:" + info.consumer_project_id;
+  }
+  if (!info.api_key.empty()) {
+    return "api_key:" + std::string(info.api_key);
+  }
+  if (!info.producer_project_id.empty()) {
+    return "project:" + std::string(info.producer_project_id);
+  }
+  return std::string();
+}
+
+// Creates the circuit breaker of the check and allocate quota calls.
+CircuitBreaker CreateCircuitBreaker(const ServerConfig* server_config) {
+  if (server_config == nullptr) {
+    return CircuitBreaker(0, std::chrono::milliseconds(0));
+  }
+  const auto& config =
+      server_config->service_control_config().circuit_breaker_config();
+  int open_duration_ms = config.open_duration_ms() > 0
+                             ? config.open_duration_ms()
+                             : kCircuitBreakerOpenDurationMs;
+  return CircuitBreaker(config.failure_threshold(),
+                        std::chrono::milliseconds(open_duration_ms));
+}
+
+// The protobuf arena of the request of one call. The first block of the
+// arena is part of the object, so on the stack, filling a typical request
+// does not call malloc. The request with all its strings, label maps and
+// metric values is freed at once when the arena is destroyed.
+class RequestArena {
+ public:
+  RequestArena() : arena_(Options(block_)) {}
+
+  // Creates a protobuf owned by the arena.
+  template <class Type>
+  Type* Create() {
+    return Arena::CreateMessage<Type>(&arena_);
+  }
+
+ private:
+  static ArenaOptions Options(char* block) {
+    ArenaOptions options;
+    options.initial_block = block;
+    options.initial_block_size = kRequestArenaBlockSize;
+    return options;
+  }
+
+  // Must be declared before arena_, which uses it.
+  alignas(8) char block_[kRequestArenaBlockSize];
+  Arena arena_;
+};
+
+}  // namespace
+
 Aggregated::Aggregated(const ::google::api::Service& service,
                        const ServerConfig* server_config,
                        ApiManagerEnvInterface* env,
@@ -168,7 +322,25 @@ Aggregated::Aggregated(const ::google::api::Service& service,
       url_(service_, server_config),
       mismatched_check_config_id_(service.id()),
       mismatched_report_config_id_(service.id()),
-      max_report_size_(0) {
+      max_report_size_(0),
+      report_size_counts_(),
+      max_report_bytes_(GetReportMaxBytes(server_config)),
+      circuit_breaker_(CreateCircuitBreaker(server_config)),
+      fail_open_(server_config && server_config->service_control_config()
+                                      .circuit_breaker_config()
+                                      .fail_open()),
+      hedge_percentile_(server_config ? server_config->service_control_config()
+                                            .hedging_config()
+                                            .delay_percentile()
+                                      : 0),
+      hedge_min_delay_(GetHedgeMinDelay(server_config)),
+      hedged_calls_(0),
+      check_result_cache_(CreateCheckResultCache(server_config)),
+      use_grpc_(server_config &&
+                server_config->service_control_config().transport() ==
+                    kGrpcTransport) {
+  LoadLocalQuotaLimits(service, server_config, env_->GetProcessCount(),
+                       &local_quota_);
   if (sa_token_) {
     sa_token_->SetAudience(
         auth::ServiceAccountToken::JWT_TOKEN_FOR_SERVICE_CONTROL,
@@ -189,7 +361,15 @@ Aggregated::Aggregated(const std::set<std::string>& logs,
       service_control_proto_(logs, "", ""),
       url_(service_, server_config_),
       client_(std::move(client)),
-      max_report_size_(0) {}
+      max_report_size_(0),
+      report_size_counts_(),
+      max_report_bytes_(kReportMaxBytes),
+      circuit_breaker_(CreateCircuitBreaker(nullptr)),
+      fail_open_(false),
+      hedge_percentile_(0),
+      hedge_min_delay_(GetHedgeMinDelay(nullptr)),
+      hedged_calls_(0),
+      use_grpc_(false) {}
 
 Aggregated::~Aggregated() {}
 
@@ -227,7 +407,7 @@ Status Aggregated::Init() {
 
   options.report_transport = [this](
       const ReportRequest& request, ReportResponse* response,
-      TransportDoneFunc on_done) { Call(request, response, on_done, nullptr); };
+      TransportDoneFunc on_done) { CallReport(request, response, on_done); };
 
   options.periodic_timer = [this](int interval_ms,
                                   std::function<void()> callback)
@@ -238,10 +418,21 @@ Status Aggregated::Init() {
       };
   client_ = ::google::service_control_client::CreateServiceControlClient(
       service_->name(), service_->id(), options);
+
+  if (local_quota_.HasLimits()) {
+    reconcile_timer_ = env_->StartPeriodicTimer(
+        std::chrono::milliseconds(GetQuotaRefreshIntervalMs(server_config_)),
+        [this]() { ReconcileQuota(); });
+  }
   return Status::OK;
 }
 
 Status Aggregated::Close() {
+  if (reconcile_timer_) {
+    reconcile_timer_->Stop();
+    reconcile_timer_.reset();
+    ReconcileQuota();
+  }
   // Just destroy the client to flush all its cache.
   client_.reset();
   return Status::OK;
@@ -251,10 +442,10 @@ Status Aggregated::Report(const ReportRequestInfo& info) {
   if (!client_) {
     return Status(Code::INTERNAL, "Missing service control client");
   }
-  auto request = report_pool_.Alloc();
-  Status status = service_control_proto_.FillReportRequest(info, request.get());
+  RequestArena arena;
+  ReportRequest* request = arena.Create<ReportRequest>();
+  Status status = service_control_proto_.FillReportRequest(info, request);
   if (!status.ok()) {
-    report_pool_.Free(std::move(request));
     return status;
   }
   ReportResponse* response = new ReportResponse;
@@ -283,8 +474,7 @@ Status Aggregated::Report(const ReportRequestInfo& info) {
         delete response;
       });
   // There is no reference to request anymore at this point and it is safe to
-  // free request now.
-  report_pool_.Free(std::move(request));
+  // free request with the arena now.
   return Status::OK;
 }
 
@@ -299,11 +489,31 @@ void Aggregated::Check(
             dummy_response_info);
     return;
   }
-  auto request = check_pool_.Alloc();
-  Status status = service_control_proto_.FillCheckRequest(info, request.get());
+
+  // The cached results of the API keys are refreshed in the background.
+  std::string result_key;
+  if (check_result_cache_ && !info.api_key.empty()) {
+    result_key = GetCheckResultKey(info);
+    CheckResponseInfo response_info;
+    switch (check_result_cache_->Lookup(
+        result_key, std::chrono::steady_clock::now(), &response_info)) {
+      case CheckResultCache::REFRESH:
+        TRACE(trace_span) << "Refreshing the cached check result";
+        RefreshCheck(result_key, info);
+      // Fall through.
+      case CheckResultCache::HIT:
+        on_done(Status::OK, response_info);
+        return;
+      case CheckResultCache::MISS:
+        break;
+    }
+  }
+
+  RequestArena arena;
+  CheckRequest* request = arena.Create<CheckRequest>();
+  Status status = service_control_proto_.FillCheckRequest(info, request);
   if (!status.ok()) {
     on_done(status, dummy_response_info);
-    check_pool_.Free(std::move(request));
     return;
   }
 
@@ -311,7 +521,7 @@ void Aggregated::Check(
   bool allow_unregistered_calls = info.allow_unregistered_calls;
 
   auto check_on_done = [this, response, allow_unregistered_calls, on_done,
-                        trace_span](
+                        trace_span, result_key](
       const ::google::protobuf::util::Status& status) {
     TRACE(trace_span) << "Check returned with status: " << status.ToString();
     CheckResponseInfo response_info;
@@ -330,6 +540,10 @@ void Aggregated::Check(
     if (status.ok()) {
       Status status = Proto::ConvertCheckResponse(
           *response, service_control_proto_.service_name(), &response_info);
+      if (status.ok() && !result_key.empty()) {
+        check_result_cache_->Insert(result_key, response_info,
+                                    std::chrono::steady_clock::now());
+      }
       // If server replied with either invalid api_key or not activated service,
       // the request is rejected even allow_unregistered_calls is true. Most
       // likely, users provide a wrong api key. By failing the request, the
@@ -344,7 +558,8 @@ void Aggregated::Check(
       }
     } else {
       // If allow_unregistered_calls is true, it is always OK to proceed.
-      if (allow_unregistered_calls) {
+      // It is also OK while the circuit breaker is open and fails open.
+      if (allow_unregistered_calls || FailOpen()) {
         on_done(Status::OK, response_info);
       } else {
         on_done(Status(status.error_code(), status.error_message(),
@@ -362,8 +577,7 @@ void Aggregated::Check(
         Call(request, response, on_done, trace_span.get());
       });
   // There is no reference to request anymore at this point and it is safe to
-  // free request now.
-  check_pool_.Free(std::move(request));
+  // free request with the arena now.
 }
 
 void Aggregated::Quota(const QuotaRequestInfo& info,
@@ -377,13 +591,40 @@ void Aggregated::Quota(const QuotaRequestInfo& info,
     return;
   }
 
-  auto request = quota_pool_.Alloc();
+  // The quota is allocated locally if the request has a limited metric, and
+  // sent to the server later by ReconcileQuota.
+  if (local_quota_.HasLimits() && info.metric_cost_vector) {
+    std::string consumer = GetQuotaConsumer(info);
+    if (!consumer.empty()) {
+      switch (local_quota_.Allocate(consumer, *info.metric_cost_vector,
+                                    std::chrono::steady_clock::now())) {
+        case LocalQuota::ALLOW:
+          TRACE(trace_span) << "Quota allocated locally";
+          AddPendingQuota(consumer, info, &pending_quota_);
+          on_done(Status::OK);
+          return;
+        case LocalQuota::DENY:
+          TRACE(trace_span) << "Quota exhausted locally";
+          if (local_quota_.IsExhausted(consumer)) {
+            AddPendingQuota(consumer, info, &denied_quota_);
+          }
+          on_done(Status(Code::RESOURCE_EXHAUSTED,
+                         "Insufficient tokens for quota of the consumer",
+                         Status::SERVICE_CONTROL));
+          return;
+        case LocalQuota::UNLIMITED:
+          break;
+      }
+    }
+  }
+
+  RequestArena arena;
+  AllocateQuotaRequest* request = arena.Create<AllocateQuotaRequest>();
 
   Status status =
-      service_control_proto_.FillAllocateQuotaRequest(info, request.get());
+      service_control_proto_.FillAllocateQuotaRequest(info, request);
   if (!status.ok()) {
     on_done(status);
-    quota_pool_.Free(std::move(request));
     return;
   }
 
@@ -397,6 +638,8 @@ void Aggregated::Quota(const QuotaRequestInfo& info,
     if (status.ok()) {
       on_done(Proto::ConvertAllocateQuotaResponse(
           *response, service_control_proto_.service_name()));
+    } else if (FailOpen()) {
+      on_done(Status::OK);
     } else {
       on_done(Status(status.error_code(), status.error_message(),
                      Status::SERVICE_CONTROL));
@@ -413,8 +656,132 @@ void Aggregated::Quota(const QuotaRequestInfo& info,
                  });
 
   // There is no reference to request anymore at this point and it is safe to
-  // free request now.
-  quota_pool_.Free(std::move(request));
+  // free request with the arena now.
+}
+
+void Aggregated::RefreshCheck(const std::string& key,
+                              const CheckRequestInfo& info) {
+  RequestArena arena;
+  CheckRequest* request = arena.Create<CheckRequest>();
+  Status status = service_control_proto_.FillCheckRequest(info, request);
+  if (!status.ok()) {
+    check_result_cache_->Remove(key);
+    return;
+  }
+
+  // The request is sent without going through the cache of client_, which
+  // would return its own cached response.
+  CheckResponse* response = new CheckResponse;
+  Call(*request, response,
+       [this, key, response](const ::google::protobuf::util::Status& status) {
+         CheckResponseInfo response_info;
+         // A result not accepted by the server is removed, the next request
+         // of the key gets it from a regular check.
+         if (status.ok() &&
+             Proto::ConvertCheckResponse(*response,
+                                         service_control_proto_.service_name(),
+                                         &response_info)
+                 .ok()) {
+           check_result_cache_->Insert(key, response_info,
+                                       std::chrono::steady_clock::now());
+         } else {
+           check_result_cache_->Remove(key);
+         }
+         delete response;
+       },
+       nullptr);
+}
+
+void Aggregated::AddPendingQuota(
+    const std::string& consumer, const QuotaRequestInfo& info,
+    std::unordered_map<std::string, PendingQuota>* pending_quota) {
+  PendingQuota& pending = (*pending_quota)[consumer + '/' + info.method_name];
+  if (pending.consumer.empty()) {
+    pending.consumer = consumer;
+    pending.api_key = std::string(info.api_key);
+    pending.producer_project_id = std::string(info.producer_project_id);
+    pending.method_name = info.method_name;
+    pending.operation_name = std::string(info.operation_name);
+  }
+  pending.operation_id = std::string(info.operation_id);
+  pending.referer = std::string(info.referer);
+  pending.client_ip = info.client_ip;
+
+  for (const auto& cost : *info.metric_cost_vector) {
+    int tokens = cost.second <= 0 ? 1 : cost.second;
+    auto it = std::find_if(pending.metric_costs.begin(),
+                           pending.metric_costs.end(),
+                           [&cost](const std::pair<std::string, int>& entry) {
+                             return entry.first == cost.first;
+                           });
+    if (it != pending.metric_costs.end()) {
+      it->second += tokens;
+    } else {
+      pending.metric_costs.emplace_back(cost.first, tokens);
+    }
+  }
+}
+
+void Aggregated::ReconcileQuota() {
+  std::unordered_map<std::string, PendingQuota> pending_quota;
+  pending_quota.swap(pending_quota_);
+  for (const auto& it : pending_quota) {
+    SendPendingQuota(it.second, false);
+  }
+
+  std::unordered_map<std::string, PendingQuota> denied_quota;
+  denied_quota.swap(denied_quota_);
+  for (const auto& it : denied_quota) {
+    SendPendingQuota(it.second, true);
+  }
+
+  // The consumers with full buckets are idle, a new consumer starts with the
+  // same buckets.
+  local_quota_.Sweep(std::chrono::steady_clock::now());
+}
+
+void Aggregated::SendPendingQuota(const PendingQuota& pending,
+                                  bool check_only) {
+  QuotaRequestInfo info;
+  info.operation_id = pending.operation_id;
+  info.operation_name = pending.operation_name;
+  info.api_key = pending.api_key;
+  info.producer_project_id = pending.producer_project_id;
+  info.referer = pending.referer;
+  info.client_ip = pending.client_ip;
+  info.method_name = pending.method_name;
+  info.metric_cost_vector = &pending.metric_costs;
+  info.check_only = check_only;
+
+  RequestArena arena;
+  AllocateQuotaRequest* request = arena.Create<AllocateQuotaRequest>();
+  Status status =
+      service_control_proto_.FillAllocateQuotaRequest(info, request);
+  if (!status.ok()) {
+    env_->LogError("Failed to send the local quota. " + status.ToString());
+    return;
+  }
+
+  AllocateQuotaResponse* response = new AllocateQuotaResponse();
+  std::string consumer = pending.consumer;
+  Call(*request, response,
+       [this, response, consumer](
+           const ::google::protobuf::util::Status& status) {
+         if (status.ok()) {
+           Status quota_status = Proto::ConvertAllocateQuotaResponse(
+               *response, service_control_proto_.service_name());
+           if (quota_status.code() == Code::RESOURCE_EXHAUSTED) {
+             local_quota_.Exhaust(consumer, std::chrono::steady_clock::now());
+           } else if (quota_status.ok()) {
+             local_quota_.Restore(consumer);
+           }
+         } else {
+           env_->LogError("Failed to send the local quota. " +
+                          status.ToString());
+         }
+         delete response;
+       },
+       nullptr);
 }
 
 Status Aggregated::GetStatistics(Statistics* esp_stat) const {
@@ -432,11 +799,30 @@ Status Aggregated::GetStatistics(Statistics* esp_stat) const {
   esp_stat->total_called_checks = client_stat.total_called_checks;
   esp_stat->send_checks_by_flush = client_stat.send_checks_by_flush;
   esp_stat->send_checks_in_flight = client_stat.send_checks_in_flight;
+  // The checks answered from check_result_cache_ do not reach client_, their
+  // refreshes are sent to the server directly.
+  if (check_result_cache_) {
+    esp_stat->total_called_checks += check_result_cache_->hits();
+    esp_stat->send_checks_in_flight += check_result_cache_->refreshes();
+  }
   esp_stat->total_called_reports = client_stat.total_called_reports;
   esp_stat->send_reports_by_flush = client_stat.send_reports_by_flush;
   esp_stat->send_reports_in_flight = client_stat.send_reports_in_flight;
   esp_stat->send_report_operations = client_stat.send_report_operations;
   esp_stat->max_report_size = max_report_size_;
+  esp_stat->circuit_breaker_open = circuit_breaker_.IsOpen() ? 1 : 0;
+  esp_stat->circuit_breaker_opens = circuit_breaker_.opens();
+  esp_stat->circuit_breaker_rejected_calls = circuit_breaker_.rejected_calls();
+  esp_stat->check_latency_p50_ms = check_latencies_.Percentile(50).count();
+  esp_stat->check_latency_p99_ms = check_latencies_.Percentile(99).count();
+  esp_stat->quota_latency_p50_ms = quota_latencies_.Percentile(50).count();
+  esp_stat->quota_latency_p99_ms = quota_latencies_.Percentile(99).count();
+  esp_stat->hedged_calls = hedged_calls_;
+  esp_stat->check_result_cache_hits =
+      check_result_cache_ ? check_result_cache_->hits() : 0;
+  for (int i = 0; i < Statistics::kReportSizeBuckets; i++) {
+    esp_stat->report_size_counts[i] = report_size_counts_[i];
+  }
 
   return Status::OK;
 }
@@ -502,6 +888,95 @@ const std::string& Aggregated::GetAuthToken() {
   }
 }
 
+template <class RequestType>
+const char* Aggregated::GetGrpcMethod() {
+  if (typeid(RequestType) == typeid(CheckRequest)) {
+    return "Check";
+  } else if (typeid(RequestType) == typeid(AllocateQuotaRequest)) {
+    return "AllocateQuota";
+  } else {
+    return "Report";
+  }
+}
+
+void Aggregated::CallReport(const ReportRequest& request,
+                            ReportResponse* response,
+                            TransportDoneFunc on_done) {
+  if (request.operations_size() <= 1 ||
+      request.ByteSizeLong() <= max_report_bytes_) {
+    Call(request, response, on_done, nullptr);
+    return;
+  }
+
+  // Splits the operations into requests of at most max_report_bytes_. An
+  // operation larger than that is sent alone.
+  std::vector<std::unique_ptr<ReportRequest>> parts;
+  size_t part_bytes = 0;
+  for (const Operation& operation : request.operations()) {
+    size_t operation_bytes = operation.ByteSizeLong();
+    if (parts.empty() || part_bytes + operation_bytes > max_report_bytes_) {
+      parts.emplace_back(new ReportRequest);
+      parts.back()->set_service_name(request.service_name());
+      parts.back()->set_service_config_id(request.service_config_id());
+      part_bytes = 0;
+    }
+    *parts.back()->add_operations() = operation;
+    part_bytes += operation_bytes;
+  }
+
+  // The state shared by the calls of the parts. The responses of the parts
+  // are merged into response, the status is the first failure.
+  struct SplitReport {
+    size_t pending;
+    ::google::protobuf::util::Status status;
+    ReportResponse* response;
+    TransportDoneFunc on_done;
+  };
+  std::shared_ptr<SplitReport> split(new SplitReport);
+  split->pending = parts.size();
+  split->response = response;
+  split->on_done = on_done;
+
+  for (const auto& part : parts) {
+    ReportResponse* part_response = new ReportResponse;
+    auto part_on_done = [split, part_response](
+        const ::google::protobuf::util::Status& status) {
+      if (!status.ok() && split->status.ok()) {
+        split->status = status;
+      }
+      split->response->MergeFrom(*part_response);
+      delete part_response;
+      if (--split->pending == 0) {
+        split->on_done(split->status);
+      }
+    };
+    Call(*part, part_response, part_on_done, nullptr);
+  }
+}
+
+void Aggregated::RecordCallResult(
+    uint64_t epoch, const ::google::protobuf::util::Status& status) {
+  // Only UNAVAILABLE means the server could not be reached, any other error
+  // is an answer of the server.
+  if (status.error_code() != Code::UNAVAILABLE) {
+    bool was_open = circuit_breaker_.IsOpen();
+    circuit_breaker_.OnSuccess(epoch);
+    if (was_open && !circuit_breaker_.IsOpen()) {
+      env_->LogInfo("Service control circuit breaker closed.");
+    }
+    return;
+  }
+  uint64_t opens = circuit_breaker_.opens();
+  circuit_breaker_.OnFailure(epoch, std::chrono::steady_clock::now());
+  if (circuit_breaker_.opens() != opens) {
+    env_->LogError("Service control circuit breaker opened.");
+  }
+}
+
+bool Aggregated::FailOpen() const {
+  return fail_open_ && circuit_breaker_.IsOpen();
+}
+
 template <class RequestType, class ResponseType>
 void Aggregated::Call(const RequestType& request, ResponseType* response,
                       TransportDoneFunc on_done,
@@ -509,6 +984,179 @@ void Aggregated::Call(const RequestType& request, ResponseType* response,
   std::shared_ptr<cloud_trace::CloudTraceSpan> trace_span(
       CreateChildSpan(parent_span, "Call ServiceControl server"));
 
+  std::string request_body;
+  request.SerializeToString(&request_body);
+
+  // Reports are always sent, they are not on the path of the requests.
+  if (typeid(RequestType) == typeid(ReportRequest)) {
+    Send<RequestType>(std::move(request_body), response, on_done, trace_span);
+    return;
+  }
+
+  static const ::google::protobuf::util::Status kCircuitOpen(
+      Code::UNAVAILABLE, "Service control circuit breaker is open");
+  CircuitBreaker::Decision decision =
+      circuit_breaker_.Decide(std::chrono::steady_clock::now());
+  uint64_t epoch = circuit_breaker_.epoch();
+  switch (decision) {
+    case CircuitBreaker::ALLOW:
+      SendHedged<RequestType>(
+          std::move(request_body), response,
+          [this, epoch,
+           on_done](const ::google::protobuf::util::Status& status) {
+            RecordCallResult(epoch, status);
+            on_done(status);
+          },
+          trace_span);
+      break;
+    case CircuitBreaker::PROBE:
+      // The call is the probe. It is not hedged, so that the probe is one
+      // request to a server that may still be down.
+      TRACE(trace_span) << "Sending circuit breaker probe";
+      Send<RequestType>(
+          std::move(request_body), response,
+          [this, epoch,
+           on_done](const ::google::protobuf::util::Status& status) {
+            RecordCallResult(epoch, status);
+            on_done(status);
+          },
+          trace_span);
+      break;
+    case CircuitBreaker::REJECT:
+      TRACE(trace_span) << "Rejected by circuit breaker";
+      on_done(kCircuitOpen);
+      break;
+  }
+}
+
+template <class RequestType, class ResponseType>
+void Aggregated::SendHedged(std::string&& request_body, ResponseType* response,
+                            TransportDoneFunc on_done,
+                            std::shared_ptr<cloud_trace::CloudTraceSpan>
+                                trace_span) {
+  LatencyTracker* latencies = typeid(RequestType) == typeid(CheckRequest)
+                                  ? &check_latencies_
+                                  : &quota_latencies_;
+
+  if (hedge_percentile_ <= 0) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    Send<RequestType>(
+        std::move(request_body), response,
+        [latencies, start, on_done](
+            const ::google::protobuf::util::Status& status) {
+          if (status.ok()) {
+            latencies->Record(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start));
+          }
+          on_done(status);
+        },
+        trace_span);
+    return;
+  }
+
+  // The state of a call shared by its attempts.
+  struct HedgedCall {
+    std::string request_body;
+    ResponseType* response;
+    TransportDoneFunc on_done;
+    // The number of attempts in flight.
+    int pending;
+    bool done;
+    // The timer sending the second attempt.
+    std::unique_ptr<::google::api_manager::PeriodicTimer> timer;
+  };
+  std::shared_ptr<HedgedCall> call(new HedgedCall);
+  call->response = response;
+  call->on_done = on_done;
+  call->pending = 0;
+  call->done = false;
+
+  // Sends an attempt with its own response. The call is done with the first
+  // successful attempt, or with the failure of the last attempt. The result
+  // of the other attempt is ignored, it cannot be cancelled.
+  auto send_attempt = [this, latencies, trace_span](
+      std::shared_ptr<HedgedCall> call, std::string&& request_body) {
+    ResponseType* attempt_response = new ResponseType;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    call->pending++;
+    auto attempt_on_done = [call, latencies, attempt_response, start](
+        const ::google::protobuf::util::Status& status) {
+      call->pending--;
+      if (status.ok()) {
+        latencies->Record(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start));
+      }
+      if (!call->done && (status.ok() || call->pending == 0)) {
+        call->done = true;
+        if (call->timer) {
+          call->timer->Stop();
+        }
+        if (status.ok()) {
+          call->response->Swap(attempt_response);
+        }
+        call->on_done(status);
+      }
+      delete attempt_response;
+    };
+    Send<RequestType>(std::move(request_body), attempt_response,
+                      attempt_on_done, trace_span);
+  };
+
+  call->request_body = std::move(request_body);
+  send_attempt(call, std::string(call->request_body));
+  if (call->done) {
+    return;
+  }
+
+  std::chrono::milliseconds delay =
+      std::max(latencies->Percentile(hedge_percentile_), hedge_min_delay_);
+  std::weak_ptr<HedgedCall> weak_call(call);
+  call->timer = env_->StartPeriodicTimer(
+      delay, [this, weak_call, send_attempt, trace_span]() {
+        // The first attempt holds the call until it is done, and the timer
+        // is stopped when the call is done, so the call, which owns the
+        // timer, is not deleted in this callback.
+        std::shared_ptr<HedgedCall> call = weak_call.lock();
+        if (!call || call->done) {
+          return;
+        }
+        call->timer->Stop();
+        TRACE(trace_span) << "Sending hedged attempt";
+        hedged_calls_++;
+        send_attempt(call, std::string(call->request_body));
+      });
+}
+
+template <class RequestType, class ResponseType>
+void Aggregated::Send(std::string&& request_body, ResponseType* response,
+                      TransportDoneFunc on_done,
+                      std::shared_ptr<cloud_trace::CloudTraceSpan>
+                          trace_span) {
+  if (typeid(RequestType) == typeid(ReportRequest)) {
+    if (request_body.size() > max_report_size_) {
+      max_report_size_ = request_body.size();
+    }
+    report_size_counts_[Statistics::ReportSizeBucket(request_body.size())]++;
+  }
+
+  if (use_grpc_) {
+    CallGrpc<RequestType>(std::move(request_body), response, on_done,
+                          trace_span);
+  } else {
+    CallHttp<RequestType>(std::move(request_body), response, on_done,
+                          trace_span);
+  }
+}
+
+template <class RequestType, class ResponseType>
+void Aggregated::CallHttp(std::string&& request_body, ResponseType* response,
+                          TransportDoneFunc on_done,
+                          std::shared_ptr<cloud_trace::CloudTraceSpan>
+                              trace_span) {
   const std::string& url = GetApiReqeustUrl<RequestType>();
   TRACE(trace_span) << "Http request URL: " << url;
 
@@ -527,13 +1175,20 @@ void Aggregated::Call(const RequestType& request, ResponseType* response,
       env_->LogError(std::string("Failed to call ") + url + ", Error: " +
                      status.ToString() + ", Response body: " + body);
 
-      // Handle NGX error as opposed to pass-through error code
+      // An NGX error or a gateway error means the server could not be
+      // reached. The other HTTP codes, such as 403 for a rejected token,
+      // are the answer of the server and keep their canonical code.
       if (status.code() < 0) {
         status =
             Status(Code::UNAVAILABLE, "Failed to connect to service control");
       } else {
+        Code code = status.CanonicalCode();
+        if (status.code() == 502 || status.code() == 503 ||
+            status.code() == 504) {
+          code = Code::UNAVAILABLE;
+        }
         status =
-            Status(Code::UNAVAILABLE,
+            Status(code,
                    "Service control request failed with HTTP response code " +
                        std::to_string(status.code()));
       }
@@ -541,25 +1196,68 @@ void Aggregated::Call(const RequestType& request, ResponseType* response,
     on_done(status.ToProto());
   }));
 
-  std::string request_body;
-  request.SerializeToString(&request_body);
-
-  if ((typeid(RequestType) == typeid(ReportRequest)) &&
-      (request_body.size() > max_report_size_)) {
-    max_report_size_ = request_body.size();
-  }
-
   http_request->set_url(url)
       .set_method("POST")
       .set_auth_token(GetAuthToken<RequestType>())
       .set_header("Content-Type", application_proto)
-      .set_body(request_body);
+      .set_body(std::move(request_body));
 
   http_request->set_timeout_ms(GetHttpRequestTimeout<RequestType>());
 
   env_->RunHTTPRequest(std::move(http_request));
 }
 
+template <class RequestType, class ResponseType>
+void Aggregated::CallGrpc(std::string&& request_body, ResponseType* response,
+                          TransportDoneFunc on_done,
+                          std::shared_ptr<cloud_trace::CloudTraceSpan>
+                              trace_span) {
+  // The service names are used without the leading '/'.
+  const char* service =
+      (typeid(RequestType) == typeid(AllocateQuotaRequest)
+           ? quotacontrol_service
+           : servicecontrol_service) +
+      1;
+  std::string method =
+      std::string(service) + "/" + GetGrpcMethod<RequestType>();
+  TRACE(trace_span) << "gRPC request method: " << method;
+
+  std::unique_ptr<GRPCRequest> grpc_request(new GRPCRequest(
+      [method, response, on_done, trace_span, this](Status status,
+                                                     std::string&& body) {
+        TRACE(trace_span) << "gRPC response status: " << status.ToString();
+        if (status.ok()) {
+          if (!response->ParseFromString(body)) {
+            status =
+                Status(Code::INVALID_ARGUMENT, std::string("Invalid response"));
+          }
+        } else {
+          env_->LogError(std::string("Failed to call ") + method +
+                         ", Error: " + status.ToString());
+          // An NGX error or a missed deadline means the server could not
+          // be reached, like the connection failures of the HTTP transport.
+          // The other gRPC statuses are the answer of the server.
+          Code code = status.CanonicalCode();
+          if (status.code() < 0 || code == Code::DEADLINE_EXCEEDED) {
+            code = Code::UNAVAILABLE;
+          }
+          status = Status(code, "Service control request failed: " +
+                                    status.message());
+        }
+        on_done(status.ToProto());
+      }));
+
+  grpc_request->set_server(url_.grpc_server())
+      .set_use_ssl(url_.grpc_use_ssl())
+      .set_service(service)
+      .set_method(GetGrpcMethod<RequestType>())
+      .set_auth_token(GetAuthToken<RequestType>())
+      .set_timeout_ms(GetHttpRequestTimeout<RequestType>())
+      .set_body(std::move(request_body));
+
+  env_->RunGRPCRequest(std::move(grpc_request));
+}
+
 Interface* Aggregated::Create(const ::google::api::Service& service,
                               const ServerConfig* server_config,
                               ApiManagerEnvInterface* env,
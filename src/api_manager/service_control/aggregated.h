@@ -15,6 +15,12 @@
 #ifndef API_MANAGER_SERVICE_CONTROL_AGGREGATED_H_
 #define API_MANAGER_SERVICE_CONTROL_AGGREGATED_H_
 
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include "google/api/service.pb.h"
 #include "google/api/servicecontrol/v1/quota_controller.pb.h"
 #include "google/api/servicecontrol/v1/service_controller.pb.h"
@@ -23,13 +29,14 @@
 #include "src/api_manager/auth/service_account_token.h"
 #include "src/api_manager/cloud_trace/cloud_trace.h"
 #include "src/api_manager/proto/server_config.pb.h"
+#include "src/api_manager/service_control/check_result_cache.h"
+#include "src/api_manager/service_control/circuit_breaker.h"
 #include "src/api_manager/service_control/interface.h"
+#include "src/api_manager/service_control/latency_tracker.h"
+#include "src/api_manager/service_control/local_quota.h"
 #include "src/api_manager/service_control/proto.h"
 #include "src/api_manager/service_control/url.h"
 
-#include <list>
-#include <mutex>
-
 namespace google {
 namespace api_manager {
 namespace service_control {
@@ -77,23 +84,18 @@ class Aggregated : public Interface {
     std::unique_ptr<::google::api_manager::PeriodicTimer> esp_timer_;
   };
 
-  // The protobuf pool to reuse protobuf. Performance tests showed that reusing
-  // protobuf is faster than allocating a new protobuf.
-  template <class Type>
-  class ProtoPool {
-   public:
-    // Allocates a protobuf. If there is one in the pool, uses it, otherwise
-    // creates a new one.
-    std::unique_ptr<Type> Alloc();
-    // Frees a protobuf. If pool did not reach maximum size, stores it in the
-    // pool, otherwise frees it.
-    void Free(std::unique_ptr<Type> item);
-
-   private:
-    // Protobuf pool to store used protobufs.
-    std::list<std::unique_ptr<Type>> pool_;
-    // Mutex to protect the protobuf pool.
-    std::mutex mutex_;
+  // The quota allocated locally to a consumer for a method, not yet sent to
+  // the server. The fields of the operation are those of its last request.
+  struct PendingQuota {
+    std::string consumer;
+    std::string operation_id;
+    std::string operation_name;
+    std::string api_key;
+    std::string producer_project_id;
+    std::string referer;
+    std::string client_ip;
+    std::string method_name;
+    std::vector<std::pair<std::string, int>> metric_costs;
   };
 
   friend class AggregatedTestWithMockedClient;
@@ -110,12 +112,80 @@ class Aggregated : public Interface {
              const std::set<std::string>& metrics,
              const std::set<std::string>& labels);
 
-  // Calls to service control server.
+  // Calls the service control server with a report request. A report larger
+  // than max_report_bytes_ is split into several requests, on_done is called
+  // when all of them are done.
+  void CallReport(
+      const ::google::api::servicecontrol::v1::ReportRequest& request,
+      ::google::api::servicecontrol::v1::ReportResponse* response,
+      ::google::service_control_client::TransportDoneFunc on_done);
+
+  // Calls to service control server. The check and allocate quota calls go
+  // through the circuit breaker.
   template <class RequestType, class ResponseType>
   void Call(const RequestType& request, ResponseType* response,
             ::google::service_control_client::TransportDoneFunc on_done,
             cloud_trace::CloudTraceSpan* parent_span);
 
+  // Sends a serialized check or allocate quota request to service control
+  // server, and records its latency. If hedging is enabled, sends a second
+  // attempt if the first one did not answer after the hedge delay.
+  template <class RequestType, class ResponseType>
+  void SendHedged(std::string&& request_body, ResponseType* response,
+                  ::google::service_control_client::TransportDoneFunc on_done,
+                  std::shared_ptr<cloud_trace::CloudTraceSpan> trace_span);
+
+  // Sends a serialized request to service control server.
+  template <class RequestType, class ResponseType>
+  void Send(std::string&& request_body, ResponseType* response,
+            ::google::service_control_client::TransportDoneFunc on_done,
+            std::shared_ptr<cloud_trace::CloudTraceSpan> trace_span);
+
+  // Sends a check request in the background to refresh the cached result of
+  // a key.
+  void RefreshCheck(const std::string& key, const CheckRequestInfo& info);
+
+  // Adds the costs of a request of consumer to the quota by consumer and
+  // method in pending.
+  void AddPendingQuota(const std::string& consumer,
+                       const QuotaRequestInfo& info,
+                       std::unordered_map<std::string, PendingQuota>* pending);
+
+  // Sends the quota allocated locally since the last call to the server, one
+  // allocate quota request per consumer and method. The consumers the server
+  // reports as exhausted are denied locally. For the exhausted consumers with
+  // denied requests, checks whether the server allows them again.
+  void ReconcileQuota();
+
+  // Sends the pending quota of a consumer to the server, or only checks that
+  // it is available if check_only is true.
+  void SendPendingQuota(const PendingQuota& pending, bool check_only);
+
+  // Records the result of a call sent through the circuit breaker in the
+  // breaker epoch in which it was decided.
+  void RecordCallResult(uint64_t epoch,
+                        const ::google::protobuf::util::Status& status);
+
+  // Returns true if the requests are allowed because the circuit breaker is
+  // open and configured to fail open.
+  bool FailOpen() const;
+
+  // Sends a serialized request over HTTP.
+  template <class RequestType, class ResponseType>
+  void CallHttp(std::string&& request_body, ResponseType* response,
+                ::google::service_control_client::TransportDoneFunc on_done,
+                std::shared_ptr<cloud_trace::CloudTraceSpan> trace_span);
+
+  // Sends a serialized request over gRPC.
+  template <class RequestType, class ResponseType>
+  void CallGrpc(std::string&& request_body, ResponseType* response,
+                ::google::service_control_client::TransportDoneFunc on_done,
+                std::shared_ptr<cloud_trace::CloudTraceSpan> trace_span);
+
+  // Returns the gRPC method name based on RequestType
+  template <class RequestType>
+  const char* GetGrpcMethod();
+
   // Returns API request url based on RequestType
   template <class RequestType>
   const std::string& GetApiReqeustUrl();
@@ -149,15 +219,6 @@ class Aggregated : public Interface {
   std::unique_ptr<::google::service_control_client::ServiceControlClient>
       client_;
 
-  // The protobuf pool to reuse AllocateQuotaRequest protobuf.
-  ProtoPool<::google::api::servicecontrol::v1::AllocateQuotaRequest>
-      quota_pool_;
-
-  // The protobuf pool to reuse CheckRequest protobuf.
-  ProtoPool<::google::api::servicecontrol::v1::CheckRequest> check_pool_;
-  // The protobuf pool to reuse ReportRequest protobuf.
-  ProtoPool<::google::api::servicecontrol::v1::ReportRequest> report_pool_;
-
   // Mismatched config ID received for a check request
   std::string mismatched_check_config_id_;
 
@@ -166,6 +227,45 @@ class Aggregated : public Interface {
 
   // Maximum report size send to server.
   uint64_t max_report_size_;
+
+  // The number of reports send to server by size.
+  uint64_t report_size_counts_[Statistics::kReportSizeBuckets];
+
+  // The maximum size of a report request send to server.
+  size_t max_report_bytes_;
+
+  // The circuit breaker of the check and allocate quota calls.
+  CircuitBreaker circuit_breaker_;
+  // If true, the requests are allowed while circuit_breaker_ is open.
+  bool fail_open_;
+
+  // The latencies of the check and allocate quota calls.
+  LatencyTracker check_latencies_;
+  LatencyTracker quota_latencies_;
+  // The percentile of the latencies used as the hedge delay, hedging is
+  // disabled if it is <= 0.
+  double hedge_percentile_;
+  // The minimum hedge delay.
+  std::chrono::milliseconds hedge_min_delay_;
+  // The number of hedged attempts sent.
+  uint64_t hedged_calls_;
+
+  // The check results of the API keys refreshed ahead of their expiration,
+  // null if refresh ahead is disabled.
+  std::unique_ptr<CheckResultCache> check_result_cache_;
+
+  // The quota limits enforced locally, no limit is enforced if local quota is
+  // disabled.
+  LocalQuota local_quota_;
+  // The quota allocated locally, by consumer and method.
+  std::unordered_map<std::string, PendingQuota> pending_quota_;
+  // The quota denied to the exhausted consumers, by consumer and method.
+  std::unordered_map<std::string, PendingQuota> denied_quota_;
+  // The timer sending pending_quota_ to the server.
+  std::unique_ptr<::google::api_manager::PeriodicTimer> reconcile_timer_;
+
+  // If true, calls service control over gRPC rather than HTTP.
+  bool use_grpc_;
 };
 
 }  // namespace service_control
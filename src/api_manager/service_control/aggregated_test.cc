@@ -15,6 +15,10 @@
 ////////////////////////////////////////////////////////////////////////////////
 //
 #include "src/api_manager/service_control/aggregated.h"
+
+#include <chrono>
+#include <thread>
+
 #include "gmock/gmock.h"
 #include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
@@ -34,6 +38,7 @@ using ::google::service_control_client::ServiceControlClient;
 using ::google::service_control_client::TransportCheckFunc;
 using ::google::service_control_client::TransportQuotaFunc;
 using ::google::service_control_client::TransportReportFunc;
+using ::testing::AnyNumber;
 using ::testing::Return;
 using ::testing::Invoke;
 using ::testing::_;
@@ -241,6 +246,573 @@ TEST_F(AggregatedTestWithRealClient, CheckOKTest) {
   EXPECT_EQ(stat.send_report_operations, 0);
 }
 
+// The tests of an Aggregated created with a server config. A test fills
+// server_config_, may replace env_, and then calls CreateLib.
+class AggregatedTest : public ::testing::Test {
+ public:
+  void SetUp() {
+    service_.set_name("test_service");
+    service_.mutable_control()->set_environment("http://127.0.0.1:8081");
+    env_.reset(new ::testing::NiceMock<MockApiManagerEnvironment>);
+  }
+
+  void CreateLib() {
+    sc_lib_.reset(
+        Aggregated::Create(service_, &server_config_, env_.get(), nullptr));
+    ASSERT_TRUE((bool)(sc_lib_));
+    sc_lib_->Init();
+  }
+
+  // Returns the status the check of info completed with.
+  Status DoCheck(const CheckRequestInfo& info) {
+    Status result = Status::OK;
+    sc_lib_->Check(info, nullptr,
+                   [&result](Status status, const CheckResponseInfo&) {
+                     result = status;
+                   });
+    return result;
+  }
+
+  Status DoCheck() {
+    CheckRequestInfo info;
+    FillOperationInfo(&info);
+    return DoCheck(info);
+  }
+
+  ::google::api::Service service_;
+  proto::ServerConfig server_config_;
+  std::unique_ptr<MockApiManagerEnvironment> env_;
+  std::unique_ptr<Interface> sc_lib_;
+};
+
+class AggregatedGrpcTransportTest : public AggregatedTest {
+ public:
+  void SetUp() {
+    AggregatedTest::SetUp();
+    server_config_.mutable_service_control_config()->set_transport("grpc");
+    CreateLib();
+  }
+};
+
+TEST_F(AggregatedGrpcTransportTest, CheckOverGrpc) {
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_)).Times(0);
+  EXPECT_CALL(*env_, DoRunGRPCRequest(_))
+      .WillOnce(Invoke([](GRPCRequest* request) {
+        EXPECT_EQ(request->server(), "127.0.0.1:8081");
+        EXPECT_FALSE(request->use_ssl());
+        EXPECT_EQ(request->service(),
+                  "google.api.servicecontrol.v1.ServiceController");
+        EXPECT_EQ(request->method(), "Check");
+        EXPECT_EQ(request->timeout_ms(), 5000);
+        CheckRequest check_request;
+        ASSERT_TRUE(check_request.ParseFromString(request->body()));
+        EXPECT_EQ(check_request.service_name(), "test_service");
+        request->OnComplete(Status::OK, CheckResponse().SerializeAsString());
+      }));
+
+  CheckRequestInfo info;
+  FillOperationInfo(&info);
+  bool done = false;
+  sc_lib_->Check(info, nullptr,
+                 [&done](Status status, const CheckResponseInfo& info) {
+                   EXPECT_TRUE(status.ok());
+                   done = true;
+                 });
+  EXPECT_TRUE(done);
+}
+
+TEST_F(AggregatedGrpcTransportTest, CheckErrorOverGrpc) {
+  // The gRPC status of the server is kept, a missed deadline means the
+  // server is unavailable.
+  std::vector<std::pair<Code, Code>> cases = {
+      {Code::PERMISSION_DENIED, Code::PERMISSION_DENIED},
+      {Code::INVALID_ARGUMENT, Code::INVALID_ARGUMENT},
+      {Code::DEADLINE_EXCEEDED, Code::UNAVAILABLE},
+      {Code::UNAVAILABLE, Code::UNAVAILABLE},
+  };
+  for (const auto& c : cases) {
+    Code grpc_code = c.first;
+    EXPECT_CALL(*env_, DoRunGRPCRequest(_))
+        .WillOnce(Invoke([grpc_code](GRPCRequest* request) {
+          request->OnComplete(Status(grpc_code, "Server error"),
+                              std::string());
+        }));
+
+    CheckRequestInfo info;
+    FillOperationInfo(&info);
+    // A different operation each time, so the check is not cached.
+    info.operation_id = std::to_string(grpc_code);
+    info.api_key = "api_key_" + std::to_string(grpc_code);
+    EXPECT_EQ(DoCheck(info).code(), c.second);
+  }
+}
+
+class AggregatedReportSplitTest : public AggregatedTest {};
+
+TEST_F(AggregatedReportSplitTest, SplitLargeReport) {
+  auto* report_config = server_config_.mutable_service_control_config()
+                            ->mutable_report_aggregator_config();
+  // Disables the aggregation, and splits every report of two operations.
+  report_config->set_cache_entries(0);
+  report_config->set_max_report_bytes(1);
+  CreateLib();
+
+  std::vector<std::string> operation_ids;
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_))
+      .Times(2)
+      .WillRepeatedly(Invoke([&operation_ids](HTTPRequest* request) {
+        ReportRequest report_request;
+        ASSERT_TRUE(report_request.ParseFromString(request->body()));
+        EXPECT_EQ(report_request.service_name(), "test_service");
+        ASSERT_EQ(report_request.operations_size(), 1);
+        operation_ids.push_back(report_request.operations(0).operation_id());
+        request->OnComplete(Status::OK, {},
+                            ReportResponse().SerializeAsString());
+      }));
+
+  ReportRequestInfo info;
+  FillOperationInfo(&info);
+  // The consumer project adds a by consumer operation to the report.
+  info.check_response_info.consumer_project_id = "consumer_project";
+  EXPECT_TRUE(sc_lib_->Report(info).ok());
+  EXPECT_EQ(operation_ids,
+            std::vector<std::string>({"operation_id", "operation_id1"}));
+
+  Statistics stat;
+  EXPECT_TRUE(sc_lib_->GetStatistics(&stat).ok());
+  EXPECT_EQ(stat.report_size_counts[0], 2u);
+  for (int i = 1; i < Statistics::kReportSizeBuckets; i++) {
+    EXPECT_EQ(stat.report_size_counts[i], 0u);
+  }
+}
+
+class AggregatedCircuitBreakerTest : public AggregatedTest {
+ public:
+  void SetUp() {
+    AggregatedTest::SetUp();
+    server_config_.mutable_service_control_config()
+        ->mutable_check_aggregator_config()
+        ->set_cache_entries(0);
+  }
+
+  void CreateLib(bool fail_open, int open_duration_ms = 0) {
+    auto* breaker_config = server_config_.mutable_service_control_config()
+                               ->mutable_circuit_breaker_config();
+    breaker_config->set_failure_threshold(1);
+    breaker_config->set_fail_open(fail_open);
+    breaker_config->set_open_duration_ms(open_duration_ms);
+    AggregatedTest::CreateLib();
+  }
+};
+
+TEST_F(AggregatedCircuitBreakerTest, FailClosed) {
+  CreateLib(false);
+  // Only the first check is sent, the breaker opens when it fails.
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke([](HTTPRequest* request) {
+        request->OnComplete(Status(Code::UNAVAILABLE, "Unavailable"), {}, "");
+      }));
+
+  EXPECT_FALSE(DoCheck().ok());
+  Status status = DoCheck();
+  EXPECT_EQ(status.code(), Code::UNAVAILABLE);
+
+  Statistics stat;
+  EXPECT_TRUE(sc_lib_->GetStatistics(&stat).ok());
+  EXPECT_EQ(stat.circuit_breaker_open, 1u);
+  EXPECT_EQ(stat.circuit_breaker_opens, 1u);
+  EXPECT_EQ(stat.circuit_breaker_rejected_calls, 1u);
+}
+
+TEST_F(AggregatedCircuitBreakerTest, ProbeIsTheCall) {
+  CreateLib(false, 1);
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke([](HTTPRequest* request) {
+        request->OnComplete(Status(Code::UNAVAILABLE, "Unavailable"), {}, "");
+      }))
+      .WillOnce(Invoke([](HTTPRequest* request) {
+        request->OnComplete(Status::OK, {},
+                            CheckResponse().SerializeAsString());
+      }));
+
+  EXPECT_FALSE(DoCheck().ok());
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  // The check after the open duration is sent as the probe, and gets the
+  // result of the server even if the breaker fails closed.
+  EXPECT_TRUE(DoCheck().ok());
+
+  Statistics stat;
+  EXPECT_TRUE(sc_lib_->GetStatistics(&stat).ok());
+  EXPECT_EQ(stat.circuit_breaker_open, 0u);
+  EXPECT_EQ(stat.circuit_breaker_rejected_calls, 0u);
+}
+
+TEST_F(AggregatedCircuitBreakerTest, FailOpen) {
+  CreateLib(true);
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke([](HTTPRequest* request) {
+        request->OnComplete(Status(Code::UNAVAILABLE, "Unavailable"), {}, "");
+      }));
+
+  // The failure which opens the breaker already fails open.
+  EXPECT_TRUE(DoCheck().ok());
+  EXPECT_TRUE(DoCheck().ok());
+}
+
+TEST_F(AggregatedCircuitBreakerTest, HttpAnswersDoNotOpen) {
+  CreateLib(true);
+  // A server answering 403, e.g. for a revoked token, is reachable.
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_))
+      .Times(3)
+      .WillRepeatedly(Invoke([](HTTPRequest* request) {
+        request->OnComplete(Status(403, "Forbidden"), {}, "");
+      }));
+
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(DoCheck().code(), Code::PERMISSION_DENIED);
+  }
+
+  Statistics stat;
+  EXPECT_TRUE(sc_lib_->GetStatistics(&stat).ok());
+  EXPECT_EQ(stat.circuit_breaker_open, 0u);
+  EXPECT_EQ(stat.circuit_breaker_opens, 0u);
+}
+
+TEST_F(AggregatedCircuitBreakerTest, HttpGatewayErrorsOpen) {
+  CreateLib(false);
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke([](HTTPRequest* request) {
+        request->OnComplete(Status(503, "Service Unavailable"), {}, "");
+      }));
+
+  EXPECT_EQ(DoCheck().code(), Code::UNAVAILABLE);
+
+  Statistics stat;
+  EXPECT_TRUE(sc_lib_->GetStatistics(&stat).ok());
+  EXPECT_EQ(stat.circuit_breaker_opens, 1u);
+}
+
+// An environment which keeps the HTTP requests, to complete them later.
+class PendingRequestsEnvironment
+    : public ::testing::NiceMock<MockApiManagerEnvironment> {
+ public:
+  virtual void RunHTTPRequest(std::unique_ptr<HTTPRequest> request) {
+    requests.push_back(std::move(request));
+  }
+
+  std::vector<std::unique_ptr<HTTPRequest>> requests;
+};
+
+class FakeTimer : public PeriodicTimer {
+ public:
+  virtual void Stop() {}
+};
+
+class AggregatedHedgingTest : public AggregatedTest {};
+
+TEST_F(AggregatedHedgingTest, HedgedCheck) {
+  auto* config = server_config_.mutable_service_control_config();
+  config->mutable_check_aggregator_config()->set_cache_entries(0);
+  config->mutable_hedging_config()->set_delay_percentile(95);
+  config->mutable_hedging_config()->set_min_delay_ms(10);
+  PendingRequestsEnvironment* pending_env = new PendingRequestsEnvironment;
+  env_.reset(pending_env);
+  PendingRequestsEnvironment& env = *pending_env;
+  CreateLib();
+
+  // No latency is recorded yet, the hedge delay is the minimum delay.
+  std::function<void()> hedge;
+  EXPECT_CALL(env, StartPeriodicTimer(std::chrono::milliseconds(10), _))
+      .WillOnce(Invoke([&hedge](std::chrono::milliseconds,
+                                std::function<void()> continuation) {
+        hedge = continuation;
+        return std::unique_ptr<PeriodicTimer>(new FakeTimer);
+      }));
+
+  CheckRequestInfo info;
+  FillOperationInfo(&info);
+  int done = 0;
+  sc_lib_->Check(info, nullptr,
+                 [&done](Status status, const CheckResponseInfo& info) {
+                   EXPECT_TRUE(status.ok());
+                   done++;
+                 });
+  ASSERT_EQ(env.requests.size(), 1u);
+  ASSERT_TRUE((bool)hedge);
+
+  hedge();
+  ASSERT_EQ(env.requests.size(), 2u);
+  EXPECT_EQ(env.requests[0]->body(), env.requests[1]->body());
+
+  // The second attempt answers first.
+  env.requests[1]->OnComplete(Status::OK, {},
+                              CheckResponse().SerializeAsString());
+  EXPECT_EQ(done, 1);
+  env.requests[0]->OnComplete(Status::OK, {},
+                              CheckResponse().SerializeAsString());
+  EXPECT_EQ(done, 1);
+
+  Statistics stat;
+  EXPECT_TRUE(sc_lib_->GetStatistics(&stat).ok());
+  EXPECT_EQ(stat.hedged_calls, 1u);
+}
+
+class AggregatedCheckResultCacheTest : public AggregatedTest {
+ public:
+  void SetUp() {
+    AggregatedTest::SetUp();
+    // The results are refreshed 100 ms after they are fetched, and expire
+    // after 1 second.
+    auto* check_config = server_config_.mutable_service_control_config()
+                             ->mutable_check_aggregator_config();
+    check_config->set_cache_entries(10);
+    check_config->set_flush_interval_ms(1000);
+    check_config->set_refresh_ahead_percent(90);
+    CreateLib();
+  }
+
+  // Returns the consumer project of a check, or the error.
+  std::string DoCheckProject() {
+    CheckRequestInfo info;
+    FillOperationInfo(&info);
+    std::string result;
+    sc_lib_->Check(info, nullptr,
+                   [&result](Status status,
+                             const CheckResponseInfo& response_info) {
+                     result = status.ok() ? response_info.consumer_project_id
+                                          : status.ToString();
+                   });
+    return result;
+  }
+
+  // Answers the check requests with the consumer project project_number, or
+  // with status if it is not OK.
+  static std::function<void(HTTPRequest*)> Answer(int project_number,
+                                                  Status status = Status::OK) {
+    return [project_number, status](HTTPRequest* request) {
+      CheckRequest check_request;
+      ASSERT_TRUE(check_request.ParseFromString(request->body()));
+      EXPECT_EQ(check_request.operation().consumer_id(), "api_key:api_key_x");
+      CheckResponse response;
+      auto* consumer_info =
+          response.mutable_check_info()->mutable_consumer_info();
+      consumer_info->set_project_number(project_number);
+      request->OnComplete(status, {}, response.SerializeAsString());
+    };
+  }
+
+  Statistics GetStatistics() {
+    Statistics stat;
+    EXPECT_TRUE(sc_lib_->GetStatistics(&stat).ok());
+    return stat;
+  }
+};
+
+TEST_F(AggregatedCheckResultCacheTest, Hit) {
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_)).WillOnce(Invoke(Answer(123)));
+  EXPECT_EQ(DoCheckProject(), "123");
+  // The result is cached, the check is not sent.
+  EXPECT_EQ(DoCheckProject(), "123");
+
+  // The hit is counted as a check.
+  Statistics stat = GetStatistics();
+  EXPECT_EQ(stat.total_called_checks, 2u);
+  EXPECT_EQ(stat.check_result_cache_hits, 1u);
+}
+
+TEST_F(AggregatedCheckResultCacheTest, Refresh) {
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke(Answer(123)))
+      .WillOnce(Invoke(Answer(456)));
+  EXPECT_EQ(DoCheckProject(), "123");
+  uint64_t sent_checks = GetStatistics().send_checks_in_flight;
+
+  // The check after the refresh time gets the cached result, and sends the
+  // refresh check, whose result is cached.
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  EXPECT_EQ(DoCheckProject(), "123");
+  EXPECT_EQ(DoCheckProject(), "456");
+
+  Statistics stat = GetStatistics();
+  EXPECT_EQ(stat.total_called_checks, 3u);
+  EXPECT_EQ(stat.check_result_cache_hits, 2u);
+  EXPECT_EQ(stat.send_checks_in_flight, sent_checks + 1);
+}
+
+TEST_F(AggregatedCheckResultCacheTest, FailedRefreshCheck) {
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_))
+      .WillOnce(Invoke(Answer(123)))
+      .WillOnce(Invoke(Answer(0, Status(Code::UNAVAILABLE, "Unavailable"))))
+      .WillRepeatedly(Invoke(Answer(789)));
+  EXPECT_EQ(DoCheckProject(), "123");
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  EXPECT_EQ(DoCheckProject(), "123");
+  // The failed refresh removed the result, the next check is not a hit.
+  DoCheckProject();
+  EXPECT_EQ(GetStatistics().check_result_cache_hits, 1u);
+}
+
+const char kQuotaMetric[] = "test.googleapis.com/read";
+
+class AggregatedLocalQuotaTest : public AggregatedTest {
+ public:
+  // Creates the library with a per minute limit of kQuotaMetric.
+  void CreateLib(int64_t limit) {
+    auto* quota_limit = service_.mutable_quota()->add_limits();
+    quota_limit->set_metric(kQuotaMetric);
+    quota_limit->set_unit("1/min/{project}");
+    (*quota_limit->mutable_values())["STANDARD"] = limit;
+    auto* quota_config = server_config_.mutable_service_control_config()
+                             ->mutable_quota_aggregator_config();
+    quota_config->set_local_enforcement(true);
+    quota_config->set_refresh_interval_ms(1234);
+
+    EXPECT_CALL(*env_, StartPeriodicTimer(_, _)).Times(AnyNumber());
+    EXPECT_CALL(*env_,
+                StartPeriodicTimer(std::chrono::milliseconds(1234), _))
+        .WillOnce(Invoke([this](std::chrono::milliseconds,
+                                std::function<void()> continuation) {
+          reconcile_ = continuation;
+          return std::unique_ptr<PeriodicTimer>(new FakeTimer);
+        }));
+    AggregatedTest::CreateLib();
+    ASSERT_TRUE((bool)reconcile_);
+  }
+
+  // Returns the status the allocation of cost tokens completed with.
+  Status DoQuota(const std::string& api_key, int cost,
+                 const std::string& consumer_project_id = "") {
+    std::vector<std::pair<std::string, int>> costs = {{kQuotaMetric, cost}};
+    QuotaRequestInfo info;
+    FillOperationInfo(&info);
+    info.api_key = api_key;
+    info.method_name = "operation_name";
+    info.metric_cost_vector = &costs;
+    info.consumer_project_id = consumer_project_id;
+    Status result = Status::OK;
+    sc_lib_->Quota(info, nullptr,
+                   [&result](Status status) { result = status; });
+    return result;
+  }
+
+  // Expects count allocate quota requests, and answers them with response.
+  void ExpectAllocateQuota(int count, const AllocateQuotaResponse& response,
+                           std::vector<AllocateQuotaRequest>* requests) {
+    std::string body = response.SerializeAsString();
+    EXPECT_CALL(*env_, DoRunHTTPRequest(_))
+        .Times(count)
+        .WillRepeatedly(Invoke([body, requests](HTTPRequest* request) {
+          AllocateQuotaRequest quota_request;
+          ASSERT_TRUE(quota_request.ParseFromString(request->body()));
+          requests->push_back(quota_request);
+          request->OnComplete(Status::OK, {}, std::string(body));
+        }));
+  }
+
+  static AllocateQuotaResponse ExhaustedResponse() {
+    AllocateQuotaResponse response;
+    response.add_allocate_errors()->set_code(
+        ::google::api::servicecontrol::v1::QuotaError::RESOURCE_EXHAUSTED);
+    return response;
+  }
+
+  std::function<void()> reconcile_;
+};
+
+TEST_F(AggregatedLocalQuotaTest, AllocateLocallyAndReconcile) {
+  CreateLib(10);
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_)).Times(0);
+  EXPECT_TRUE(DoQuota("key", 4).ok());
+  EXPECT_TRUE(DoQuota("key", 4).ok());
+  EXPECT_EQ(DoQuota("key", 4).code(), Code::RESOURCE_EXHAUSTED);
+  // The other consumers have their own buckets.
+  EXPECT_TRUE(DoQuota("other", 10).ok());
+  ::testing::Mock::VerifyAndClearExpectations(env_.get());
+
+  // One request per consumer, with the quota allocated since the last one.
+  std::vector<AllocateQuotaRequest> requests;
+  ExpectAllocateQuota(2, AllocateQuotaResponse(), &requests);
+  reconcile_();
+  ASSERT_EQ(requests.size(), 2u);
+  std::map<std::string, int64_t> costs;
+  for (const auto& request : requests) {
+    const auto& operation = request.allocate_operation();
+    EXPECT_EQ(operation.quota_mode(),
+              ::google::api::servicecontrol::v1::QuotaOperation::BEST_EFFORT);
+    ASSERT_EQ(operation.quota_metrics_size(), 1);
+    EXPECT_EQ(operation.quota_metrics(0).metric_name(), kQuotaMetric);
+    costs[operation.consumer_id()] =
+        operation.quota_metrics(0).metric_values(0).int64_value();
+  }
+  EXPECT_EQ(costs, (std::map<std::string, int64_t>{{"api_key:key", 8},
+                                                   {"api_key:other", 10}}));
+
+  // Nothing was allocated since.
+  ::testing::Mock::VerifyAndClearExpectations(env_.get());
+  EXPECT_CALL(*env_, DoRunHTTPRequest(_)).Times(0);
+  reconcile_();
+}
+
+TEST_F(AggregatedLocalQuotaTest, ExhaustedUntilServerAllows) {
+  // 10 tokens per millisecond, the buckets refill quickly.
+  CreateLib(600000);
+  EXPECT_TRUE(DoQuota("key", 1).ok());
+
+  std::vector<AllocateQuotaRequest> requests;
+  ExpectAllocateQuota(1, ExhaustedResponse(), &requests);
+  reconcile_();
+  ::testing::Mock::VerifyAndClearExpectations(env_.get());
+
+  // The consumer is denied although its bucket refilled.
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  EXPECT_EQ(DoQuota("key", 1).code(), Code::RESOURCE_EXHAUSTED);
+
+  // The next reconcile only checks the denied quota, the server still
+  // reports it as exhausted.
+  requests.clear();
+  ExpectAllocateQuota(1, ExhaustedResponse(), &requests);
+  reconcile_();
+  ::testing::Mock::VerifyAndClearExpectations(env_.get());
+  ASSERT_EQ(requests.size(), 1u);
+  EXPECT_EQ(requests[0].allocate_operation().quota_mode(),
+            ::google::api::servicecontrol::v1::QuotaOperation::CHECK_ONLY);
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  EXPECT_EQ(DoQuota("key", 1).code(), Code::RESOURCE_EXHAUSTED);
+
+  // The server allows the consumer again.
+  requests.clear();
+  ExpectAllocateQuota(1, AllocateQuotaResponse(), &requests);
+  reconcile_();
+  ::testing::Mock::VerifyAndClearExpectations(env_.get());
+  EXPECT_TRUE(DoQuota("key", 1).ok());
+}
+
+TEST_F(AggregatedLocalQuotaTest, KeyedByConsumerProject) {
+  CreateLib(10);
+  // The API keys of a consumer project share its buckets.
+  EXPECT_TRUE(DoQuota("key1", 10, "project").ok());
+  EXPECT_EQ(DoQuota("key2", 1, "project").code(), Code::RESOURCE_EXHAUSTED);
+  EXPECT_TRUE(DoQuota("key2", 1, "other_project").ok());
+}
+
+TEST_F(AggregatedLocalQuotaTest, LimitDividedAmongProcesses) {
+  EXPECT_CALL(*env_, GetProcessCount()).WillRepeatedly(Return(4));
+  CreateLib(40);
+  EXPECT_TRUE(DoQuota("key", 10).ok());
+  EXPECT_EQ(DoQuota("key", 1).code(), Code::RESOURCE_EXHAUSTED);
+}
+
+TEST(StatisticsTest, ReportSizeBucket) {
+  EXPECT_EQ(Statistics::ReportSizeBucket(0), 0);
+  EXPECT_EQ(Statistics::ReportSizeBucket(16 * 1024 - 1), 0);
+  EXPECT_EQ(Statistics::ReportSizeBucket(16 * 1024), 1);
+  EXPECT_EQ(Statistics::ReportSizeBucket(1024 * 1024 - 1), 3);
+  EXPECT_EQ(Statistics::ReportSizeBucket(1024 * 1024), 4);
+  EXPECT_EQ(Statistics::ReportSizeBucket(4 * 1024 * 1024), 5);
+  EXPECT_EQ(Statistics::ReportSizeBucket(1ull << 40), 5);
+}
+
 class QuotaAllocationTestWithRealClient : public ::testing::Test {
  public:
   void SetUp() {
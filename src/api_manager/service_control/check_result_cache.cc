@@ -0,0 +1,93 @@
+/* Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "src/api_manager/service_control/check_result_cache.h"
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace google {
+namespace api_manager {
+namespace service_control {
+
+CheckResultCache::CheckResultCache(size_t capacity, milliseconds lifetime,
+                                   int refresh_ahead_percent)
+    : capacity_(capacity),
+      lifetime_(lifetime),
+      refresh_delay_(lifetime * (100 - refresh_ahead_percent) / 100),
+      hits_(0),
+      refreshes_(0) {}
+
+CheckResultCache::Result CheckResultCache::Lookup(
+    const std::string& key, const steady_clock::time_point& now,
+    CheckResponseInfo* response_info) {
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    return MISS;
+  }
+  auto entry = it->second;
+  if (now >= entry->expiration) {
+    index_.erase(it);
+    lru_.erase(entry);
+    return MISS;
+  }
+
+  lru_.splice(lru_.begin(), lru_, entry);
+  *response_info = entry->response_info;
+  hits_++;
+  if (entry->refreshing || now < entry->refresh_time) {
+    return HIT;
+  }
+  entry->refreshing = true;
+  refreshes_++;
+  return REFRESH;
+}
+
+void CheckResultCache::Insert(const std::string& key,
+                              const CheckResponseInfo& response_info,
+                              const steady_clock::time_point& now) {
+  if (capacity_ == 0) {
+    return;
+  }
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    lru_.splice(lru_.begin(), lru_, it->second);
+  } else {
+    if (index_.size() >= capacity_) {
+      index_.erase(lru_.back().key);
+      lru_.pop_back();
+    }
+    lru_.emplace_front();
+    lru_.front().key = key;
+    index_[key] = lru_.begin();
+  }
+
+  Entry& entry = lru_.front();
+  entry.response_info = response_info;
+  entry.refresh_time = now + refresh_delay_;
+  entry.expiration = now + lifetime_;
+  entry.refreshing = false;
+}
+
+void CheckResultCache::Remove(const std::string& key) {
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    lru_.erase(it->second);
+    index_.erase(it);
+  }
+}
+
+}  // namespace service_control
+}  // namespace api_manager
+}  // namespace google
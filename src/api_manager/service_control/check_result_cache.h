@@ -0,0 +1,108 @@
+/* Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef API_MANAGER_SERVICE_CONTROL_CHECK_RESULT_CACHE_H_
+#define API_MANAGER_SERVICE_CONTROL_CHECK_RESULT_CACHE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "src/api_manager/service_control/info.h"
+
+namespace google {
+namespace api_manager {
+namespace service_control {
+
+// A LRU cache of the check results accepted by the server, which refreshes
+// them ahead of their expiration.
+//
+// A result is valid for lifetime after it is fetched. A hit in the last
+// refresh_ahead_percent of the lifetime asks the caller to refresh the
+// result in the background while the cached result is used, so the results
+// of the hot API keys are refreshed before they expire.
+//
+// Aggregated owns the cache of its service, so every nginx worker caches and
+// refreshes its own results. Lookup runs on the request path and Insert from
+// the check callbacks, which the worker runs on its event loop; the cache has
+// no lock.
+class CheckResultCache {
+ public:
+  // The result of a lookup.
+  enum Result {
+    // There is no valid result.
+    MISS = 0,
+    // The result is valid.
+    HIT = 1,
+    // The result is valid, and should be refreshed. The caller calls Insert
+    // or Remove when the refresh is done.
+    REFRESH = 2,
+  };
+
+  CheckResultCache(size_t capacity, std::chrono::milliseconds lifetime,
+                   int refresh_ahead_percent);
+
+  // Looks up the result of a key at now, and fills response_info if it is
+  // valid. An expired result is removed. Only one lookup returns REFRESH
+  // until the result is inserted again.
+  Result Lookup(const std::string& key,
+                const std::chrono::steady_clock::time_point& now,
+                CheckResponseInfo* response_info);
+
+  // Inserts the result of a key fetched at now.
+  void Insert(const std::string& key, const CheckResponseInfo& response_info,
+              const std::chrono::steady_clock::time_point& now);
+
+  // Removes the result of a key.
+  void Remove(const std::string& key);
+
+  // Returns the number of cached results.
+  size_t Size() const { return index_.size(); }
+
+  // The number of lookups which returned HIT or REFRESH.
+  uint64_t hits() const { return hits_; }
+  // The number of lookups which returned REFRESH.
+  uint64_t refreshes() const { return refreshes_; }
+
+ private:
+  struct Entry {
+    std::string key;
+    CheckResponseInfo response_info;
+    // When the result is refreshed and when it expires.
+    std::chrono::steady_clock::time_point refresh_time;
+    std::chrono::steady_clock::time_point expiration;
+    // If a refresh is in flight.
+    bool refreshing;
+  };
+
+  const size_t capacity_;
+  const std::chrono::milliseconds lifetime_;
+  // The part of lifetime_ before the refresh.
+  const std::chrono::milliseconds refresh_delay_;
+
+  // The most recently used result is first.
+  std::list<Entry> lru_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+
+  uint64_t hits_;
+  uint64_t refreshes_;
+};
+
+}  // namespace service_control
+}  // namespace api_manager
+}  // namespace google
+
+#endif  // API_MANAGER_SERVICE_CONTROL_CHECK_RESULT_CACHE_H_
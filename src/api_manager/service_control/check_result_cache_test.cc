@@ -0,0 +1,101 @@
+// Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+#include "src/api_manager/service_control/check_result_cache.h"
+
+#include "gtest/gtest.h"
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace google {
+namespace api_manager {
+namespace service_control {
+
+namespace {
+
+CheckResponseInfo ResponseInfo(const std::string& consumer_project_id) {
+  CheckResponseInfo response_info;
+  response_info.consumer_project_id = consumer_project_id;
+  return response_info;
+}
+
+}  // namespace
+
+TEST(CheckResultCacheTest, RefreshAhead) {
+  // The results are refreshed in the last 20% of their 1000 ms lifetime.
+  CheckResultCache cache(10, milliseconds(1000), 20);
+  steady_clock::time_point now = steady_clock::now();
+  CheckResponseInfo response_info;
+
+  EXPECT_EQ(CheckResultCache::MISS, cache.Lookup("key", now, &response_info));
+  cache.Insert("key", ResponseInfo("project"), now);
+
+  EXPECT_EQ(CheckResultCache::HIT,
+            cache.Lookup("key", now + milliseconds(799), &response_info));
+  EXPECT_EQ("project", response_info.consumer_project_id);
+
+  // Only the first hit in the refresh window refreshes the result.
+  EXPECT_EQ(CheckResultCache::REFRESH,
+            cache.Lookup("key", now + milliseconds(800), &response_info));
+  EXPECT_EQ(CheckResultCache::HIT,
+            cache.Lookup("key", now + milliseconds(900), &response_info));
+
+  // The refreshed result is valid for another lifetime.
+  cache.Insert("key", ResponseInfo("refreshed"), now + milliseconds(900));
+  EXPECT_EQ(CheckResultCache::HIT,
+            cache.Lookup("key", now + milliseconds(1500), &response_info));
+  EXPECT_EQ("refreshed", response_info.consumer_project_id);
+  EXPECT_EQ(CheckResultCache::REFRESH,
+            cache.Lookup("key", now + milliseconds(1700), &response_info));
+
+  EXPECT_EQ(5, cache.hits());
+  EXPECT_EQ(2, cache.refreshes());
+}
+
+TEST(CheckResultCacheTest, ExpireAndRemove) {
+  CheckResultCache cache(10, milliseconds(1000), 20);
+  steady_clock::time_point now = steady_clock::now();
+  CheckResponseInfo response_info;
+
+  cache.Insert("key", ResponseInfo("project"), now);
+  EXPECT_EQ(CheckResultCache::MISS,
+            cache.Lookup("key", now + milliseconds(1000), &response_info));
+  EXPECT_EQ(0, cache.Size());
+
+  cache.Insert("key", ResponseInfo("project"), now);
+  cache.Remove("key");
+  EXPECT_EQ(CheckResultCache::MISS, cache.Lookup("key", now, &response_info));
+}
+
+TEST(CheckResultCacheTest, EvictLeastRecentlyUsed) {
+  CheckResultCache cache(2, milliseconds(1000), 20);
+  steady_clock::time_point now = steady_clock::now();
+  CheckResponseInfo response_info;
+
+  cache.Insert("key1", ResponseInfo("project1"), now);
+  cache.Insert("key2", ResponseInfo("project2"), now);
+  EXPECT_EQ(CheckResultCache::HIT, cache.Lookup("key1", now, &response_info));
+  cache.Insert("key3", ResponseInfo("project3"), now);
+
+  EXPECT_EQ(2, cache.Size());
+  EXPECT_EQ(CheckResultCache::HIT, cache.Lookup("key1", now, &response_info));
+  EXPECT_EQ(CheckResultCache::MISS, cache.Lookup("key2", now, &response_info));
+  EXPECT_EQ(CheckResultCache::HIT, cache.Lookup("key3", now, &response_info));
+}
+
+}  // namespace service_control
+}  // namespace api_manager
+}  // namespace google
@@ -0,0 +1,93 @@
+/* Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "src/api_manager/service_control/circuit_breaker.h"
+
+using std::chrono::steady_clock;
+
+namespace google {
+namespace api_manager {
+namespace service_control {
+
+CircuitBreaker::CircuitBreaker(int failure_threshold,
+                               std::chrono::milliseconds open_duration)
+    : failure_threshold_(failure_threshold),
+      open_duration_(open_duration),
+      state_(CLOSED),
+      epoch_(0),
+      failures_(0),
+      opens_(0),
+      rejected_calls_(0) {}
+
+CircuitBreaker::Decision CircuitBreaker::Decide(
+    const steady_clock::time_point& now) {
+  switch (state_) {
+    case CLOSED:
+      return ALLOW;
+    case OPEN:
+      if (now >= probe_time_) {
+        state_ = HALF_OPEN;
+        epoch_++;
+        return PROBE;
+      }
+      break;
+    case HALF_OPEN:
+      break;
+  }
+  rejected_calls_++;
+  return REJECT;
+}
+
+void CircuitBreaker::OnSuccess(uint64_t epoch) {
+  if (epoch != epoch_) {
+    return;
+  }
+  if (state_ != CLOSED) {
+    state_ = CLOSED;
+    epoch_++;
+  }
+  failures_ = 0;
+}
+
+void CircuitBreaker::OnFailure(uint64_t epoch,
+                               const steady_clock::time_point& now) {
+  if (failure_threshold_ <= 0 || epoch != epoch_) {
+    return;
+  }
+  switch (state_) {
+    case CLOSED:
+      if (++failures_ >= failure_threshold_) {
+        Open(now);
+      }
+      break;
+    case OPEN:
+      break;
+    case HALF_OPEN:
+      // The probe failed.
+      Open(now);
+      break;
+  }
+}
+
+void CircuitBreaker::Open(const steady_clock::time_point& now) {
+  state_ = OPEN;
+  epoch_++;
+  failures_ = 0;
+  probe_time_ = now + open_duration_;
+  opens_++;
+}
+
+}  // namespace service_control
+}  // namespace api_manager
+}  // namespace google
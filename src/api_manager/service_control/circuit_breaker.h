@@ -0,0 +1,103 @@
+/* Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef API_MANAGER_SERVICE_CONTROL_CIRCUIT_BREAKER_H_
+#define API_MANAGER_SERVICE_CONTROL_CIRCUIT_BREAKER_H_
+
+#include <chrono>
+#include <cstdint>
+
+namespace google {
+namespace api_manager {
+namespace service_control {
+
+// A circuit breaker of the calls to the service control server.
+//
+// The breaker is closed while the calls succeed. It opens after
+// failure_threshold consecutive failed calls, and then rejects the calls
+// without sending them for open_duration. The first call after that is sent
+// as a probe, the other calls are rejected while it is in flight. The breaker
+// closes if the probe succeeds, and opens again if it fails.
+//
+// Every state change starts a new epoch. A result is recorded with the epoch
+// in which its call was decided, and the results of calls decided before the
+// last state change are ignored, so that a late call cannot close the breaker
+// it did not probe, nor open it again.
+//
+// Aggregated owns one breaker for the check and allocate quota calls of its
+// service. Decide is called when a call is made and the results from the
+// transport callbacks, both on the event loop of the nginx worker, so the
+// breaker has no locking.
+class CircuitBreaker {
+ public:
+  // What to do with a call.
+  enum Decision {
+    // Send the call.
+    ALLOW = 0,
+    // Send the call as the probe of the half open breaker.
+    PROBE = 1,
+    // Do not send the call.
+    REJECT = 2,
+  };
+
+  // Creates a breaker. The breaker is disabled, never opens, if
+  // failure_threshold <= 0.
+  CircuitBreaker(int failure_threshold,
+                 std::chrono::milliseconds open_duration);
+
+  // Returns the decision for a call made at now. The epoch of the call is
+  // epoch() after the decision.
+  Decision Decide(const std::chrono::steady_clock::time_point& now);
+
+  // Records the result of a sent call decided in epoch.
+  void OnSuccess(uint64_t epoch);
+  void OnFailure(uint64_t epoch,
+                 const std::chrono::steady_clock::time_point& now);
+
+  // The current epoch.
+  uint64_t epoch() const { return epoch_; }
+
+  // Returns true if the breaker is open or half open.
+  bool IsOpen() const { return state_ != CLOSED; }
+
+  // The number of times the breaker opened.
+  uint64_t opens() const { return opens_; }
+  // The number of calls which were not sent because the breaker was open.
+  uint64_t rejected_calls() const { return rejected_calls_; }
+
+ private:
+  enum State { CLOSED, OPEN, HALF_OPEN };
+
+  void Open(const std::chrono::steady_clock::time_point& now);
+
+  const int failure_threshold_;
+  const std::chrono::milliseconds open_duration_;
+
+  State state_;
+  // Incremented on every state change.
+  uint64_t epoch_;
+  // The number of consecutive failed calls while closed.
+  int failures_;
+  // When the open breaker sends a probe.
+  std::chrono::steady_clock::time_point probe_time_;
+
+  uint64_t opens_;
+  uint64_t rejected_calls_;
+};
+
+}  // namespace service_control
+}  // namespace api_manager
+}  // namespace google
+
+#endif  // API_MANAGER_SERVICE_CONTROL_CIRCUIT_BREAKER_H_
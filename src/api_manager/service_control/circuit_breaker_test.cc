@@ -0,0 +1,120 @@
+// Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+#include "src/api_manager/service_control/circuit_breaker.h"
+
+#include "gtest/gtest.h"
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace google {
+namespace api_manager {
+namespace service_control {
+
+TEST(CircuitBreakerTest, Disabled) {
+  CircuitBreaker breaker(0, milliseconds(1000));
+  steady_clock::time_point now = steady_clock::now();
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(breaker.Decide(now), CircuitBreaker::ALLOW);
+    breaker.OnFailure(breaker.epoch(), now);
+  }
+  EXPECT_FALSE(breaker.IsOpen());
+  EXPECT_EQ(breaker.opens(), 0u);
+}
+
+TEST(CircuitBreakerTest, OpensAfterConsecutiveFailures) {
+  CircuitBreaker breaker(3, milliseconds(1000));
+  steady_clock::time_point now = steady_clock::now();
+  uint64_t epoch = breaker.epoch();
+  breaker.OnFailure(epoch, now);
+  breaker.OnFailure(epoch, now);
+  // A success resets the failures.
+  breaker.OnSuccess(epoch);
+  breaker.OnFailure(epoch, now);
+  breaker.OnFailure(epoch, now);
+  EXPECT_FALSE(breaker.IsOpen());
+  EXPECT_EQ(breaker.Decide(now), CircuitBreaker::ALLOW);
+
+  breaker.OnFailure(epoch, now);
+  EXPECT_TRUE(breaker.IsOpen());
+  EXPECT_EQ(breaker.opens(), 1u);
+  EXPECT_EQ(breaker.Decide(now + milliseconds(999)), CircuitBreaker::REJECT);
+  EXPECT_EQ(breaker.rejected_calls(), 1u);
+}
+
+TEST(CircuitBreakerTest, ProbeSucceeds) {
+  CircuitBreaker breaker(1, milliseconds(1000));
+  steady_clock::time_point now = steady_clock::now();
+  breaker.OnFailure(breaker.epoch(), now);
+  EXPECT_TRUE(breaker.IsOpen());
+
+  now += milliseconds(1000);
+  EXPECT_EQ(breaker.Decide(now), CircuitBreaker::PROBE);
+  uint64_t probe_epoch = breaker.epoch();
+  // Only one probe is in flight.
+  EXPECT_EQ(breaker.Decide(now), CircuitBreaker::REJECT);
+  EXPECT_TRUE(breaker.IsOpen());
+
+  breaker.OnSuccess(probe_epoch);
+  EXPECT_FALSE(breaker.IsOpen());
+  EXPECT_EQ(breaker.Decide(now), CircuitBreaker::ALLOW);
+}
+
+TEST(CircuitBreakerTest, ProbeFails) {
+  CircuitBreaker breaker(1, milliseconds(1000));
+  steady_clock::time_point now = steady_clock::now();
+  breaker.OnFailure(breaker.epoch(), now);
+
+  now += milliseconds(1000);
+  EXPECT_EQ(breaker.Decide(now), CircuitBreaker::PROBE);
+  breaker.OnFailure(breaker.epoch(), now);
+  EXPECT_TRUE(breaker.IsOpen());
+  EXPECT_EQ(breaker.opens(), 2u);
+  EXPECT_EQ(breaker.Decide(now + milliseconds(999)), CircuitBreaker::REJECT);
+  EXPECT_EQ(breaker.Decide(now + milliseconds(1000)), CircuitBreaker::PROBE);
+}
+
+TEST(CircuitBreakerTest, IgnoresCallsDecidedBeforeStateChange) {
+  CircuitBreaker breaker(2, milliseconds(1000));
+  steady_clock::time_point now = steady_clock::now();
+  EXPECT_EQ(breaker.Decide(now), CircuitBreaker::ALLOW);
+  uint64_t closed_epoch = breaker.epoch();
+  breaker.OnFailure(closed_epoch, now);
+  breaker.OnFailure(closed_epoch, now);
+  EXPECT_TRUE(breaker.IsOpen());
+
+  // A late success of a call made while closed does not close the breaker.
+  breaker.OnSuccess(closed_epoch);
+  EXPECT_TRUE(breaker.IsOpen());
+  EXPECT_EQ(breaker.Decide(now), CircuitBreaker::REJECT);
+
+  now += milliseconds(1000);
+  EXPECT_EQ(breaker.Decide(now), CircuitBreaker::PROBE);
+  uint64_t probe_epoch = breaker.epoch();
+  breaker.OnSuccess(probe_epoch);
+  EXPECT_FALSE(breaker.IsOpen());
+
+  // Late failures of calls made before the probe do not open it again.
+  breaker.OnFailure(closed_epoch, now);
+  breaker.OnFailure(closed_epoch, now);
+  breaker.OnFailure(probe_epoch, now);
+  EXPECT_FALSE(breaker.IsOpen());
+  EXPECT_EQ(breaker.opens(), 1u);
+}
+
+}  // namespace service_control
+}  // namespace api_manager
+}  // namespace google
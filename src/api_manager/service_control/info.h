@@ -101,6 +101,15 @@ struct QuotaRequestInfo : public OperationInfo {
   std::string method_name;
 
   const std::vector<std::pair<std::string, int>>* metric_cost_vector;
+
+  // The consumer project returned by the check of the request, empty if it
+  // is unknown.
+  std::string consumer_project_id;
+
+  // If true, only checks that the quota is available without allocating it.
+  bool check_only;
+
+  QuotaRequestInfo() : metric_cost_vector(nullptr), check_only(false) {}
 };
 
 // Information to fill Report request protobuf.
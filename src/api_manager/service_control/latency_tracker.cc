@@ -0,0 +1,57 @@
+/* Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "src/api_manager/service_control/latency_tracker.h"
+
+#include <algorithm>
+
+using std::chrono::milliseconds;
+
+namespace google {
+namespace api_manager {
+namespace service_control {
+
+const size_t LatencyTracker::kWindowSize;
+const size_t LatencyTracker::kRefreshSamples;
+
+LatencyTracker::LatencyTracker() : next_(0), recorded_(0) {
+  window_.reserve(kWindowSize);
+}
+
+void LatencyTracker::Record(milliseconds latency) {
+  if (window_.size() < kWindowSize) {
+    window_.push_back(latency);
+  } else {
+    window_[next_] = latency;
+    next_ = (next_ + 1) % kWindowSize;
+  }
+
+  if (++recorded_ >= kRefreshSamples) {
+    sorted_ = window_;
+    std::sort(sorted_.begin(), sorted_.end());
+    recorded_ = 0;
+  }
+}
+
+milliseconds LatencyTracker::Percentile(double percentile) const {
+  if (sorted_.empty()) {
+    return milliseconds(0);
+  }
+  size_t index = static_cast<size_t>(percentile / 100 * sorted_.size());
+  return sorted_[std::min(index, sorted_.size() - 1)];
+}
+
+}  // namespace service_control
+}  // namespace api_manager
+}  // namespace google
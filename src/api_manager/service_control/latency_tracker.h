@@ -0,0 +1,65 @@
+/* Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef API_MANAGER_SERVICE_CONTROL_LATENCY_TRACKER_H_
+#define API_MANAGER_SERVICE_CONTROL_LATENCY_TRACKER_H_
+
+#include <chrono>
+#include <vector>
+
+namespace google {
+namespace api_manager {
+namespace service_control {
+
+// Tracks the latencies of the recent calls of a type to estimate their
+// percentiles. The percentiles are read from a sorted copy of the recent
+// latencies, which is refreshed every kRefreshSamples latencies, so reading
+// them is cheap.
+//
+// Aggregated keeps a tracker per call type. Record is called from the
+// transport callback of a call and Percentile when the next call decides its
+// hedge delay, both on the event loop of the nginx worker.
+class LatencyTracker {
+ public:
+  LatencyTracker();
+
+  // Records the latency of a call.
+  void Record(std::chrono::milliseconds latency);
+
+  // Returns the percentile, in [0, 100], of the recent latencies. Returns 0
+  // until kRefreshSamples latencies are recorded.
+  std::chrono::milliseconds Percentile(double percentile) const;
+
+  // The number of recent latencies kept.
+  static const size_t kWindowSize = 256;
+  // The number of recorded latencies between the refreshes of the sorted
+  // latencies.
+  static const size_t kRefreshSamples = 32;
+
+ private:
+  // The recent latencies, a ring buffer once it has kWindowSize latencies.
+  std::vector<std::chrono::milliseconds> window_;
+  // The index of the oldest latency in the full window_.
+  size_t next_;
+  // The number of latencies recorded since the last refresh.
+  size_t recorded_;
+  // The sorted copy of window_ at the last refresh.
+  std::vector<std::chrono::milliseconds> sorted_;
+};
+
+}  // namespace service_control
+}  // namespace api_manager
+}  // namespace google
+
+#endif  // API_MANAGER_SERVICE_CONTROL_LATENCY_TRACKER_H_
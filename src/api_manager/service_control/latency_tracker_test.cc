@@ -0,0 +1,65 @@
+// Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+#include "src/api_manager/service_control/latency_tracker.h"
+
+#include "gtest/gtest.h"
+
+using std::chrono::milliseconds;
+
+namespace google {
+namespace api_manager {
+namespace service_control {
+
+TEST(LatencyTrackerTest, NotEnoughSamples) {
+  LatencyTracker tracker;
+  for (size_t i = 1; i < LatencyTracker::kRefreshSamples; i++) {
+    tracker.Record(milliseconds(i));
+  }
+  EXPECT_EQ(tracker.Percentile(50), milliseconds(0));
+  tracker.Record(milliseconds(LatencyTracker::kRefreshSamples));
+  EXPECT_NE(tracker.Percentile(50), milliseconds(0));
+}
+
+TEST(LatencyTrackerTest, Percentiles) {
+  LatencyTracker tracker;
+  // Latencies 1 to 100 ms, in a shuffled order.
+  for (int i = 0; i < 100; i++) {
+    tracker.Record(milliseconds((i * 37) % 100 + 1));
+  }
+  // 128 latencies in total, the sorted copy is refreshed with all of them.
+  for (int i = 0; i < 28; i++) {
+    tracker.Record(milliseconds(1000));
+  }
+  EXPECT_EQ(tracker.Percentile(0), milliseconds(1));
+  EXPECT_EQ(tracker.Percentile(50), milliseconds(65));
+  EXPECT_EQ(tracker.Percentile(100), milliseconds(1000));
+}
+
+TEST(LatencyTrackerTest, OldLatenciesAreDropped) {
+  LatencyTracker tracker;
+  for (size_t i = 0; i < LatencyTracker::kWindowSize; i++) {
+    tracker.Record(milliseconds(1000));
+  }
+  EXPECT_EQ(tracker.Percentile(0), milliseconds(1000));
+  for (size_t i = 0; i < LatencyTracker::kWindowSize; i++) {
+    tracker.Record(milliseconds(1));
+  }
+  EXPECT_EQ(tracker.Percentile(100), milliseconds(1));
+}
+
+}  // namespace service_control
+}  // namespace api_manager
+}  // namespace google
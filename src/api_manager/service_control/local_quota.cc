@@ -0,0 +1,150 @@
+/* Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "src/api_manager/service_control/local_quota.h"
+
+#include <algorithm>
+
+using std::chrono::steady_clock;
+
+namespace google {
+namespace api_manager {
+namespace service_control {
+
+LocalQuota::LocalQuota() : allowed_(0), denied_(0) {}
+
+void LocalQuota::AddLimit(const std::string& metric,
+                          int64_t tokens_per_minute) {
+  if (tokens_per_minute <= 0) {
+    return;
+  }
+  Limit limit;
+  limit.capacity = static_cast<double>(tokens_per_minute);
+  limit.rate = limit.capacity / 60;
+
+  auto it = metric_limits_.find(metric);
+  if (it != metric_limits_.end()) {
+    limits_[it->second] = limit;
+    return;
+  }
+  metric_limits_[metric] = limits_.size();
+  limits_.push_back(limit);
+  // The buckets of the existing consumers do not have the new limit.
+  consumers_.clear();
+}
+
+double LocalQuota::Refill(const Limit& limit, Bucket* bucket,
+                          const steady_clock::time_point& now) {
+  if (now > bucket->updated) {
+    std::chrono::duration<double> elapsed = now - bucket->updated;
+    bucket->tokens =
+        std::min(limit.capacity, bucket->tokens + elapsed.count() * limit.rate);
+    bucket->updated = now;
+  }
+  return bucket->tokens;
+}
+
+LocalQuota::Decision LocalQuota::Allocate(
+    const std::string& consumer,
+    const std::vector<std::pair<std::string, int>>& costs,
+    const steady_clock::time_point& now) {
+  request_costs_.clear();
+  for (const auto& cost : costs) {
+    auto it = metric_limits_.find(cost.first);
+    if (it != metric_limits_.end()) {
+      request_costs_.emplace_back(it->second,
+                                  cost.second <= 0 ? 1 : cost.second);
+    }
+  }
+  if (request_costs_.empty()) {
+    return UNLIMITED;
+  }
+
+  Consumer& state = consumers_[consumer];
+  if (state.exhausted) {
+    denied_++;
+    return DENY;
+  }
+  std::vector<Bucket>& buckets = state.buckets;
+  if (buckets.empty()) {
+    buckets.resize(limits_.size());
+    for (size_t i = 0; i < limits_.size(); i++) {
+      buckets[i].tokens = limits_[i].capacity;
+      buckets[i].updated = now;
+    }
+  }
+
+  // A metric may have several costs, sum them before checking its bucket.
+  std::sort(request_costs_.begin(), request_costs_.end());
+  size_t i = 0;
+  while (i < request_costs_.size()) {
+    size_t index = request_costs_[i].first;
+    int64_t cost = 0;
+    for (; i < request_costs_.size() && request_costs_[i].first == index; i++) {
+      cost += request_costs_[i].second;
+    }
+    if (Refill(limits_[index], &buckets[index], now) < cost) {
+      denied_++;
+      return DENY;
+    }
+  }
+
+  for (const auto& cost : request_costs_) {
+    buckets[cost.first].tokens -= cost.second;
+  }
+  allowed_++;
+  return ALLOW;
+}
+
+void LocalQuota::Exhaust(const std::string& consumer,
+                         const steady_clock::time_point& now) {
+  Consumer& state = consumers_[consumer];
+  state.exhausted = true;
+  state.buckets.resize(limits_.size());
+  for (Bucket& bucket : state.buckets) {
+    bucket.tokens = 0;
+    bucket.updated = now;
+  }
+}
+
+void LocalQuota::Restore(const std::string& consumer) {
+  auto it = consumers_.find(consumer);
+  if (it != consumers_.end()) {
+    it->second.exhausted = false;
+  }
+}
+
+bool LocalQuota::IsExhausted(const std::string& consumer) const {
+  auto it = consumers_.find(consumer);
+  return it != consumers_.end() && it->second.exhausted;
+}
+
+void LocalQuota::Sweep(const steady_clock::time_point& now) {
+  for (auto it = consumers_.begin(); it != consumers_.end();) {
+    bool full = !it->second.exhausted;
+    for (size_t i = 0; i < limits_.size() && full; i++) {
+      full = Refill(limits_[i], &it->second.buckets[i], now) >=
+             limits_[i].capacity;
+    }
+    if (full) {
+      it = consumers_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+}  // namespace service_control
+}  // namespace api_manager
+}  // namespace google
@@ -0,0 +1,136 @@
+/* Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef API_MANAGER_SERVICE_CONTROL_LOCAL_QUOTA_H_
+#define API_MANAGER_SERVICE_CONTROL_LOCAL_QUOTA_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace google {
+namespace api_manager {
+namespace service_control {
+
+// Enforces the quota limits of the consumers locally with token buckets.
+//
+// Each consumer has a bucket per limited metric. A bucket holds up to the
+// per minute limit of its metric, and is refilled continuously at that rate.
+// The buckets of a new consumer start full. A request is allowed if the
+// buckets of all its limited metrics hold its costs, which are then taken
+// from them. The caller reconciles the allocated tokens with the server. A
+// consumer the server reports as exhausted is denied, whatever its buckets
+// hold, until the server allows it again.
+//
+// Aggregated owns the buckets of its service in each nginx worker, the
+// workers do not share them. Allocate runs on the request path, Exhaust and
+// Sweep when the allocations are reconciled from the worker timer, so the
+// buckets are only touched by the event loop of the worker.
+class LocalQuota {
+ public:
+  // The decision for a request.
+  enum Decision {
+    // None of the metrics of the request is limited.
+    UNLIMITED = 0,
+    // The costs of the request were taken from the buckets.
+    ALLOW = 1,
+    // A bucket does not hold the cost of the request.
+    DENY = 2,
+  };
+
+  LocalQuota();
+
+  // Adds the limit of a metric, in tokens per minute. Limits <= 0 are
+  // ignored.
+  void AddLimit(const std::string& metric, int64_t tokens_per_minute);
+
+  // Returns true if a metric is limited.
+  bool HasLimits() const { return !limits_.empty(); }
+
+  // Returns the decision for a request of a consumer made at now with the
+  // metric costs. Costs <= 0 count as 1, like in the allocate quota requests.
+  Decision Allocate(const std::string& consumer,
+                    const std::vector<std::pair<std::string, int>>& costs,
+                    const std::chrono::steady_clock::time_point& now);
+
+  // Empties the buckets of a consumer, and denies its requests until Restore
+  // is called.
+  void Exhaust(const std::string& consumer,
+               const std::chrono::steady_clock::time_point& now);
+
+  // Allows the requests of an exhausted consumer again. Its buckets refill
+  // from the time they were emptied.
+  void Restore(const std::string& consumer);
+
+  // Returns true if the consumer is exhausted.
+  bool IsExhausted(const std::string& consumer) const;
+
+  // Removes the buckets of the consumers which are not exhausted and whose
+  // buckets are full again at now, a new consumer starts with the same
+  // buckets.
+  void Sweep(const std::chrono::steady_clock::time_point& now);
+
+  // Returns the number of consumers with buckets.
+  size_t consumers() const { return consumers_.size(); }
+
+  // The number of requests allowed and denied locally.
+  uint64_t allowed() const { return allowed_; }
+  uint64_t denied() const { return denied_; }
+
+ private:
+  struct Limit {
+    // The bucket size.
+    double capacity;
+    // The refill rate per second.
+    double rate;
+  };
+
+  struct Bucket {
+    double tokens;
+    std::chrono::steady_clock::time_point updated;
+  };
+
+  struct Consumer {
+    Consumer() : exhausted(false) {}
+
+    // The buckets, indexed like limits_.
+    std::vector<Bucket> buckets;
+    bool exhausted;
+  };
+
+  // Refills a bucket of limit until now, and returns its tokens.
+  static double Refill(const Limit& limit, Bucket* bucket,
+                       const std::chrono::steady_clock::time_point& now);
+
+  std::vector<Limit> limits_;
+  // The index in limits_ by metric.
+  std::unordered_map<std::string, size_t> metric_limits_;
+  std::unordered_map<std::string, Consumer> consumers_;
+
+  // The costs of the request being allocated, by index in limits_, reused
+  // to avoid allocations.
+  std::vector<std::pair<size_t, int64_t>> request_costs_;
+
+  uint64_t allowed_;
+  uint64_t denied_;
+};
+
+}  // namespace service_control
+}  // namespace api_manager
+}  // namespace google
+
+#endif  // API_MANAGER_SERVICE_CONTROL_LOCAL_QUOTA_H_
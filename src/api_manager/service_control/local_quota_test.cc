@@ -0,0 +1,124 @@
+// Copyright (C) Extensible Service Proxy Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+#include "src/api_manager/service_control/local_quota.h"
+
+#include "gtest/gtest.h"
+
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+using std::chrono::steady_clock;
+
+namespace google {
+namespace api_manager {
+namespace service_control {
+
+namespace {
+
+const char kReadMetric[] = "test.googleapis.com/read";
+const char kWriteMetric[] = "test.googleapis.com/write";
+
+}  // namespace
+
+TEST(LocalQuotaTest, Unlimited) {
+  LocalQuota quota;
+  EXPECT_FALSE(quota.HasLimits());
+  quota.AddLimit(kReadMetric, 0);
+  EXPECT_FALSE(quota.HasLimits());
+
+  quota.AddLimit(kReadMetric, 60);
+  EXPECT_TRUE(quota.HasLimits());
+  EXPECT_EQ(LocalQuota::UNLIMITED,
+            quota.Allocate("key", {{kWriteMetric, 1}}, steady_clock::now()));
+  EXPECT_EQ(0u, quota.consumers());
+}
+
+TEST(LocalQuotaTest, AllocateAndRefill) {
+  LocalQuota quota;
+  quota.AddLimit(kReadMetric, 60);
+  steady_clock::time_point now = steady_clock::now();
+
+  // A new consumer starts with a full bucket.
+  EXPECT_EQ(LocalQuota::ALLOW,
+            quota.Allocate("key", {{kReadMetric, 50}}, now));
+  EXPECT_EQ(LocalQuota::ALLOW,
+            quota.Allocate("key", {{kReadMetric, 10}}, now));
+  EXPECT_EQ(LocalQuota::DENY, quota.Allocate("key", {{kReadMetric, 1}}, now));
+  // The other consumers have their own buckets.
+  EXPECT_EQ(LocalQuota::ALLOW,
+            quota.Allocate("other", {{kReadMetric, 1}}, now));
+
+  // The bucket is refilled by 1 token per second.
+  EXPECT_EQ(LocalQuota::DENY,
+            quota.Allocate("key", {{kReadMetric, 2}}, now + seconds(1)));
+  EXPECT_EQ(LocalQuota::ALLOW,
+            quota.Allocate("key", {{kReadMetric, 2}}, now + seconds(2)));
+
+  EXPECT_EQ(4u, quota.allowed());
+  EXPECT_EQ(2u, quota.denied());
+}
+
+TEST(LocalQuotaTest, AllMetricsMustHoldTheCosts) {
+  LocalQuota quota;
+  quota.AddLimit(kReadMetric, 100);
+  quota.AddLimit(kWriteMetric, 10);
+  steady_clock::time_point now = steady_clock::now();
+
+  // Costs <= 0 count as 1.
+  EXPECT_EQ(LocalQuota::ALLOW,
+            quota.Allocate("key", {{kReadMetric, 0}, {kWriteMetric, 9}}, now));
+  // The write bucket only holds 1 token, no token is taken.
+  EXPECT_EQ(LocalQuota::DENY,
+            quota.Allocate("key", {{kReadMetric, 50}, {kWriteMetric, 2}}, now));
+  // The costs of a metric are summed.
+  EXPECT_EQ(LocalQuota::DENY,
+            quota.Allocate("key", {{kWriteMetric, 1}, {kWriteMetric, 1}}, now));
+  EXPECT_EQ(LocalQuota::ALLOW,
+            quota.Allocate("key", {{kReadMetric, 99}, {kWriteMetric, 1}}, now));
+}
+
+TEST(LocalQuotaTest, ExhaustAndSweep) {
+  LocalQuota quota;
+  quota.AddLimit(kReadMetric, 60);
+  steady_clock::time_point now = steady_clock::now();
+
+  EXPECT_EQ(LocalQuota::ALLOW, quota.Allocate("key", {{kReadMetric, 1}}, now));
+  EXPECT_EQ(LocalQuota::ALLOW,
+            quota.Allocate("other", {{kReadMetric, 1}}, now));
+  quota.Exhaust("key", now);
+  EXPECT_TRUE(quota.IsExhausted("key"));
+  EXPECT_EQ(LocalQuota::DENY, quota.Allocate("key", {{kReadMetric, 1}}, now));
+
+  // The bucket of "other" is full again after 1 second.
+  quota.Sweep(now + milliseconds(1500));
+  EXPECT_EQ(1u, quota.consumers());
+  // An exhausted consumer is kept and denied, even with a full bucket.
+  quota.Sweep(now + seconds(60));
+  EXPECT_EQ(1u, quota.consumers());
+  EXPECT_EQ(LocalQuota::DENY,
+            quota.Allocate("key", {{kReadMetric, 1}}, now + seconds(60)));
+
+  // The bucket refilled since it was emptied.
+  quota.Restore("key");
+  EXPECT_FALSE(quota.IsExhausted("key"));
+  EXPECT_EQ(LocalQuota::ALLOW,
+            quota.Allocate("key", {{kReadMetric, 30}}, now + seconds(30)));
+  quota.Sweep(now + seconds(90));
+  EXPECT_EQ(0u, quota.consumers());
+}
+
+}  // namespace service_control
+}  // namespace api_manager
+}  // namespace google
@@ -20,7 +20,9 @@
 
 #include <time.h>
 #include <uuid/uuid.h>
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 
 #include "google/api/metric.pb.h"
 #include "google/protobuf/timestamp.pb.h"
@@ -28,7 +30,6 @@
 #include "include/api_manager/utils/version.h"
 #include "src/api_manager/auth/lib/auth_token.h"
 #include "src/api_manager/auth/lib/base64.h"
-#include "utils/distribution_helper.h"
 
 using ::google::api::servicecontrol::v1::CheckError;
 using ::google::api::servicecontrol::v1::QuotaError;
@@ -45,7 +46,6 @@ using ::google::protobuf::Map;
 using ::google::protobuf::StringPiece;
 using ::google::protobuf::Timestamp;
 using ::google::protobuf::util::error::Code;
-using ::google::service_control_client::DistributionHelper;
 
 namespace google {
 namespace api_manager {
@@ -80,6 +80,10 @@ struct SupportedLabel {
                 Map<std::string, std::string>* labels);
 
   bool by_consumer_only;
+
+  // The value does not depend on the request, it is rendered once when the
+  // report plans are built.
+  bool is_constant;
 };
 
 namespace {
@@ -98,29 +102,72 @@ void AddInt64Metric(const char* metric_name, int64_t value,
   metric_value->set_int64_value(value);
 }
 
-// The parameters to initialize DistributionHelper
-struct DistributionHelperOptions {
-  int buckets;
-  double growth;
-  double scale;
+// The exponential buckets of a distribution metric, with the same layout as
+// DistributionHelper::InitExponential: bucket 0 is the underflow bucket,
+// bucket i in [1, buckets] holds [scale * growth^(i-1), scale * growth^i),
+// and bucket buckets + 1 is the overflow bucket.
+// The constants of the layout are computed once, and the distribution of a
+// sample is filled directly in the metric value, instead of building a
+// distribution with DistributionHelper and copying it for every sample.
+// Merging the distributions of aggregated operations is left to the report
+// aggregator of the service control client.
+class ExponentialBuckets {
+ public:
+  ExponentialBuckets(int buckets, double growth, double scale)
+      : buckets_(buckets),
+        growth_(growth),
+        scale_(scale),
+        log_growth_(std::log(growth)) {}
+
+  // Sets distribution to the distribution of a single sample.
+  void SetSample(double value, Distribution* distribution) const {
+    distribution->set_count(1);
+    distribution->set_mean(value);
+    distribution->set_minimum(value);
+    distribution->set_maximum(value);
+    distribution->set_sum_of_squared_deviation(0);
+
+    Distribution::ExponentialBuckets* exponential =
+        distribution->mutable_exponential_buckets();
+    exponential->set_num_finite_buckets(buckets_);
+    exponential->set_growth_factor(growth_);
+    exponential->set_scale(scale_);
+
+    auto* counts = distribution->mutable_bucket_counts();
+    counts->Resize(buckets_ + 2, 0);
+    counts->Set(BucketIndex(value), 1);
+  }
+
+ private:
+  int BucketIndex(double value) const {
+    if (!(value >= scale_)) return 0;
+    int index;
+    if (growth_ == 2.0) {
+      // value / scale_ is in [2^(exponent - 1), 2^exponent).
+      std::frexp(value / scale_, &index);
+    } else {
+      // The same computation as DistributionHelper, so that the samples on
+      // a bucket boundary fall in the same bucket.
+      index = 1 + static_cast<int>(std::log(value / scale_) / log_growth_);
+    }
+    return std::min(index, buckets_ + 1);
+  }
+
+  int buckets_;
+  double growth_;
+  double scale_;
+  double log_growth_;
 };
 
-const DistributionHelperOptions time_distribution = {29, 2.0, 1e-6};
-const DistributionHelperOptions size_distribution = {8, 10.0, 1};
+const ExponentialBuckets time_distribution(29, 2.0, 1e-6);
+const ExponentialBuckets size_distribution(8, 10.0, 1);
 const double kMsToSecs = 1e-3;
 
-Status AddDistributionMetric(const DistributionHelperOptions& options,
+Status AddDistributionMetric(const ExponentialBuckets& buckets,
                              const char* metric_name, double value,
                              Operation* operation) {
   MetricValue* metric_value = AddMetricValue(metric_name, operation);
-  Distribution distribution;
-  ::google::protobuf::util::Status proto_status =
-      DistributionHelper::InitExponential(options.buckets, options.growth,
-                                          options.scale, &distribution);
-  if (!proto_status.ok()) return Status::FromProto(proto_status);
-  proto_status = DistributionHelper::AddSample(value, &distribution);
-  if (!proto_status.ok()) return Status::FromProto(proto_status);
-  *metric_value->mutable_distribution_value() = distribution;
+  buckets.SetSample(value, metric_value->mutable_distribution_value());
   return Status::OK;
 }
 
@@ -791,12 +838,12 @@ const SupportedLabel supported_labels[] = {
     {
         kServiceControlServiceAgent,
         ::google::api::LabelDescriptor_ValueType_STRING, SupportedLabel::SYSTEM,
-        set_service_agent, false,
+        set_service_agent, false, true,
     },
     {
         kServiceControlUserAgent,
         ::google::api::LabelDescriptor_ValueType_STRING, SupportedLabel::SYSTEM,
-        set_user_agent, false,
+        set_user_agent, false, true,
     },
     {
         kServiceControlPlatform,
@@ -974,6 +1021,20 @@ std::vector<const Element*> FilterPointers(
   return filtered;
 }
 
+// Returns true if the metric is reported in the report phase.
+bool IsMetricInReportPhase(const SupportedMetric* m, bool is_first_report,
+                           bool is_final_report) {
+  return (is_first_report && m->tag == SupportedMetric::START) ||
+         (is_final_report && (m->tag == SupportedMetric::FINAL ||
+                              m->tag == SupportedMetric::INTERMEDIATE)) ||
+         (!is_final_report && m->tag == SupportedMetric::INTERMEDIATE);
+}
+
+// Returns the index of the report phase in the report plans.
+int ReportPhase(bool is_first_report, bool is_final_report) {
+  return (is_first_report ? 1 : 0) | (is_final_report ? 2 : 0);
+}
+
 }  // namespace
 
 Proto::Proto(const std::set<std::string>& logs, const std::string& service_name,
@@ -986,7 +1047,9 @@ Proto::Proto(const std::set<std::string>& logs, const std::string& service_name,
           supported_labels, supported_labels + supported_labels_count,
           [](const struct SupportedLabel* l) { return l->set != nullptr; })),
       service_name_(service_name),
-      service_config_id_(service_config_id) {}
+      service_config_id_(service_config_id) {
+  BuildReportPlans();
+}
 
 Proto::Proto(const std::set<std::string>& logs,
              const std::set<std::string>& metrics,
@@ -1006,7 +1069,72 @@ Proto::Proto(const std::set<std::string>& logs,
                               labels.find(l->name) != labels.end());
           })),
       service_name_(service_name),
-      service_config_id_(service_config_id) {}
+      service_config_id_(service_config_id) {
+  BuildReportPlans();
+}
+
+void Proto::BuildReportPlans() {
+  for (int phase = 0; phase < kReportPhases; phase++) {
+    bool is_first_report = phase & ReportPhase(true, false);
+    bool is_final_report = phase & ReportPhase(false, true);
+
+    for (int consumer = 0; consumer < 2; consumer++) {
+      ReportPlan& plan = report_plans_[phase][consumer];
+      AddLabelsToPlan(false, &plan);
+      for (const SupportedMetric* m : metrics_) {
+        if ((consumer || m->mark != SupportedMetric::CONSUMER) &&
+            m->mark != SupportedMetric::PRODUCER_BY_CONSUMER &&
+            IsMetricInReportPhase(m, is_first_report, is_final_report)) {
+          plan.metrics.push_back(m);
+        }
+      }
+    }
+
+    ReportPlan& plan = by_consumer_report_plans_[phase];
+    AddLabelsToPlan(true, &plan);
+    for (const SupportedMetric* m : metrics_) {
+      if (m->mark == SupportedMetric::PRODUCER_BY_CONSUMER &&
+          IsMetricInReportPhase(m, is_first_report, is_final_report)) {
+        plan.metrics.push_back(m);
+      }
+    }
+  }
+}
+
+void Proto::AddLabelsToPlan(bool by_consumer, ReportPlan* plan) {
+  for (const SupportedLabel* l : labels_) {
+    if (l->by_consumer_only && !by_consumer) {
+      continue;
+    }
+    if (l->is_constant) {
+      Map<std::string, std::string> labels;
+      (l->set)(*l, ReportRequestInfo(), &labels);
+      for (const auto& label : labels) {
+        plan->constant_labels.emplace_back(label.first, label.second);
+      }
+    } else {
+      plan->labels.push_back(l);
+    }
+  }
+}
+
+Status Proto::RunReportPlan(const ReportPlan& plan,
+                            const ReportRequestInfo& info, Operation* op) {
+  Map<std::string, std::string>* labels = op->mutable_labels();
+  for (const auto& label : plan.constant_labels) {
+    (*labels)[label.first] = label.second;
+  }
+  for (const SupportedLabel* l : plan.labels) {
+    Status status = (l->set)(*l, info, labels);
+    if (!status.ok()) return status;
+  }
+
+  for (const SupportedMetric* m : plan.metrics) {
+    Status status = (m->set)(*m, info, op);
+    if (!status.ok()) return status;
+  }
+  return Status::OK;
+}
 
 utils::Status Proto::FillAllocateQuotaRequest(
     const QuotaRequestInfo& info,
@@ -1038,8 +1166,11 @@ utils::Status Proto::FillAllocateQuotaRequest(
 
   // allocate_operation.quota_mode
   operation->set_quota_mode(
-      ::google::api::servicecontrol::v1::QuotaOperation_QuotaMode::
-          QuotaOperation_QuotaMode_BEST_EFFORT);
+      info.check_only
+          ? ::google::api::servicecontrol::v1::QuotaOperation_QuotaMode::
+                QuotaOperation_QuotaMode_CHECK_ONLY
+          : ::google::api::servicecontrol::v1::QuotaOperation_QuotaMode::
+                QuotaOperation_QuotaMode_BEST_EFFORT);
 
   // allocate_operation.labels
   auto* labels = operation->mutable_labels();
@@ -1120,16 +1251,6 @@ Status Proto::FillReportRequest(const ReportRequestInfo& info,
 
   // Only populate metrics if we can associate them with a method/operation.
   if (!info.operation_id.empty() && !info.operation_name.empty()) {
-    Map<std::string, std::string>* labels = op->mutable_labels();
-    // Set all labels with by_consumer_only is false
-    for (auto it = labels_.begin(), end = labels_.end(); it != end; it++) {
-      const SupportedLabel* l = *it;
-      if (l->set && !l->by_consumer_only) {
-        status = (l->set)(*l, info, labels);
-        if (!status.ok()) return status;
-      }
-    }
-
     // Not to send consumer metrics if api_key is empty.
     // api_key is empty in one of following cases:
     // 1) api_key is not provided,
@@ -1137,23 +1258,13 @@ Status Proto::FillReportRequest(const ReportRequestInfo& info,
     // 3) the service is not activated for the consumer project.
     bool send_consumer_metric = !info.api_key.empty();
 
-    // Populate all metrics.
-    for (auto it = metrics_.begin(), end = metrics_.end(); it != end; it++) {
-      const SupportedMetric* m = *it;
-      if (send_consumer_metric || m->mark != SupportedMetric::CONSUMER) {
-        if (m->set && m->mark != SupportedMetric::PRODUCER_BY_CONSUMER) {
-          if ((info.is_first_report && m->tag == SupportedMetric::START) ||
-              (info.is_final_report &&
-               (m->tag == SupportedMetric::FINAL ||
-                m->tag == SupportedMetric::INTERMEDIATE)) ||
-              (!info.is_final_report &&
-               m->tag == SupportedMetric::INTERMEDIATE)) {
-            status = (m->set)(*m, info, op);
-            if (!status.ok()) return status;
-          }
-        }
-      }
-    }
+    // Set all labels with by_consumer_only is false, and the metrics of the
+    // report phase.
+    status = RunReportPlan(
+        report_plans_[ReportPhase(info.is_first_report, info.is_final_report)]
+                     [send_consumer_metric ? 1 : 0],
+        info, op);
+    if (!status.ok()) return status;
   }
 
   // Fill log entries.
@@ -1181,31 +1292,12 @@ utils::Status Proto::AppendByConsumerOperations(
 
   // Only populate metrics if we can associate them with a method/operation.
   if (!info.operation_id.empty() && !info.operation_name.empty()) {
-    Map<std::string, std::string>* labels = op->mutable_labels();
-    // Set all labels.
-    for (auto it = labels_.begin(), end = labels_.end(); it != end; it++) {
-      const SupportedLabel* l = *it;
-      if (l->set) {
-        Status status = (l->set)(*l, info, labels);
-        if (!status.ok()) return status;
-      }
-    }
-
-    // Populate all metrics.
-    for (auto it = metrics_.begin(), end = metrics_.end(); it != end; it++) {
-      const SupportedMetric* m = *it;
-      if (m->set && m->mark == SupportedMetric::PRODUCER_BY_CONSUMER) {
-        if ((info.is_first_report && m->tag == SupportedMetric::START) ||
-            (info.is_final_report &&
-             (m->tag == SupportedMetric::FINAL ||
-              m->tag == SupportedMetric::INTERMEDIATE)) ||
-            (!info.is_final_report &&
-             m->tag == SupportedMetric::INTERMEDIATE)) {
-          Status status = (m->set)(*m, info, op);
-          if (!status.ok()) return status;
-        }
-      }
-    }
+    // Set all labels, and the by consumer metrics of the report phase.
+    Status status = RunReportPlan(
+        by_consumer_report_plans_[ReportPhase(info.is_first_report,
+                                              info.is_final_report)],
+        info, op);
+    if (!status.ok()) return status;
   }
 
   return Status::OK;
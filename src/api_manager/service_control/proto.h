@@ -87,11 +87,43 @@ class Proto final {
   const std::string& service_config_id() const { return service_config_id_; }
 
  private:
+  // The labels and metrics to set on a report operation. They are selected
+  // from labels_ and metrics_ for each report phase when Proto is created,
+  // so filling a report only runs their setters.
+  struct ReportPlan {
+    // The labels whose values do not depend on the request, pre-rendered.
+    std::vector<std::pair<std::string, std::string>> constant_labels;
+    std::vector<const struct SupportedLabel*> labels;
+    std::vector<const struct SupportedMetric*> metrics;
+  };
+
+  // The number of report phases, the combinations of is_first_report and
+  // is_final_report.
+  static const int kReportPhases = 4;
+
+  // Builds report_plans_ and by_consumer_report_plans_.
+  void BuildReportPlans();
+
+  // Adds the labels of an operation to a plan. The labels with
+  // by_consumer_only are only added to the by consumer operations.
+  void AddLabelsToPlan(bool by_consumer, ReportPlan* plan);
+
+  // Sets the labels and metrics of a plan on an operation.
+  static utils::Status RunReportPlan(
+      const ReportPlan& plan, const ReportRequestInfo& info,
+      ::google::api::servicecontrol::v1::Operation* op);
+
   const std::vector<std::string> logs_;
   const std::vector<const struct SupportedMetric*> metrics_;
   const std::vector<const struct SupportedLabel*> labels_;
   const std::string service_name_;
   const std::string service_config_id_;
+
+  // The plans of the operations by report phase, and whether consumer
+  // metrics are sent.
+  ReportPlan report_plans_[kReportPhases][2];
+  // The plans of the by consumer operations by report phase.
+  ReportPlan by_consumer_report_plans_[kReportPhases];
 };
 
 }  // namespace service_control
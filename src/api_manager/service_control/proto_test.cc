@@ -20,15 +20,18 @@
 #include <assert.h>
 #include <fstream>
 #include <string>
+#include <vector>
 
 #include "google/protobuf/struct.pb.h"
 #include "google/protobuf/text_format.h"
 #include "include/api_manager/utils/version.h"
+#include "utils/distribution_helper.h"
 
 namespace gasv1 = ::google::api::servicecontrol::v1;
 using ::google::api_manager::utils::Status;
 using ::google::protobuf::util::error::Code;
 using ::google::protobuf::Timestamp;
+using ::google::service_control_client::DistributionHelper;
 
 namespace google {
 namespace api_manager {
@@ -143,6 +146,26 @@ std::string ReportRequestToString(gasv1::ReportRequest* request) {
   return text;
 }
 
+// Returns the distribution of the metric of the first operation.
+const gasv1::Distribution& GetDistribution(const gasv1::ReportRequest& request,
+                                           const std::string& metric_name) {
+  for (const auto& value_set : request.operations(0).metric_value_sets()) {
+    if (value_set.metric_name() == metric_name) {
+      return value_set.metric_values(0).distribution_value();
+    }
+  }
+  ADD_FAILURE() << "Missing metric " << metric_name;
+  return gasv1::Distribution::default_instance();
+}
+
+// Returns the bucket of the single sample of the distribution.
+int SampleBucket(const gasv1::Distribution& distribution) {
+  for (int i = 0; i < distribution.bucket_counts_size(); i++) {
+    if (distribution.bucket_counts(i) > 0) return i;
+  }
+  return -1;
+}
+
 class ProtoTest : public ::testing::Test {
  protected:
   ProtoTest() : scp_({"local_test_log"}, "test_service", "2016-09-19r0") {}
@@ -276,6 +299,50 @@ TEST_F(ProtoTest, FillGoodReportRequestTest) {
   ASSERT_EQ(expected_text, text);
 }
 
+TEST_F(ProtoTest, DistributionBucketsMatchDistributionHelper) {
+  // The time distribution grows by 2, the size distribution by 10. Both
+  // have samples in the underflow, the finite and the overflow buckets, and
+  // on the bucket boundaries of the size distribution.
+  std::vector<int64_t> values = {
+      0,      1,       7,       10,      99,       100,       1000,
+      1023,   1024,    4096,    12345,   100000,   536870,    536871,
+      1000000, 10000000, 99999999, 100000000, 1000000000};
+  for (int64_t value : values) {
+    ReportRequestInfo info;
+    FillOperationInfo(&info);
+    FillReportRequestInfo(&info);
+    info.latency.request_time_ms = value;
+    info.request_size = value;
+
+    gasv1::ReportRequest request;
+    ASSERT_TRUE(scp_.FillReportRequest(info, &request).ok());
+
+    gasv1::Distribution expected_time;
+    ASSERT_TRUE(
+        DistributionHelper::InitExponential(29, 2.0, 1e-6, &expected_time)
+            .ok());
+    ASSERT_TRUE(DistributionHelper::AddSample(value * 1e-3, &expected_time)
+                    .ok());
+    const gasv1::Distribution& time = GetDistribution(
+        request, "serviceruntime.googleapis.com/api/producer/total_latencies");
+    EXPECT_EQ(SampleBucket(expected_time), SampleBucket(time))
+        << "request_time_ms: " << value;
+    EXPECT_EQ(expected_time.SerializeAsString(), time.SerializeAsString())
+        << "request_time_ms: " << value;
+
+    gasv1::Distribution expected_size;
+    ASSERT_TRUE(
+        DistributionHelper::InitExponential(8, 10.0, 1, &expected_size).ok());
+    ASSERT_TRUE(DistributionHelper::AddSample(value, &expected_size).ok());
+    const gasv1::Distribution& size = GetDistribution(
+        request, "serviceruntime.googleapis.com/api/producer/request_sizes");
+    EXPECT_EQ(SampleBucket(expected_size), SampleBucket(size))
+        << "request_size: " << value;
+    EXPECT_EQ(expected_size.SerializeAsString(), size.SerializeAsString())
+        << "request_size: " << value;
+  }
+}
+
 TEST_F(ProtoTest, FillGoodReportRequestByConsumerTest) {
   ReportRequestInfo info;
   FillOperationInfo(&info);
@@ -75,6 +75,27 @@ TEST(UrlTest, ServerControlOverride) {
             url.service_control());
 }
 
+TEST(UrlTest, GrpcServer) {
+  std::unique_ptr<ApiManagerEnvInterface> env(
+      new ::testing::NiceMock<MockApiManagerEnvironmentWithLog>());
+  std::unique_ptr<Config> config(
+      Config::Create(env.get(), prepend_https_config, ""));
+  ASSERT_TRUE(config);
+  Url url(&config->service(), config->server_config());
+  ASSERT_EQ("servicecontrol.googleapis.com:443", url.grpc_server());
+  ASSERT_TRUE(url.grpc_use_ssl());
+
+  config = Config::Create(env.get(), prepend_https_config, R"(
+service_control_config {
+  url_override: "http://127.0.0.1:8081/"
+}
+)");
+  ASSERT_TRUE(config);
+  Url local_url(&config->service(), config->server_config());
+  ASSERT_EQ("127.0.0.1:8081", local_url.grpc_server());
+  ASSERT_FALSE(local_url.grpc_use_ssl());
+}
+
 }  // namespace
 
 }  // namespace service_control
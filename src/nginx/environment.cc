@@ -26,7 +26,9 @@
 //
 #include "src/nginx/environment.h"
 
+#include "src/nginx/grpc_client_call.h"
 #include "src/nginx/http.h"
+#include "src/nginx/shared_cache.h"
 #include "src/nginx/util.h"
 
 #include <stdexcept>
@@ -108,7 +110,27 @@ void NgxEspEnv::RunHTTPRequest(std::unique_ptr<HTTPRequest> request) {
   ngx_esp_send_http_request(std::move(request));
 }
 
-void NgxEspEnv::RunGRPCRequest(std::unique_ptr<GRPCRequest> request) {}
+void NgxEspEnv::RunGRPCRequest(std::unique_ptr<GRPCRequest> request) {
+  ngx_esp_send_grpc_request(std::move(request));
+}
+
+bool NgxEspEnv::SharedCacheLookup(
+    const std::string &key, std::string *value,
+    std::chrono::system_clock::time_point *expiration) {
+  return ngx_esp_shared_cache_lookup(key, value, expiration);
+}
+
+void NgxEspEnv::SharedCacheInsert(
+    const std::string &key, const std::string &value,
+    std::chrono::system_clock::time_point expiration) {
+  ngx_esp_shared_cache_insert(key, value, expiration);
+}
+
+int NgxEspEnv::GetProcessCount() {
+  auto *ccf = reinterpret_cast<ngx_core_conf_t *>(
+      ngx_get_conf(ngx_cycle->conf_ctx, ngx_core_module));
+  return ccf->worker_processes > 0 ? ccf->worker_processes : 1;
+}
 
 }  // namespace nginx
 }  // namespace api_manager
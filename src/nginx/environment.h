@@ -55,6 +55,16 @@ class NgxEspEnv : public ApiManagerEnvInterface {
 
   virtual void RunGRPCRequest(std::unique_ptr<GRPCRequest> request);
 
+  virtual bool SharedCacheLookup(
+      const std::string &key, std::string *value,
+      std::chrono::system_clock::time_point *expiration);
+
+  virtual void SharedCacheInsert(
+      const std::string &key, const std::string &value,
+      std::chrono::system_clock::time_point expiration);
+
+  virtual int GetProcessCount();
+
  private:
   ngx_log_t *log_;
 };
@@ -47,6 +47,11 @@ const ngx_str_t kContentTypeApplicationGrpc = ngx_string("application/grpc");
 const ngx_str_t kContentTypeApplicationGrpcProto =
     ngx_string("application/grpc+proto");
 
+// A channel argument set to the index of the channel in its pool. GRPC
+// shares the connections of the channels with identical arguments, so the
+// index gives each channel of the pool its own connection.
+const char kGrpcChannelIndexArg[] = "esp.channel_index";
+
 std::pair<Status, std::string> GrpcGetBackendAddress(
     ngx_log_t *log, ngx_esp_loc_conf_t *espcf, ngx_esp_request_ctx_t *ctx) {
   if (espcf->grpc_backend_address_override.data &&
@@ -76,6 +81,50 @@ std::pair<Status, std::string> GrpcGetBackendAddress(
       Status(NGX_DECLINED, "No GRPC backend address specified"), std::string());
 }
 
+// Returns the arguments of the channel at index in the pool of a backend.
+::grpc::ChannelArguments GrpcGetChannelArguments(ngx_esp_loc_conf_t *espcf,
+                                                 ngx_int_t index) {
+  ::grpc::ChannelArguments channel_arguments;
+
+  channel_arguments.SetMaxReceiveMessageSize(INT_MAX);
+  channel_arguments.SetMaxSendMessageSize(INT_MAX);
+
+  if (espcf->grpc_keepalive_time != NGX_CONF_UNSET_MSEC) {
+    channel_arguments.SetInt(GRPC_ARG_KEEPALIVE_TIME_MS,
+                             espcf->grpc_keepalive_time);
+  }
+  if (espcf->grpc_keepalive_timeout != NGX_CONF_UNSET_MSEC) {
+    channel_arguments.SetInt(GRPC_ARG_KEEPALIVE_TIMEOUT_MS,
+                             espcf->grpc_keepalive_timeout);
+  }
+  if (espcf->grpc_stream_window_size != NGX_CONF_UNSET_SIZE) {
+    channel_arguments.SetInt(GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES,
+                             espcf->grpc_stream_window_size);
+  }
+  if (espcf->grpc_channels > 1) {
+    channel_arguments.SetInt(kGrpcChannelIndexArg, index);
+  }
+
+  return channel_arguments;
+}
+
+// Returns the stub of the pool with the fewest calls in flight; each call
+// in flight holds a reference to its stub.  Equal loads are broken round
+// robin.
+std::shared_ptr<::grpc::GenericStub> GrpcSelectStub(
+    ngx_esp_grpc_stub_pool_t *pool) {
+  size_t count = pool->stubs.size();
+  size_t best = pool->next % count;
+  for (size_t i = 1; i < count; i++) {
+    size_t candidate = (pool->next + i) % count;
+    if (pool->stubs[candidate].use_count() < pool->stubs[best].use_count()) {
+      best = candidate;
+    }
+  }
+  pool->next = best + 1;
+  return pool->stubs[best];
+}
+
 std::pair<Status, std::shared_ptr<::grpc::GenericStub>> GrpcGetStub(
     ngx_http_request_t *r, ngx_esp_loc_conf_t *espcf,
     ngx_esp_request_ctx_t *ctx) {
@@ -90,27 +139,26 @@ std::pair<Status, std::shared_ptr<::grpc::GenericStub>> GrpcGetStub(
                 "GrpcGetStub: connecting to backend=%s", address.c_str());
 
   auto it = espcf->grpc_stubs.find(address);
-  if (it != espcf->grpc_stubs.end()) {
-    return std::make_pair(Status::OK, it->second);
-  }
-
-  ::grpc::ChannelArguments channel_arguments;
-
-  channel_arguments.SetMaxReceiveMessageSize(INT_MAX);
-  channel_arguments.SetMaxSendMessageSize(INT_MAX);
-
-  auto result =
-      std::make_shared<::grpc::GenericStub>(::grpc::CreateCustomChannel(
-          address, ::grpc::InsecureChannelCredentials(), channel_arguments));
-
-  if (result) {
-    espcf->grpc_stubs.emplace(address, result);
-    return std::make_pair(Status::OK, result);
+  if (it == espcf->grpc_stubs.end()) {
+    ngx_esp_grpc_stub_pool_t pool;
+    pool.next = 0;
+    for (ngx_int_t i = 0; i < espcf->grpc_channels; i++) {
+      auto stub =
+          std::make_shared<::grpc::GenericStub>(::grpc::CreateCustomChannel(
+              address, ::grpc::InsecureChannelCredentials(),
+              GrpcGetChannelArguments(espcf, i)));
+      if (!stub) {
+        return std::make_pair(
+            Status(NGX_HTTP_INTERNAL_SERVER_ERROR,
+                   "Unable to create channel to GRPC backend"),
+            std::shared_ptr<::grpc::GenericStub>());
+      }
+      pool.stubs.push_back(std::move(stub));
+    }
+    it = espcf->grpc_stubs.emplace(address, std::move(pool)).first;
   }
 
-  return std::make_pair(Status(NGX_HTTP_INTERNAL_SERVER_ERROR,
-                               "Unable to create channel to GRPC backend"),
-                        std::shared_ptr<::grpc::GenericStub>());
+  return std::make_pair(Status::OK, GrpcSelectStub(&it->second));
 }
 
 std::multimap<std::string, std::string> ExtractMetadata(ngx_http_request_t *r) {
@@ -0,0 +1,215 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/nginx/grpc_client_call.h"
+
+#include <climits>
+
+#include <grpc++/generic/generic_stub.h>
+#include <grpc++/grpc++.h>
+#include <grpc/slice.h>
+
+#include "src/nginx/grpc_queue.h"
+#include "src/nginx/module.h"
+
+using ::google::api_manager::utils::Status;
+
+namespace google {
+namespace api_manager {
+namespace nginx {
+
+namespace {
+
+// A unary call made with the generic stub: the request is written as the
+// last message, then the response is read and the call is finished. All the
+// steps run on the nginx main thread.
+class GrpcClientCall : public std::enable_shared_from_this<GrpcClientCall> {
+ public:
+  GrpcClientCall(std::shared_ptr<NgxEspGrpcQueue> queue,
+                 std::shared_ptr<::grpc::GenericStub> stub,
+                 std::unique_ptr<GRPCRequest> request)
+      : queue_(queue),
+        stub_(stub),
+        request_(std::move(request)),
+        has_response_(false) {}
+
+  // Starts the call.
+  void Start();
+
+ private:
+  void WriteRequest();
+  void ReadResponse();
+  void FinishCall();
+  void Complete();
+
+  std::shared_ptr<NgxEspGrpcQueue> queue_;
+  std::shared_ptr<::grpc::GenericStub> stub_;
+  std::unique_ptr<GRPCRequest> request_;
+
+  ::grpc::ClientContext context_;
+  std::unique_ptr<::grpc::GenericClientAsyncReaderWriter> call_;
+  ::grpc::ByteBuffer request_buffer_;
+  ::grpc::ByteBuffer response_buffer_;
+  // True if the response message has been read.
+  bool has_response_;
+  ::grpc::Status status_;
+};
+
+void GrpcClientCall::Start() {
+  if (request_->timeout_ms() > 0) {
+    context_.set_deadline(std::chrono::system_clock::now() +
+                          std::chrono::milliseconds(request_->timeout_ms()));
+  }
+  if (!request_->auth_token().empty()) {
+    context_.AddMetadata("authorization", "Bearer " + request_->auth_token());
+  }
+
+  // The slice references the body, which lives as long as the call.
+  ::grpc::Slice slice(
+      grpc_slice_from_static_buffer(request_->body().data(),
+                                    request_->body().size()),
+      ::grpc::Slice::STEAL_REF);
+  request_buffer_ = ::grpc::ByteBuffer(&slice, 1);
+
+  // The completion is delivered on the nginx main thread after this
+  // function returns, so call_ is set by then.
+  auto self = shared_from_this();
+  call_ = stub_->Call(&context_,
+                      "/" + request_->service() + "/" + request_->method(),
+                      queue_->GetQueue(), queue_->MakeTag([self](bool ok) {
+                        if (ok) {
+                          self->WriteRequest();
+                        } else {
+                          self->FinishCall();
+                        }
+                      }));
+}
+
+void GrpcClientCall::WriteRequest() {
+  auto self = shared_from_this();
+  call_->Write(request_buffer_, ::grpc::WriteOptions().set_last_message(),
+               queue_->MakeTag([self](bool ok) {
+                 if (ok) {
+                   self->ReadResponse();
+                 } else {
+                   self->FinishCall();
+                 }
+               }));
+}
+
+void GrpcClientCall::ReadResponse() {
+  auto self = shared_from_this();
+  call_->Read(&response_buffer_, queue_->MakeTag([self](bool ok) {
+                self->has_response_ = ok;
+                self->FinishCall();
+              }));
+}
+
+void GrpcClientCall::FinishCall() {
+  auto self = shared_from_this();
+  call_->Finish(&status_,
+                queue_->MakeTag([self](bool ok) { self->Complete(); }));
+}
+
+void GrpcClientCall::Complete() {
+  if (!status_.ok()) {
+    request_->OnComplete(Status(status_.error_code(), status_.error_message(),
+                                Status::SERVICE_CONTROL),
+                         std::string());
+    return;
+  }
+  if (!has_response_) {
+    request_->OnComplete(Status(::grpc::StatusCode::INTERNAL,
+                                "Missing response message",
+                                Status::SERVICE_CONTROL),
+                         std::string());
+    return;
+  }
+
+  std::string body;
+  std::vector<::grpc::Slice> slices;
+  response_buffer_.Dump(&slices);
+  for (const auto &slice : slices) {
+    body.append(reinterpret_cast<const char *>(slice.begin()), slice.size());
+  }
+  request_->OnComplete(Status::OK, std::move(body));
+}
+
+// Returns the queue of the worker process, initializing it on first use.
+std::shared_ptr<NgxEspGrpcQueue> GetGrpcQueue(ngx_cycle_t *cycle,
+                                              ngx_esp_main_conf_t *mc) {
+  if (!mc->grpc_queue) {
+    mc->grpc_queue = NgxEspGrpcQueue::Instance();
+    mc->grpc_queue->Init(cycle, mc->grpc_queues);
+  }
+  return mc->grpc_queue;
+}
+
+// Returns the stub of the channel to the server of a request, creating the
+// channel on first use.
+std::shared_ptr<::grpc::GenericStub> GetGrpcStub(ngx_esp_main_conf_t *mc,
+                                                 const GRPCRequest &request) {
+  std::string key =
+      (request.use_ssl() ? "https://" : "http://") + request.server();
+  auto it = mc->grpc_client_stubs.find(key);
+  if (it != mc->grpc_client_stubs.end()) {
+    return it->second;
+  }
+
+  ::grpc::ChannelArguments channel_arguments;
+  channel_arguments.SetMaxReceiveMessageSize(INT_MAX);
+  channel_arguments.SetMaxSendMessageSize(INT_MAX);
+
+  auto credentials =
+      request.use_ssl()
+          ? ::grpc::SslCredentials(::grpc::SslCredentialsOptions())
+          : ::grpc::InsecureChannelCredentials();
+  auto stub = std::make_shared<::grpc::GenericStub>(::grpc::CreateCustomChannel(
+      request.server(), credentials, channel_arguments));
+  mc->grpc_client_stubs.emplace(key, stub);
+  return stub;
+}
+
+}  // namespace
+
+void ngx_esp_send_grpc_request(std::unique_ptr<GRPCRequest> request) {
+  ngx_cycle_t *cycle = const_cast<ngx_cycle_t *>(ngx_cycle);
+  ngx_esp_main_conf_t *mc = reinterpret_cast<ngx_esp_main_conf_t *>(
+      ngx_http_cycle_get_module_main_conf(cycle, ngx_esp_module));
+  if (mc == nullptr) {
+    request->OnComplete(Status(NGX_ERROR, "Missing ESP configuration"),
+                        std::string());
+    return;
+  }
+
+  auto queue = GetGrpcQueue(cycle, mc);
+  auto stub = GetGrpcStub(mc, *request);
+  std::make_shared<GrpcClientCall>(queue, stub, std::move(request))->Start();
+}
+
+}  // namespace nginx
+}  // namespace api_manager
+}  // namespace google
@@ -33,9 +33,12 @@
 #include "grpc++/support/byte_buffer.h"
 #include "src/nginx/error.h"
 #include "src/nginx/grpc_finish.h"
+#include "src/nginx/module.h"
 #include "src/nginx/util.h"
 
 extern "C" {
+#include "src/core/lib/compression/message_compress.h"
+#include "src/core/lib/iomgr/exec_ctx.h"
 #include "src/http/v2/ngx_http_v2_module.h"
 }
 
@@ -46,6 +49,37 @@ namespace nginx {
 namespace {
 const ngx_str_t kContentTypeApplicationGrpc = ngx_string("application/grpc");
 
+u_char kGrpcAcceptEncoding[] = "grpc-accept-encoding";
+const char kGrpcEncoding[] = "grpc-encoding";
+
+// The response compression algorithms, by order of preference.
+const grpc_compression_algorithm kResponseCompressionAlgorithms[] = {
+    GRPC_COMPRESS_GZIP, GRPC_COMPRESS_DEFLATE,
+};
+
+// Returns true if a comma separated list of encodings contains an encoding.
+bool HasEncoding(const ngx_str_t &encodings, const char *encoding) {
+  size_t len = ngx_strlen(encoding);
+  u_char *p = encodings.data;
+  u_char *end = encodings.data + encodings.len;
+  while (p < end) {
+    while (p < end && (*p == ' ' || *p == ',')) {
+      p++;
+    }
+    u_char *token = p;
+    while (p < end && *p != ',' && *p != ' ') {
+      p++;
+    }
+    if (static_cast<size_t>(p - token) == len &&
+        ngx_strncasecmp(token, reinterpret_cast<u_char *>(
+                                   const_cast<char *>(encoding)),
+                        len) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 // Deletes GRPC objects.
 //
 // This is used (instead of specializing std::default_deleter<>) in
@@ -61,13 +95,16 @@ struct GrpcDeleter {
 
 NgxEspGrpcPassThroughServerCall::NgxEspGrpcPassThroughServerCall(
     ngx_http_request_t *r)
-    : NgxEspGrpcServerCall(r, false) {}
+    : NgxEspGrpcServerCall(r, false),
+      response_compression_(GRPC_COMPRESS_NONE),
+      response_compression_min_length_(0) {}
 
 utils::Status NgxEspGrpcPassThroughServerCall::Create(
     ngx_http_request_t *r,
     std::shared_ptr<NgxEspGrpcPassThroughServerCall> *out) {
   std::shared_ptr<NgxEspGrpcPassThroughServerCall> call(
       new NgxEspGrpcPassThroughServerCall(r));
+  call->NegotiateResponseCompression();
   auto status = call->ProcessPrereadRequestBody();
 
   if (!status.ok()) {
@@ -118,6 +155,7 @@ bool NgxEspGrpcPassThroughServerCall::ConvertRequestBody(
 
 bool NgxEspGrpcPassThroughServerCall::ConvertResponseMessage(
     const ::grpc::ByteBuffer &msg, ngx_chain_t *out) {
+  static grpc_exec_ctx exec_ctx = GRPC_EXEC_CTX_INIT;
   grpc_byte_buffer *grpc_msg = nullptr;
   bool own_buffer;
 
@@ -133,6 +171,22 @@ bool NgxEspGrpcPassThroughServerCall::ConvertResponseMessage(
     msg_deleter.reset(grpc_msg);
   }
 
+  grpc_slice_buffer *payload = &grpc_msg->data.raw.slice_buffer;
+  bool compressed = grpc_msg->data.raw.compression != GRPC_COMPRESS_NONE;
+
+  // Compress the message if the client accepts it and it is large
+  // enough.  grpc_msg_compress() returns 0 (and a copy of the message)
+  // if the message does not shrink; it is then sent as is.
+  grpc_slice_buffer compressed_payload;
+  grpc_slice_buffer_init(&compressed_payload);
+  if (!compressed && response_compression_ != GRPC_COMPRESS_NONE &&
+      payload->length >= response_compression_min_length_ &&
+      grpc_msg_compress(&exec_ctx, response_compression_, payload,
+                        &compressed_payload) == 1) {
+    payload = &compressed_payload;
+    compressed = true;
+  }
+
   // Since there's no good way to reuse the underlying grpc_slice for
   // the nginx buffer, we need to allocate an nginx buffer and copy
   // the data into it.
@@ -140,7 +194,7 @@ bool NgxEspGrpcPassThroughServerCall::ConvertResponseMessage(
 
   // Get the length of the actual message.  N.B. This is the
   // *compressed* length.
-  size_t msglen = grpc_byte_buffer_length(grpc_msg);
+  size_t msglen = payload->length;
   buflen += msglen;
 
   // Allocate the chain link and buffer.
@@ -149,6 +203,7 @@ bool NgxEspGrpcPassThroughServerCall::ConvertResponseMessage(
     ngx_log_error(
         NGX_LOG_ERR, r_->connection->log, 0,
         "Failed to allocate response buffer header for GRPC response message.");
+    grpc_slice_buffer_destroy(&compressed_payload);
     return false;
   }
   buf->last_in_chain = 1;
@@ -157,7 +212,7 @@ bool NgxEspGrpcPassThroughServerCall::ConvertResponseMessage(
   out->buf = buf;
 
   // Write the 'compressed' flag.
-  *buf->last++ = (grpc_msg->data.raw.compression == GRPC_COMPRESS_NONE ? 0 : 1);
+  *buf->last++ = compressed ? 1 : 0;
 
   // Write the message length: four bytes, big-endian.
   // TODO: We should fail if asked to forward a message with length > uint32_max
@@ -171,16 +226,47 @@ bool NgxEspGrpcPassThroughServerCall::ConvertResponseMessage(
   buf->last += 4;
 
   // Fill in the message.
-  for (size_t sln = 0; sln < grpc_msg->data.raw.slice_buffer.count; sln++) {
-    grpc_slice *slice = grpc_msg->data.raw.slice_buffer.slices + sln;
+  for (size_t sln = 0; sln < payload->count; sln++) {
+    grpc_slice *slice = payload->slices + sln;
     ngx_memcpy(buf->last, GRPC_SLICE_START_PTR(*slice),
                GRPC_SLICE_LENGTH(*slice));
     buf->last += GRPC_SLICE_LENGTH(*slice);
   }
 
+  grpc_slice_buffer_destroy(&compressed_payload);
   return true;
 }
 
+void NgxEspGrpcPassThroughServerCall::NegotiateResponseCompression() {
+  ngx_esp_loc_conf_t *lc = reinterpret_cast<ngx_esp_loc_conf_t *>(
+      ngx_http_get_module_loc_conf(r_, ngx_esp_module));
+  if (!lc->grpc_response_compression) {
+    return;
+  }
+
+  ngx_table_elt_t *header = ngx_esp_find_headers_in(
+      r_, kGrpcAcceptEncoding, sizeof(kGrpcAcceptEncoding) - 1);
+  if (header == nullptr) {
+    return;
+  }
+
+  for (grpc_compression_algorithm algorithm : kResponseCompressionAlgorithms) {
+    const char *name = nullptr;
+    if (grpc_compression_algorithm_name(algorithm, &name) &&
+        HasEncoding(header->value, name)) {
+      ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r_->connection->log, 0,
+                     "NgxEspGrpcPassThroughServerCall: compressing the "
+                     "response messages with %s",
+                     name);
+      response_compression_ = algorithm;
+      response_compression_min_length_ =
+          lc->grpc_response_compression_min_length;
+      AddInitialMetadata(kGrpcEncoding, name);
+      return;
+    }
+  }
+}
+
 grpc_slice NgxEspGrpcPassThroughServerCall::GrpcSliceFromNginxBuffer(
     ngx_buf_t *buf) {
   if (!ngx_buf_in_memory(buf) && buf->file) {
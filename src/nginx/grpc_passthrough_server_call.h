@@ -35,6 +35,7 @@ extern "C" {
 }
 
 #include "grpc++/support/byte_buffer.h"
+#include "grpc/compression.h"
 #include "include/api_manager/utils/status.h"
 #include "src/nginx/grpc_server_call.h"
 
@@ -77,6 +78,16 @@ class NgxEspGrpcPassThroughServerCall : public NgxEspGrpcServerCall {
   virtual bool ConvertRequestBody(std::vector<grpc_slice>* out);
   virtual bool ConvertResponseMessage(const ::grpc::ByteBuffer& msg,
                                       ngx_chain_t* out);
+
+  // Chooses the compression of the response messages from the location
+  // config and the grpc-accept-encoding header of the request, and adds the
+  // grpc-encoding response header if they are compressed.
+  void NegotiateResponseCompression();
+
+  // The compression of the response messages.
+  grpc_compression_algorithm response_compression_;
+  // The minimum size of a compressed response message.
+  size_t response_compression_min_length_;
 };
 
 }  // namespace nginx
@@ -55,9 +55,11 @@ namespace nginx {
 // IO completes.  And because nginx is relatively portable, it's able
 // to do this with an OS-agnostic interface.
 //
-// This code runs a separate libgrpc processing thread, pulling events
-// from a ::grpc::CompletionQueue and donating cycles to libgrpc in
-// the process.  As events are pulled, the thread casts their tags to
+// This code runs separate libgrpc processing threads, each pulling
+// events from its own ::grpc::CompletionQueue and donating cycles to
+// libgrpc in the process.  The calls are spread across the queues,
+// so a worker with many streaming calls is not limited to one core
+// for their events.  As events are pulled, the thread casts their tags to
 // NgxEspGrpcQueue::Tag* objects, and queues them back to the nginx
 // main thread, which then calls them.  This has the effect of
 // synchronizing those callbacks with the other work being done on the
@@ -80,9 +82,9 @@ namespace nginx {
 // reference to it.
 //
 // When the last shared_ptr<> to the instance is destroyed,
-// NgxEspGrpcQueue's destructor will shut down the ::grpc::CompletionQueue,
-// and then join with the queue processing thread.  Libgrpc will
-// continue supplying events to the thread until the queue is clear;
+// NgxEspGrpcQueue's destructor will shut down the ::grpc::CompletionQueues,
+// and then join with the queue processing threads.  Libgrpc will
+// continue supplying events to a thread until its queue is clear;
 // then, the queue will return a shutdown event, and the thread will
 // exit, allowing the destructor to proceed to completion.
 //
@@ -110,8 +112,30 @@ std::shared_ptr<NgxEspGrpcQueue> NgxEspGrpcQueue::TryInstance() {
   return instance.lock();
 }
 
-void NgxEspGrpcQueue::Init(ngx_cycle_t *cycle) {
+void NgxEspGrpcQueue::Init(ngx_cycle_t *cycle, int num_queues) {
   ngx_notify_init(&notify_, NginxTagHandler, cycle);
+
+  // Init() can be called repeatedly.
+  if (!pollers_.empty()) {
+    return;
+  }
+  if (num_queues < 1) {
+    num_queues = 1;
+  }
+  for (int i = 0; i < num_queues; i++) {
+    std::unique_ptr<Poller> poller(new Poller);
+    poller->cq.reset(new ::grpc::CompletionQueue());
+    poller->thread =
+        std::thread(&NgxEspGrpcQueue::WorkerThread, this, poller->cq.get());
+    pollers_.push_back(std::move(poller));
+  }
+}
+
+::grpc::CompletionQueue *NgxEspGrpcQueue::GetQueue() {
+  if (next_poller_ >= pollers_.size()) {
+    next_poller_ = 0;
+  }
+  return pollers_[next_poller_++]->cq.get();
 }
 
 // Runs GRPC event callbacks on the main nginx thread.
@@ -122,34 +146,35 @@ void NgxEspGrpcQueue::NginxTagHandler(ngx_event_t *) {
   }
 }
 
-void NgxEspGrpcQueue::WorkerThread(NgxEspGrpcQueue *queue) {
+void NgxEspGrpcQueue::WorkerThread(NgxEspGrpcQueue *queue,
+                                   ::grpc::CompletionQueue *cq) {
   void *tag;
   bool ok;
-  while (queue->cq_->Next(&tag, &ok)) {
-    std::unique_ptr<Tag> cb(static_cast<Tag *>(tag));
+  while (cq->Next(&tag, &ok)) {
+    Tag *cb = static_cast<Tag *>(tag);
     if (cb) {
-      bool notify_nginx = false;
-      {
-        std::lock_guard<std::mutex> lock(queue->mu_);
-        queue->pending_.emplace_back(Finalizer{std::move(cb), ok});
-        if (!queue->notified_) {
-          notify_nginx = true;
-          queue->notified_ = true;
-        }
-      }
-      if (notify_nginx) {
+      cb->ok_ = ok;
+      // The nginx main thread is notified once for all the tags
+      // completed before it takes them.
+      if (queue->PushCompleted(cb)) {
         ngx_notify(&queue->notify_);
       }
     }
   }
 }
 
+bool NgxEspGrpcQueue::PushCompleted(Tag *tag) {
+  Tag *head = completed_.load(std::memory_order_relaxed);
+  do {
+    tag->next_ = head;
+  } while (!completed_.compare_exchange_weak(
+      head, tag, std::memory_order_release, std::memory_order_relaxed));
+  return head == nullptr;
+}
+
 void NgxEspGrpcQueue::Deleter(NgxEspGrpcQueue *lib) { delete lib; }
 
-NgxEspGrpcQueue::NgxEspGrpcQueue()
-    : cq_(new ::grpc::CompletionQueue()), notified_(false) {
-  worker_thread_ = std::thread(&NgxEspGrpcQueue::WorkerThread, this);
-}
+NgxEspGrpcQueue::NgxEspGrpcQueue() : completed_(nullptr), next_poller_(0) {}
 
 NgxEspGrpcQueue::~NgxEspGrpcQueue() {
   // N.B. At this point, we expect that all components have
@@ -165,31 +190,50 @@ NgxEspGrpcQueue::~NgxEspGrpcQueue() {
   //
   // If this happens, this code handles them correctly, by:
   //
-  //   * Shutting down the queue
+  //   * Shutting down the queues
   //
-  //   * Waiting for the queue to drain (i.e. waiting for the event
-  //     worker thread to dequeue all pending tags and exit)
+  //   * Waiting for the queues to drain (i.e. waiting for the event
+  //     worker threads to dequeue all pending tags and exit)
   //
   //   * Ignoring the outstanding events as they may try to enqueue
-  //     new events, which is dangerous as the completion queue
-  //     has been shut down.
+  //     new events, which is dangerous as the completion queues
+  //     have been shut down.
+
+  for (auto &poller : pollers_) {
+    poller->cq->Shutdown();
+  }
 
-  cq_->Shutdown();
+  // N.B. Joining on the worker threads is essential, as they maintain
+  // raw pointers to this datastructure.
+  for (auto &poller : pollers_) {
+    poller->thread.join();
+  }
 
-  // N.B. Joining on the worker thread is essential, as that thread
-  // maintains a raw pointer to this datastructure.
-  worker_thread_.join();
+  Tag *tag = completed_.exchange(nullptr);
+  while (tag) {
+    Tag *next = tag->next_;
+    delete tag;
+    tag = next;
+  }
 }
 
 void NgxEspGrpcQueue::DrainPending() {
-  std::deque<Finalizer> pending;
-  {
-    std::lock_guard<std::mutex> lock(mu_);
-    pending.swap(pending_);
-    notified_ = false;
+  Tag *head = completed_.exchange(nullptr, std::memory_order_acquire);
+
+  // The list starts with the last completed tag, reverse it to run the
+  // callbacks in the completion order.
+  Tag *pending = nullptr;
+  while (head) {
+    Tag *next = head->next_;
+    head->next_ = pending;
+    pending = head;
+    head = next;
   }
-  for (auto &it : pending) {
-    (*it.callback)(it.success);
+
+  while (pending) {
+    std::unique_ptr<Tag> cb(pending);
+    pending = pending->next_;
+    (*cb)(cb->ok_);
   }
 }
 
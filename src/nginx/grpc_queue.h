@@ -26,9 +26,10 @@
 #ifndef NGINX_NGX_ESP_GRPC_QUEUE_H_
 #define NGINX_NGX_ESP_GRPC_QUEUE_H_
 
-#include <deque>
+#include <atomic>
 #include <memory>
 #include <thread>
+#include <vector>
 
 #include <grpc++/grpc++.h>
 
@@ -70,11 +71,14 @@ class NgxEspGrpcQueue : public AsyncGrpcQueue {
     return AllocTag(std::move(callback));
   }
 
-  // The completion queue processed by the library.  Tags queued to
-  // this queue must be created by MakeTag or AllocTag.
-  virtual ::grpc::CompletionQueue *GetQueue() { return cq_.get(); }
+  // Returns one of the completion queues processed by the library,
+  // in turn, so the calls are spread across the queues.  Tags queued
+  // to the queues must be created by MakeTag or AllocTag.
+  virtual ::grpc::CompletionQueue *GetQueue();
 
-  void Init(ngx_cycle_t *cycle);
+  // Initializes the queue with num_queues completion queues, each
+  // polled by its own thread.
+  void Init(ngx_cycle_t *cycle, int num_queues);
 
  private:
   static std::weak_ptr<NgxEspGrpcQueue> instance;
@@ -84,14 +88,30 @@ class NgxEspGrpcQueue : public AsyncGrpcQueue {
   // C++ interfaces, all tags must subclass
   // ::grpc::CompletionQueueTag, since the framework will invoke the
   // virtual FinalizeResult method on the tag before returning it.
+  //
+  // A completed tag is linked into the completed_ list with the
+  // result to pass to its callback once the nginx main thread picks
+  // it up, so queueing it back does not allocate.
   class Tag : public ::grpc::CompletionQueueTag {
    public:
     virtual bool FinalizeResult(void **tag, bool *status) { return true; }
     virtual void operator()(bool ok) = 0;
+
+   private:
+    friend class NgxEspGrpcQueue;
+
+    // The next tag in the completed_ list.
+    Tag *next_;
+    // The result of the completed tag.
+    bool ok_;
   };
 
   // Specializes Tag for the continuation being queued to a completion
   // port.  T must be MoveConstructible.
+  //
+  // The tags are allocated and deleted on the main nginx thread, so
+  // the memory of the deleted tags of a type is kept in a plain free
+  // list and reused by the next tags of the type.
   template <typename T>
   class TypedTag : public Tag {
    public:
@@ -99,31 +119,59 @@ class NgxEspGrpcQueue : public AsyncGrpcQueue {
 
     virtual void operator()(bool ok) { t_(ok); }
 
+    static void *operator new(size_t size) {
+      std::vector<void *> *free_tags = FreeTags();
+      if (free_tags->empty()) {
+        return ::operator new(size);
+      }
+      void *tag = free_tags->back();
+      free_tags->pop_back();
+      return tag;
+    }
+
+    static void operator delete(void *tag) {
+      std::vector<void *> *free_tags = FreeTags();
+      if (free_tags->size() < kMaxFreeTags) {
+        free_tags->push_back(tag);
+      } else {
+        ::operator delete(tag);
+      }
+    }
+
    private:
+    // Returns the free list of the type.  It is never deleted, since
+    // tags may be deleted during the static destruction.
+    static std::vector<void *> *FreeTags() {
+      static std::vector<void *> *free_tags = new std::vector<void *>();
+      return free_tags;
+    }
+
     T t_;
   };
 
-  // The type stored in the pending event queue (pending_).  This
-  // holds the callback function and the result to pass to that
-  // function once the Nginx main thread picks up the pending event.
-  struct Finalizer {
-    std::unique_ptr<Tag> callback;
-    bool success;
-  };
+  // The maximum number of deleted tags of a type kept for reuse.
+  static const size_t kMaxFreeTags = 1024;
 
   // Runs GRPC callbacks on the main nginx thread.
   static void NginxTagHandler(ngx_event_t *);
 
+  // A completion queue and the worker thread polling it.
+  struct Poller {
+    std::unique_ptr<::grpc::CompletionQueue> cq;
+    std::thread thread;
+  };
+
   // The GRPC worker thread main routine.  This shuttles events from
-  // the GRPC completion queue to the nginx event queue, getting them
+  // a GRPC completion queue to the nginx event queue, getting them
   // onto the main nginx thread.
   //
   // Note that the worker thread's lifetime is strictly contained
   // within the lifetime of its associated NgxEspGrpcQueue (the
   // NgxEspGrpcQueue destructor joins on the thread).  This makes it
-  // possible to pass the queue to the worker thread via a raw
-  // pointer.
-  static void WorkerThread(NgxEspGrpcQueue *queue);
+  // possible to pass the queue and the completion queue to the worker
+  // thread via raw pointers.
+  static void WorkerThread(NgxEspGrpcQueue *queue,
+                           ::grpc::CompletionQueue *cq);
 
   // Deletes the NgxEspGrpcQueue.  (This lets us avoid making the
   // constructor and destructor public, which is a little overly
@@ -133,16 +181,26 @@ class NgxEspGrpcQueue : public AsyncGrpcQueue {
   NgxEspGrpcQueue();
   virtual ~NgxEspGrpcQueue();
 
-  // Drains the contents of the pending_ queue.
+  // Links a completed tag into the completed_ list.  Returns true if
+  // the list was empty, in which case the nginx main thread must be
+  // notified; it is already notified otherwise.
+  bool PushCompleted(Tag *tag);
+
+  // Runs the callbacks of the tags of the completed_ list.
   void DrainPending();
 
-  std::mutex mu_;
   ngx_event_t notify_;
-  std::unique_ptr<::grpc::CompletionQueue> cq_;
-  std::deque<Finalizer> pending_;
-  bool notified_;
 
-  std::thread worker_thread_;
+  // The completed tags not yet picked up by the nginx main thread, a
+  // lock free list linked by Tag::next_ from the last completed tag.
+  // The poller threads push tags, the nginx main thread takes them
+  // all at once.
+  std::atomic<Tag *> completed_;
+
+  std::vector<std::unique_ptr<Poller>> pollers_;
+  // The index in pollers_ of the queue returned by the next GetQueue
+  // call.  GetQueue is only called on the main nginx thread.
+  size_t next_poller_;
 };
 
 }  // namespace nginx
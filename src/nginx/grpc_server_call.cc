@@ -50,32 +50,9 @@ namespace nginx {
 
 namespace {
 
-// Returns a character at a logical offset within a vector of slices.
-unsigned char GetByte(const std::vector<grpc_slice> &slices, size_t offset) {
-  for (const auto &it : slices) {
-    if (offset < GRPC_SLICE_LENGTH(it)) {
-      return GRPC_SLICE_START_PTR(it)[offset];
-    }
-    offset -= GRPC_SLICE_LENGTH(it);
-  }
-  return '\0';
-}
-
-// Trims some bytes from the front of vector of slices, removing
-// slices as needed.
-void TrimFront(std::vector<grpc_slice> *slices, size_t count) {
-  while (count) {
-    grpc_slice &head = slices->front();
-    if (GRPC_SLICE_LENGTH(head) <= count) {
-      count -= GRPC_SLICE_LENGTH(head);
-      grpc_slice_unref(head);
-      slices->erase(slices->begin());
-    } else {
-      head = grpc_slice_sub_no_ref(head, count, GRPC_SLICE_LENGTH(head));
-      break;
-    }
-  }
-}
+// The size of the header of a GRPC message: a one-byte compressed-flag
+// and a four-byte message length.
+const size_t kGrpcMessageHeaderSize = 5;
 
 // Calls ngx_http_output_filter() to call the output filter chain and sets up
 // the write event handler and the write event if ngx_http_output_filter()
@@ -145,6 +122,12 @@ NgxEspGrpcServerCall::NgxEspGrpcServerCall(ngx_http_request_t *r,
       add_header_failed_(false),
       reading_(false),
       read_msg_(nullptr),
+      downstream_head_(0),
+      downstream_counted_(0),
+      downstream_length_(0),
+      downstream_header_read_(false),
+      downstream_compressed_(false),
+      downstream_message_length_(0),
       delay_downstream_headers_(delay_downstream_headers) {
   // Add the cleanup handler.  This unlinks the NgxEspGrpcServerCall
   // from the request when the underlying nginx request is terminated,
@@ -186,8 +169,8 @@ NgxEspGrpcServerCall::~NgxEspGrpcServerCall() {
       }
     }
   }
-  for (auto &slice : downstream_slices_) {
-    grpc_slice_unref(slice);
+  for (size_t i = downstream_head_; i < downstream_slices_.size(); i++) {
+    grpc_slice_unref(downstream_slices_[i]);
   }
   downstream_slices_.clear();
 }
@@ -408,7 +391,8 @@ void NgxEspGrpcServerCall::CompletePendingRead(bool proceed,
   // We already received end stream flag from downstream (r_reading_body is 0)
   // and we converted all downstream_slices_ at this point, so it is ok to send
   // end stream to upstream.
-  if (proceed && !r_->reading_body && downstream_slices_.size() == 0) {
+  if (proceed && !r_->reading_body && !downstream_header_read_ &&
+      BufferedDownstreamLength() == 0) {
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r_->connection->log, 0,
                    "NgxEspGrpcServerCall::CompletePendingRead: DONE");
     status = utils::Status::DONE;
@@ -522,82 +506,116 @@ bool NgxEspGrpcServerCall::TryReadDownstreamMessage() {
   // * A one-byte compressed-flag
   // * A four-byte message length
   // * The message body (length octets)
+  //
+  // The header is consumed as soon as it is buffered, and kept until
+  // the message body is buffered, so each call only looks at the
+  // slices converted since the previous call.
 
-  size_t buflen = 0;
-  for (auto it : downstream_slices_) {
-    buflen += GRPC_SLICE_LENGTH(it);
-  }
+  size_t buflen = BufferedDownstreamLength();
   ngx_log_debug1(
       NGX_LOG_DEBUG_HTTP, r_->connection->log, 0,
       "NgxEspGrpcServerCall::TryReadDownstreamMessage: buffered length=%z",
       buflen);
 
-  if (buflen < 5) {
-    // There's not even enough data to figure out how long the message
-    // is.
-    return false;
-  }
+  if (!downstream_header_read_) {
+    if (buflen < kGrpcMessageHeaderSize) {
+      // There's not even enough data to figure out how long the message
+      // is.
+      return false;
+    }
 
-  uint8_t compressed_flag = GetByte(downstream_slices_, 0);
+    uint8_t header[kGrpcMessageHeaderSize];
+    size_t header_len = 0;
+    for (size_t i = downstream_head_; header_len < kGrpcMessageHeaderSize;
+         i++) {
+      const grpc_slice &slice = downstream_slices_[i];
+      for (size_t j = 0; j < GRPC_SLICE_LENGTH(slice) &&
+                         header_len < kGrpcMessageHeaderSize;
+           j++) {
+        header[header_len++] = GRPC_SLICE_START_PTR(slice)[j];
+      }
+    }
+    ConsumeDownstream(kGrpcMessageHeaderSize);
+    buflen -= kGrpcMessageHeaderSize;
 
-  // Decode the length.  Note that this is in network byte order.
-  uint32_t msglen = 0;
-  msglen |= GetByte(downstream_slices_, 1);
-  msglen <<= 8;
-  msglen |= GetByte(downstream_slices_, 2);
-  msglen <<= 8;
-  msglen |= GetByte(downstream_slices_, 3);
-  msglen <<= 8;
-  msglen |= GetByte(downstream_slices_, 4);
+    // Decode the length.  Note that this is in network byte order.
+    downstream_header_read_ = true;
+    downstream_compressed_ = header[0] == 1;
+    downstream_message_length_ = (static_cast<uint32_t>(header[1]) << 24) |
+                                 (static_cast<uint32_t>(header[2]) << 16) |
+                                 (static_cast<uint32_t>(header[3]) << 8) |
+                                 static_cast<uint32_t>(header[4]);
 
-  ngx_log_debug1(
-      NGX_LOG_DEBUG_HTTP, r_->connection->log, 0,
-      "NgxEspGrpcServerCall::TryReadDownstreamMessage: message length=%z",
-      msglen);
+    ngx_log_debug1(
+        NGX_LOG_DEBUG_HTTP, r_->connection->log, 0,
+        "NgxEspGrpcServerCall::TryReadDownstreamMessage: message length=%z",
+        static_cast<size_t>(downstream_message_length_));
+  }
 
-  if ((buflen - 5) < msglen) {
+  size_t msglen = downstream_message_length_;
+  if (buflen < msglen) {
     // We're still waiting for the rest of the message.
     return false;
   }
 
   // Okay, we can return a message.
-  TrimFront(&downstream_slices_, 5);
+  downstream_header_read_ = false;
 
-  // Get an iterator pointing into the downstream_slices_ vector to the slice
-  // containing the byte just pass the message length (which could be
-  // downstream_slices_->end() if the length is an exact match).
-  auto it = downstream_slices_.begin();
-  size_t prefixlen =
-      0;  // The number of bytes in downstream_slices_ before *it.
-  while (prefixlen < msglen && GRPC_SLICE_LENGTH(*it) <= (msglen - prefixlen)) {
-    prefixlen += GRPC_SLICE_LENGTH(*it);
-    ++it;
+  // Find the index in downstream_slices_ of the slice containing the
+  // byte just past the message (which could be downstream_slices_.size()
+  // if the length is an exact match).
+  size_t end = downstream_head_;
+  size_t prefixlen = 0;  // The number of message bytes before end.
+  while (prefixlen < msglen &&
+         GRPC_SLICE_LENGTH(downstream_slices_[end]) <= (msglen - prefixlen)) {
+    prefixlen += GRPC_SLICE_LENGTH(downstream_slices_[end]);
+    ++end;
   }
 
   grpc_slice remainder;
   if (prefixlen < msglen) {
-    // We need to use part of the contents of the slice at *it, but
+    // We need to use part of the contents of the slice at end, but
     // not all of the contents.  Save the remainder off on the side
     // (with its own refcount), replace the vector element with the
     // trimmed slice (i.e. what we want for building the message byte
     // buffer), and advance to the next slice.  After this, the slices
-    // [downstream_slices_->begin(), it) are the message contents.
-    remainder = grpc_slice_sub(*it, msglen - prefixlen, GRPC_SLICE_LENGTH(*it));
-    *it = grpc_slice_sub_no_ref(*it, 0, msglen - prefixlen);
-    ++it;
-  }
-
-  // Copy the slices, logically transferring their reference counts to
-  // the 'slices' vector (which will drop those reference counts as
-  // the vector is destroyed).
+    // [downstream_head_, end) are the message contents.
+    grpc_slice &last = downstream_slices_[end];
+    remainder =
+        grpc_slice_sub(last, msglen - prefixlen, GRPC_SLICE_LENGTH(last));
+    last = grpc_slice_sub_no_ref(last, 0, msglen - prefixlen);
+    ++end;
+  }
+
+  // Hand the message slices over, logically transferring their
+  // reference counts to 'input' or to the 'slices' vector (which will
+  // drop those reference counts as they are destroyed).
+  grpc_slice *message_slices = downstream_slices_.data() + downstream_head_;
+  size_t message_slice_count = end - downstream_head_;
   std::vector<::grpc::Slice> slices;
-
-  if (compressed_flag == 1) {
-    grpc_slice_buffer input;
+  grpc_slice_buffer input;
+  if (downstream_compressed_) {
     grpc_slice_buffer_init(&input);
-    grpc_slice_buffer_addn(&input, downstream_slices_.data(),
-                           it - downstream_slices_.begin());
+    grpc_slice_buffer_addn(&input, message_slices, message_slice_count);
+  } else {
+    slices.reserve(message_slice_count);
+    std::transform(message_slices, message_slices + message_slice_count,
+                   std::back_inserter(slices), [](grpc_slice &slice) {
+                     return ::grpc::Slice(slice, ::grpc::Slice::STEAL_REF);
+                   });
+  }
+
+  // Consume the message slices, replacing the last one with the
+  // remainder after the message contents.
+  if (prefixlen < msglen) {
+    --end;
+    downstream_slices_[end] = remainder;
+  }
+  downstream_head_ = end;
+  downstream_length_ -= msglen;
+  CompactDownstreamSlices();
 
+  if (downstream_compressed_) {
     grpc_slice_buffer output;
     grpc_slice_buffer_init(&output);
 
@@ -621,28 +639,12 @@ bool NgxEspGrpcServerCall::TryReadDownstreamMessage() {
 
     grpc_slice_buffer_destroy(&input);
     grpc_slice_buffer_destroy(&output);
-  } else {
-    slices.reserve(it - downstream_slices_.begin());
-    std::transform(downstream_slices_.begin(), it, std::back_inserter(slices),
-                   [](grpc_slice &slice) {
-                     return ::grpc::Slice(slice, ::grpc::Slice::STEAL_REF);
-                   });
   }
 
   // Write the message byte buffer (giving the ByteBuffer its own
   // reference counts).
   *read_msg_ = ::grpc::ByteBuffer(slices.data(), slices.size());
 
-  if (prefixlen < msglen) {
-    // Replace the last slice used to create the byte buffer with the
-    // remainder after the message contents.
-    --it;
-    *it = remainder;
-  }
-
-  // Erase the consumed slices.
-  downstream_slices_.erase(downstream_slices_.begin(), it);
-
   // Complete the pending Read operation.
   CompletePendingRead(true, utils::Status::OK);
 
@@ -650,6 +652,42 @@ bool NgxEspGrpcServerCall::TryReadDownstreamMessage() {
   return true;
 }
 
+size_t NgxEspGrpcServerCall::BufferedDownstreamLength() {
+  for (; downstream_counted_ < downstream_slices_.size();
+       downstream_counted_++) {
+    downstream_length_ +=
+        GRPC_SLICE_LENGTH(downstream_slices_[downstream_counted_]);
+  }
+  return downstream_length_;
+}
+
+void NgxEspGrpcServerCall::ConsumeDownstream(size_t count) {
+  downstream_length_ -= count;
+  while (count) {
+    grpc_slice &head = downstream_slices_[downstream_head_];
+    if (GRPC_SLICE_LENGTH(head) <= count) {
+      count -= GRPC_SLICE_LENGTH(head);
+      grpc_slice_unref(head);
+      downstream_head_++;
+    } else {
+      head = grpc_slice_sub_no_ref(head, count, GRPC_SLICE_LENGTH(head));
+      break;
+    }
+  }
+  CompactDownstreamSlices();
+}
+
+void NgxEspGrpcServerCall::CompactDownstreamSlices() {
+  if (downstream_head_ == 0 ||
+      downstream_head_ * 2 < downstream_slices_.size()) {
+    return;
+  }
+  downstream_slices_.erase(downstream_slices_.begin(),
+                           downstream_slices_.begin() + downstream_head_);
+  downstream_counted_ -= downstream_head_;
+  downstream_head_ = 0;
+}
+
 void NgxEspGrpcServerCall::Write(const ::grpc::ByteBuffer &msg,
                                  std::function<void(bool)> continuation) {
   if (!cln_.data) {
@@ -99,6 +99,9 @@ class NgxEspGrpcServerCall : public grpc::ServerCall {
   // body.
   utils::Status ProcessPrereadRequestBody();
 
+  // Adds a header to the response headers sent to the client.
+  void AddInitialMetadata(const std::string& key, const std::string& value);
+
   // Sends the headers to the client. Returns Status::OK if successful,
   // otherwise returns the error status.
   utils::Status WriteDownstreamHeaders();
@@ -117,12 +120,22 @@ class NgxEspGrpcServerCall : public grpc::ServerCall {
 
   void RunPendingRead();
 
-  void AddInitialMetadata(const std::string& key, const std::string& value);
-
   // Attempts to read a GRPC message from downstream into read_msg_;
   // calls CompletePendingRead and returns true if successful.
   bool TryReadDownstreamMessage();
 
+  // Returns the number of bytes buffered in downstream_slices_, counting
+  // only the slices appended since the last call.
+  size_t BufferedDownstreamLength();
+
+  // Removes count buffered bytes from the front of downstream_slices_.
+  void ConsumeDownstream(size_t count);
+
+  // Erases the consumed slices from downstream_slices_ once they are at
+  // least half of it, so that each slice is moved a bounded number of
+  // times.
+  void CompactDownstreamSlices();
+
   // Indicates that the request is going away (being freed, &c).  This
   // causes currently outstanding and newly initiated operations to be
   // completed with 'false'.
@@ -133,7 +146,22 @@ class NgxEspGrpcServerCall : public grpc::ServerCall {
   std::function<void(bool)> write_continuation_;
   std::function<void(bool, utils::Status)> read_continuation_;
   ::grpc::ByteBuffer* read_msg_;
+
+  // The request body converted from downstream.  ConvertRequestBody
+  // appends the slices, the slices before downstream_head_ have been
+  // consumed.
   ::std::vector<grpc_slice> downstream_slices_;
+  size_t downstream_head_;
+  // The slices before downstream_counted_ are counted in
+  // downstream_length_, the number of bytes buffered.
+  size_t downstream_counted_;
+  size_t downstream_length_;
+
+  // The header of the message being read, once it is consumed from
+  // downstream_slices_.
+  bool downstream_header_read_;
+  bool downstream_compressed_;
+  uint32_t downstream_message_length_;
 
   // If true, sending of the headers will be delayed.
   bool delay_downstream_headers_;
@@ -218,9 +218,12 @@ inline void append(ngx_buf_t *buf, const char (&value)[n]) {
 
 // Create request.
 // When NGINX is ready to send the data to the upstream, it calls this handler
-// to create the request buffer.
-// It will compute needed buffer size, allocate the buffer, and create an HTTP
-// request within it, passing it back to NGINX for network communication.
+// to create the request buffers.
+// It will compute needed buffer size, allocate the buffer, and create the HTTP
+// request headers within it, passing it back to NGINX for network
+// communication. The body is not copied: it is sent from a second buffer
+// pointing at the body of the HTTPRequest, which lives until the request is
+// finalized. Service control reports can be megabytes large.
 ngx_int_t ngx_esp_upstream_create_request(ngx_http_request_t *r) {
   ngx_esp_http_connection *http_connection = get_esp_connection(r);
   ngx_log_debug2(
@@ -243,17 +246,18 @@ ngx_int_t ngx_esp_upstream_create_request(ngx_http_request_t *r) {
 
   // <method> followed by a space.
   buffer_size += http_request->method().size() + sizeof(" ") - 1;
-  // <URL path> followed by 'HTTP/1.0' and a newline.
-  buffer_size += http_connection->url_path.len + sizeof(" HTTP/1.0" CRLF) - 1;
+  // <URL path> followed by 'HTTP/1.1' and a newline.
+  buffer_size += http_connection->url_path.len + sizeof(" HTTP/1.1" CRLF) - 1;
   // 'Host:' header, followed by a newline.
   buffer_size += sizeof("Host: ") - 1;
   buffer_size += http_connection->host_header.len;
   buffer_size += sizeof(CRLF) - 1;
-  // Right now all our subrequests close connection (both old and new
-  // implementation).
-  // TODO: investigate NGINX ability for connection reuse. This may especially
-  // benefit service control connections.
-  buffer_size += sizeof("Connection: close" CRLF) - 1;
+  // HTTP/1.1 connections are persistent by default. Ask the server to close
+  // the connection if it is not going to be returned to the keep-alive pool.
+  bool keepalive = !http_connection->keepalive_key.empty();
+  if (!keepalive) {
+    buffer_size += sizeof("Connection: close" CRLF) - 1;
+  }
 
   // Add sizes of all headers and their values.
   for (const auto &header : http_request->request_headers()) {
@@ -274,9 +278,6 @@ ngx_int_t ngx_esp_upstream_create_request(ngx_http_request_t *r) {
     // Add space for Content-Length header and its value.
     buffer_size +=
         sizeof("Content-Length: ") - 1 + NGX_OFF_T_LEN + sizeof(CRLF) - 1;
-
-    // Add the body size.
-    buffer_size += http_request->body().size();
   }
 
   buffer_size += sizeof(CRLF) - 1;  // Newline following the HTTP headers.
@@ -291,13 +292,15 @@ ngx_int_t ngx_esp_upstream_create_request(ngx_http_request_t *r) {
   append(buf, http_request->method());
   append(buf, " ");
   append(buf, http_connection->url_path);
-  append(buf, " HTTP/1.0" CRLF);
+  append(buf, " HTTP/1.1" CRLF);
 
   // Append the Host and Connection headers.
   append(buf, "Host: ");
   append(buf, http_connection->host_header);
   append(buf, CRLF);
-  append(buf, "Connection: close" CRLF);
+  if (!keepalive) {
+    append(buf, "Connection: close" CRLF);
+  }
 
   // Append the headers provided by the caller.
   for (const auto &header : http_request->request_headers()) {
@@ -321,10 +324,6 @@ ngx_int_t ngx_esp_upstream_create_request(ngx_http_request_t *r) {
   // End request headers, insert newline before the body.
   append(buf, CRLF);
 
-  if (request_accepts_body && http_request->body().size() > 0) {
-    append(buf, http_request->body());
-  }
-
   // Allocate a buffer chain for NGINX.
   ngx_chain_t *chain = ngx_alloc_chain_link(r->pool);
   if (chain == nullptr) {
@@ -334,7 +333,27 @@ ngx_int_t ngx_esp_upstream_create_request(ngx_http_request_t *r) {
   chain->next = nullptr;
   chain->buf = buf;
 
-  // We are only sending one buffer.
+  if (request_accepts_body && http_request->body().size() > 0) {
+    // The body buffer references the body in memory, nginx does not modify
+    // it.
+    ngx_buf_t *body_buf = ngx_calloc_buf(r->pool);
+    ngx_chain_t *body_chain = ngx_alloc_chain_link(r->pool);
+    if (body_buf == nullptr || body_chain == nullptr) {
+      return NGX_ERROR;
+    }
+    u_char *body = reinterpret_cast<u_char *>(
+        const_cast<char *>(http_request->body().data()));
+    body_buf->start = body_buf->pos = body;
+    body_buf->end = body_buf->last = body + http_request->body().size();
+    body_buf->memory = 1;
+
+    body_chain->next = nullptr;
+    body_chain->buf = body_buf;
+    chain->next = body_chain;
+    buf = body_buf;
+  }
+
+  // The last buffer ends the request.
   buf->last_buf = 1;
 
   // Attach the buffer to the request.
@@ -360,6 +379,9 @@ ngx_int_t ngx_esp_upstream_reinit_request(ngx_http_request_t *r) {
 
   // We only reset state to start parsing status line again.
   r->upstream->process_header = ngx_esp_upstream_process_status_line;
+  http_connection->response_chunked = false;
+  ngx_memzero(&http_connection->response_chunked_state,
+              sizeof(ngx_http_chunked_t));
   return NGX_OK;
 }
 
@@ -407,6 +429,11 @@ ngx_int_t ngx_esp_upstream_process_status_line(ngx_http_request_t *r) {
   // continuation as a status).
   http_connection->response_status = status;
 
+  // HTTP/1.0 servers close the connection after the response.
+  if (status.http_version < NGX_HTTP_VERSION_11) {
+    r->upstream->headers_in.connection_close = 1;
+  }
+
   // Advance the state machine to parse individual headers next.
   r->upstream->process_header = ngx_esp_upstream_process_header;
   return ngx_esp_upstream_process_header(r);
@@ -452,6 +479,22 @@ ngx_int_t ngx_esp_upstream_process_header(ngx_http_request_t *r) {
         r->upstream->headers_in.content_length_n =
             ngx_atoof(value.data, value.len);
       }
+
+      // "Connection: close" and "Transfer-Encoding: chunked" determine
+      // where the response ends and whether the connection can be reused.
+      static ngx_str_t connection = ngx_string("connection");
+      static ngx_str_t transfer_encoding = ngx_string("transfer-encoding");
+      if (ngx_string_equal(name, connection) &&
+          ngx_strlcasestrn(value.data, value.data + value.len,
+                           (u_char *)"close", sizeof("close") - 2) !=
+              nullptr) {
+        r->upstream->headers_in.connection_close = 1;
+      } else if (ngx_string_equal(name, transfer_encoding) &&
+                 ngx_strlcasestrn(value.data, value.data + value.len,
+                                  (u_char *)"chunked",
+                                  sizeof("chunked") - 2) != nullptr) {
+        http_connection->response_chunked = true;
+      }
     } else if (rc == NGX_HTTP_PARSE_HEADER_DONE) {
       return NGX_OK;
     } else if (rc == NGX_AGAIN) {
@@ -523,6 +566,29 @@ void ngx_esp_upstream_finalize_request(ngx_http_request_t *r, ngx_int_t rc) {
                  "ngx_esp_upstream_finalize_request called: %V%V",
                  &http_connection->host_header, &http_connection->url_path);
 
+  // A request sent over a reused connection may fail because the server
+  // closed the idle connection just before the request was sent. If not a
+  // byte of the request was written, the server cannot have seen it, so it
+  // is safe to retry even a non-idempotent report or quota call.
+  ngx_connection_t *c = r->upstream->peer.connection;
+  bool stale_connection = rc != NGX_OK && rc != NGX_HTTP_GATEWAY_TIME_OUT &&
+                          http_connection->keepalive_connection != nullptr &&
+                          http_connection->response_status.code == 0 &&
+                          c != nullptr && c->sent == 0;
+
+  // Return the connection to the keep-alive pool if the whole response has
+  // been read and the server did not ask to close it. The upstream module
+  // then no longer sees the connection and does not close it.
+  if (rc == NGX_OK && r->upstream->keepalive &&
+      !http_connection->keepalive_key.empty()) {
+    if (ngx_esp_http_keepalive_release(http_connection->keepalive_key,
+                                       &r->upstream->peer)) {
+      ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                     "esp: connection to %V kept alive",
+                     &http_connection->host_header);
+    }
+  }
+
   std::string message;
   if (rc == NGX_OK) {
     // If the overall transmission succeeded (rc == NGX_OK), use the HTTP
@@ -549,8 +615,19 @@ void ngx_esp_upstream_finalize_request(ngx_http_request_t *r, ngx_int_t rc) {
     std::unique_ptr<HTTPRequest> request;
     request.swap(http_connection->esp_request);
 
-    // Retry if an error and retry budget left
-    if (rc == NGX_ERROR && request->max_retries() > 0) {
+    if (stale_connection && request->max_retries() > 0) {
+      // The retry counts against the retry budget, but the timeout is kept
+      // since the server did not get to time out.
+      request->set_max_retries(request->max_retries() - 1);
+
+      ngx_log_debug1(NGX_LOG_DEBUG_HTTP, &http_connection->log, 0,
+                     "Retrying request failed on a reused connection, "
+                     "max retries left %d",
+                     request->max_retries());
+
+      ngx_esp_send_http_request(std::move(request));
+    } else if (rc == NGX_ERROR && request->max_retries() > 0) {
+      // Retry if an error and retry budget left
       // increase timeout
       request->set_max_retries(request->max_retries() - 1);
       request->set_timeout_ms(request->timeout_ms() *
@@ -621,6 +698,21 @@ ngx_int_t ngx_esp_upstream_input_filter_init(void *data) {
     return NGX_ERROR;
   }
 
+  // Determine where the response body ends. The connection can only be
+  // reused if the body is delimited by Content-Length or chunked encoding.
+  ngx_http_upstream_t *u = r->upstream;
+  ngx_uint_t code = http_connection->response_status.code;
+  if (http_connection->response_chunked) {
+    // The length is not known until the last chunk has been parsed.
+    u->length = 1;
+  } else if (code == NGX_HTTP_NO_CONTENT || code == NGX_HTTP_NOT_MODIFIED) {
+    u->length = 0;
+  } else {
+    // -1 (read until the server closes the connection) if not present.
+    u->length = u->headers_in.content_length_n;
+  }
+  u->keepalive = u->length == 0 && !u->headers_in.connection_close;
+
 #if (NGX_DEBUG)
   // esp_request is only used in debug mode; the log_debug macro
   // is noop in release
@@ -657,8 +749,65 @@ ngx_int_t ngx_esp_upstream_input_filter(void *data, ssize_t bytes) {
                  "endpoints received %d bytes: %V", (int)bytes, &body);
 #endif
 
+  ngx_http_upstream_t *u = r->upstream;
+
+  if (http_connection->response_chunked) {
+    ngx_buf_t buf;
+    ngx_memzero(&buf, sizeof(buf));
+    buf.pos = u->buffer.last;
+    buf.last = u->buffer.last + bytes;
+
+    ngx_http_chunked_t *chunked = &http_connection->response_chunked_state;
+    for (;;) {
+      ngx_int_t rc = ngx_http_parse_chunked(r, &buf, chunked);
+
+      if (rc == NGX_OK) {
+        // Chunk data (or a part of it) is available at buf.pos.
+        off_t size = ngx_min(buf.last - buf.pos, chunked->size);
+        http_connection->response_body.write(
+            reinterpret_cast<char *>(buf.pos), size);
+        buf.pos += size;
+        chunked->size -= size;
+        continue;
+      }
+
+      if (rc == NGX_DONE) {
+        // The whole response has been read.
+        u->keepalive = !u->headers_in.connection_close && buf.pos == buf.last;
+        u->length = 0;
+        break;
+      }
+
+      if (rc == NGX_AGAIN) {
+        break;
+      }
+
+      ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                    "upstream sent invalid chunked response");
+      return NGX_ERROR;
+    }
+
+    return NGX_OK;
+  }
+
+  // Never read past the end of the response; trailing bytes make the
+  // connection unusable for the next request.
+  bool extra_data = false;
+  if (u->length >= 0 && bytes > u->length) {
+    bytes = u->length;
+    extra_data = true;
+    u->keepalive = 0;
+  }
+
   http_connection->response_body.write(
-      reinterpret_cast<char *>(r->upstream->buffer.last), bytes);
+      reinterpret_cast<char *>(u->buffer.last), bytes);
+
+  if (u->length > 0) {
+    u->length -= bytes;
+    if (u->length == 0) {
+      u->keepalive = !u->headers_in.connection_close && !extra_data;
+    }
+  }
 
   return NGX_OK;
 }
@@ -930,6 +1079,50 @@ Status initialize_request(ngx_pool_t *request_pool,
   return Status::OK;
 }
 
+// Upstream peer handlers used when the request reuses an idle connection from
+// the keep-alive pool. They replace the round robin peer NGINX would otherwise
+// create for the resolved server address.
+
+// Hands the idle connection to the upstream module. NGX_DONE tells NGINX the
+// peer is already connected.
+ngx_int_t ngx_esp_upstream_get_keepalive_peer(ngx_peer_connection_t *pc,
+                                              void *data) {
+  ngx_esp_http_connection *http_connection =
+      reinterpret_cast<ngx_esp_http_connection *>(data);
+
+  if (!http_connection->keepalive_connection ||
+      !http_connection->keepalive_connection->Attach(pc)) {
+    return NGX_ERROR;
+  }
+
+  ngx_log_debug1(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                 "esp: reusing keepalive connection %p", pc->connection);
+
+  return NGX_DONE;
+}
+
+// Called when the request is done with the peer. There is no other peer to
+// try, so the upstream module will not retry the request.
+void ngx_esp_upstream_free_keepalive_peer(ngx_peer_connection_t *pc,
+                                          void *data, ngx_uint_t state) {
+  pc->tries = 0;
+}
+
+ngx_int_t ngx_esp_upstream_init_keepalive_peer(
+    ngx_http_request_t *r, ngx_http_upstream_srv_conf_t *us) {
+  ngx_esp_http_connection *http_connection = get_esp_connection(r);
+  if (http_connection == nullptr) {
+    return NGX_ERROR;
+  }
+
+  r->upstream->peer.data = http_connection;
+  r->upstream->peer.get = ngx_esp_upstream_get_keepalive_peer;
+  r->upstream->peer.free = ngx_esp_upstream_free_keepalive_peer;
+  r->upstream->peer.tries = 1;
+
+  return NGX_OK;
+}
+
 // Initializes the upstream data structures which NGINX upstream module uses to
 // call the server.
 Status initialize_upstream_request(ngx_log_t *log, HTTPRequest *request,
@@ -962,6 +1155,28 @@ Status initialize_upstream_request(ngx_log_t *log, HTTPRequest *request,
     return status;
   }
 
+  // Reuse an idle connection to the same server if there is one.
+  if (ngx_esp_http_keepalive_enabled()) {
+    http_connection->keepalive_key =
+        ngx_str_to_std(upstream->schema) +
+        ngx_str_to_std(upstream->resolved->host) + ":" +
+        std::to_string(upstream->resolved->port);
+
+    http_connection->keepalive_connection =
+        ngx_esp_http_keepalive_acquire(http_connection->keepalive_key);
+
+    if (http_connection->keepalive_connection) {
+      // Without a resolved address, NGINX takes the peer from the upstream
+      // server configuration, whose peer hands out the idle connection.
+      upstream->resolved = nullptr;
+
+      ngx_http_upstream_srv_conf_t *uscf = &http_connection->keepalive_upstream;
+      uscf->host = http_connection->host_header;
+      uscf->peer.init = ngx_esp_upstream_init_keepalive_peer;
+      http_connection->upstream_conf.upstream = uscf;
+    }
+  }
+
   // Set timeout, defaulting to 60 seconds.
   //
   // NGINX has very fine-grained timeouts. We may want to further evolve
@@ -32,6 +32,7 @@
 
 #include "include/api_manager/http_request.h"
 #include "include/api_manager/utils/status.h"
+#include "src/nginx/http_keepalive.h"
 
 extern "C" {
 #include "src/http/ngx_http.h"
@@ -84,6 +85,20 @@ struct ngx_esp_http_connection {
   ngx_str_t url_path;
   ngx_str_t host_header;
 
+  // Keep-alive support.
+
+  // The key of the upstream server in the keep-alive connection pool,
+  // empty if connections to the server are not kept alive.
+  std::string keepalive_key;
+
+  // The idle connection taken from the keep-alive pool, if the request
+  // reuses one. Owns the peer address while the request is in flight.
+  std::unique_ptr<NgxEspHttpKeepaliveConnection> keepalive_connection;
+
+  // The upstream server configuration through which the upstream module
+  // picks up keepalive_connection instead of connecting.
+  ngx_http_upstream_srv_conf_t keepalive_upstream;
+
   // A unique pointer to the HTTP request object created by the caller
   // (contains headers, body, HTTP verb, URL, timeout, and completion
   // continuation).
@@ -94,6 +109,11 @@ struct ngx_esp_http_connection {
   // Parsed HTTP response status.
   ngx_http_status_t response_status;
 
+  // Whether the response body uses chunked transfer encoding, and the state
+  // of the chunked body parser.
+  bool response_chunked;
+  ngx_http_chunked_t response_chunked_state;
+
   // Stream in which we accumulate response body as it is streamed to us
   // by the NGINX upstream module.
   std::ostringstream response_body;
@@ -0,0 +1,277 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/nginx/http_keepalive.h"
+
+#include <sys/socket.h>
+#include <map>
+
+
+namespace google {
+namespace api_manager {
+namespace nginx {
+
+namespace {
+
+// A group of idle connections to the same upstream server.
+struct KeepaliveGroup {
+  KeepaliveGroup() : count(0) { ngx_queue_init(&idle); }
+
+  // Idle connections, the most recently used one first.
+  ngx_queue_t idle;
+
+  // Number of connections in the idle queue.
+  ngx_uint_t count;
+};
+
+// An idle connection queued in its group. The item is stored in the
+// connection's data field while the connection is idle.
+struct KeepaliveItem {
+  ngx_queue_t queue;
+  KeepaliveGroup *group;
+  ngx_connection_t *c;
+  NgxEspHttpKeepaliveConnection *connection;
+};
+
+// Maximum number of idle connections kept per group; 0 disables the pool.
+ngx_uint_t max_idle_connections = 0;
+
+// How long a connection may stay idle before it is closed.
+ngx_msec_t idle_timeout = 0;
+
+// The groups of idle connections keyed by scheme, host and port.
+std::map<std::string, KeepaliveGroup> keepalive_groups;
+
+ngx_esp_http_keepalive_stats_t keepalive_stats;
+
+void ngx_esp_http_keepalive_close(ngx_connection_t *c) {
+#if (NGX_HTTP_SSL)
+  if (c->ssl) {
+    c->ssl->no_wait_shutdown = 1;
+    c->ssl->no_send_shutdown = 1;
+
+    if (ngx_ssl_shutdown(c) == NGX_AGAIN) {
+      c->ssl->handler = ngx_esp_http_keepalive_close;
+      return;
+    }
+  }
+#endif
+
+  ngx_destroy_pool(c->pool);
+  ngx_close_connection(c);
+}
+
+// Unlinks the item from its group and closes its connection.
+void ngx_esp_http_keepalive_remove(KeepaliveItem *item) {
+  ngx_queue_remove(&item->queue);
+  item->group->count--;
+  keepalive_stats.idle_connections--;
+
+  delete item->connection;
+  delete item;
+}
+
+void ngx_esp_http_keepalive_dummy_handler(ngx_event_t *ev) {
+  ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ev->log, 0,
+                 "esp: keepalive dummy handler");
+}
+
+// Called when an idle connection becomes readable or its idle timer expires.
+// An idle connection has no request in flight, so any readable event means
+// the server has closed the connection (or sent something unexpected).
+void ngx_esp_http_keepalive_close_handler(ngx_event_t *ev) {
+  ngx_connection_t *c = reinterpret_cast<ngx_connection_t *>(ev->data);
+
+  if (!c->close && !ev->timedout) {
+    char buf[1];
+    ssize_t n = recv(c->fd, buf, 1, MSG_PEEK);
+    if (n == -1 && ngx_socket_errno == NGX_EAGAIN) {
+      ev->ready = 0;
+      if (ngx_handle_read_event(c->read, 0) == NGX_OK) {
+        return;
+      }
+    }
+  }
+
+  ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ev->log, 0,
+                 "esp: closing idle keepalive connection %p", c);
+
+  ngx_esp_http_keepalive_remove(reinterpret_cast<KeepaliveItem *>(c->data));
+}
+
+}  // namespace
+
+NgxEspHttpKeepaliveConnection::NgxEspHttpKeepaliveConnection(
+    ngx_connection_t *connection, ngx_peer_connection_t *pc)
+    : connection_(connection), socklen_(pc->socklen) {
+  ngx_memcpy(&sockaddr_, pc->sockaddr, pc->socklen);
+  if (pc->name != nullptr) {
+    name_.assign(reinterpret_cast<const char *>(pc->name->data),
+                 pc->name->len);
+  }
+  name_str_.data = reinterpret_cast<u_char *>(const_cast<char *>(name_.data()));
+  name_str_.len = name_.size();
+}
+
+NgxEspHttpKeepaliveConnection::~NgxEspHttpKeepaliveConnection() {
+  if (connection_ != nullptr) {
+    ngx_esp_http_keepalive_close(connection_);
+  }
+}
+
+bool NgxEspHttpKeepaliveConnection::Attach(ngx_peer_connection_t *pc) {
+  ngx_connection_t *c = connection_;
+  if (c == nullptr) {
+    return false;
+  }
+  connection_ = nullptr;
+
+  c->idle = 0;
+  c->sent = 0;
+  c->data = nullptr;
+  c->log = pc->log;
+  c->read->log = pc->log;
+  c->write->log = pc->log;
+  c->pool->log = pc->log;
+
+  pc->connection = c;
+  pc->cached = 1;
+  pc->sockaddr = &sockaddr_.sockaddr;
+  pc->socklen = socklen_;
+  pc->name = &name_str_;
+
+  return true;
+}
+
+void ngx_esp_http_keepalive_init(ngx_uint_t max_idle, ngx_msec_t timeout) {
+  max_idle_connections = max_idle;
+  idle_timeout = timeout;
+}
+
+bool ngx_esp_http_keepalive_enabled() { return max_idle_connections > 0; }
+
+std::unique_ptr<NgxEspHttpKeepaliveConnection> ngx_esp_http_keepalive_acquire(
+    const std::string &key) {
+  auto it = keepalive_groups.find(key);
+  if (it == keepalive_groups.end() || ngx_queue_empty(&it->second.idle)) {
+    keepalive_stats.missed_connections++;
+    return nullptr;
+  }
+
+  ngx_queue_t *q = ngx_queue_head(&it->second.idle);
+  KeepaliveItem *item = ngx_queue_data(q, KeepaliveItem, queue);
+
+  ngx_queue_remove(q);
+  it->second.count--;
+  keepalive_stats.idle_connections--;
+  keepalive_stats.reused_connections++;
+
+  ngx_connection_t *c = item->c;
+  std::unique_ptr<NgxEspHttpKeepaliveConnection> connection(item->connection);
+  delete item;
+
+  // The connection is no longer idle: stop the idle timer and the handlers
+  // watching for the server closing it. The upstream module installs its own
+  // handlers once the connection is attached to a request.
+  c->data = nullptr;
+  if (c->read->timer_set) {
+    ngx_del_timer(c->read);
+  }
+  c->read->handler = ngx_esp_http_keepalive_dummy_handler;
+  c->write->handler = ngx_esp_http_keepalive_dummy_handler;
+
+  return connection;
+}
+
+bool ngx_esp_http_keepalive_release(const std::string &key,
+                                    ngx_peer_connection_t *pc) {
+  ngx_connection_t *c = pc->connection;
+
+  if (max_idle_connections == 0 || c == nullptr || c->read->eof ||
+      c->read->error || c->read->timedout || c->write->error ||
+      c->write->timedout) {
+    return false;
+  }
+
+  if (ngx_terminate || ngx_exiting) {
+    return false;
+  }
+
+  if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
+    return false;
+  }
+
+  KeepaliveGroup &group = keepalive_groups[key];
+
+  // Make room by closing the least recently used idle connection.
+  if (group.count >= max_idle_connections) {
+    ngx_queue_t *q = ngx_queue_last(&group.idle);
+    ngx_esp_http_keepalive_remove(ngx_queue_data(q, KeepaliveItem, queue));
+  }
+
+  KeepaliveItem *item = new KeepaliveItem;
+  item->group = &group;
+  item->c = c;
+  item->connection = new NgxEspHttpKeepaliveConnection(c, pc);
+  ngx_queue_insert_head(&group.idle, &item->queue);
+  group.count++;
+  keepalive_stats.idle_connections++;
+
+  pc->connection = nullptr;
+
+  c->read->delayed = 0;
+  if (c->write->timer_set) {
+    ngx_del_timer(c->write);
+  }
+  if (c->read->timer_set) {
+    ngx_del_timer(c->read);
+  }
+  ngx_add_timer(c->read, idle_timeout);
+
+  c->write->handler = ngx_esp_http_keepalive_dummy_handler;
+  c->read->handler = ngx_esp_http_keepalive_close_handler;
+
+  c->data = item;
+  c->idle = 1;
+  c->log = ngx_cycle->log;
+  c->read->log = ngx_cycle->log;
+  c->write->log = ngx_cycle->log;
+  c->pool->log = ngx_cycle->log;
+
+  if (c->read->ready) {
+    ngx_esp_http_keepalive_close_handler(c->read);
+  }
+
+  return true;
+}
+
+void ngx_esp_http_keepalive_get_stats(ngx_esp_http_keepalive_stats_t *stats) {
+  *stats = keepalive_stats;
+}
+
+}  // namespace nginx
+}  // namespace api_manager
+}  // namespace google
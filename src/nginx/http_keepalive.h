@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) Extensible Service Proxy Authors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef NGINX_NGX_ESP_HTTP_KEEPALIVE_H_
+#define NGINX_NGX_ESP_HTTP_KEEPALIVE_H_
+
+#include <memory>
+#include <string>
+
+extern "C" {
+#include "src/http/ngx_http.h"
+}
+
+namespace google {
+namespace api_manager {
+namespace nginx {
+
+// A per-worker pool of idle upstream connections used by the HTTP client in
+// http.cc (service control, auth key fetches and metadata calls).
+//
+// Connections are grouped by a key identifying the scheme, host and port of
+// the upstream server. Each group keeps at most a configured number of idle
+// connections; the least recently used one is closed when the group is full.
+// Idle connections are closed when the server closes them, when they stay
+// unused longer than the idle timeout, or when the worker exits.
+//
+// All functions must be called on the nginx main thread.
+
+// Keep-alive statistics of the worker process.
+typedef struct {
+  // Number of requests sent over a reused idle connection.
+  uint64_t reused_connections;
+
+  // Number of requests which found no idle connection and had to connect.
+  uint64_t missed_connections;
+
+  // Number of connections currently idle in the pool.
+  uint64_t idle_connections;
+} ngx_esp_http_keepalive_stats_t;
+
+// An idle connection taken out of the pool, along with the address of the
+// peer it is connected to.
+class NgxEspHttpKeepaliveConnection {
+ public:
+  NgxEspHttpKeepaliveConnection(ngx_connection_t *connection,
+                                ngx_peer_connection_t *pc);
+
+  // Closes the connection unless it has been handed out by Attach().
+  ~NgxEspHttpKeepaliveConnection();
+
+  // Hands the connection over to the upstream peer, pointing the connection
+  // logs at the peer's log. The peer address remains owned by this object,
+  // which must outlive the upstream request. Returns false if the connection
+  // has already been handed out.
+  bool Attach(ngx_peer_connection_t *pc);
+
+ private:
+  NgxEspHttpKeepaliveConnection(const NgxEspHttpKeepaliveConnection &) =
+      delete;
+  NgxEspHttpKeepaliveConnection &operator=(
+      const NgxEspHttpKeepaliveConnection &) = delete;
+
+  ngx_connection_t *connection_;
+  ngx_sockaddr_t sockaddr_;
+  socklen_t socklen_;
+  std::string name_;
+  ngx_str_t name_str_;
+};
+
+// Configures the pool: at most max_idle idle connections are kept per key,
+// each one for up to timeout milliseconds. A max_idle of 0 disables the pool.
+void ngx_esp_http_keepalive_init(ngx_uint_t max_idle, ngx_msec_t timeout);
+
+// Returns true if idle connections are being kept for reuse.
+bool ngx_esp_http_keepalive_enabled();
+
+// Takes the most recently used idle connection for the key out of the pool.
+// Returns nullptr (and counts a miss) if there is none.
+std::unique_ptr<NgxEspHttpKeepaliveConnection> ngx_esp_http_keepalive_acquire(
+    const std::string &key);
+
+// Moves the upstream peer's connection into the pool. On success, the
+// connection is detached from the peer (pc->connection is reset to nullptr)
+// and true is returned. On failure, the peer is left untouched and the caller
+// remains responsible for closing the connection.
+bool ngx_esp_http_keepalive_release(const std::string &key,
+                                    ngx_peer_connection_t *pc);
+
+// Reads the keep-alive statistics of the worker process.
+void ngx_esp_http_keepalive_get_stats(ngx_esp_http_keepalive_stats_t *stats);
+
+}  // namespace nginx
+}  // namespace api_manager
+}  // namespace google
+
+#endif  // NGINX_NGX_ESP_HTTP_KEEPALIVE_H_
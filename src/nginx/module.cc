@@ -38,6 +38,7 @@
 #include "src/nginx/environment.h"
 #include "src/nginx/error.h"
 #include "src/nginx/response.h"
+#include "src/nginx/shared_cache.h"
 #include "src/nginx/status.h"
 #include "src/nginx/util.h"
 #include "src/nginx/version.h"
@@ -169,6 +170,22 @@ namespace {
 // During process exiting.
 const int kWaitCloseTime = 3;
 
+// Default maximum number of idle keep-alive connections per upstream server
+// used by service control, auth and metadata calls.
+const ngx_int_t kDefaultHttpKeepalive = 16;
+
+// Default time in milliseconds an idle keep-alive connection is kept open.
+const ngx_msec_t kDefaultHttpKeepaliveTimeout = 60000;
+
+// Default number of gRPC completion queues per worker process.
+const ngx_int_t kDefaultGrpcQueues = 1;
+
+// Default number of channels to each gRPC backend.
+const ngx_int_t kDefaultGrpcChannels = 1;
+
+// Default minimum size of a compressed gRPC response message.
+const size_t kDefaultGrpcResponseCompressionMinLength = 1024;
+
 // ********************************************************
 // * Extensible Service Proxy - Configuration declarations. *
 // ********************************************************
@@ -241,6 +258,106 @@ ngx_command_t ngx_esp_commands[] = {
         NGX_HTTP_LOC_CONF | NGX_CONF_NOARGS | NGX_CONF_TAKE12,
         ConfigureGrpcBackendHandler, NGX_HTTP_LOC_CONF_OFFSET, 0, nullptr,
     },
+    {
+        // Number of channels, each with its own HTTP/2 connection, to each
+        // gRPC backend. A call uses the channel with the fewest calls in
+        // flight, so the streams to a busy backend are not limited by the
+        // concurrent stream limit of one connection.
+        //
+        // Usage:
+        //   endpoints_grpc_channels <channels>;
+        //
+        ngx_string("endpoints_grpc_channels"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF |
+            NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_num_slot(
+              cf, cmd,
+              &reinterpret_cast<ngx_esp_loc_conf_t *>(conf)->grpc_channels);
+        },
+        NGX_HTTP_LOC_CONF_OFFSET, 0, nullptr,
+    },
+    {
+        // Interval and timeout of the keepalive pings on the channels to the
+        // gRPC backends. The gRPC defaults are used if not set.
+        //
+        // Usage:
+        //   endpoints_grpc_keepalive_time <time>;
+        //   endpoints_grpc_keepalive_timeout <time>;
+        //
+        ngx_string("endpoints_grpc_keepalive_time"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF |
+            NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_msec_slot(
+              cf, cmd, &reinterpret_cast<ngx_esp_loc_conf_t *>(conf)
+                            ->grpc_keepalive_time);
+        },
+        NGX_HTTP_LOC_CONF_OFFSET, 0, nullptr,
+    },
+    {
+        ngx_string("endpoints_grpc_keepalive_timeout"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF |
+            NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_msec_slot(
+              cf, cmd, &reinterpret_cast<ngx_esp_loc_conf_t *>(conf)
+                            ->grpc_keepalive_timeout);
+        },
+        NGX_HTTP_LOC_CONF_OFFSET, 0, nullptr,
+    },
+    {
+        // HTTP/2 stream flow control window of the channels to the gRPC
+        // backends. The gRPC default is used if not set.
+        //
+        // Usage:
+        //   endpoints_grpc_stream_window_size <size>;
+        //
+        ngx_string("endpoints_grpc_stream_window_size"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF |
+            NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_size_slot(
+              cf, cmd, &reinterpret_cast<ngx_esp_loc_conf_t *>(conf)
+                            ->grpc_stream_window_size);
+        },
+        NGX_HTTP_LOC_CONF_OFFSET, 0, nullptr,
+    },
+    {
+        // Compresses the gRPC pass-through response messages with gzip or
+        // deflate, whichever the client accepts in grpc-accept-encoding
+        // (gzip is preferred). Off by default.
+        //
+        // Usage:
+        //   endpoints_grpc_response_compression on|off;
+        //
+        ngx_string("endpoints_grpc_response_compression"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF |
+            NGX_CONF_FLAG,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_flag_slot(
+              cf, cmd, &reinterpret_cast<ngx_esp_loc_conf_t *>(conf)
+                            ->grpc_response_compression);
+        },
+        NGX_HTTP_LOC_CONF_OFFSET, 0, nullptr,
+    },
+    {
+        // The minimum size of a compressed gRPC response message. Smaller
+        // messages are not worth compressing and are sent as is.
+        //
+        // Usage:
+        //   endpoints_grpc_response_compression_min_length <size>;
+        //
+        ngx_string("endpoints_grpc_response_compression_min_length"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF |
+            NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_size_slot(
+              cf, cmd, &reinterpret_cast<ngx_esp_loc_conf_t *>(conf)
+                            ->grpc_response_compression_min_length);
+        },
+        NGX_HTTP_LOC_CONF_OFFSET, 0, nullptr,
+    },
     {
         ngx_string("endpoints_status"), NGX_HTTP_LOC_CONF | NGX_CONF_NOARGS,
         ngx_esp_configure_status_handler, NGX_HTTP_LOC_CONF_OFFSET, 0, nullptr,
@@ -264,6 +381,79 @@ ngx_command_t ngx_esp_commands[] = {
         },
         NGX_HTTP_MAIN_CONF_OFFSET, 0, nullptr,
     },
+    {
+        // Maximum number of idle connections kept open per upstream server
+        // by the HTTP client used for service control, auth and metadata
+        // calls. 0 disables connection reuse.
+        //
+        // Usage:
+        //   endpoints_http_keepalive <connections>;
+        //
+        ngx_string("endpoints_http_keepalive"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_num_slot(
+              cf, cmd,
+              &reinterpret_cast<ngx_esp_main_conf_t *>(conf)->http_keepalive);
+        },
+        NGX_HTTP_MAIN_CONF_OFFSET, 0, nullptr,
+    },
+    {
+        ngx_string("endpoints_http_keepalive_timeout"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_msec_slot(
+              cf, cmd, &reinterpret_cast<ngx_esp_main_conf_t *>(conf)
+                            ->http_keepalive_timeout);
+        },
+        NGX_HTTP_MAIN_CONF_OFFSET, 0, nullptr,
+    },
+    {
+        // Number of gRPC completion queues per worker process, each polled
+        // by its own thread. The gRPC calls are spread across the queues, so
+        // the events of many streaming calls can use more than one core.
+        //
+        // Usage:
+        //   endpoints_grpc_queues <queues>;
+        //
+        ngx_string("endpoints_grpc_queues"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          return ngx_conf_set_num_slot(
+              cf, cmd,
+              &reinterpret_cast<ngx_esp_main_conf_t *>(conf)->grpc_queues);
+        },
+        NGX_HTTP_MAIN_CONF_OFFSET, 0, nullptr,
+    },
+    {
+        // Size of the shared memory zone caching the verified auth tokens and
+        // the verification keys for all the worker processes. Without it,
+        // every worker verifies the tokens and fetches the keys on its own.
+        //
+        // Usage:
+        //   endpoints_shared_cache <size>;
+        //
+        ngx_string("endpoints_shared_cache"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        [](ngx_conf_t *cf, ngx_command_t *cmd, void *conf) -> char * {
+          auto *mc = reinterpret_cast<ngx_esp_main_conf_t *>(conf);
+          if (mc->shared_cache_zone != nullptr) {
+            return const_cast<char *>("is duplicate");
+          }
+          ngx_str_t *value = reinterpret_cast<ngx_str_t *>(cf->args->elts);
+          ssize_t size = ngx_parse_size(&value[1]);
+          if (size == NGX_ERROR) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid size \"%V\"",
+                               &value[1]);
+            return reinterpret_cast<char *>(NGX_CONF_ERROR);
+          }
+          if (ngx_esp_add_shared_cache(cf, size) != NGX_OK) {
+            return reinterpret_cast<char *>(NGX_CONF_ERROR);
+          }
+          return NGX_CONF_OK;
+        },
+        NGX_HTTP_MAIN_CONF_OFFSET, 0, nullptr,
+    },
     ngx_null_command  // last entry
 };
 
@@ -358,12 +548,27 @@ void *ngx_esp_create_main_conf(ngx_conf_t *cf) {
     return nullptr;
   }
 
+  conf->http_keepalive = NGX_CONF_UNSET;
+  conf->http_keepalive_timeout = NGX_CONF_UNSET_MSEC;
+  conf->grpc_queues = NGX_CONF_UNSET;
+
   return conf;
 }
 
 // Initialize module's main context configuration.
 char *ngx_esp_init_main_conf(ngx_conf_t *cf, void *conf) {
-  // noop
+  ngx_esp_main_conf_t *mc = reinterpret_cast<ngx_esp_main_conf_t *>(conf);
+
+  ngx_conf_init_value(mc->http_keepalive, kDefaultHttpKeepalive);
+  ngx_conf_init_msec_value(mc->http_keepalive_timeout,
+                           kDefaultHttpKeepaliveTimeout);
+  ngx_conf_init_value(mc->grpc_queues, kDefaultGrpcQueues);
+  if (mc->grpc_queues < 1) {
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "endpoints_grpc_queues must be at least 1");
+    return reinterpret_cast<char *>(NGX_CONF_ERROR);
+  }
+
   return NGX_CONF_OK;
 }
 
@@ -387,6 +592,12 @@ void *ngx_esp_create_loc_conf(ngx_conf_t *cf) {
   lc->service_control = NGX_CONF_UNSET;
   lc->cloud_tracing = NGX_CONF_UNSET;
   lc->api_authentication = NGX_CONF_UNSET;
+  lc->grpc_channels = NGX_CONF_UNSET;
+  lc->grpc_keepalive_time = NGX_CONF_UNSET_MSEC;
+  lc->grpc_keepalive_timeout = NGX_CONF_UNSET_MSEC;
+  lc->grpc_stream_window_size = NGX_CONF_UNSET_SIZE;
+  lc->grpc_response_compression = NGX_CONF_UNSET;
+  lc->grpc_response_compression_min_length = NGX_CONF_UNSET_SIZE;
 
   return lc;
 }
@@ -448,6 +659,32 @@ char *ngx_esp_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child) {
   ngx_conf_merge_str_value(conf->grpc_backend_address_fallback,
                            prev->grpc_backend_address_fallback, nullptr);
 
+  ngx_conf_merge_value(conf->grpc_channels, prev->grpc_channels,
+                       kDefaultGrpcChannels);
+  if (conf->grpc_channels < 1) {
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "endpoints_grpc_channels must be at least 1");
+    return reinterpret_cast<char *>(NGX_CONF_ERROR);
+  }
+  ngx_conf_merge_msec_value(conf->grpc_keepalive_time,
+                            prev->grpc_keepalive_time, NGX_CONF_UNSET_MSEC);
+  ngx_conf_merge_msec_value(conf->grpc_keepalive_timeout,
+                            prev->grpc_keepalive_timeout, NGX_CONF_UNSET_MSEC);
+  ngx_conf_merge_size_value(conf->grpc_stream_window_size,
+                            prev->grpc_stream_window_size, NGX_CONF_UNSET_SIZE);
+  if (conf->grpc_stream_window_size != NGX_CONF_UNSET_SIZE &&
+      conf->grpc_stream_window_size > NGX_MAX_INT32_VALUE) {
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "endpoints_grpc_stream_window_size is too large");
+    return reinterpret_cast<char *>(NGX_CONF_ERROR);
+  }
+
+  ngx_conf_merge_value(conf->grpc_response_compression,
+                       prev->grpc_response_compression, 0);
+  ngx_conf_merge_size_value(conf->grpc_response_compression_min_length,
+                            prev->grpc_response_compression_min_length,
+                            kDefaultGrpcResponseCompressionMinLength);
+
   if (conf->metadata_server == NGX_CONF_UNSET) {
     conf->metadata_server = prev->metadata_server;
     conf->metadata_server_url = prev->metadata_server_url;
@@ -1138,6 +1375,10 @@ ngx_int_t ngx_esp_init_process(ngx_cycle_t *cycle) {
     // Handle the case where there is no http section at all.
     return NGX_OK;
   }
+  // Configure the keep-alive pool before any outgoing HTTP request is made.
+  ngx_esp_http_keepalive_init(mc->http_keepalive, mc->http_keepalive_timeout);
+  ngx_esp_shared_cache_init(mc->shared_cache_zone);
+
   bool has_esp = false;
   ngx_esp_loc_conf_t **endpoints =
       reinterpret_cast<ngx_esp_loc_conf_t **>(mc->endpoints.elts);
@@ -1150,7 +1391,7 @@ ngx_int_t ngx_esp_init_process(ngx_cycle_t *cycle) {
     }
     if (lc->grpc_pass && !mc->grpc_queue) {
       mc->grpc_queue = NgxEspGrpcQueue::Instance();
-      mc->grpc_queue->Init(cycle);
+      mc->grpc_queue->Init(cycle, mc->grpc_queues);
     }
   }
 
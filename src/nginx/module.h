@@ -30,6 +30,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 extern "C" {
 #include "src/http/ngx_http.h"
@@ -56,6 +57,21 @@ namespace nginx {
 // * Extensible Service Proxy - Configuration declarations. *
 // ********************************************************
 
+typedef std::map<std::string, std::shared_ptr<::grpc::GenericStub>>
+    ngx_esp_grpc_stub_map_t;
+
+// The channels to a gRPC backend, each with its own connection. The calls
+// are spread across them.
+typedef struct {
+  std::vector<std::shared_ptr<::grpc::GenericStub>> stubs;
+  // The index of the stub preferred by the next call when the loads of the
+  // channels are equal.
+  size_t next;
+} ngx_esp_grpc_stub_pool_t;
+
+typedef std::map<std::string, ngx_esp_grpc_stub_pool_t>
+    ngx_esp_grpc_stub_pool_map_t;
+
 //
 // ESP Module Configuration - main context.
 //
@@ -73,9 +89,17 @@ typedef struct {
   // The module-level GRPC library interface.
   std::shared_ptr<NgxEspGrpcQueue> grpc_queue;
 
+  // The channels of the gRPC calls made by API Manager, such as the service
+  // control calls, keyed by the scheme and the address of the server.
+  ngx_esp_grpc_stub_map_t grpc_client_stubs;
+
   // Shared memory zone for stats per process
   ngx_shm_zone_t *stats_zone;
 
+  // Shared memory zone of the cache shared by the worker processes, nullptr
+  // if the cache is not configured.
+  ngx_shm_zone_t *shared_cache_zone;
+
   // Timer to update process stats
   std::unique_ptr<PeriodicTimer> stats_timer;
 
@@ -97,6 +121,17 @@ typedef struct {
   // Address of the http.cc upstream DNS resolver
   ngx_str_t upstream_resolver;
 
+  // Maximum number of idle connections the http.cc client keeps open per
+  // upstream server, 0 to close connections after every request.
+  ngx_int_t http_keepalive;
+
+  // How long an idle http.cc client connection is kept open.
+  ngx_msec_t http_keepalive_timeout;
+
+  // Number of gRPC completion queues, each polled by its own thread, used
+  // for the gRPC calls of the worker process.
+  ngx_int_t grpc_queues;
+
   // HTTP module configuration context pointers used for the HTTP implementation
   // based on NGINX upstream module. Only used in the HTTP subrequest path.
   ngx_http_conf_ctx_t http_module_conf_ctx;
@@ -108,9 +143,6 @@ typedef struct {
 
 } ngx_esp_main_conf_t;
 
-typedef std::map<std::string, std::shared_ptr<::grpc::GenericStub>>
-    ngx_esp_grpc_stub_map_t;
-
 //
 // ESP Module Configuration - location context.
 //
@@ -157,9 +189,21 @@ typedef struct {
   // Server config
   ngx_str_t endpoints_server_config;
 
-  // The map of backends to GRPC stubs.  These are constructed
+  // The map of backends to pools of GRPC stubs.  These are constructed
   // on-demand.
-  ngx_esp_grpc_stub_map_t grpc_stubs;
+  ngx_esp_grpc_stub_pool_map_t grpc_stubs;
+
+  // The number of channels to each GRPC backend.
+  ngx_int_t grpc_channels;
+
+  // The keepalive ping interval and timeout of the channels to the GRPC
+  // backends; NGX_CONF_UNSET_MSEC to use the GRPC defaults.
+  ngx_msec_t grpc_keepalive_time;
+  ngx_msec_t grpc_keepalive_timeout;
+
+  // The HTTP/2 stream flow control window of the channels to the GRPC
+  // backends; NGX_CONF_UNSET_SIZE to use the GRPC default.
+  size_t grpc_stream_window_size;
 
   // The GRPC backend address override.  If this is a non-zero-length
   // string, this is where all GRPC API traffic will be sent,
@@ -172,6 +216,14 @@ typedef struct {
   // configured backend address for the API method in the API service
   // configuration.
   ngx_str_t grpc_backend_address_fallback;
+
+  // Whether the gRPC pass-through response messages are compressed with an
+  // algorithm accepted by the client (grpc-accept-encoding).
+  ngx_flag_t grpc_response_compression;
+
+  // The minimum size of a compressed gRPC response message; smaller
+  // messages are sent uncompressed.
+  size_t grpc_response_compression_min_length;
 } ngx_esp_loc_conf_t;
 
 // **************************************************
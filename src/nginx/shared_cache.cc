@@ -0,0 +1,241 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "src/nginx/shared_cache.h"
+
+#include <stddef.h>
+
+#include "src/nginx/module.h"
+
+namespace google {
+namespace api_manager {
+namespace nginx {
+
+namespace {
+
+ngx_str_t shared_cache_name = ngx_string("esp_shared_cache");
+
+// The minimum size of the zone, nginx needs a few pages for the slab pool.
+const size_t kMinSharedCachePages = 8;
+
+// The state of the cache in the shared memory.
+struct SharedCacheState {
+  ngx_rbtree_t rbtree;
+  ngx_rbtree_node_t sentinel;
+  // Entries, the most recently used one first.
+  ngx_queue_t lru;
+};
+
+// The cache zone data, allocated in the configuration pool.
+struct SharedCache {
+  SharedCacheState *sh;
+  ngx_slab_pool_t *shpool;
+};
+
+// A cache entry allocated in the slab pool. The key and the value are stored
+// right after the entry, sn.str points to the key.
+struct SharedCacheEntry {
+  // sn.node.key is the hash of the key.
+  ngx_str_node_t sn;
+  ngx_queue_t queue;
+  // Expiration time, in milliseconds since the epoch.
+  int64_t expiration;
+  size_t value_len;
+  u_char data[1];
+};
+
+// The cache of the worker process, nullptr if not configured.
+SharedCache *shared_cache = nullptr;
+
+int64_t ToMilliseconds(std::chrono::system_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+ngx_int_t ngx_esp_shared_cache_init_zone(ngx_shm_zone_t *shm_zone,
+                                         void *data) {
+  auto *cache = reinterpret_cast<SharedCache *>(shm_zone->data);
+  if (data) {  // nginx is being reloaded, keep the cached entries
+    auto *old_cache = reinterpret_cast<SharedCache *>(data);
+    cache->sh = old_cache->sh;
+    cache->shpool = old_cache->shpool;
+    return NGX_OK;
+  }
+
+  cache->shpool = reinterpret_cast<ngx_slab_pool_t *>(shm_zone->shm.addr);
+  if (shm_zone->shm.exists) {
+    cache->sh = reinterpret_cast<SharedCacheState *>(cache->shpool->data);
+    return NGX_OK;
+  }
+
+  cache->sh = reinterpret_cast<SharedCacheState *>(
+      ngx_slab_alloc(cache->shpool, sizeof(SharedCacheState)));
+  if (cache->sh == nullptr) {
+    return NGX_ERROR;
+  }
+  cache->shpool->data = cache->sh;
+
+  ngx_rbtree_init(&cache->sh->rbtree, &cache->sh->sentinel,
+                  ngx_str_rbtree_insert_value);
+  ngx_queue_init(&cache->sh->lru);
+
+  // Running out of memory is expected, the LRU entries are evicted then.
+  cache->shpool->log_nomem = 0;
+  return NGX_OK;
+}
+
+// Removes an entry. Must be called with the mutex locked.
+void DeleteEntryLocked(SharedCacheEntry *entry) {
+  ngx_queue_remove(&entry->queue);
+  ngx_rbtree_delete(&shared_cache->sh->rbtree, &entry->sn.node);
+  ngx_slab_free_locked(shared_cache->shpool, entry);
+}
+
+// Finds the entry of a key. Must be called with the mutex locked.
+SharedCacheEntry *FindEntryLocked(ngx_str_t *key, uint32_t hash) {
+  return reinterpret_cast<SharedCacheEntry *>(
+      ngx_str_rbtree_lookup(&shared_cache->sh->rbtree, key, hash));
+}
+
+}  // namespace
+
+ngx_int_t ngx_esp_add_shared_cache(ngx_conf_t *cf, size_t size) {
+  if (size < kMinSharedCachePages * ngx_pagesize) {
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "endpoints shared cache size must be at least %uzK",
+                       kMinSharedCachePages * ngx_pagesize / 1024);
+    return NGX_ERROR;
+  }
+
+  auto *cache = reinterpret_cast<SharedCache *>(
+      ngx_pcalloc(cf->pool, sizeof(SharedCache)));
+  if (cache == nullptr) {
+    return NGX_ERROR;
+  }
+
+  auto *shm = ngx_shared_memory_add(cf, &shared_cache_name, size,
+                                    &ngx_esp_module);
+  if (shm == nullptr) {
+    ngx_log_error(NGX_LOG_ERR, cf->log, 0,
+                  "Failed to add shared memory for the shared cache");
+    return NGX_ERROR;
+  }
+  shm->init = ngx_esp_shared_cache_init_zone;
+  shm->data = cache;
+
+  ngx_esp_main_conf_t *mc = reinterpret_cast<ngx_esp_main_conf_t *>(
+      ngx_http_conf_get_module_main_conf(cf, ngx_esp_module));
+  mc->shared_cache_zone = shm;
+
+  return NGX_OK;
+}
+
+void ngx_esp_shared_cache_init(ngx_shm_zone_t *zone) {
+  shared_cache =
+      zone == nullptr ? nullptr : reinterpret_cast<SharedCache *>(zone->data);
+}
+
+bool ngx_esp_shared_cache_lookup(
+    const std::string &key, std::string *value,
+    std::chrono::system_clock::time_point *expiration) {
+  if (shared_cache == nullptr) {
+    return false;
+  }
+
+  ngx_str_t name = {key.size(),
+                    reinterpret_cast<u_char *>(const_cast<char *>(key.data()))};
+  uint32_t hash = ngx_crc32_long(name.data, name.len);
+  int64_t now = ToMilliseconds(std::chrono::system_clock::now());
+  bool found = false;
+
+  ngx_shmtx_lock(&shared_cache->shpool->mutex);
+  SharedCacheEntry *entry = FindEntryLocked(&name, hash);
+  if (entry != nullptr) {
+    if (now >= entry->expiration) {
+      DeleteEntryLocked(entry);
+    } else {
+      value->assign(reinterpret_cast<char *>(entry->data) + key.size(),
+                    entry->value_len);
+      *expiration = std::chrono::system_clock::time_point(
+          std::chrono::milliseconds(entry->expiration));
+      ngx_queue_remove(&entry->queue);
+      ngx_queue_insert_head(&shared_cache->sh->lru, &entry->queue);
+      found = true;
+    }
+  }
+  ngx_shmtx_unlock(&shared_cache->shpool->mutex);
+
+  return found;
+}
+
+void ngx_esp_shared_cache_insert(
+    const std::string &key, const std::string &value,
+    std::chrono::system_clock::time_point expiration) {
+  if (shared_cache == nullptr) {
+    return;
+  }
+
+  ngx_str_t name = {key.size(),
+                    reinterpret_cast<u_char *>(const_cast<char *>(key.data()))};
+  uint32_t hash = ngx_crc32_long(name.data, name.len);
+  size_t size = offsetof(SharedCacheEntry, data) + key.size() + value.size();
+  ngx_queue_t *lru = &shared_cache->sh->lru;
+
+  ngx_shmtx_lock(&shared_cache->shpool->mutex);
+  SharedCacheEntry *entry = FindEntryLocked(&name, hash);
+  if (entry != nullptr) {
+    DeleteEntryLocked(entry);
+  }
+
+  // Evicts the least recently used entries until the new entry fits.
+  void *memory = ngx_slab_alloc_locked(shared_cache->shpool, size);
+  while (memory == nullptr && !ngx_queue_empty(lru)) {
+    DeleteEntryLocked(ngx_queue_data(ngx_queue_last(lru), SharedCacheEntry,
+                                     queue));
+    memory = ngx_slab_alloc_locked(shared_cache->shpool, size);
+  }
+  if (memory == nullptr) {
+    ngx_shmtx_unlock(&shared_cache->shpool->mutex);
+    return;
+  }
+
+  entry = reinterpret_cast<SharedCacheEntry *>(memory);
+  ngx_memcpy(entry->data, key.data(), key.size());
+  ngx_memcpy(entry->data + key.size(), value.data(), value.size());
+  entry->sn.node.key = hash;
+  entry->sn.str.len = key.size();
+  entry->sn.str.data = entry->data;
+  entry->expiration = ToMilliseconds(expiration);
+  entry->value_len = value.size();
+  ngx_rbtree_insert(&shared_cache->sh->rbtree, &entry->sn.node);
+  ngx_queue_insert_head(lru, &entry->queue);
+  ngx_shmtx_unlock(&shared_cache->shpool->mutex);
+}
+
+}  // namespace nginx
+}  // namespace api_manager
+}  // namespace google
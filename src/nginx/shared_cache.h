@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) Extensible Service Proxy Authors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef NGINX_NGX_ESP_SHARED_CACHE_H_
+#define NGINX_NGX_ESP_SHARED_CACHE_H_
+
+#include <chrono>
+#include <string>
+
+extern "C" {
+#include "src/http/ngx_http.h"
+}
+
+namespace google {
+namespace api_manager {
+namespace nginx {
+
+// A key-value cache in a shared memory zone, shared by all the worker
+// processes. API Manager stores the verified JWTs and the fetched
+// verification keys in it, so that a token is verified and a key is fetched
+// once per host rather than once per worker.
+//
+// Entries are kept in a red-black tree keyed by the hash of the key, and in
+// a LRU queue. The least recently used entries are evicted when the zone is
+// full, an expired entry is removed when it is looked up. The zone is
+// protected by the mutex of its slab pool.
+
+// Adds the shared memory zone of the cache, of the given size in bytes.
+// Called while parsing the configuration.
+ngx_int_t ngx_esp_add_shared_cache(ngx_conf_t *cf, size_t size);
+
+// Attaches the worker process to the cache zone, nullptr if the cache is
+// not configured. Called in the worker process initialization.
+void ngx_esp_shared_cache_init(ngx_shm_zone_t *zone);
+
+// Looks up a value which has not expired. Returns false if the value is not
+// found or the cache is not configured.
+bool ngx_esp_shared_cache_lookup(
+    const std::string &key, std::string *value,
+    std::chrono::system_clock::time_point *expiration);
+
+// Inserts a value, replacing the existing value of the key. Does nothing if
+// the cache is not configured or the value does not fit in the zone.
+void ngx_esp_shared_cache_insert(
+    const std::string &key, const std::string &value,
+    std::chrono::system_clock::time_point expiration);
+
+}  // namespace nginx
+}  // namespace api_manager
+}  // namespace google
+
+#endif  // NGINX_NGX_ESP_SHARED_CACHE_H_
@@ -55,6 +55,8 @@ using service_control::Statistics;
 using utils::Status;
 using ServiceControlStatisticsProto =
     ::google::api_manager::proto::ServiceControlStatistics;
+using JwtCacheStatisticsProto =
+    ::google::api_manager::proto::JwtCacheStatistics;
 using ServiceConfigRolloutsProto =
     ::google::api_manager::proto::ServiceConfigRollouts;
 
@@ -110,6 +112,26 @@ void fill_service_control_statistics(const Statistics &stat,
   pb->set_send_reports_in_flight(stat.send_reports_in_flight);
   pb->set_send_report_operations(stat.send_report_operations);
   pb->set_max_report_size(stat.max_report_size);
+  for (int i = 0; i < Statistics::kReportSizeBuckets; i++) {
+    pb->add_report_size_counts(stat.report_size_counts[i]);
+  }
+  pb->set_circuit_breaker_open(stat.circuit_breaker_open);
+  pb->set_circuit_breaker_opens(stat.circuit_breaker_opens);
+  pb->set_circuit_breaker_rejected_calls(stat.circuit_breaker_rejected_calls);
+  pb->set_check_latency_p50_ms(stat.check_latency_p50_ms);
+  pb->set_check_latency_p99_ms(stat.check_latency_p99_ms);
+  pb->set_quota_latency_p50_ms(stat.quota_latency_p50_ms);
+  pb->set_quota_latency_p99_ms(stat.quota_latency_p99_ms);
+  pb->set_hedged_calls(stat.hedged_calls);
+  pb->set_check_result_cache_hits(stat.check_result_cache_hits);
+}
+
+void fill_jwt_cache_statistics(const JwtCacheStatistics &stat,
+                               JwtCacheStatisticsProto *pb) {
+  pb->set_hits(stat.hits);
+  pb->set_misses(stat.misses);
+  pb->set_evictions(stat.evictions);
+  pb->set_entries(stat.entries);
 }
 
 void fill_process_stats(const ngx_esp_process_stats_t &stat,
@@ -123,12 +145,24 @@ void fill_process_stats(const ngx_esp_process_stats_t &stat,
   process_status->set_system_cpu_time_us(stat.sys_time.count());
   process_status->set_user_cpu_time_us(stat.user_time.count());
 
+  auto *http_client_statistics =
+      process_status->mutable_http_client_statistics();
+  http_client_statistics->set_keepalive_reused_connections(
+      stat.http_keepalive.reused_connections);
+  http_client_statistics->set_keepalive_missed_connections(
+      stat.http_keepalive.missed_connections);
+  http_client_statistics->set_keepalive_idle_connections(
+      stat.http_keepalive.idle_connections);
+
   for (int j = 0; j < stat.num_esp; ++j) {
     auto *esp_status_proto = process_status->add_esp_status();
     esp_status_proto->set_service_name(stat.esp_stats[j].service_name);
     fill_service_control_statistics(
         stat.esp_stats[j].statistics.service_control_statistics,
         esp_status_proto->mutable_service_control_statistics());
+    fill_jwt_cache_statistics(
+        stat.esp_stats[j].statistics.jwt_cache_statistics,
+        esp_status_proto->mutable_jwt_cache_statistics());
     esp_status_proto->mutable_service_config_rollouts()->ParseFromArray(
         stat.esp_stats[j].rollouts, stat.esp_stats[j].rollouts_length);
   }
@@ -369,6 +403,7 @@ ngx_int_t ngx_esp_init_process_stats(ngx_cycle_t *cycle) {
     process_stat->maxrss = r.ru_maxrss;
     get_current_memory_usage(&process_stat->virtual_size,
                              &process_stat->current_rss);
+    ngx_esp_http_keepalive_get_stats(&process_stat->http_keepalive);
 
     int esp_idx = 0;
     ngx_esp_loc_conf_t **endpoints =
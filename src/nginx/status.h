@@ -29,6 +29,7 @@
 #include <chrono>
 
 #include "include/api_manager/api_manager.h"
+#include "src/nginx/http_keepalive.h"
 
 extern "C" {
 #include "src/http/ngx_http.h"
@@ -77,6 +78,9 @@ typedef struct {
   };
   EspData esp_stats[kMaxEspNum];
 
+  // Keep-alive statistics of the outgoing HTTP connections.
+  ngx_esp_http_keepalive_stats_t http_keepalive;
+
 } ngx_esp_process_stats_t;
 
 // Adds shared memory for process stats
@@ -326,6 +326,12 @@ sub grpc_test_server {
   exec $server, @args;
 }
 
+sub grpc_service_control_server {
+  my ($t, @args) = @_;
+  my $server = './test/grpc/grpc-service-control-server';
+  exec $server, @args;
+}
+
 sub grpc_interop_server {
   my ($t, $port) = @_;
   my $server = './external/org_golang_google_grpc/interop/server/server';
@@ -395,8 +401,10 @@ sub run_nginx_with_stderr_redirect {
   # redirect, fork & run, restore
   open ORIGINAL, ">&", \*STDERR;
   open STDERR, ">", $redirect_file;
-  $t->run();
+  eval { $t->run(); };
+  my $error = $@;
   open STDERR, ">&", \*ORIGINAL;
+  die $error if $error;
 }
 
 # Runs an HTTP server that returns "404 Not Found" for every request.
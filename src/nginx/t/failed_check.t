@@ -99,7 +99,7 @@ like($response1, qr/content-type: application\/json/i,
 like($response1, qr/API endpoints-test.cloudendpointsapis.com is not enabled for the project/i,
   "Error body contains 'activation error'.");
 
-like($response2, qr/HTTP\/1\.1 503 Service Temporarily Unavailable/, 'Response2 returned HTTP 503.');
+like($response2, qr/HTTP\/1\.1 403 Forbidden/, 'Response2 returned HTTP 403.');
 like($response2, qr/content-type: application\/json/i,
      'Unauthorized returned application/json body.');
 like($response2, qr/Service control request failed/i, "Error body contains 'service control failed'.");
@@ -0,0 +1,112 @@
+# Copyright (C) Extensible Service Proxy Authors
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+################################################################################
+#
+use strict;
+use warnings;
+
+################################################################################
+
+use src::nginx::t::ApiManager;   # Must be first (sets up import path to the Nginx test module)
+use src::nginx::t::HttpServer;
+use Test::Nginx;  # Imports Nginx's test module
+use Test::More;   # And the test framework
+
+################################################################################
+
+# Port assignments
+my $NginxPort = ApiManager::pick_port();
+my $GrpcBackendPort = ApiManager::pick_port();
+
+my $t = Test::Nginx->new()->has(qw/http proxy/)->plan(8);
+
+# Nginx refuses to start with an invalid value of a gRPC channel directive.
+my @invalid_directives = (
+  [ 'endpoints_grpc_channels 0;',
+    'endpoints_grpc_channels must be at least 1' ],
+  [ 'endpoints_grpc_channels many;',
+    '"endpoints_grpc_channels" directive invalid number' ],
+  [ 'endpoints_grpc_keepalive_time forever;',
+    '"endpoints_grpc_keepalive_time" directive invalid value' ],
+  [ 'endpoints_grpc_keepalive_timeout 5x;',
+    '"endpoints_grpc_keepalive_timeout" directive invalid value' ],
+  [ 'endpoints_grpc_stream_window_size big;',
+    '"endpoints_grpc_stream_window_size" directive invalid value' ],
+  [ 'endpoints_grpc_stream_window_size 4g;',
+    'endpoints_grpc_stream_window_size is too large' ],
+);
+
+foreach my $invalid (@invalid_directives) {
+  my ($directive, $error) = @$invalid;
+  write_nginx_conf($t, $directive);
+  eval { ApiManager::run_nginx_with_stderr_redirect($t) };
+  like($t->read_file('stderr.log'), qr/\[emerg\].*\Q${error}\E/,
+       "Nginx rejected '${directive}'.");
+}
+
+# Nginx starts with valid values, set at the location or at the server level.
+my $valid_directives = 'endpoints_grpc_channels 4; ' .
+    'endpoints_grpc_keepalive_time 10s; ' .
+    'endpoints_grpc_keepalive_timeout 5s; ' .
+    'endpoints_grpc_stream_window_size 1m;';
+
+write_nginx_conf($t, $valid_directives);
+$t->run();
+is($t->waitforsocket("127.0.0.1:${NginxPort}"), 1, 'Nginx started with location level values.');
+$t->stop();
+
+write_nginx_conf($t, '', $valid_directives);
+$t->run();
+is($t->waitforsocket("127.0.0.1:${NginxPort}"), 1, 'Nginx started with server level values.');
+$t->stop();
+
+################################################################################
+
+sub write_nginx_conf {
+  my ($t, $location_directives, $server_directives) = @_;
+  $server_directives //= '';
+
+  ApiManager::write_file_expand($t, 'nginx.conf', <<"EOF");
+%%TEST_GLOBALS%%
+daemon off;
+events {
+  worker_connections 32;
+}
+http {
+  %%TEST_GLOBALS_HTTP%%
+  server {
+    listen 127.0.0.1:${NginxPort} http2;
+    server_name localhost;
+    ${server_directives}
+    location / {
+      ${location_directives}
+      grpc_pass 127.0.0.1:${GrpcBackendPort};
+    }
+  }
+}
+EOF
+}
+
+################################################################################
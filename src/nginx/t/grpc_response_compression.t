@@ -0,0 +1,208 @@
+# Copyright (C) Extensible Service Proxy Authors
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+################################################################################
+#
+use strict;
+use warnings;
+
+################################################################################
+
+use src::nginx::t::ApiManager;   # Must be first (sets up import path to the Nginx test module)
+use src::nginx::t::HttpServer;
+use Test::Nginx;  # Imports Nginx's test module
+use Test::More;   # And the test framework
+
+################################################################################
+
+# Port assignments
+my $ServiceControlPort = ApiManager::pick_port();
+my $Http2NginxPort = ApiManager::pick_port();
+my $HttpNginxPort = ApiManager::pick_port();
+my $GrpcBackendPort = ApiManager::pick_port();
+my $GrpcFallbackPort = ApiManager::pick_port();
+
+my $t = Test::Nginx->new()->has(qw/http proxy/)->plan(10);
+$t->write_file('service.pb.txt',
+        ApiManager::get_grpc_test_service_config($GrpcBackendPort) . <<"EOF");
+control {
+  environment: "http://127.0.0.1:${ServiceControlPort}"
+}
+EOF
+
+# Each request names its case in x-compression-case, and the access log
+# records the grpc-encoding ESP picked for the response.
+ApiManager::write_file_expand($t, 'nginx.conf', <<"EOF");
+%%TEST_GLOBALS%%
+daemon off;
+events {
+  worker_connections 32;
+}
+http {
+  %%TEST_GLOBALS_HTTP%%
+  log_format compression '\$http_x_compression_case \$sent_http_grpc_encoding';
+  server {
+    listen 127.0.0.1:${Http2NginxPort} http2;
+    listen 127.0.0.1:${HttpNginxPort};
+    server_name localhost;
+    access_log compression.log compression;
+    location / {
+      endpoints {
+        api service.pb.txt;
+        %%TEST_CONFIG%%
+        on;
+      }
+      endpoints_grpc_response_compression on;
+      endpoints_grpc_response_compression_min_length 32;
+      grpc_pass 127.0.0.2:${GrpcFallbackPort};
+    }
+  }
+}
+EOF
+
+$t->run_daemon(\&service_control, $t, $ServiceControlPort, 'servicecontrol.log');
+$t->run_daemon(\&ApiManager::grpc_test_server, $t, "127.0.0.1:${GrpcBackendPort}");
+is($t->waitforsocket("127.0.0.1:${ServiceControlPort}"), 1, 'Service control socket ready.');
+is($t->waitforsocket("127.0.0.1:${GrpcBackendPort}"), 1, 'GRPC test server socket ready.');
+$t->run();
+is($t->waitforsocket("127.0.0.1:${Http2NginxPort}"), 1, 'Nginx HTTP/2 socket ready.');
+is($t->waitforsocket("127.0.0.1:${HttpNginxPort}"), 1, 'Nginx HTTP/1 socket ready.');
+
+my $text = 'Compress me: ' . ('_' x 64);
+
+################################################################################
+# The client accepts gzip, so the response is compressed, and the client
+# library decompresses it back into the echoed text.
+my $test_results = &ApiManager::run_grpc_test($t, <<"EOF");
+server_addr: "127.0.0.1:${Http2NginxPort}"
+plans {
+  echo {
+    call_config {
+      api_key: "this-is-an-api-key"
+      metadata {
+        key: "x-compression-case"
+        value: "accepting"
+      }
+    }
+    request {
+      text: "${text}"
+    }
+  }
+}
+EOF
+
+my $test_results_expected = <<"EOF";
+results {
+  echo {
+    text: "${text}"
+  }
+}
+EOF
+is($test_results, $test_results_expected, 'Accepting client got the echo.');
+
+################################################################################
+# The client only accepts the identity encoding.
+$test_results = &ApiManager::run_grpc_test($t, <<"EOF");
+server_addr: "127.0.0.1:${Http2NginxPort}"
+plans {
+  echo {
+    call_config {
+      api_key: "this-is-an-api-key"
+      identity_response_only: true
+      metadata {
+        key: "x-compression-case"
+        value: "identity"
+      }
+    }
+    request {
+      text: "${text}"
+    }
+  }
+}
+EOF
+is($test_results, $test_results_expected, 'Identity client got the echo.');
+
+################################################################################
+# gRPC-Web responses are never compressed, even if the client accepts gzip.
+# Request body:
+# | 1 byte gRPC-Web flag | 4 bytes length | EchoRequest with text |
+my $request = "\x0a" . chr(length($text)) . $text;
+my $frame = "\x00" . pack('N', length($request)) . $request;
+my $content_length = length($frame);
+
+my $response = ApiManager::http($HttpNginxPort, <<"EOF" . $frame);
+POST /test.grpc.Test/Echo HTTP/1.0
+Host: 127.0.0.1:${HttpNginxPort}
+Content-Type: application/grpc-web
+grpc-accept-encoding: gzip
+x-api-key: this-is-an-api-key
+x-compression-case: grpc-web
+Content-Length: ${content_length}
+
+EOF
+
+my ($response_headers, $response_body) = split /\r\n\r\n/, $response, 2;
+unlike($response_headers, qr/grpc-encoding/i, 'gRPC-Web response has no grpc-encoding.');
+like($response_body, qr/^\x00.{4}.*\Q${text}\E/s,
+     'gRPC-Web response message is not compressed.');
+
+$t->stop_daemons();
+
+################################################################################
+
+my $log = $t->read_file('compression.log');
+like($log, qr/^accepting gzip$/m, 'Response to the accepting client was gzipped.');
+is(join("\n", grep { !/^accepting/ } split(/\n/, $log)),
+   "identity -\ngrpc-web -",
+   'Other responses were not compressed.');
+
+################################################################################
+
+sub service_control {
+  my ($t, $port, $file) = @_;
+  my $server = HttpServer->new($port, $t->testdir() . '/' . $file)
+    or die "Can't create test server socket: $!\n";
+
+  $server->on_sub('POST', '/v1/services/endpoints-grpc-test.cloudendpointsapis.com:check', sub {
+    my ($headers, $body, $client) = @_;
+    print $client <<'EOF';
+HTTP/1.1 200 OK
+Connection: close
+
+EOF
+  });
+
+  $server->on_sub('POST', '/v1/services/endpoints-grpc-test.cloudendpointsapis.com:report', sub {
+    my ($headers, $body, $client) = @_;
+    print $client <<'EOF';
+HTTP/1.1 200 OK
+Connection: close
+
+EOF
+  });
+
+  $server->run();
+}
+
+################################################################################
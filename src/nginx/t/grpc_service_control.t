@@ -0,0 +1,147 @@
+# Copyright (C) Extensible Service Proxy Authors
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+################################################################################
+#
+use strict;
+use warnings;
+
+################################################################################
+
+use src::nginx::t::ApiManager;   # Must be first (sets up import path to the Nginx test module)
+use src::nginx::t::HttpServer;
+use Test::Nginx;  # Imports Nginx's test module
+use Test::More;   # And the test framework
+
+################################################################################
+
+# Port assignments
+my $NginxPort = ApiManager::pick_port();
+my $BackendPort = ApiManager::pick_port();
+my $ServiceControlPort = ApiManager::pick_port();
+
+my $t = Test::Nginx->new()->has(qw/http proxy/)->plan(8);
+
+$t->write_file('service.pb.txt', ApiManager::get_bookstore_service_config . <<"EOF");
+control {
+  environment: "http://127.0.0.1:${ServiceControlPort}"
+}
+EOF
+
+# The service control calls are sent over gRPC.
+$t->write_file('server_config.pb.txt', <<"EOF");
+service_control_config {
+  transport: "grpc"
+}
+EOF
+
+ApiManager::write_file_expand($t, 'nginx.conf', <<"EOF");
+%%TEST_GLOBALS%%
+daemon off;
+events {
+  worker_connections 32;
+}
+http {
+  %%TEST_GLOBALS_HTTP%%
+  server_tokens off;
+  server {
+    listen 127.0.0.1:${NginxPort};
+    server_name localhost;
+    location / {
+      endpoints {
+        api service.pb.txt;
+        server_config server_config.pb.txt;
+        %%TEST_CONFIG%%
+        on;
+      }
+      proxy_pass http://127.0.0.1:${BackendPort};
+    }
+  }
+}
+EOF
+
+$t->run_daemon(\&bookstore, $t, $BackendPort, 'bookstore.log');
+$t->run_daemon(\&ApiManager::grpc_service_control_server, $t,
+               "127.0.0.1:${ServiceControlPort}",
+               $t->testdir() . '/servicecontrol.log');
+is($t->waitforsocket("127.0.0.1:${BackendPort}"), 1, 'Bookstore socket ready.');
+is($t->waitforsocket("127.0.0.1:${ServiceControlPort}"), 1,
+   'Service control socket ready.');
+$t->run();
+
+################################################################################
+
+my $response = ApiManager::http_get($NginxPort, '/shelves?key=api-key-1');
+like($response, qr/HTTP\/1\.1 200 OK/, 'Allowed API key returned HTTP 200.');
+
+# The gRPC status of the check is not turned into UNAVAILABLE, which would
+# let the request through.
+$response = ApiManager::http_get($NginxPort, '/shelves?key=denied-api-key');
+like($response, qr/HTTP\/1\.1 403 Forbidden/,
+     'Denied API key returned HTTP 403.');
+like($response, qr/API key denied/, 'The error of the check is returned.');
+
+# Wait for the reports, which are flushed periodically.
+my @calls;
+for (my $i = 0; $i < 100; $i++) {
+  @calls = split /\n/, $t->read_file('servicecontrol.log');
+  last if grep { /\/Report$/ } @calls;
+  select undef, undef, undef, 0.1;
+}
+
+$t->stop_daemons();
+
+my @checks = grep { /\/Check / } @calls;
+is_deeply(\@checks, [
+  '/google.api.servicecontrol.v1.ServiceController/Check api_key:api-key-1',
+  '/google.api.servicecontrol.v1.ServiceController/Check api_key:denied-api-key',
+], 'Both checks were sent over gRPC.');
+ok((grep { $_ eq '/google.api.servicecontrol.v1.ServiceController/Report' }
+    @calls), 'The reports were sent over gRPC.');
+
+my @requests = ApiManager::read_http_stream($t, 'bookstore.log');
+is(scalar @requests, 1, 'Only the allowed request reached the backend.');
+
+################################################################################
+
+sub bookstore {
+  my ($t, $port, $file) = @_;
+  my $server = HttpServer->new($port, $t->testdir() . '/' . $file)
+    or die "Can't create test server socket: $!\n";
+  local $SIG{PIPE} = 'IGNORE';
+
+  $server->on_sub('GET', '/shelves', sub {
+    my ($headers, $body, $client) = @_;
+    print $client <<'EOF';
+HTTP/1.1 200 OK
+Connection: close
+
+{ "shelves": [] }
+EOF
+  });
+
+  $server->run();
+}
+
+################################################################################
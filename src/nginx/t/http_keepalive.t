@@ -0,0 +1,195 @@
+# Copyright (C) Extensible Service Proxy Authors
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+################################################################################
+#
+use strict;
+use warnings;
+
+################################################################################
+
+use src::nginx::t::ApiManager;   # Must be first (sets up import path to the Nginx test module)
+use src::nginx::t::HttpServer;
+use IO::Socket::INET;
+use Test::Nginx;  # Imports Nginx's test module
+use Test::More;   # And the test framework
+
+################################################################################
+
+# Port assignments
+my $NginxPort = ApiManager::pick_port();
+my $BackendPort = ApiManager::pick_port();
+my $ServiceControlPort = ApiManager::pick_port();
+
+my $t = Test::Nginx->new()->has(qw/http proxy/)->plan(8);
+
+# Save service name in the service configuration protocol buffer file.
+
+$t->write_file('service.pb.txt', ApiManager::get_bookstore_service_config . <<"EOF");
+control {
+  environment: "http://127.0.0.1:${ServiceControlPort}"
+}
+EOF
+
+ApiManager::write_file_expand($t, 'nginx.conf', <<"EOF");
+%%TEST_GLOBALS%%
+daemon off;
+events {
+  worker_connections 32;
+}
+http {
+  %%TEST_GLOBALS_HTTP%%
+  server_tokens off;
+  endpoints_http_keepalive 4;
+  server {
+    listen 127.0.0.1:${NginxPort};
+    server_name localhost;
+    location /endpoints_status {
+      endpoints_status;
+    }
+    location / {
+      endpoints {
+        api service.pb.txt;
+        %%TEST_CONFIG%%
+        on;
+      }
+      proxy_pass http://127.0.0.1:${BackendPort};
+    }
+  }
+}
+EOF
+
+$t->run_daemon(\&bookstore, $t, $BackendPort, 'bookstore.log');
+$t->run_daemon(\&servicecontrol, $t, $ServiceControlPort,
+               'servicecontrol.log', 'connections.log');
+is($t->waitforsocket("127.0.0.1:${BackendPort}"), 1, 'Bookstore socket ready.');
+is($t->waitforsocket("127.0.0.1:${ServiceControlPort}"), 1, 'Service control socket ready.');
+$t->run();
+
+################################################################################
+
+# Different API keys so that every request misses the check cache.
+ApiManager::http_get($NginxPort,'/shelves?key=api-key-1');
+ApiManager::http_get($NginxPort,'/shelves?key=api-key-2');
+my $response = ApiManager::http_get($NginxPort,'/shelves?key=api-key-3');
+
+# Wait for the process statistics to be refreshed.
+sleep 2;
+my $status = ApiManager::http_get($NginxPort,'/endpoints_status');
+
+$t->stop_daemons();
+
+like($response, qr/HTTP\/1\.1 200 OK/, 'Returned HTTP 200.');
+
+my @requests = ApiManager::read_http_stream($t, 'servicecontrol.log');
+my @checks = grep { $_->{uri} =~ /:check$/ } @requests;
+is(scalar @checks, 3, 'Service control received three checks');
+is($checks[0]->{headers}->{connection}, undef,
+   'Check did not ask to close the connection');
+
+my @connections = split /\n/, $t->read_file('connections.log');
+is(scalar @connections, 1, 'All service control calls used one connection');
+
+like($status, qr/"keepaliveReusedConnections": "[2-9]"/,
+     'Reused connections were counted.');
+like($status, qr/"keepaliveIdleConnections": "1"/,
+     'Idle connection was counted.');
+
+################################################################################
+
+sub bookstore {
+  my ($t, $port, $file) = @_;
+  my $server = HttpServer->new($port, $t->testdir() . '/' . $file)
+    or die "Can't create test server socket: $!\n";
+  local $SIG{PIPE} = 'IGNORE';
+
+  $server->on_sub('GET', '/shelves', sub {
+    my ($headers, $body, $client) = @_;
+    print $client <<'EOF';
+HTTP/1.1 200 OK
+Connection: close
+
+{ "shelves": [] }
+EOF
+  });
+
+  $server->run();
+}
+
+# A service control server which serves any number of requests on one
+# connection, logging the requests and the connections they arrived on.
+sub servicecontrol {
+  my ($t, $port, $file, $connections_file) = @_;
+  my $server = IO::Socket::INET->new(
+      Proto => 'tcp',
+      LocalHost => '127.0.0.1',
+      LocalPort => $port,
+      Listen => 5,
+      Reuse => 1
+  )
+  or die "Can't create test server socket: $!\n";
+  local $SIG{PIPE} = 'IGNORE';
+
+  open my $rh, '>', $t->testdir() . '/' . $file
+    or die "cannot open > $file";
+  open my $ch, '>', $t->testdir() . '/' . $connections_file
+    or die "cannot open > $connections_file";
+  select $ch; $| = 1; # Enable auto-flush.
+  select $rh; $| = 1;
+
+  while (my $client = $server->accept()) {
+    $client->autoflush(1);
+    my $count = 0;
+
+    while (my $request = <$client>) {
+      while (my $line = <$client>) {
+        $request .= $line;
+        last if ($line =~ /^\x0d?\x0a?$/);
+      }
+
+      my $content_length = 0;
+      if ($request =~ /content-length:\s*(\d+)/i) {
+        $content_length = $1;
+      }
+      my $body = '';
+      while (length $body < $content_length) {
+        my $chunk = '';
+        $client->read($chunk, $content_length - length $body) or last;
+        $body .= $chunk;
+      }
+      print $rh $request . $body;
+
+      print $client "HTTP/1.1 200 OK\r\n" .
+                    "Content-Type: application/x-protobuf\r\n" .
+                    "Content-Length: 0\r\n\r\n";
+      $count++;
+    }
+
+    # Connections without requests (e.g. from waitforsocket) are not counted.
+    print $ch "connection served $count requests\n" if $count > 0;
+    close $client;
+  }
+}
+
+################################################################################
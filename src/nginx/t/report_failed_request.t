@@ -138,7 +138,7 @@ sub servicecontrol {
   $server->on_sub('POST', '/v1/services/endpoints-test.cloudendpointsapis.com:check', sub {
     my ($headers, $body, $client) = @_;
     print $client <<'EOF';
-HTTP/1.1 403 Forbidden
+HTTP/1.1 503 Service Unavailable
 Connection: close
 
 EOF
@@ -90,12 +90,35 @@ std::shared_ptr<ChannelCredentials> GetCreds(const EchoStreamTest &desc) {
   return GetCreds(desc.call_config());
 }
 
+template <class T>
+void SetChannelArgs(const T &unused_desc, ChannelArguments *unused_args) {}
+
+template <>
+void SetChannelArgs(const CallConfig &call_config, ChannelArguments *args) {
+  if (call_config.identity_response_only()) {
+    // Only advertise the identity encoding in grpc-accept-encoding.
+    args->SetInt(GRPC_COMPRESSION_CHANNEL_ENABLED_ALGORITHMS_BITSET,
+                 1 << GRPC_COMPRESS_NONE);
+  }
+}
+
+template <>
+void SetChannelArgs(const EchoTest &desc, ChannelArguments *args) {
+  SetChannelArgs(desc.call_config(), args);
+}
+
+template <>
+void SetChannelArgs(const EchoStreamTest &desc, ChannelArguments *args) {
+  SetChannelArgs(desc.call_config(), args);
+}
+
 template <class T>
 static std::unique_ptr<Test::Stub> GetStub(const std::string &addr,
                                            const T &desc) {
   ChannelArguments args;
   args.SetMaxReceiveMessageSize(INT_MAX);
   args.SetMaxSendMessageSize(INT_MAX);
+  SetChannelArgs(desc, &args);
   std::shared_ptr<Channel> channel(
       CreateCustomChannel(addr, GetCreds(desc), args));
   return std::unique_ptr<Test::Stub>(Test::NewStub(channel));
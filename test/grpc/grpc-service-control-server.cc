@@ -0,0 +1,211 @@
+// Copyright (C) Extensible Service Proxy Authors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//
+// A stand-in for the service control server, used to test the gRPC transport
+// of the service control calls. Check, Report and AllocateQuota are answered
+// with empty responses, except a Check of the API key "denied-api-key",
+// which fails with PERMISSION_DENIED. Each call is logged as a line with its
+// method and, for a Check, its consumer.
+//
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <grpc++/generic/async_generic_service.h>
+#include <grpc++/grpc++.h>
+
+#include "google/api/servicecontrol/v1/service_controller.pb.h"
+
+using ::google::api::servicecontrol::v1::CheckRequest;
+using ::google::api::servicecontrol::v1::CheckResponse;
+using ::grpc::AsyncGenericService;
+using ::grpc::ByteBuffer;
+using ::grpc::GenericServerAsyncReaderWriter;
+using ::grpc::GenericServerContext;
+using ::grpc::InsecureServerCredentials;
+using ::grpc::Server;
+using ::grpc::ServerBuilder;
+using ::grpc::ServerCompletionQueue;
+using ::grpc::Status;
+using ::grpc::StatusCode;
+using ::grpc::WriteOptions;
+
+namespace test {
+namespace grpc {
+
+namespace {
+
+const char kCheckMethod[] =
+    "/google.api.servicecontrol.v1.ServiceController/Check";
+const char kDeniedConsumer[] = "api_key:denied-api-key";
+
+typedef std::function<void(bool)> Tag;
+
+void *MakeTag(std::function<void(bool)> continuation) {
+  return reinterpret_cast<void *>(new Tag(continuation));
+}
+
+std::string ToString(const ByteBuffer &buffer) {
+  std::vector<::grpc::Slice> slices;
+  buffer.Dump(&slices);
+  std::string str;
+  for (const auto &slice : slices) {
+    str.append(reinterpret_cast<const char *>(slice.begin()), slice.size());
+  }
+  return str;
+}
+
+ByteBuffer ToByteBuffer(const std::string &str) {
+  ::grpc::Slice slice(str);
+  return ByteBuffer(&slice, 1);
+}
+
+}  // namespace
+
+class ServiceControlServer {
+ public:
+  explicit ServiceControlServer(const char *log_file) : log_(log_file) {}
+
+  void Run(const char *addr);
+
+ private:
+  // A unary call: the request is read, then the response is written.
+  class Call {
+   public:
+    explicit Call(ServiceControlServer *server)
+        : server_(server), stream_(&context_) {}
+
+    void Start();
+
+   private:
+    void Respond();
+
+    ServiceControlServer *server_;
+    GenericServerContext context_;
+    GenericServerAsyncReaderWriter stream_;
+    ByteBuffer request_;
+    ByteBuffer response_;
+  };
+
+  // Logs a call.
+  void Log(const std::string &line) { log_ << line << std::endl; }
+
+  AsyncGenericService service_;
+  std::unique_ptr<ServerCompletionQueue> cq_;
+  std::ofstream log_;
+};
+
+void ServiceControlServer::Call::Start() {
+  server_->service_.RequestCall(
+      &context_, &stream_, server_->cq_.get(), server_->cq_.get(),
+      MakeTag([this](bool ok) {
+        if (!ok) {
+          delete this;
+          return;
+        }
+        (new Call(server_))->Start();
+        stream_.Read(&request_, MakeTag([this](bool read_ok) {
+                       if (read_ok) {
+                         Respond();
+                       } else {
+                         delete this;
+                       }
+                     }));
+      }));
+}
+
+void ServiceControlServer::Call::Respond() {
+  Status status;
+  std::string response;
+  if (context_.method() == kCheckMethod) {
+    CheckRequest check_request;
+    check_request.ParseFromString(ToString(request_));
+    const std::string &consumer = check_request.operation().consumer_id();
+    server_->Log(context_.method() + " " + consumer);
+    if (consumer == kDeniedConsumer) {
+      status = Status(StatusCode::PERMISSION_DENIED, "API key denied");
+    } else {
+      CheckResponse check_response;
+      check_response.set_operation_id(
+          check_request.operation().operation_id());
+      response = check_response.SerializeAsString();
+    }
+  } else {
+    server_->Log(context_.method());
+  }
+
+  auto done = MakeTag([this](bool ok) { delete this; });
+  if (status.ok()) {
+    response_ = ToByteBuffer(response);
+    stream_.WriteAndFinish(response_, WriteOptions(), status, done);
+  } else {
+    stream_.Finish(status, done);
+  }
+}
+
+void ServiceControlServer::Run(const char *addr) {
+  ServerBuilder builder;
+  builder.AddListeningPort(addr, InsecureServerCredentials());
+  builder.RegisterAsyncGenericService(&service_);
+  builder.SetMaxReceiveMessageSize(INT_MAX);
+  cq_ = builder.AddCompletionQueue();
+  std::unique_ptr<Server> server(builder.BuildAndStart());
+
+  (new Call(this))->Start();
+
+  std::cout << "Service control server listening at address " << addr
+            << std::endl;
+
+  void *tag;
+  bool ok;
+  while (cq_->Next(&tag, &ok)) {
+    Tag *func = reinterpret_cast<Tag *>(tag);
+    (*func)(ok);
+    delete func;
+  }
+}
+
+}  // namespace grpc
+}  // namespace test
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: grpc-service-control-server <listening address> "
+                 "<log file>"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  ::test::grpc::ServiceControlServer server(argv[2]);
+  server.Run(argv[1]);
+
+  return EXIT_SUCCESS;
+}